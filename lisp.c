@@ -20,11 +20,22 @@
 #include <assert.h>
 #include <stdarg.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <limits.h>
 #include <math.h>
 #include <setjmp.h>
 #include <time.h>
 #include "lisp.h"
 
+#if defined(__unix__) || defined(__APPLE__)
+#define LISP_MMAP 1
+#define LISP_THREADS 1
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 enum
 {
     GC_CLEAR = 0,
@@ -32,6 +43,19 @@ enum
     GC_VISITED = (1 << 1), // has this block's pointers been moved?
 };
 
+// block types which are not value types
+enum
+{
+    BLOCK_STRING_VIEW = 64, // a LISP_STRING which shares another string's bytes
+    BLOCK_COMPACT_LIST, // cells of LISP_PAIR lists stored in a run
+    BLOCK_HAMT_NODE, // inner node of a LISP_PMAP
+    BLOCK_HAMT_COLLISION, // keys of a LISP_PMAP with equal hashes
+    BLOCK_TRIE_BRANCH, // inner node of a LISP_PVECTOR
+    BLOCK_TRIE_LEAF, // 32 elements of a LISP_PVECTOR
+    BLOCK_SLOTS, // storage of queues
+    BLOCK_LAZY, // a LISP_PAIR or LISP_VECTOR which hasn't been read yet
+};
+
 typedef struct Page
 {
     size_t size;
@@ -71,15 +95,34 @@ typedef struct Block
     unsigned char type;
 } Block;
 
+// symbols are interned in an open addressing table outside of the heap.
+// the hash and length are stored so most probes don't need to touch the symbol.
+typedef struct
+{
+    struct Symbol* symbol;
+    unsigned int hash;
+    unsigned int length;
+} InternSlot;
+
+typedef struct
+{
+    InternSlot* slots;
+    unsigned int capacity;
+    unsigned int size;
+} InternTable;
+
 struct LispImpl
 {
     Heap heap;
     Heap to_heap;
 
-    Lisp symbol_table;
+    InternTable symbol_table;
+    unsigned int symbol_table_size;
     Lisp global_env;
     Lisp reuse_env;
     int lambda_counter;
+    unsigned int edit_counter; // owners of transient nodes
+    struct LazyTape* lazy_tapes; // of data read lazily, while any of it is unread
 };
 
 static void heap_init(Heap* heap, size_t page_size)
@@ -106,6 +149,8 @@ static void heap_shutdown(Heap* heap)
 static void* heap_alloc(size_t alloc_size, LispType type, Heap* heap)
 {
     assert(alloc_size > 0);
+    // keep every block 8 byte aligned
+    alloc_size = (alloc_size + 7) & ~(size_t)7;
     
     size_t desired_page_size =  (alloc_size <= heap->page_size) ? heap->page_size : alloc_size;
     
@@ -149,13 +194,33 @@ typedef struct
 typedef struct
 {
     Block block;
+    unsigned int length; // bytes, not counting the NUL terminator
+    unsigned int hash; // 0 until computed
     char string[];
 } String;
 
+// a slice of a String (never of another view).
+// starts the same as String, so length and hash are shared.
+// its hash stays 0, as the parent's bytes may change.
 typedef struct
+{
+    Block block;
+    unsigned int length;
+    unsigned int hash;
+    String* parent;
+    unsigned int offset;
+} StringView;
+
+// when nothing else keeps its parent, a slice this short
+// is copied into the view's own block by the collector.
+#define STRING_VIEW_INLINE (sizeof(StringView) - sizeof(String) - 1)
+
+typedef struct Symbol
 {
     Block block;
     unsigned int hash;
+    unsigned int length;
+    unsigned int pinned; // kept in the symbol table even when unreachable
     char string[];
 } Symbol;
 
@@ -213,32 +278,179 @@ float lisp_float(Lisp x)
     return x.val.float_val;
 }
 
+// cdr coded lists.
+// a run of list cells stored as slots, where the cdr of each slot is the next one,
+// and the cdr of the last is the tail.
+// a LISP_PAIR refers to a slot with a tagged pointer (low bit set).
+// Pairs are 8 byte aligned, so the bit is otherwise clear.
+typedef struct
+{
+    union LispVal car; // or the Pair which replaced this cell
+    unsigned char type;
+    unsigned char forwarded;
+    unsigned int index;
+} CompactSlot;
+
+typedef struct
+{
+    Block block;
+    unsigned int length;
+    unsigned int forwards; // number of slots replaced by Pairs
+    struct LispImpl* owner; // heap for the Pairs
+    Lisp tail;
+    CompactSlot slots[];
+} CompactList;
+
+#define COMPACT_TAG 1
+
+// shorter lists are made of Pairs
+#define COMPACT_LIST_MIN 2
+
+static int is_compact(Lisp p)
+{
+    return ((uintptr_t)p.val.ptr_val & COMPACT_TAG) != 0;
+}
+
+static CompactSlot* compact_slot(Lisp p)
+{
+    return (CompactSlot*)((char*)p.val.ptr_val - COMPACT_TAG);
+}
+
+static CompactList* compact_list(CompactSlot* slot)
+{
+    return (CompactList*)((char*)(slot - slot->index) - offsetof(CompactList, slots));
+}
+
+// lists and vectors which are read lazily are referred to
+// with this tag until they are read. (see lisp_read_path_lazy)
+#define LAZY_TAG 2
+
+static int is_lazy(Lisp p)
+{
+    return ((uintptr_t)p.val.ptr_val & LAZY_TAG) != 0;
+}
+
+// reads the list or vector, the first time it is reached
+static Lisp lazy_force(Lisp p);
+
+static Lisp compact_ref(CompactSlot* slot)
+{
+    Lisp p;
+    p.type = LISP_PAIR;
+    p.val.ptr_val = (char*)slot + COMPACT_TAG;
+    return p;
+}
+
+static Lisp compact_list_make(const Lisp* items, unsigned int n, Lisp tail, LispContext ctx)
+{
+    assert(n > 0);
+    CompactList* list = gc_alloc(sizeof(CompactList) + sizeof(CompactSlot) * n, LISP_PAIR, ctx);
+    list->block.type = BLOCK_COMPACT_LIST;
+    list->length = n;
+    list->forwards = 0;
+    list->owner = ctx.impl;
+    list->tail = tail;
+    for (unsigned int i = 0; i < n; ++i)
+    {
+        list->slots[i].car = items ? items[i].val : tail.val;
+        list->slots[i].type = items ? lisp_type(items[i]) : lisp_type(tail);
+        list->slots[i].forwarded = 0;
+        list->slots[i].index = i;
+    }
+    return compact_ref(list->slots);
+}
+
+// the Pair which replaced a slot, or the Pair itself
+static Pair* lisp_pair(Lisp p)
+{
+    assert(p.type == LISP_PAIR);
+    if (is_compact(p))
+    {
+        CompactSlot* slot = compact_slot(p);
+        assert(slot->forwarded);
+        return slot->car.ptr_val;
+    }
+    return p.val.ptr_val;
+}
+
 Lisp lisp_car(Lisp p)
 {
     assert(p.type == LISP_PAIR);
-    const Pair* pair = p.val.ptr_val;
-    return pair->car;
+    if (is_lazy(p)) p = lazy_force(p);
+    if (is_compact(p))
+    {
+        const CompactSlot* slot = compact_slot(p);
+        if (!slot->forwarded)
+        {
+            Lisp x;
+            x.type = slot->type;
+            x.val = slot->car;
+            return x;
+        }
+    }
+    return lisp_pair(p)->car;
 }
 
 Lisp lisp_cdr(Lisp p)
 {
     assert(p.type == LISP_PAIR);
-    const Pair* pair = p.val.ptr_val;
-    return pair->cdr;
+    if (is_lazy(p)) p = lazy_force(p);
+    if (is_compact(p))
+    {
+        CompactSlot* slot = compact_slot(p);
+        if (!slot->forwarded)
+        {
+            CompactList* list = compact_list(slot);
+            return slot->index + 1 < list->length ? compact_ref(slot + 1) : list->tail;
+        }
+    }
+    return lisp_pair(p)->cdr;
 }
 
 void lisp_set_car(Lisp p, Lisp x)
 {
     assert(p.type == LISP_PAIR);
-    Pair* pair = p.val.ptr_val;
-    pair->car = x;
+    if (is_lazy(p)) p = lazy_force(p);
+    if (is_compact(p))
+    {
+        CompactSlot* slot = compact_slot(p);
+        if (!slot->forwarded)
+        {
+            slot->type = lisp_type(x);
+            slot->car = x.val;
+            return;
+        }
+    }
+    lisp_pair(p)->car = x;
 }
 
 void lisp_set_cdr(Lisp p, Lisp x)
 {
     assert(p.type == LISP_PAIR);
-    Pair* pair = p.val.ptr_val;
-    pair->cdr = x;
+    if (is_lazy(p)) p = lazy_force(p);
+    if (is_compact(p))
+    {
+        CompactSlot* slot = compact_slot(p);
+        if (!slot->forwarded)
+        {
+            CompactList* list = compact_list(slot);
+            if (slot->index + 1 == list->length)
+            {
+                list->tail = x;
+                return;
+            }
+
+            // the middle of the run no longer points to the next slot.
+            // the slot is replaced by a Pair, which references to it are forwarded to.
+            Pair* pair = heap_alloc(sizeof(Pair), LISP_PAIR, &list->owner->heap);
+            pair->car.type = slot->type;
+            pair->car.val = slot->car;
+            slot->car.ptr_val = pair;
+            slot->forwarded = 1;
+            ++list->forwards;
+        }
+    }
+    lisp_pair(p)->cdr = x;
 }
 
 Lisp lisp_cons(Lisp car, Lisp cdr, LispContext ctx)
@@ -269,12 +481,17 @@ static void back_append(Lisp* front, Lisp* back, Lisp item, LispContext ctx)
 
 Lisp lisp_make_list(Lisp x, int n, LispContext ctx)
 {
-    Lisp front = lisp_make_null();
-    Lisp back = front;
+    if (n <= 0) return lisp_make_null();
+    if (n < COMPACT_LIST_MIN) return lisp_cons(x, lisp_make_null(), ctx);
 
+    Lisp list = compact_list_make(NULL, n, lisp_make_null(), ctx);
+    CompactList* compact = compact_list(compact_slot(list));
     for (int i = 0; i < n; ++i)
-        back_append(&front, &back, x, ctx);
-    return front;
+    {
+        compact->slots[i].type = lisp_type(x);
+        compact->slots[i].car = x.val;
+    }
+    return list;
 }
 
 Lisp lisp_make_listv(LispContext ctx, Lisp first, ...)
@@ -323,6 +540,22 @@ Lisp lisp_list_advance(Lisp l, int i)
     while (i > 0)
     {
         if (!lisp_is_pair(l)) return l;
+
+        // jump within runs which have no forwarded slots
+        if (is_compact(l) && !compact_slot(l)->forwarded)
+        {
+            CompactSlot* slot = compact_slot(l);
+            CompactList* list = compact_list(slot);
+            if (list->forwards == 0)
+            {
+                int remaining = (int)(list->length - slot->index) - 1;
+                if (i <= remaining) return compact_ref(slot + i);
+                i -= remaining + 1;
+                l = list->tail;
+                continue;
+            }
+        }
+
         l = lisp_cdr(l);
         --i;
     }
@@ -353,6 +586,18 @@ int lisp_list_length(Lisp l)
     int count = 0;
     while (lisp_is_pair(l))
     {
+        if (is_compact(l) && !compact_slot(l)->forwarded)
+        {
+            CompactSlot* slot = compact_slot(l);
+            CompactList* list = compact_list(slot);
+            if (list->forwards == 0)
+            {
+                count += list->length - slot->index;
+                l = list->tail;
+                continue;
+            }
+        }
+
         ++count;
         l = lisp_cdr(l);
     }
@@ -445,14 +690,20 @@ typedef struct
     Block block;
     LispType type;
     unsigned int length;    
+    // optional open addressing table from symbol keys to entries
+    // of an association vector. (i32 typed vector or null)
+    Lisp index;
     union LispVal entries[];
 } Vector;
 
+static unsigned int symbol_hash(Lisp l);
+
 Lisp lisp_make_vector(unsigned int n, Lisp x, LispContext ctx)
 {
     Vector* vector = gc_alloc(sizeof(Vector) + sizeof(union LispVal) * n, LISP_VECTOR, ctx);
     vector->length = n;
     vector->type = lisp_type(x);
+    vector->index = lisp_make_null();
     for (unsigned int i = 0; i < n; ++i)
         vector->entries[i] = x.val;
 
@@ -465,6 +716,7 @@ Lisp lisp_make_vector(unsigned int n, Lisp x, LispContext ctx)
 static Vector* lisp_vector(Lisp v)
 {
     assert(lisp_type(v) == LISP_VECTOR);
+    if (is_lazy(v)) v = lazy_force(v);
     return v.val.ptr_val;
 }
 
@@ -489,6 +741,51 @@ void lisp_vector_set(Lisp v, unsigned int i, Lisp x)
     assert(i < vector->length);
     assert(lisp_type(x) == vector->type);
     vector->entries[i] = x.val;
+    vector->index = lisp_make_null();
+}
+
+void lisp_vector_index(Lisp v, LispContext ctx)
+{
+    Vector* vector = lisp_vector(v);
+    vector->index = lisp_make_null();
+    if (vector->type != LISP_PAIR || vector->length < LISP_VECTOR_INDEX_MIN) return;
+
+    Lisp x;
+    x.type = LISP_PAIR;
+    for (unsigned int i = 0; i < vector->length; ++i)
+    {
+        x.val = vector->entries[i];
+        // entries which are read lazily are left until they are reached
+        if (is_lazy(x)) return;
+        if (lisp_type(lisp_car(x)) != LISP_SYMBOL) return;
+    }
+
+    // at most half full
+    unsigned int capacity = 16;
+    while (capacity < vector->length * 2) capacity *= 2;
+
+    Lisp index = lisp_make_typed_vector(LISP_TYPED_I32, capacity, ctx);
+    int* slots = lisp_i32_vector(index, NULL);
+
+    // slots hold entry + 1, so zero is empty.
+    // symbol hashes don't change when the GC moves them.
+    for (unsigned int i = 0; i < vector->length; ++i)
+    {
+        x.val = vector->entries[i];
+        Lisp key = lisp_car(x);
+        unsigned int j = symbol_hash(key) & (capacity - 1);
+        while (slots[j] != 0)
+        {
+            Lisp y;
+            y.type = LISP_PAIR;
+            y.val = vector->entries[slots[j] - 1];
+            // first entry wins, as in a linear search
+            if (lisp_eq(lisp_car(y), key)) break;
+            j = (j + 1) & (capacity - 1);
+        }
+        if (slots[j] == 0) slots[j] = (int)i + 1;
+    }
+    vector->index = index;
 }
 
 Lisp lisp_vector_assoc(Lisp v, Lisp key)
@@ -499,6 +796,21 @@ Lisp lisp_vector_assoc(Lisp v, Lisp key)
     Lisp x;
     x.type = LISP_PAIR;
 
+    if (!lisp_is_null(vector->index) && lisp_type(key) == LISP_SYMBOL)
+    {
+        int capacity;
+        const int* slots = lisp_i32_vector(vector->index, &capacity);
+        unsigned int j = symbol_hash(key) & (capacity - 1);
+        while (slots[j] != 0)
+        {
+            x.val = vector->entries[slots[j] - 1];
+            if (lisp_eq(lisp_car(x), key)) return x;
+            j = (j + 1) & (capacity - 1);
+        }
+        // the index is not told about lisp_set_car on an entry,
+        // so a miss still checks every key.
+    }
+
     for (int i = 0; i < vector->length; ++i)
     {
         x.val = vector->entries[i];
@@ -532,2380 +844,10961 @@ Lisp lisp_vector_grow(Lisp v, unsigned int n, LispContext ctx)
     }
 }
 
-Lisp lisp_make_string(const char* c_string, LispContext ctx)
+// values left to compare in lisp_equal, two at a time
+typedef struct
 {
-    size_t length = strlen(c_string) + 1;
-    String* string = gc_alloc(sizeof(String) + length, LISP_STRING, ctx);
-    memcpy(string->string, c_string, length);
-    
-    Lisp l;
-    l.type = string->block.type;
-    l.val.ptr_val = string;
-    return l;
-}
+    Lisp* items;
+    size_t count;
+    size_t capacity;
+} EqualStack;
 
-static String* get_string(Lisp s)
+// compares atoms straight away, and stacks the others.
+// returns 0 if they differ.
+static int equal_step(EqualStack* stack, Lisp a, Lisp b)
 {
-    assert(s.type == LISP_STRING);
-    return s.val.ptr_val;
+    if (lisp_type(a) != lisp_type(b)) return 0;
+    switch (lisp_type(a))
+    {
+        case LISP_NULL:
+            // the pointer of a null isn't always cleared
+            return 1;
+        case LISP_INT:
+            return lisp_int(a) == lisp_int(b);
+        case LISP_FLOAT:
+            return lisp_float(a) == lisp_float(b);
+        case LISP_STRING:
+            return lisp_string_equal(a, b);
+        case LISP_PAIR:
+        case LISP_VECTOR:
+        case LISP_TYPED_VECTOR:
+        {
+            if (lisp_eq(a, b)) return 1;
+            if (stack->count + 2 > stack->capacity)
+            {
+                stack->capacity = stack->capacity == 0 ? 64 : stack->capacity * 2;
+                stack->items = realloc(stack->items, sizeof(Lisp) * stack->capacity);
+            }
+            stack->items[stack->count++] = a;
+            stack->items[stack->count++] = b;
+            return 1;
+        }
+        default:
+            return lisp_eq(a, b);
+    }
 }
 
-const char* lisp_string(Lisp s)
+int lisp_equal(Lisp a, Lisp b)
 {
-    return get_string(s)->string;
+    // lists are walked in a loop, so the stack
+    // only holds items which nest.
+    EqualStack stack = { NULL, 0, 0 };
+    int equal = equal_step(&stack, a, b);
+
+    while (equal && stack.count > 0)
+    {
+        b = stack.items[--stack.count];
+        a = stack.items[--stack.count];
+        switch (lisp_type(a))
+        {
+            case LISP_PAIR:
+            {
+                while (equal && lisp_type(a) == LISP_PAIR && lisp_type(b) == LISP_PAIR)
+                {
+                    equal = equal_step(&stack, lisp_car(a), lisp_car(b));
+                    a = lisp_cdr(a);
+                    b = lisp_cdr(b);
+                }
+                // the tails
+                if (equal) equal = equal_step(&stack, a, b);
+                break;
+            }
+            case LISP_VECTOR:
+            {
+                int n = lisp_vector_length(a);
+                equal = n == lisp_vector_length(b);
+                for (int i = 0; equal && i < n; ++i)
+                    equal = equal_step(&stack, lisp_vector_ref(a, i), lisp_vector_ref(b, i));
+                break;
+            }
+            case LISP_TYPED_VECTOR:
+            {
+                int n = lisp_typed_vector_length(a);
+                equal = lisp_typed_vector_kind(a) == lisp_typed_vector_kind(b) && n == lisp_typed_vector_length(b);
+                for (int i = 0; equal && i < n; ++i)
+                    equal = equal_step(&stack, lisp_typed_vector_ref(a, i), lisp_typed_vector_ref(b, i));
+                break;
+            }
+            default:
+                assert(0);
+                break;
+        }
+    }
+
+    free(stack.items);
+    return equal;
 }
 
-char lisp_string_ref(Lisp s, int n)
+// densely packed numbers, without a type per element
+typedef struct
 {
-    const char* str = lisp_string(s);
-    return str[n];
-}
+    Block block;
+    unsigned int kind;
+    unsigned int length;
+    unsigned char data[];
+} TypedVector;
+
+static const size_t typed_element_size[] = {
+    sizeof(float),
+    sizeof(int),
+    sizeof(unsigned char),
+};
 
-void lisp_string_set(Lisp s, int n, char c)
+static const char* typed_kind_name[] = {
+    "F32",
+    "I32",
+    "U8",
+};
+
+Lisp lisp_make_typed_vector(LispTypedKind kind, unsigned int n, LispContext ctx)
 {
-    String* string = get_string(s);
-    string->string[n] = c;
+    size_t data_size = typed_element_size[kind] * n;
+    TypedVector* vector = gc_alloc(sizeof(TypedVector) + data_size, LISP_TYPED_VECTOR, ctx);
+    vector->kind = kind;
+    vector->length = n;
+    memset(vector->data, 0, data_size);
+
+    Lisp l;
+    l.type = LISP_TYPED_VECTOR;
+    l.val.ptr_val = vector;
+    return l;
 }
 
-const char* lisp_symbol(Lisp l)
+static TypedVector* lisp_typed_vector(Lisp v)
 {
-    assert(l.type == LISP_SYMBOL);
-    Symbol* symbol = l.val.ptr_val;
-    return symbol->string;
+    assert(lisp_type(v) == LISP_TYPED_VECTOR);
+    return v.val.ptr_val;
 }
 
-static unsigned int symbol_hash(Lisp l)
+LispTypedKind lisp_typed_vector_kind(Lisp v)
 {
-    assert(l.type == LISP_SYMBOL);
-    Symbol* symbol = l.val.ptr_val;
-    return symbol->hash;
+    return lisp_typed_vector(v)->kind;
 }
 
-// TODO
-#if defined(WIN32) || defined(WIN64)
-#define strncasecmp _stricmp
-#endif
-
-static Lisp table_get_string(Lisp l, const char* string, unsigned int hash)
+int lisp_typed_vector_length(Lisp v)
 {
-    Table* table = lisp_table(l);
-    unsigned int index = hash % table->capacity;
+    return lisp_typed_vector(v)->length;
+}
 
-    Lisp it = table->entries[index];
+Lisp lisp_typed_vector_ref(Lisp v, unsigned int i)
+{
+    const TypedVector* vector = lisp_typed_vector(v);
+    assert(i < vector->length);
 
-    while (!lisp_is_null(it))
+    switch (vector->kind)
     {
-        Lisp pair = lisp_car(it);
-        Lisp symbol = lisp_car(pair);
-
-        if (strncasecmp(lisp_symbol(symbol), string, 2048) == 0)
-        {
-            return pair;
-        }
-
-        it = lisp_cdr(it);
+        case LISP_TYPED_F32:
+            return lisp_make_float(((const float*)vector->data)[i]);
+        case LISP_TYPED_I32:
+            return lisp_make_int(((const int*)vector->data)[i]);
+        case LISP_TYPED_U8:
+            return lisp_make_int(vector->data[i]);
+        default:
+            assert(0);
+            return lisp_make_null();
     }
-
-    return lisp_make_null();
 }
 
-static unsigned int hash_string(const char* c)
-{     
-    // adler 32
-    int s1 = 1;
-    int s2 = 0;
+void lisp_typed_vector_set(Lisp v, unsigned int i, Lisp x)
+{
+    TypedVector* vector = lisp_typed_vector(v);
+    assert(i < vector->length);
 
-    while (*c)
+    switch (vector->kind)
     {
-        s1 = (s1 + toupper(*c)) % 65521;
-        s2 = (s2 + s1) % 65521;
-        ++c; 
-    } 
-    return (s2 << 16) | s1;
+        case LISP_TYPED_F32:
+            ((float*)vector->data)[i] = lisp_float(x);
+            break;
+        case LISP_TYPED_I32:
+            ((int*)vector->data)[i] = lisp_int(x);
+            break;
+        case LISP_TYPED_U8:
+            vector->data[i] = (unsigned char)lisp_int(x);
+            break;
+        default:
+            assert(0);
+    }
 }
 
-Lisp lisp_make_symbol(const char* string, LispContext ctx)
+// whether x can be stored in a typed vector of kind without changing.
+// bytes are ints from 0 to 255.
+static int typed_vector_accepts(LispTypedKind kind, Lisp x)
 {
-    unsigned int hash = hash_string(string);
-    Lisp pair = table_get_string(ctx.impl->symbol_table, string, hash);
-    
-    if (lisp_is_null(pair))
-    {
-        size_t string_length = strlen(string) + 1;
-        // allocate a new block
-        Symbol* symbol = gc_alloc(sizeof(Symbol) + string_length, LISP_SYMBOL, ctx);
-        
-        symbol->hash = hash;
-        memcpy(symbol->string, string, string_length);
+    if (kind == LISP_TYPED_U8) return lisp_type(x) == LISP_INT && lisp_int(x) >= 0 && lisp_int(x) <= 255;
+    return lisp_type(x) == LISP_INT || lisp_type(x) == LISP_FLOAT;
+}
 
-        // always convert symbols to uppercase
-        char* c = symbol->string;
-        
-        while (*c)
-        {
-            *c = toupper(*c);
-            ++c;
-        }
+void* lisp_typed_vector_data(Lisp v, int* out_length)
+{
+    TypedVector* vector = lisp_typed_vector(v);
+    if (out_length) *out_length = vector->length;
+    return vector->data;
+}
 
-        Lisp l;
-        l.type = symbol->block.type;
-        l.val.ptr_val = symbol;
-        lisp_table_set(ctx.impl->symbol_table, l, lisp_make_null(), ctx);
-        return l;
-    }
-    else
-    {
-        return lisp_car(pair);
-    }
+float* lisp_f32_vector(Lisp v, int* out_length)
+{
+    assert(lisp_typed_vector_kind(v) == LISP_TYPED_F32);
+    return lisp_typed_vector_data(v, out_length);
 }
 
-Lisp lisp_make_func(LispFunc func)
+int* lisp_i32_vector(Lisp v, int* out_length)
 {
-    Lisp l;
-    l.type = LISP_FUNC;
-    l.val.ptr_val = func;
-    return l;
+    assert(lisp_typed_vector_kind(v) == LISP_TYPED_I32);
+    return lisp_typed_vector_data(v, out_length);
 }
 
-LispFunc lisp_func(Lisp l)
+unsigned char* lisp_bytevector(Lisp v, int* out_length)
 {
-    assert(lisp_type(l) == LISP_FUNC);
-    return l.val.ptr_val;
+    assert(lisp_typed_vector_kind(v) == LISP_TYPED_U8);
+    return lisp_typed_vector_data(v, out_length);
 }
 
+// bits packed into 64 bit words.
+// bits past the length are kept 0, so whole words can be counted.
 typedef struct
 {
     Block block;
-    int identifier;
-    Lisp args;
-    Lisp body;
-    Lisp env;
-} Lambda;
+    unsigned int length;
+    uint64_t words[];
+} BitVector;
 
-Lisp lisp_make_lambda(Lisp args, Lisp body, Lisp env, LispContext ctx)
+static size_t bit_word_count(unsigned int length)
 {
-    Lambda* lambda = gc_alloc(sizeof(Lambda), LISP_LAMBDA, ctx);
-    lambda->identifier = ctx.impl->lambda_counter++;
-    lambda->args = args;
-    lambda->body = body;
-    lambda->env = env;
-    
-    Lisp l;
-    l.type = lambda->block.type;
-    l.val.ptr_val = lambda;
+    return (length + 63) / 64;
+}
+
+Lisp lisp_make_bitvector(unsigned int n, LispContext ctx)
+{
+    size_t word_count = bit_word_count(n);
+    BitVector* vector = gc_alloc(sizeof(BitVector) + sizeof(uint64_t) * word_count, LISP_BITVECTOR, ctx);
+    vector->length = n;
+    memset(vector->words, 0, sizeof(uint64_t) * word_count);
+
+    Lisp l;
+    l.type = LISP_BITVECTOR;
+    l.val.ptr_val = vector;
     return l;
 }
 
-static Lambda* lisp_lambda(Lisp l)
+static BitVector* lisp_bitvector(Lisp v)
 {
-    return l.val.ptr_val;
+    assert(lisp_type(v) == LISP_BITVECTOR);
+    return v.val.ptr_val;
 }
 
-typedef enum
+int lisp_bitvector_length(Lisp v)
 {
-    TOKEN_NONE = 0,
-    TOKEN_L_PAREN,
-    TOKEN_R_PAREN,
-    TOKEN_HASH,
-    TOKEN_DOT,
-    TOKEN_QUOTE,
-    TOKEN_SYMBOL,
-    TOKEN_STRING,
-    TOKEN_INT,
-    TOKEN_FLOAT,
-} TokenType;
+    return lisp_bitvector(v)->length;
+}
 
-/* for debug
-static const char* token_type_name[] = {
-    "NONE", "L_PAREN", "R_PAREN", "#", ".", "QUOTE", "SYMBOL", "STRING", "INT", "FLOAT",
-}; */
+int lisp_bitvector_ref(Lisp v, unsigned int i)
+{
+    const BitVector* vector = lisp_bitvector(v);
+    assert(i < vector->length);
+    return (vector->words[i / 64] >> (i % 64)) & 1;
+}
 
-typedef struct
+void lisp_bitvector_set(Lisp v, unsigned int i, int bit)
 {
-    FILE* file;
+    BitVector* vector = lisp_bitvector(v);
+    assert(i < vector->length);
+    uint64_t mask = (uint64_t)1 << (i % 64);
+    if (bit)
+        vector->words[i / 64] |= mask;
+    else
+        vector->words[i / 64] &= ~mask;
+}
 
-    const char* sc; // start of token
-    const char* c;  // scanner
-    size_t scan_length;
-    TokenType token;
+static String* string_alloc(unsigned int length, LispContext ctx)
+{
+    String* string = gc_alloc(sizeof(String) + length + 1, LISP_STRING, ctx);
+    string->length = length;
+    string->hash = 0;
+    string->string[length] = '\0';
+    return string;
+}
 
-    int sc_buff_index;
-    int c_buff_index; 
+Lisp lisp_make_string_n(const char* bytes, unsigned int length, LispContext ctx)
+{
+    String* string = string_alloc(length, ctx);
+    memcpy(string->string, bytes, length);
 
-    char* buffs[2];
-    int buff_number[2];
-    size_t buff_size;
-} Lexer;
+    Lisp l;
+    l.type = string->block.type;
+    l.val.ptr_val = string;
+    return l;
+}
 
-static void lexer_shutdown(Lexer* lex)
+Lisp lisp_make_string(const char* c_string, LispContext ctx)
+{
+    return lisp_make_string_n(c_string, (unsigned int)strlen(c_string), ctx);
+}
+
+static String* get_string(Lisp s)
 {
-    if (lex->file)
+    assert(s.type == LISP_STRING);
+    return s.val.ptr_val;
+}
+
+static const char* string_bytes(const String* string)
+{
+    if (string->block.type == BLOCK_STRING_VIEW)
     {
-        free(lex->buffs[0]);
-        free(lex->buffs[1]);
+        const StringView* view = (const StringView*)string;
+        return view->parent->string + view->offset;
     }
+    return string->string;
 }
 
-static void lexer_init(Lexer* lex, const char* program)
+const char* lisp_string(Lisp s)
 {
-    lex->file = NULL;
-    lex->sc_buff_index = 0;
-    lex->c_buff_index = 0; 
-    lex->buffs[0] = (char*)program;
-    lex->buffs[1] = NULL;
-    lex->buff_number[0] = 0;
-    lex->buff_number[1] = -1;
-    lex->sc = lex->c = lex->buffs[0];
-    lex->scan_length = 0;
+    return string_bytes(get_string(s));
 }
 
-static void lexer_init_file(Lexer* lex, FILE* file)
+const char* lisp_string_n(Lisp s, int* out_length)
 {
-    lex->file = file;
+    const String* string = get_string(s);
+    *out_length = string->length;
+    return string_bytes(string);
+}
 
-    lex->buff_size = LISP_FILE_CHUNK_SIZE;
+int lisp_string_is_view(Lisp s)
+{
+    return get_string(s)->block.type == BLOCK_STRING_VIEW;
+}
 
-     // double input buffering
-    lex->sc_buff_index = 0;
-    lex->c_buff_index = 0;
+Lisp lisp_substring(Lisp s, unsigned int start, unsigned int end, LispContext ctx)
+{
+    String* string = get_string(s);
+    assert(start <= end && end <= string->length);
 
-    lex->buffs[0] = malloc(lex->buff_size + 1);
-    lex->buffs[1] = malloc(lex->buff_size + 1);
-    lex->buffs[0][lex->buff_size] = '\0';
-    lex->buffs[1][lex->buff_size] = '\0';
+    unsigned int length = end - start;
+    if (string->block.type == BLOCK_STRING_VIEW)
+    {
+        StringView* parent_view = (StringView*)string;
+        start += parent_view->offset;
+        string = parent_view->parent;
+    }
 
-    // sc the pointers out
-    lex->sc = lex->c = lex->buffs[0];
-    lex->scan_length = 0;
+    StringView* view = gc_alloc(sizeof(StringView), LISP_STRING, ctx);
+    view->block.type = BLOCK_STRING_VIEW;
+    view->length = length;
+    view->hash = 0;
+    view->parent = string;
+    view->offset = start;
 
-    // read a new block
-    size_t read = fread(lex->buffs[0], 1, lex->buff_size, lex->file);
-    lex->buffs[0][read] = '\0';
+    Lisp l;
+    l.type = LISP_STRING;
+    l.val.ptr_val = view;
+    return l;
+}
 
-    lex->buff_number[0] = 0;
-    lex->buff_number[1] = -1;
+int lisp_string_length(Lisp s)
+{
+    return get_string(s)->length;
 }
 
-static void lexer_advance_start(Lexer* lex)
+char lisp_string_ref(Lisp s, int n)
 {
-    lex->sc = lex->c;
-    lex->sc_buff_index = lex->c_buff_index;
-    lex->scan_length = 0;
+    const String* string = get_string(s);
+    assert(n >= 0 && n < string->length);
+    return string_bytes(string)[n];
 }
 
-static void lexer_restart_scan(Lexer* lex)
+void lisp_string_set(Lisp s, int n, char c)
 {
-    lex->c = lex->sc;
-    lex->c_buff_index = lex->sc_buff_index;
-    lex->scan_length = 0;
+    String* string = get_string(s);
+    assert(string->block.type != BLOCK_STRING_VIEW);
+    assert(n >= 0 && n < string->length);
+    string->string[n] = c;
+    string->hash = 0;
 }
 
-static int lexer_step(Lexer* lex)
+int lisp_string_equal(Lisp a, Lisp b)
 {
-    ++lex->c;
-    ++lex->scan_length;
+    const String* x = get_string(a);
+    const String* y = get_string(b);
+    if (x->length != y->length) return 0;
+    if (x->hash != 0 && y->hash != 0 && x->hash != y->hash) return 0;
+    return memcmp(string_bytes(x), string_bytes(y), x->length) == 0;
+}
 
-    if (*lex->c == '\0')
-    { 
-        if (lex->file)
-        {
-            // flip the buffer
-            int previous_index = lex->c_buff_index;
-            int new_index = !previous_index;
+// views are not NUL terminated.
+// this returns s, or a terminated copy of it.
+static Lisp string_terminated(Lisp s, LispContext ctx)
+{
+    if (!lisp_string_is_view(s)) return s;
+    return lisp_make_string_n(lisp_string(s), lisp_string_length(s), ctx);
+}
 
-            if (new_index == lex->sc_buff_index)
-            {
-                fprintf(stderr, "token too long\n");
-                return 0;
-            }
- 
-            // next block is older. so read a new one
-            if (lex->buff_number[new_index] < lex->buff_number[previous_index])
-            {
-                if (!feof(lex->file))
-                {
-                    size_t read = fread(lex->buffs[new_index], 1, lex->buff_size, lex->file);
-                    lex->buff_number[new_index] = lex->buff_number[previous_index] + 1;
-                    lex->buffs[new_index][read] = '\0';
-                }
-                else
-                {
-                    return 0;
-                }
-            }
+// a string buffer which grows by doubling.
+// the bytes are kept in a String, whose length is the capacity.
+typedef struct
+{
+    Block block;
+    unsigned int length;
+    Lisp buffer;
+} StringBuilder;
 
-            lex->c_buff_index = new_index;
-            lex->c = lex->buffs[new_index];
-        }  
-        else
-        {
-            return 0;
-        }
-    }
+Lisp lisp_make_string_builder(unsigned int capacity, LispContext ctx)
+{
+    StringBuilder* builder = gc_alloc(sizeof(StringBuilder), LISP_STRING_BUILDER, ctx);
+    builder->length = 0;
+    builder->buffer.type = LISP_STRING;
+    builder->buffer.val.ptr_val = string_alloc(capacity < 16 ? 16 : capacity, ctx);
 
-    return 1;
+    Lisp l;
+    l.type = builder->block.type;
+    l.val.ptr_val = builder;
+    return l;
 }
 
-static void lexer_skip_empty(Lexer* lex)
+static StringBuilder* lisp_string_builder(Lisp l)
+{
+    assert(lisp_type(l) == LISP_STRING_BUILDER);
+    return l.val.ptr_val;
+}
+
+void lisp_string_builder_append(Lisp sb, const char* bytes, unsigned int length, LispContext ctx)
 {
-    while (lex->c)
+    StringBuilder* builder = lisp_string_builder(sb);
+    String* buffer = get_string(builder->buffer);
+
+    if (builder->length + length > buffer->length)
     {
-        // skip whitespace
-        while (isspace(*lex->c)) lexer_step(lex);
+        unsigned int capacity = buffer->length * 2;
+        while (capacity < builder->length + length) capacity *= 2;
 
-        // skip comments to end of line
-        if (*lex->c == ';')
-        {
-            while (*lex->c && *lex->c != '\n') lexer_step(lex);
-        }
-        else
-        {
-            break;
-        }
+        String* new_buffer = string_alloc(capacity, ctx);
+        memcpy(new_buffer->string, buffer->string, builder->length);
+        builder->buffer.val.ptr_val = new_buffer;
+        buffer = new_buffer;
     }
+
+    memcpy(buffer->string + builder->length, bytes, length);
+    builder->length += length;
 }
 
-static int lexer_match_int(Lexer* lex)
+int lisp_string_builder_length(Lisp sb)
 {
-    lexer_restart_scan(lex);
-    
-    // need at least one digit or -
-    if (!isdigit(*lex->c))
-    {
-        if (*lex->c == '-' || *lex->c == '+')
-        {
-            lexer_step(lex);
-            if (!isdigit(*lex->c)) return 0;
-        }
-        else
-        {
-            return 0;
-        }
-    }
+    return lisp_string_builder(sb)->length;
+}
 
-    lexer_step(lex);
-    // + any other digits
-    while (isdigit(*lex->c)) lexer_step(lex);
-    return 1;
+Lisp lisp_string_builder_to_string(Lisp sb, LispContext ctx)
+{
+    const StringBuilder* builder = lisp_string_builder(sb);
+    return lisp_make_string_n(get_string(builder->buffer)->string, builder->length, ctx);
 }
 
-static int lexer_match_float(Lexer* lex)
+const char* lisp_symbol(Lisp l)
 {
-    lexer_restart_scan(lex);
-    
-    // need at least one digit or -
-    if (!isdigit(*lex->c))
+    assert(l.type == LISP_SYMBOL);
+    Symbol* symbol = l.val.ptr_val;
+    return symbol->string;
+}
+
+void lisp_symbol_pin(Lisp l)
+{
+    assert(l.type == LISP_SYMBOL);
+    Symbol* symbol = l.val.ptr_val;
+    symbol->pinned = 1;
+}
+
+static unsigned int symbol_hash(Lisp l)
+{
+    assert(l.type == LISP_SYMBOL);
+    Symbol* symbol = l.val.ptr_val;
+    return symbol->hash;
+}
+
+static unsigned int hash_bytes(const char* c, size_t length)
+{
+    // multiply and xor-shift a word at a time
+    uint64_t h = 0x9E3779B97F4A7C15ull ^ length;
+
+    while (length >= 8)
     {
-        if (*lex->c == '-' || *lex->c == '+')
-        {
-            lexer_step(lex);
-            if (!isdigit(*lex->c)) return 0;
-        }
-        else
-        {
-            return 0;
-        }
+        uint64_t word;
+        memcpy(&word, c, 8);
+        h = (h ^ word) * 0xFF51AFD7ED558CCDull;
+        h ^= h >> 32;
+        c += 8;
+        length -= 8;
     }
-    lexer_step(lex);
 
-    int found_decimal = 0;
-    while (isdigit(*lex->c) || *lex->c == '.')
+    if (length > 0)
     {
-        if (*lex->c == '.') found_decimal = 1;
-        lexer_step(lex);
+        uint64_t word = 0;
+        memcpy(&word, c, length);
+        h = (h ^ word) * 0xC4CEB9FE1A85EC53ull;
+        h ^= h >> 32;
     }
 
-    // must have a decimal to be a float
-    return found_decimal;
+    h ^= h >> 29;
+    h *= 0xBF58476D1CE4E5B9ull;
+    h ^= h >> 32;
+    return (unsigned int)h;
 }
 
-static int is_symbol(char c)
+static void intern_table_init(InternTable* table, unsigned int capacity)
 {
-    if (c < '!' || c > 'z') return 0;
-    const char* illegal= "()#;";
-    do
-    {
-        if (c == *illegal) return 0;
-        ++illegal;
-    } while (*illegal);
-    return 1;
+    // power of 2 so we can mask instead of mod
+    unsigned int n = 16;
+    while (n < capacity) n *= 2;
+
+    table->slots = calloc(n, sizeof(InternSlot));
+    table->capacity = n;
+    table->size = 0;
 }
 
-static int lexer_match_symbol(Lexer* lex)
-{   
-    lexer_restart_scan(lex);
-    // need at least one valid symbol character
-    if (!is_symbol(*lex->c)) return 0;
-    lexer_step(lex);
-    while (is_symbol(*lex->c)) lexer_step(lex);
-    return 1;
+static void intern_table_insert(InternTable* table, Symbol* symbol)
+{
+    unsigned int mask = table->capacity - 1;
+    unsigned int index = symbol->hash & mask;
+    while (table->slots[index].symbol) index = (index + 1) & mask;
+
+    table->slots[index].symbol = symbol;
+    table->slots[index].hash = symbol->hash;
+    table->slots[index].length = symbol->length;
+    ++table->size;
 }
 
-static int lexer_match_string(Lexer* lex)
+static void intern_table_grow(InternTable* table)
 {
-    lexer_restart_scan(lex);
-    // start with quote
-    if (*lex->c != '"') return 0;
-    lexer_step(lex);
+    InternTable old = *table;
+    intern_table_init(table, old.capacity * 2);
 
-    while (*lex->c != '"')
+    for (unsigned int i = 0; i < old.capacity; ++i)
     {
-        if (*lex->c == '\0' || *lex->c == '\n')
-            return 0;
-        lexer_step(lex);
+        if (old.slots[i].symbol) intern_table_insert(table, old.slots[i].symbol);
     }
-
-    lexer_step(lex);
-    return 1;    
+    free(old.slots);
 }
 
-static void lexer_copy_token(Lexer* lex, size_t start_index, size_t length, char* dest)
+// string must already be uppercase
+static Lisp symbol_intern(const char* string, unsigned int length, unsigned int hash, LispContext ctx)
 {
-    size_t token_length = lex->scan_length;
-    assert((start_index + length) <= token_length);
+    InternTable* table = &ctx.impl->symbol_table;
+    unsigned int mask = table->capacity - 1;
+    unsigned int index = hash & mask;
 
-    if (lex->c_buff_index == lex->sc_buff_index)
-    {
-        // both pointers are in the same buffer
-        memcpy(dest, lex->sc + start_index, length);
-    }
-    else
+    // open addressing, linear probing
+    while (table->slots[index].symbol)
     {
-        // the pointers are split across buffers. So do two copies.
-        const char* sc_end = lex->buffs[lex->sc_buff_index] + lex->buff_size;
-        const char* sc = (lex->sc + start_index);
-        
-        ptrdiff_t first_part_length = sc_end - sc;  
-        if (first_part_length < 0) first_part_length = 0;
-        if (first_part_length > length) first_part_length = length;
-        
-        if (first_part_length > 0)
-        {
-            // copy from sc to the end of its buffer (or to length)
-            memcpy(dest, sc, first_part_length);
-        }
-        
-        ptrdiff_t last_part = length - first_part_length;        
-        if (last_part > 0)
+        const InternSlot* slot = table->slots + index;
+        if (slot->hash == hash &&
+            slot->length == length &&
+            memcmp(slot->symbol->string, string, length) == 0)
         {
-            // copy from the start of c's buffer
-            memcpy(dest + first_part_length, lex->buffs[lex->c_buff_index], length - first_part_length);
+            Lisp l;
+            l.type = LISP_SYMBOL;
+            l.val.ptr_val = slot->symbol;
+            return l;
         }
+        index = (index + 1) & mask;
     }
-}
 
-static void lexer_next_token(Lexer* lex)
-{
-    lexer_skip_empty(lex);
-    lexer_advance_start(lex);
+    // allocate a new block
+    Symbol* symbol = gc_alloc(sizeof(Symbol) + length + 1, LISP_SYMBOL, ctx);
+    symbol->hash = hash;
+    symbol->length = length;
+    symbol->pinned = 0;
+    memcpy(symbol->string, string, length);
+    symbol->string[length] = '\0';
 
-    if (*lex->c == '\0')
-    {
-        lex->token = TOKEN_NONE;
-    }
-    else if (*lex->c == '(')
-    {
-        lex->token = TOKEN_L_PAREN;
-        lexer_step(lex);
-    }
-    else if (*lex->c == ')')
-    {
-        lex->token = TOKEN_R_PAREN;
-        lexer_step(lex);
-    }
-    else if (*lex->c == '#')
-    {
-        lex->token = TOKEN_HASH;
-        lexer_step(lex);
-    }
-    else if (*lex->c == '.')
-    {
-        lex->token = TOKEN_DOT;
-        lexer_step(lex);
-    }
-    else if (*lex->c == '\'')
-    {
-        lex->token = TOKEN_QUOTE;
-        lexer_step(lex);
-    }
-    else if (lexer_match_string(lex))
-    {
-        lex->token = TOKEN_STRING;
-    }
-    else if (lexer_match_float(lex))
+    if ((table->size + 1) * 2 > table->capacity)
     {
-        lex->token = TOKEN_FLOAT;
-    }
-    else if (lexer_match_int(lex))
-    {
-        lex->token = TOKEN_INT;
-    }
-    else if (lexer_match_symbol(lex))
-    {
-        lex->token = TOKEN_SYMBOL;
+        intern_table_grow(table);
+        intern_table_insert(table, symbol);
     }
     else
     {
-        lex->token = TOKEN_NONE;
+        table->slots[index].symbol = symbol;
+        table->slots[index].hash = hash;
+        table->slots[index].length = length;
+        ++table->size;
     }
+
+    Lisp l;
+    l.type = symbol->block.type;
+    l.val.ptr_val = symbol;
+    return l;
 }
 
-#define SCRATCH_MAX 1024
+#define SYMBOL_SCRATCH_MAX 256
 
-static Lisp parse_atom(Lexer* lex, jmp_buf error_jmp,  LispContext ctx)
-{ 
-    char scratch[SCRATCH_MAX];
-    size_t length = lex->scan_length;
-    Lisp l = lisp_make_null();
+Lisp lisp_make_symbol(const char* string, LispContext ctx)
+{
+    size_t length = strlen(string);
 
-    switch (lex->token)
+    char scratch[SYMBOL_SCRATCH_MAX] = { 0 };
+    char* upper = length < SYMBOL_SCRATCH_MAX ? scratch : malloc(length);
+    if (!upper) return lisp_make_null();
+
+    // always convert symbols to uppercase
+    for (size_t i = 0; i < length; ++i)
+        upper[i] = toupper(string[i]);
+
+    Lisp l = symbol_intern(upper, (unsigned int)length, hash_bytes(upper, length), ctx);
+    if (upper != scratch) free(upper);
+    return l;
+}
+
+static unsigned int hash_int(unsigned int x)
+{
+    x ^= x >> 16;
+    x *= 0x7FEB352D;
+    x ^= x >> 15;
+    x *= 0x846CA68B;
+    x ^= x >> 16;
+    return x;
+}
+
+// symbols hash by identity (their hash is computed when interned).
+// strings, ints, and floats hash by content.
+static int is_hashable(Lisp key)
+{
+    switch (lisp_type(key))
     {
-        case TOKEN_INT:
-        {
-            lexer_copy_token(lex, 0, length, scratch);
-            scratch[length] = '\0';
-            l = lisp_make_int(atoi(scratch));
-            break;
-        }
-        case TOKEN_FLOAT:
-        {
-            lexer_copy_token(lex, 0, length, scratch);
-            scratch[length] = '\0'; 
-            l = lisp_make_float(atof(scratch));
-            break;
-        }
-        case TOKEN_STRING:
-        {
-            // -2 length to skip quotes
-            String* string = gc_alloc(sizeof(String) + length - 1, LISP_STRING, ctx);
-            lexer_copy_token(lex, 1, length - 2, string->string);
-            string->string[length - 2] = '\0';
-            
-            l.type = string->block.type;
-            l.val.ptr_val = string;
-            break;
-        }
-        case TOKEN_SYMBOL:
-        {
-            // always convert symbols to uppercase
-            lexer_copy_token(lex, 0, length, scratch);
-            scratch[length] = '\0';
-            l = lisp_make_symbol(scratch, ctx);
-            break;
-        }
-        default: 
-            longjmp(error_jmp, LISP_ERROR_BAD_TOKEN);
+        case LISP_NULL:
+        case LISP_INT:
+        case LISP_FLOAT:
+        case LISP_SYMBOL:
+        case LISP_STRING:
+            return 1;
+        default:
+            return 0;
     }
-    
-    lexer_next_token(lex);
-    return l;
 }
 
-// read tokens and construct S-expresions
-static Lisp parse_list_r(Lexer* lex, jmp_buf error_jmp, LispContext ctx)
-{  
-    switch (lex->token)
+static unsigned int key_hash(Lisp key)
+{
+    switch (lisp_type(key))
     {
-        case TOKEN_NONE:
-            longjmp(error_jmp, LISP_ERROR_PAREN_EXPECTED);
-        case TOKEN_DOT:
-            longjmp(error_jmp, LISP_ERROR_DOT_UNEXPECTED);
-        case TOKEN_L_PAREN:
-        {
-            Lisp front = lisp_make_null();
-            Lisp back = lisp_make_null();
-
-            // (
-            lexer_next_token(lex);
-            while (lex->token != TOKEN_R_PAREN && lex->token != TOKEN_DOT)
-            {
-                Lisp x = parse_list_r(lex, error_jmp, ctx);
-                back_append(&front, &back, x, ctx);
-            }
-
-            // A dot at the end of a list assigns the cdr
-            if (lex->token == TOKEN_DOT)
-            {
-                if (lisp_is_null(back)) longjmp(error_jmp, LISP_ERROR_DOT_UNEXPECTED);
-
-                lexer_next_token(lex);
-                if (lex->token != TOKEN_R_PAREN)
-                {
-                    Lisp x = parse_list_r(lex, error_jmp, ctx);
-                    lisp_set_cdr(back, x);
-
-                }
-            }
-
-            if (lex->token != TOKEN_R_PAREN) longjmp(error_jmp, LISP_ERROR_PAREN_EXPECTED);
-
-            // )
-            lexer_next_token(lex);
-            return front;
-        }
-        case TOKEN_R_PAREN:
-            longjmp(error_jmp, LISP_ERROR_PAREN_UNEXPECTED);
-        case TOKEN_HASH:
+        case LISP_SYMBOL:
+            return symbol_hash(key);
+        case LISP_STRING:
         {
-            // #
-            lexer_next_token(lex);
-            if (lex->token != TOKEN_L_PAREN) longjmp(error_jmp, LISP_ERROR_PAREN_EXPECTED);
-            lexer_next_token(lex);
-            // (
-
-            Lisp v = lisp_make_null();
-            int count = 0;
-
-            while (lex->token != TOKEN_R_PAREN)
+            String* string = get_string(key);
+            unsigned int hash = string->hash;
+            if (hash == 0)
             {
-                Lisp x = parse_list_r(lex, error_jmp, ctx);
-
-                if (lisp_is_null(v))
-                {
-                    v = lisp_make_vector(16, x, ctx);
-                    ++count;
-                }
-                else
-                {
-                    int length = lisp_vector_length(v);
-                    if (count + 1 >= length)
-                    {
-                        v = lisp_vector_grow(v, length * 2, ctx);
-                    }
+                hash = hash_bytes(string_bytes(string), string->length);
+                if (hash == 0) hash = 1;
 
-                    lisp_vector_set(v, count, x);
-                    ++count;
-                }
+                // views aren't told when their parent changes,
+                // so only strings keep their hash.
+                if (string->block.type != BLOCK_STRING_VIEW) string->hash = hash;
             }
-            // )
-            lexer_next_token(lex);
-
-            // cutouff length
-            Vector* vector = lisp_vector(v);
-            vector->length = count;
-            return v;
+            return hash;
         }
-        case TOKEN_QUOTE:
+        case LISP_INT:
+            return hash_int((unsigned int)lisp_int(key));
+        case LISP_FLOAT:
         {
-             // '
-             lexer_next_token(lex);
-             Lisp l = lisp_cons(parse_list_r(lex, error_jmp, ctx), lisp_make_null(), ctx);
-             return lisp_cons(lisp_make_symbol("QUOTE", ctx), l, ctx);
+            // -0.0 and 0.0 are equal, so they must hash the same
+            float f = lisp_float(key);
+            if (f == 0.0f) f = 0.0f;
+            unsigned int bits;
+            memcpy(&bits, &f, sizeof(bits));
+            return hash_int(bits ^ 0x9E3779B9);
         }
         default:
-        {
-            return parse_atom(lex, error_jmp, ctx);
-        } 
+            return 0;
     }
 }
 
-static Lisp parse(Lexer* lex, LispError* out_error, LispContext ctx)
+// views of a string which changes would move within a table,
+// so tables keep a copy of them instead.
+static Lisp key_own(Lisp key, LispContext ctx)
 {
-    jmp_buf error_jmp;
-    LispError error = setjmp(error_jmp);
+    if (lisp_type(key) != LISP_STRING) return key;
+    return string_terminated(key, ctx);
+}
 
-    if (error != LISP_ERROR_NONE)
+static int key_equal(Lisp a, Lisp b)
+{
+    if (lisp_type(a) != lisp_type(b)) return 0;
+
+    switch (lisp_type(a))
     {
-        if (out_error) *out_error = error;
-        return lisp_make_null();
+        case LISP_NULL:
+            return 1;
+        case LISP_SYMBOL:
+            return a.val.ptr_val == b.val.ptr_val;
+        case LISP_STRING:
+            return lisp_string_equal(a, b);
+        case LISP_INT:
+            return lisp_int(a) == lisp_int(b);
+        case LISP_FLOAT:
+            return lisp_float(a) == lisp_float(b);
+        default:
+            return lisp_eq(a, b);
     }
+}
 
-    lexer_next_token(lex);
-    Lisp result = parse_list_r(lex, error_jmp, ctx);
-    
-    if (lex->token != TOKEN_NONE)
-    {
-        Lisp back = lisp_cons(result, lisp_make_null(), ctx);
-        Lisp front = lisp_cons(lisp_make_symbol("BEGIN", ctx), back, ctx);
-        
-        while (lex->token != TOKEN_NONE)
-        {
-            Lisp next_result = parse_list_r(lex, error_jmp, ctx);
-            back_append(&front, &back, next_result, ctx);
-        } 
+Lisp lisp_make_func(LispFunc func)
+{
+    Lisp l;
+    l.type = LISP_FUNC;
+    l.val.ptr_val = func;
+    return l;
+}
 
-       result = front;
-    }
+LispFunc lisp_func(Lisp l)
+{
+    assert(lisp_type(l) == LISP_FUNC);
+    return l.val.ptr_val;
+}
 
-    if (out_error) *out_error = error;
-    return result;
+typedef struct
+{
+    Block block;
+    int identifier;
+    Lisp args;
+    Lisp body;
+    Lisp env;
+} Lambda;
+
+Lisp lisp_make_lambda(Lisp args, Lisp body, Lisp env, LispContext ctx)
+{
+    Lambda* lambda = gc_alloc(sizeof(Lambda), LISP_LAMBDA, ctx);
+    lambda->identifier = ctx.impl->lambda_counter++;
+    lambda->args = args;
+    lambda->body = body;
+    lambda->env = env;
+    
+    Lisp l;
+    l.type = lambda->block.type;
+    l.val.ptr_val = lambda;
+    return l;
 }
 
-static Lisp expand_r(Lisp l, jmp_buf error_jmp, LispContext ctx)
+static Lambda* lisp_lambda(Lisp l)
 {
-    // 1. expand extended syntax into primitive syntax
-    // 2. perform optimizations
-    // 3. check syntax    
-    if (lisp_type(l) == LISP_SYMBOL &&
-        strcmp(lisp_symbol(l), "QUOTE") == 0)
+    return l.val.ptr_val;
+}
+
+// the environment for a call, with the parameters bound to args
+static Lisp lambda_env(const Lambda* lambda, Lisp args, LispContext ctx)
+{
+    Lisp new_table = lisp_make_table(13, ctx);
+
+    Lisp keyIt = lambda->args;
+    Lisp valIt = args;
+
+    while (lisp_is_pair(keyIt))
     {
-        // don't expand quotes
-        return l;
+        lisp_table_set(new_table, lisp_car(keyIt), lisp_car(valIt), ctx);
+        keyIt = lisp_cdr(keyIt); 
+        valIt = lisp_cdr(valIt);
     }
-    else if (lisp_type(l) == LISP_PAIR)
-    {
-        const char* op = NULL;
-        if (lisp_type(lisp_car(l)) == LISP_SYMBOL)
-            op = lisp_symbol(lisp_car(l));
 
-        if (op && strcmp(op, "QUOTE") == 0)
-        {
-            if (lisp_list_length(l) != 2) longjmp(error_jmp, LISP_ERROR_BAD_QUOTE);
-            // don't expand quotes
-            return l;
-        }
-        else if (op && strcmp(op, "DEFINE") == 0)
-        {
-            int length = lisp_list_length(l);
+    if (lisp_type(keyIt) == LISP_SYMBOL)
+    {
+        // variable length arguments
+        lisp_table_set(new_table, keyIt, valIt, ctx);
+    }
+    return lisp_env_extend(lambda->env, new_table, ctx);
+}
 
-            Lisp rest = lisp_cdr(l);
-            Lisp signature = lisp_car(rest);
+// call a lambda or C function with arguments which are already evaluated
+static Lisp apply_procedure(Lisp op, Lisp args, LispError* e, LispContext ctx)
+{
+    *e = LISP_ERROR_NONE;
+    if (lisp_type(op) == LISP_FUNC) return lisp_func(op)(args, e, ctx);
 
-            switch (lisp_type(signature))
-            {
-                case LISP_PAIR:
-                {
-                    // (define (<name> <arg0> ... <argn>) <body0> ... <bodyN>)
-                    // -> (define <name> (lambda (<arg0> ... <argn>) <body> ... <bodyN>))
-                  
-                    if (length < 3) longjmp(error_jmp, LISP_ERROR_BAD_DEFINE);
-                    Lisp name = lisp_car(signature);
+    const Lambda* lambda = lisp_lambda(op);
+    return lisp_eval(lambda->body, lambda_env(lambda, args, ctx), e, ctx);
+}
 
-                    if (lisp_type(name) != LISP_SYMBOL) longjmp(error_jmp, LISP_ERROR_BAD_DEFINE); 
+typedef enum
+{
+    TOKEN_NONE = 0,
+    TOKEN_L_PAREN,
+    TOKEN_R_PAREN,
+    TOKEN_HASH,
+    TOKEN_DOT,
+    TOKEN_QUOTE,
+    TOKEN_SYMBOL,
+    TOKEN_STRING,
+    TOKEN_INT,
+    TOKEN_FLOAT,
+} TokenType;
 
-                    Lisp args = lisp_cdr(signature);
-                    Lisp lambda = lisp_cdr(rest); // start with body
-                    lambda = lisp_cons(args, lambda, ctx);
-                    lambda = lisp_cons(lisp_make_symbol("LAMBDA", ctx), lambda, ctx);
+/* for debug
+static const char* token_type_name[] = {
+    "NONE", "L_PAREN", "R_PAREN", "#", ".", "QUOTE", "SYMBOL", "STRING", "INT", "FLOAT",
+}; */
 
-                    lisp_set_cdr(l, lisp_make_listv(ctx,
-                                                    name,
-                                                    expand_r(lambda, error_jmp, ctx),
-                                                    lisp_make_null()));
-                    return l;
-                }
-                case LISP_SYMBOL:
-                {
-                    if (length != 3) longjmp(error_jmp, LISP_ERROR_BAD_DEFINE); 
-                    lisp_set_cdr(rest, expand_r(lisp_cdr(rest), error_jmp, ctx));
-                    return l;
-                }
-                default:
-                    longjmp(error_jmp, LISP_ERROR_BAD_DEFINE);
-                    break;
-            }
-        }
-        else if (op && strcmp(op, "SET!") == 0)
-        {
-            if (lisp_list_length(l) != 3) longjmp(error_jmp, LISP_ERROR_BAD_SET);
+// The lexer works in two stages.
+// 1. 64 bytes at a time are classified into a bit mask per class (a kernel).
+// 2. tokens are found by searching the masks for the end of each run.
 
-            Lisp var = lisp_list_ref(l, 1);
-            if (lisp_type(var) != LISP_SYMBOL) longjmp(error_jmp, LISP_ERROR_BAD_SET);
-            Lisp expr = expand_r(lisp_list_ref(l, 2), error_jmp, ctx);
+enum
+{
+    LEX_SPACE = 0, // isspace
+    LEX_SYMBOL, // may be part of a symbol
+    LEX_DIGIT,
+    LEX_DOT,
+    LEX_QUOTE, // "
+    LEX_NEWLINE,
+    LEX_NUL, // also every byte past the end
+    LEX_CLASS_COUNT,
+};
 
-            return lisp_make_listv(ctx,
-                    lisp_list_ref(l, 0), // SET!
-                    var,
-                    expr,
-                    lisp_make_null());
-        }
-        else if (op && strcmp(op, "COND") == 0)
-        {
-            // (COND (<pred0> <expr0>)
-            //       (<pred1> <expr1>)
-            //        ...
-            //        (else <expr-1>)) ->
-            //
-            //  (IF <pred0> <expr0>
-            //      (if <pred1> <expr1>
-            //          ....
-            //      (if <predN> <exprN> <expr-1>)) ... )
+#define LEX_BLOCK 64
 
-            Lisp conds = lisp_list_reverse(lisp_cdr(l));
-            Lisp outer = lisp_make_null();
+static void lex_classify(const char* s, uint64_t* masks);
+// the lexer needs the kernels, even before any context is made
+static void kernels_init(void);
 
-            Lisp cond_pair = lisp_car(conds);
+// classes for finding the structure of a block without reading its tokens.
+// (see prescan_split)
+enum
+{
+    SCAN_QUOTE = 0,
+    SCAN_OPEN, // (
+    SCAN_CLOSE, // )
+    SCAN_BOUNDARY, // whitespace, parens and #, which always end a token
+    SCAN_UNSAFE, // ; NUL, and bytes the lexer stops at
+    SCAN_LINE_END, // newline or NUL, which end a string
+    SCAN_CLASS_COUNT,
+};
 
-            // error checks
-            if (lisp_type(cond_pair) != LISP_PAIR) longjmp(error_jmp, LISP_ERROR_BAD_COND);
-            if (lisp_list_length(cond_pair) != 2) longjmp(error_jmp, LISP_ERROR_BAD_COND);
+static void lex_structure(const char* s, uint64_t* masks);
+static size_t word_count_bits(uint64_t x);
 
-            Lisp cond_pred = lisp_car(cond_pair);
-            Lisp cond_expr = lisp_make_null();
+// index of the lowest set bit of a non zero word
+static unsigned int word_first_bit(uint64_t x)
+{
+#if defined(__GNUC__)
+    return (unsigned int)__builtin_ctzll(x);
+#else
+    unsigned int i = 0;
+    while (!(x & 1)) { x >>= 1; ++i; }
+    return i;
+#endif
+}
 
-            if ((lisp_type(cond_pred) == LISP_SYMBOL) &&
-                    strcmp(lisp_symbol(cond_pred), "ELSE") == 0)
-            {
-                cond_expr = expand_r(lisp_car(lisp_cdr(cond_pair)), error_jmp, ctx);
-                outer = cond_expr;
-                conds = lisp_cdr(conds);
-            }
-
-            Lisp if_symbol = lisp_make_symbol("IF", ctx);
-       
-            while (lisp_is_pair(conds))
-            {
-                cond_pair = lisp_car(conds);
-
-                // error checks
-                if (lisp_type(cond_pair) != LISP_PAIR) longjmp(error_jmp, LISP_ERROR_BAD_COND);
-                if (lisp_list_length(cond_pair) != 2) longjmp(error_jmp, LISP_ERROR_BAD_COND);
-
-                cond_pred = expand_r(lisp_car(cond_pair), error_jmp, ctx);
-                cond_expr = expand_r(lisp_car(lisp_cdr(cond_pair)), error_jmp, ctx);
+// index of the highest set bit of a non zero word
+static unsigned int word_last_bit(uint64_t x)
+{
+#if defined(__GNUC__)
+    return 63 - (unsigned int)__builtin_clzll(x);
+#else
+    unsigned int i = 63;
+    while (!(x >> 63)) { x <<= 1; --i; }
+    return i;
+#endif
+}
 
-                outer = lisp_make_listv(ctx,
-                                       if_symbol,
-                                       cond_pred,
-                                       cond_expr,
-                                       outer,
-                                       lisp_make_null());
+static int lex_is_symbol(char c)
+{
+    if (c < '!' || c > 'z') return 0;
+    const char* illegal= "()#;";
+    do
+    {
+        if (c == *illegal) return 0;
+        ++illegal;
+    } while (*illegal);
+    return 1;
+}
 
-                conds = lisp_cdr(conds);
-            }
+// the classes of a byte, as bits
+static unsigned char lex_class_of(unsigned char c)
+{
+    unsigned char classes = 0;
+    if (isspace(c)) classes |= 1 << LEX_SPACE;
+    if (lex_is_symbol((char)c)) classes |= 1 << LEX_SYMBOL;
+    if (isdigit(c)) classes |= 1 << LEX_DIGIT;
+    if (c == '.') classes |= 1 << LEX_DOT;
+    if (c == '"') classes |= 1 << LEX_QUOTE;
+    if (c == '\n') classes |= 1 << LEX_NEWLINE;
+    if (c == '\0') classes |= 1 << LEX_NUL;
+    return classes;
+}
 
-            return outer;
-        }
-        else if (op && strcmp(op, "AND") == 0)
-        {
-            // (AND <pred0> <pred1> ... <predN>) 
-            // -> (IF <pred0> 
-            //      (IF <pred1> ...
-            //          (IF <predN> t f)
-            if (lisp_list_length(l) < 2) longjmp(error_jmp, LISP_ERROR_BAD_AND);
+// lex_class_of every byte, filled by kernels_init
+static unsigned char lex_class_table[256];
 
-            Lisp if_symbol = lisp_make_symbol("IF", ctx);
+static unsigned char lex_structure_of(unsigned char c)
+{
+    unsigned char classes = 0;
+    if (c == '"') classes |= 1 << SCAN_QUOTE;
+    if (c == '(') classes |= 1 << SCAN_OPEN;
+    if (c == ')') classes |= 1 << SCAN_CLOSE;
+    if (isspace(c) || c == '(' || c == ')' || c == '#') classes |= 1 << SCAN_BOUNDARY;
+    else if (!lex_is_symbol((char)c)) classes |= 1 << SCAN_UNSAFE;
+    if (c == '\n' || c == '\0') classes |= 1 << SCAN_LINE_END;
+    return classes;
+}
 
-            Lisp preds = lisp_list_reverse(lisp_cdr(l));
-            Lisp p = expand_r(lisp_car(preds), error_jmp, ctx);
-            
-            Lisp outer = lisp_make_listv(ctx,
-                                        if_symbol,
-                                        p,
-                                        lisp_make_int(1),
-                                        lisp_make_int(0),
-                                        lisp_make_null());
+static unsigned char lex_structure_table[256];
 
-            preds = lisp_cdr(preds);
+typedef struct
+{
+    FILE* file;
 
-            while (lisp_is_pair(preds))
-            {
-                p = expand_r(lisp_car(preds), error_jmp, ctx);
+    const char* sc; // start of token
+    const char* c;  // scanner
+    const char* end; // end of the text in memory
+    size_t scan_length;
+    TokenType token;
 
-                outer = lisp_make_listv(ctx,
-                        if_symbol,
-                        p,
-                        outer,
-                        lisp_make_int(0),
-                        lisp_make_null());
+    // number tokens are read as they are scanned.
+    // the value is digits * 10^exponent, and is only
+    // exact when there were few enough significant digits.
+    uint64_t digits;
+    int exponent;
+    int negative;
+    int exact;
+
+    // text read from the file so far.
+    // the current token is always in one piece.
+    char* buffer;
+    size_t buffer_size;
+
+    // classified block
+    const char* block;
+    uint64_t masks[LEX_CLASS_COUNT];
+
+    // parser state.
+    // items of unfinished vectors are stacked here
+    // until their length is known.
+    int read_flags;
+    Lisp* stack;
+    size_t stack_size;
+    size_t stack_capacity;
+
+    // open lists, vectors and quotes, innermost last
+    struct ParseFrame* frames;
+    size_t frame_count;
+    size_t frame_capacity;
+
+    // when reading lazily, lists and vectors inside the one being
+    // read are left for later. (see lisp_read_path_lazy)
+    struct LazyTape* lazy;
+    unsigned int lazy_span; // tape entry of the next list or vector
+} Lexer;
 
-                preds = lisp_cdr(preds);
-            }
-                      
-           return outer;
-        }
-        else if (op && strcmp(op, "OR") == 0)
-        {
-            // (OR <pred0> <pred1> ... <predN>)
-            // -> (IF (<pred0>) t
-            //      (IF <pred1> t ...
-            //          (if <predN> t f))
-            if (lisp_list_length(l) < 2) longjmp(error_jmp, LISP_ERROR_BAD_OR);
+static void lexer_shutdown(Lexer* lex)
+{
+    free(lex->buffer);
+    free(lex->stack);
+    free(lex->frames);
+}
 
-            Lisp if_symbol = lisp_make_symbol("IF", ctx);
+static void lexer_init_n(Lexer* lex, const char* program, size_t length)
+{
+    lex->file = NULL;
+    lex->buffer = NULL;
+    lex->buffer_size = 0;
+    lex->sc = lex->c = program;
+    lex->end = program + length;
+    lex->scan_length = 0;
+    lex->block = NULL;
 
-            Lisp preds = lisp_list_reverse(lisp_cdr(l));
-            Lisp p = expand_r(lisp_car(preds), error_jmp, ctx);
-            
-            Lisp outer = lisp_make_listv(ctx,
-                                        if_symbol,
-                                        p,
-                                        lisp_make_int(1),
-                                        lisp_make_int(0),
-                                        lisp_make_null());
+    lex->read_flags = LISP_READ_DEFAULT;
+    lex->stack = NULL;
+    lex->stack_size = 0;
+    lex->stack_capacity = 0;
+    lex->frames = NULL;
+    lex->frame_count = 0;
+    lex->frame_capacity = 0;
+    lex->lazy = NULL;
+    lex->lazy_span = 0;
+}
 
-            preds = lisp_cdr(preds);
+static void lexer_init(Lexer* lex, const char* program)
+{
+    lexer_init_n(lex, program, strlen(program));
+}
 
-            while (lisp_is_pair(preds))
-            {
-                p = expand_r(lisp_car(preds), error_jmp, ctx);
+static void lexer_init_file(Lexer* lex, FILE* file)
+{
+    lex->file = file;
+    lex->read_flags = LISP_READ_DEFAULT;
+    lex->stack = NULL;
+    lex->stack_size = 0;
+    lex->stack_capacity = 0;
+    lex->frames = NULL;
+    lex->frame_count = 0;
+    lex->frame_capacity = 0;
+    lex->lazy = NULL;
+    lex->lazy_span = 0;
+
+    lex->buffer_size = LISP_FILE_CHUNK_SIZE;
+    lex->buffer = malloc(lex->buffer_size + 1);
+
+    // read the first block
+    size_t read = fread(lex->buffer, 1, lex->buffer_size, lex->file);
+    lex->buffer[read] = '\0';
+
+    lex->sc = lex->c = lex->buffer;
+    lex->end = lex->buffer + read;
+    lex->scan_length = 0;
+    lex->block = NULL;
+}
 
-                outer = lisp_make_listv(ctx,
-                                        if_symbol,
-                                        p,
-                                        lisp_make_int(1),
-                                        outer,
-                                        lisp_make_null());
-                preds = lisp_cdr(preds);
-            }
-                      
-           return outer;
+static void lexer_advance_start(Lexer* lex)
+{
+    lex->sc = lex->c;
+    lex->scan_length = 0;
+}
 
-        }
-        else if (op && strcmp(op, "LET") == 0)
-        {
-            // (LET ((<var0> <expr0>) ... (<varN> <expr1>)) <body0> ... <bodyN>)
-            //  -> ((LAMBDA (<var0> ... <varN>) <body0> ... <bodyN>) <expr0> ... <expr1>)            
-            Lisp pairs = lisp_list_ref(l, 1);
-            if (lisp_type(pairs) != LISP_PAIR) longjmp(error_jmp, LISP_ERROR_BAD_LET);
+static void lexer_restart_scan(Lexer* lex)
+{
+    lex->c = lex->sc;
+    lex->scan_length = 0;
+}
 
-            Lisp body = lisp_list_advance(l, 2);
+// at the end of the buffer.
+// move the current token to the front, and read more after it.
+// the buffer grows if the token fills most of it.
+static int lexer_refill(Lexer* lex)
+{
+    if (feof(lex->file) || ferror(lex->file)) return 0;
 
-            Lisp vars_front = lisp_make_null();
-            Lisp vars_back = vars_front;
-            
-            Lisp exprs_front = lisp_make_null();
-            Lisp exprs_back = exprs_front;
-            
-            while (lisp_is_pair(pairs))
-            {
-                if (!lisp_is_pair(lisp_car(pairs))) longjmp(error_jmp, LISP_ERROR_BAD_LET);
+    size_t keep = lex->c - lex->sc;
+    if (keep + LISP_FILE_CHUNK_SIZE > lex->buffer_size)
+    {
+        while (keep + LISP_FILE_CHUNK_SIZE > lex->buffer_size) lex->buffer_size *= 2;
+        char* buffer = malloc(lex->buffer_size + 1);
+        memcpy(buffer, lex->sc, keep);
+        free(lex->buffer);
+        lex->buffer = buffer;
+    }
+    else
+    {
+        memmove(lex->buffer, lex->sc, keep);
+    }
 
-                Lisp var = lisp_list_ref(lisp_car(pairs), 0);
+    size_t read = fread(lex->buffer + keep, 1, lex->buffer_size - keep, lex->file);
+    lex->buffer[keep + read] = '\0';
+    lex->sc = lex->buffer;
+    lex->c = lex->buffer + keep;
+    lex->end = lex->c + read;
+    lex->block = NULL;
+    return read > 0;
+}
 
-                if (lisp_type(var) != LISP_SYMBOL) longjmp(error_jmp, LISP_ERROR_BAD_LET);
-                back_append(&vars_front, &vars_back, var, ctx);
+static int lexer_step(Lexer* lex)
+{
+    ++lex->c;
+    ++lex->scan_length;
 
-                Lisp val = expand_r(lisp_list_ref(lisp_car(pairs), 1), error_jmp, ctx);
-                back_append(&exprs_front, &exprs_back, val, ctx);
-                pairs = lisp_cdr(pairs);
-            }
-            
-            Lisp lambda = lisp_make_listv(ctx, 
-                                        lisp_make_symbol("LAMBDA", ctx), 
-                                        vars_front, 
-                                        lisp_make_null());
+    if (*lex->c == '\0')
+    { 
+        if (!lex->file || lex->c != lex->end) return 0;
+        return lexer_refill(lex);
+    }
 
-            lisp_set_cdr(lisp_cdr(lambda), body);
+    return 1;
+}
 
-            return lisp_cons(expand_r(lambda, error_jmp, ctx), exprs_front, ctx);
-        }
-        /*
-        else if (op && strcmp(op, "DO") == 0)
-        {
-            // (DO ((<var0> <init0> <step0>) ...) (<test> <result>) <loop>)
-            // -> ((lambda (f)
-            //        (set! f (lambda (<var0> ... <varN>)
-            //                   (if <test>
-            //                       <result>
-            //                       (begin
-            //                          <loop>
-            //                          (f <step0> ... <stepN>)))))
-            //        (f <init0> ... <initN>)) NULL)
-        } */
-        else if (op && strcmp(op, "LAMBDA") == 0)
+// first byte at or after p which is in one of the classes,
+// or not in any of them when negate is set.
+static const char* lexer_find(Lexer* lex, const char* p, unsigned int classes, int negate)
+{
+    while (1)
+    {
+        if (!lex->block || p < lex->block || p >= lex->block + LEX_BLOCK)
         {
-            // (LAMBDA (<var0> ... <varN>) <expr0> ... <exprN>)
-            // (LAMBDA (<var0> ... <varN>) (BEGIN <expr0> ... <expr1>)) 
-            int length = lisp_list_length(l);
-
-            if (length > 3)
+            lex->block = p;
+            if (lex->end - p >= LEX_BLOCK)
             {
-                Lisp body_exprs = expand_r(lisp_list_advance(l, 2), error_jmp, ctx); 
-                Lisp begin = lisp_cons(lisp_make_symbol("BEGIN", ctx), body_exprs, ctx);
-
-                Lisp vars = lisp_list_ref(l, 1);
-                if (!lisp_is_pair(vars) && !lisp_is_null(vars)) longjmp(error_jmp, LISP_ERROR_BAD_LAMBDA);
-
-                Lisp lambda = lisp_cons(begin, lisp_make_null(), ctx);
-                lambda = lisp_cons(vars, lambda, ctx);
-                lambda = lisp_cons(lisp_car(l), lambda, ctx);
-                return lambda;
+                lex_classify(p, lex->masks);
             }
             else
             {
-                Lisp body = lisp_list_advance(l, 2);
-                lisp_set_cdr(lisp_cdr(l), expand_r(body, error_jmp, ctx));
-                return l;
+                // bytes past the end are NUL
+                char tail[LEX_BLOCK] = { 0 };
+                memcpy(tail, p, lex->end - p);
+                lex_classify(tail, lex->masks);
             }
         }
-        else if (op && strcmp(op, "ASSERT") == 0)
+
+        uint64_t bits = 0;
+        for (int i = 0; i < LEX_CLASS_COUNT; ++i)
         {
-            Lisp statement = lisp_car(lisp_cdr(l));
-            // here we save a quoted version of the code so we can see
-            // what happened to trigger the assertion
-            Lisp quoted = lisp_make_listv(ctx,
-                                         lisp_make_symbol("QUOTE", ctx),
-                                         statement,
-                                         lisp_make_null());
-            return lisp_make_listv(ctx,
-                                  lisp_car(l),
-                                  expand_r(statement, error_jmp, ctx),
-                                  quoted,
-                                  lisp_make_null());
-                                  
+            if (classes & (1 << i)) bits |= lex->masks[i];
         }
-        else
-        {
-            Lisp it = l;
-            while (lisp_is_pair(it))
-            {
-                lisp_set_car(it, expand_r(lisp_car(it), error_jmp, ctx));
-                it = lisp_cdr(it);
-            }
+        if (negate) bits = ~bits;
 
-            return l;
-        }
-    } 
-    else 
-    {
-        return l;
+        bits >>= (p - lex->block);
+        if (bits) return p + word_first_bit(bits);
+        p = lex->block + LEX_BLOCK;
     }
 }
 
-Lisp lisp_read(const char* program, LispError* out_error, LispContext ctx)
+// move the scanner to the first byte in (or out of) the classes.
+// more of the file is read at the end of the buffer.
+static void lexer_scan(Lexer* lex, unsigned int classes, int negate)
 {
-    Lexer lex;
-    lexer_init(&lex, program);
-    Lisp l = parse(&lex, out_error, ctx);
-    lexer_shutdown(&lex);
-    return l;
+    while (1)
+    {
+        lex->c = lexer_find(lex, lex->c, classes, negate);
+        if (*lex->c != '\0' || !lex->file || lex->c != lex->end || !lexer_refill(lex)) break;
+    }
+    lex->scan_length = lex->c - lex->sc;
 }
 
-Lisp lisp_read_file(FILE* file, LispError* out_error, LispContext ctx)
+static void lexer_skip_empty(Lexer* lex)
 {
-    Lexer lex;
-    lexer_init_file(&lex, file);
-    Lisp l = parse(&lex, out_error, ctx);
-    lexer_shutdown(&lex);
-    return l;
-}
+    // the start follows along, so skipped text
+    // isn't kept when the buffer is refilled.
+    while (1)
+    {
+        // skip whitespace
+        lexer_advance_start(lex);
+        lexer_scan(lex, 1 << LEX_SPACE, 1);
 
-Lisp lisp_read_path(const char* path, LispError* out_error, LispContext ctx)
-{
-    FILE* file = fopen(path, "r");
+        if (*lex->c != ';') break;
 
-    if (!file)
-    {
-        *out_error = LISP_ERROR_FILE_OPEN;
-        return lisp_make_null();
+        // skip comments to end of line
+        lexer_advance_start(lex);
+        lexer_scan(lex, (1 << LEX_NEWLINE) | (1 << LEX_NUL), 0);
     }
-
-    Lisp l = lisp_read_file(file, out_error, ctx);
-    fclose(file);
-    return l;
+    lexer_advance_start(lex);
 }
 
-Lisp lisp_expand(Lisp lisp, LispError* out_error, LispContext ctx)
+static void lexer_copy_token(Lexer* lex, size_t start_index, size_t length, char* dest)
 {
-    jmp_buf error_jmp;
-    LispError error = setjmp(error_jmp);
+    size_t token_length = lex->scan_length;
+    assert((start_index + length) <= token_length);
+    memcpy(dest, lex->sc + start_index, length);
+}
 
-    if (error == LISP_ERROR_NONE)
+#define LEX_DIGITS_MAX 19
+
+// accumulate a run of digits into the number being read.
+// fraction digits lower the exponent.
+static void lexer_read_digits(Lexer* lex, int fraction)
+{
+    if (!fraction)
     {
-        Lisp result = expand_r(lisp, error_jmp, ctx);
-        *out_error = error;
-        return result;
+        lex->digits = 0;
+        lex->exponent = 0;
+        lex->negative = *lex->sc == '-';
+        lex->exact = 1;
     }
-    else
+
+    int significant = 0;
+    for (uint64_t x = lex->digits; x; x /= 10) ++significant;
+
+    while (1)
     {
-        *out_error = error;
-        return lisp_make_null();
+        const char* c = lex->c;
+        unsigned int d;
+        while ((d = (unsigned char)*c - '0') < 10)
+        {
+            if (significant < LEX_DIGITS_MAX)
+            {
+                lex->digits = lex->digits * 10 + d;
+                if (lex->digits) ++significant;
+                if (fraction) --lex->exponent;
+            }
+            else
+            {
+                lex->exact = 0;
+            }
+            ++c;
+        }
+        lex->scan_length += c - lex->c;
+        lex->c = c;
+
+        // the digits may continue in the next part of the file
+        if (*c != '\0' || !lex->file || c != lex->end || !lexer_refill(lex)) break;
     }
 }
 
-Lisp lisp_read_expand(const char* text, LispError* out_error, LispContext ctx)
+static void lexer_next_token(Lexer* lex)
 {
-    LispError e;
-    Lisp data = lisp_read(text, &e, ctx);
+    lexer_skip_empty(lex);
 
-    if (e != LISP_ERROR_NONE) 
+    switch (*lex->c)
     {
-        if (out_error) *out_error = e;
-        return lisp_make_null();
+        case '\0':
+            lex->token = TOKEN_NONE;
+            return;
+        case '(':
+            lex->token = TOKEN_L_PAREN;
+            lexer_step(lex);
+            return;
+        case ')':
+            lex->token = TOKEN_R_PAREN;
+            lexer_step(lex);
+            return;
+        case '#':
+            lex->token = TOKEN_HASH;
+            lexer_step(lex);
+            return;
+        case '.':
+            lex->token = TOKEN_DOT;
+            lexer_step(lex);
+            return;
+        case '\'':
+            lex->token = TOKEN_QUOTE;
+            lexer_step(lex);
+            return;
+        case '"':
+        {
+            // strings end on the same line
+            lexer_step(lex);
+            lexer_scan(lex, (1 << LEX_QUOTE) | (1 << LEX_NEWLINE) | (1 << LEX_NUL), 0);
+            if (*lex->c == '"')
+            {
+                lex->token = TOKEN_STRING;
+                lexer_step(lex);
+                return;
+            }
+            // otherwise it is a symbol
+            lexer_restart_scan(lex);
+            break;
+        }
+        case '-':
+        case '+':
+        {
+            lexer_step(lex);
+            if (isdigit(*lex->c)) break;
+            // otherwise it is a symbol
+            lexer_restart_scan(lex);
+            break;
+        }
+        default:
+            break;
     }
 
-    return lisp_expand(data, out_error, ctx);
-}
+    if (isdigit(*lex->c))
+    {
+        // a number is a float if it has a decimal
+        lexer_read_digits(lex, 0);
+        if (*lex->c == '.')
+        {
+            lex->token = TOKEN_FLOAT;
+            lexer_step(lex);
+            lexer_read_digits(lex, 1);
 
-Lisp lisp_read_expand_file(FILE* file, LispError* out_error, LispContext ctx)
-{
-    LispError e;
-    Lisp data = lisp_read_file(file, &e, ctx);
-    
-    if (e != LISP_ERROR_NONE)
+            // further dots are part of the token, but not the value
+            if (*lex->c == '.') lexer_scan(lex, (1 << LEX_DIGIT) | (1 << LEX_DOT), 1);
+        }
+        else
+        {
+            lex->token = TOKEN_INT;
+        }
+    }
+    else if (lex_is_symbol(*lex->c))
     {
-        if (out_error) *out_error = e;
-        return lisp_make_null();
+        lex->token = TOKEN_SYMBOL;
+        lexer_scan(lex, 1 << LEX_SYMBOL, 1);
     }
-    
-    return lisp_expand(data, out_error, ctx);
-}
-
-Lisp lisp_read_expand_path(const char* path, LispError* out_error, LispContext ctx)
-{
-    LispError e;
-    Lisp data = lisp_read_path(path, &e, ctx);
-    
-    if (e != LISP_ERROR_NONE)
+    else
     {
-        if (out_error) *out_error = e;
-        return lisp_make_null();
+        lex->token = TOKEN_NONE;
     }
-    
-    return lisp_expand(data, out_error, ctx);
 }
 
-// TODO?
-static const char* lisp_type_name[] = {
-    "NULL",
-    "FLOAT",
-    "INT",
-    "PAIR",
-    "SYMBOL",
-    "STRING",
-    "LAMBDA",
-    "PROCEDURE",
-    "ENV",
+// Numbers are converted from the digits and exponent found by the lexer.
+// Floats are rounded to a double first, to match atof.
+// Small cases are exact in double arithmetic (Clinger's fast path).
+// Others use the Eisel-Lemire algorithm: multiply by a truncated 128 bit
+// power of five, and check the truncation couldn't change the rounding.
+// Anything it can't decide falls back to strtod.
+
+#define POW5_MIN (-64)
+#define POW5_MAX 64
+
+// 5^q normalized to 128 bits, for q in POW5_MIN to POW5_MAX
+static const uint64_t pow5_table[POW5_MAX - POW5_MIN + 1][2] = {
+    { 0xa87fea27a539e9a5ULL, 0x3f2398d747b36224ULL },
+    { 0xd29fe4b18e88640eULL, 0x8eec7f0d19a03aadULL },
+    { 0x83a3eeeef9153e89ULL, 0x1953cf68300424acULL },
+    { 0xa48ceaaab75a8e2bULL, 0x5fa8c3423c052dd7ULL },
+    { 0xcdb02555653131b6ULL, 0x3792f412cb06794dULL },
+    { 0x808e17555f3ebf11ULL, 0xe2bbd88bbee40bd0ULL },
+    { 0xa0b19d2ab70e6ed6ULL, 0x5b6aceaeae9d0ec4ULL },
+    { 0xc8de047564d20a8bULL, 0xf245825a5a445275ULL },
+    { 0xfb158592be068d2eULL, 0xeed6e2f0f0d56712ULL },
+    { 0x9ced737bb6c4183dULL, 0x55464dd69685606bULL },
+    { 0xc428d05aa4751e4cULL, 0xaa97e14c3c26b886ULL },
+    { 0xf53304714d9265dfULL, 0xd53dd99f4b3066a8ULL },
+    { 0x993fe2c6d07b7fabULL, 0xe546a8038efe4029ULL },
+    { 0xbf8fdb78849a5f96ULL, 0xde98520472bdd033ULL },
+    { 0xef73d256a5c0f77cULL, 0x963e66858f6d4440ULL },
+    { 0x95a8637627989aadULL, 0xdde7001379a44aa8ULL },
+    { 0xbb127c53b17ec159ULL, 0x5560c018580d5d52ULL },
+    { 0xe9d71b689dde71afULL, 0xaab8f01e6e10b4a6ULL },
+    { 0x9226712162ab070dULL, 0xcab3961304ca70e8ULL },
+    { 0xb6b00d69bb55c8d1ULL, 0x3d607b97c5fd0d22ULL },
+    { 0xe45c10c42a2b3b05ULL, 0x8cb89a7db77c506aULL },
+    { 0x8eb98a7a9a5b04e3ULL, 0x77f3608e92adb242ULL },
+    { 0xb267ed1940f1c61cULL, 0x55f038b237591ed3ULL },
+    { 0xdf01e85f912e37a3ULL, 0x6b6c46dec52f6688ULL },
+    { 0x8b61313bbabce2c6ULL, 0x2323ac4b3b3da015ULL },
+    { 0xae397d8aa96c1b77ULL, 0xabec975e0a0d081aULL },
+    { 0xd9c7dced53c72255ULL, 0x96e7bd358c904a21ULL },
+    { 0x881cea14545c7575ULL, 0x7e50d64177da2e54ULL },
+    { 0xaa242499697392d2ULL, 0xdde50bd1d5d0b9e9ULL },
+    { 0xd4ad2dbfc3d07787ULL, 0x955e4ec64b44e864ULL },
+    { 0x84ec3c97da624ab4ULL, 0xbd5af13bef0b113eULL },
+    { 0xa6274bbdd0fadd61ULL, 0xecb1ad8aeacdd58eULL },
+    { 0xcfb11ead453994baULL, 0x67de18eda5814af2ULL },
+    { 0x81ceb32c4b43fcf4ULL, 0x80eacf948770ced7ULL },
+    { 0xa2425ff75e14fc31ULL, 0xa1258379a94d028dULL },
+    { 0xcad2f7f5359a3b3eULL, 0x096ee45813a04330ULL },
+    { 0xfd87b5f28300ca0dULL, 0x8bca9d6e188853fcULL },
+    { 0x9e74d1b791e07e48ULL, 0x775ea264cf55347eULL },
+    { 0xc612062576589ddaULL, 0x95364afe032a819eULL },
+    { 0xf79687aed3eec551ULL, 0x3a83ddbd83f52205ULL },
+    { 0x9abe14cd44753b52ULL, 0xc4926a9672793543ULL },
+    { 0xc16d9a0095928a27ULL, 0x75b7053c0f178294ULL },
+    { 0xf1c90080baf72cb1ULL, 0x5324c68b12dd6339ULL },
+    { 0x971da05074da7beeULL, 0xd3f6fc16ebca5e04ULL },
+    { 0xbce5086492111aeaULL, 0x88f4bb1ca6bcf585ULL },
+    { 0xec1e4a7db69561a5ULL, 0x2b31e9e3d06c32e6ULL },
+    { 0x9392ee8e921d5d07ULL, 0x3aff322e62439fd0ULL },
+    { 0xb877aa3236a4b449ULL, 0x09befeb9fad487c3ULL },
+    { 0xe69594bec44de15bULL, 0x4c2ebe687989a9b4ULL },
+    { 0x901d7cf73ab0acd9ULL, 0x0f9d37014bf60a11ULL },
+    { 0xb424dc35095cd80fULL, 0x538484c19ef38c95ULL },
+    { 0xe12e13424bb40e13ULL, 0x2865a5f206b06fbaULL },
+    { 0x8cbccc096f5088cbULL, 0xf93f87b7442e45d4ULL },
+    { 0xafebff0bcb24aafeULL, 0xf78f69a51539d749ULL },
+    { 0xdbe6fecebdedd5beULL, 0xb573440e5a884d1cULL },
+    { 0x89705f4136b4a597ULL, 0x31680a88f8953031ULL },
+    { 0xabcc77118461cefcULL, 0xfdc20d2b36ba7c3eULL },
+    { 0xd6bf94d5e57a42bcULL, 0x3d32907604691b4dULL },
+    { 0x8637bd05af6c69b5ULL, 0xa63f9a49c2c1b110ULL },
+    { 0xa7c5ac471b478423ULL, 0x0fcf80dc33721d54ULL },
+    { 0xd1b71758e219652bULL, 0xd3c36113404ea4a9ULL },
+    { 0x83126e978d4fdf3bULL, 0x645a1cac083126eaULL },
+    { 0xa3d70a3d70a3d70aULL, 0x3d70a3d70a3d70a4ULL },
+    { 0xccccccccccccccccULL, 0xcccccccccccccccdULL },
+    { 0x8000000000000000ULL, 0x0000000000000000ULL },
+    { 0xa000000000000000ULL, 0x0000000000000000ULL },
+    { 0xc800000000000000ULL, 0x0000000000000000ULL },
+    { 0xfa00000000000000ULL, 0x0000000000000000ULL },
+    { 0x9c40000000000000ULL, 0x0000000000000000ULL },
+    { 0xc350000000000000ULL, 0x0000000000000000ULL },
+    { 0xf424000000000000ULL, 0x0000000000000000ULL },
+    { 0x9896800000000000ULL, 0x0000000000000000ULL },
+    { 0xbebc200000000000ULL, 0x0000000000000000ULL },
+    { 0xee6b280000000000ULL, 0x0000000000000000ULL },
+    { 0x9502f90000000000ULL, 0x0000000000000000ULL },
+    { 0xba43b74000000000ULL, 0x0000000000000000ULL },
+    { 0xe8d4a51000000000ULL, 0x0000000000000000ULL },
+    { 0x9184e72a00000000ULL, 0x0000000000000000ULL },
+    { 0xb5e620f480000000ULL, 0x0000000000000000ULL },
+    { 0xe35fa931a0000000ULL, 0x0000000000000000ULL },
+    { 0x8e1bc9bf04000000ULL, 0x0000000000000000ULL },
+    { 0xb1a2bc2ec5000000ULL, 0x0000000000000000ULL },
+    { 0xde0b6b3a76400000ULL, 0x0000000000000000ULL },
+    { 0x8ac7230489e80000ULL, 0x0000000000000000ULL },
+    { 0xad78ebc5ac620000ULL, 0x0000000000000000ULL },
+    { 0xd8d726b7177a8000ULL, 0x0000000000000000ULL },
+    { 0x878678326eac9000ULL, 0x0000000000000000ULL },
+    { 0xa968163f0a57b400ULL, 0x0000000000000000ULL },
+    { 0xd3c21bcecceda100ULL, 0x0000000000000000ULL },
+    { 0x84595161401484a0ULL, 0x0000000000000000ULL },
+    { 0xa56fa5b99019a5c8ULL, 0x0000000000000000ULL },
+    { 0xcecb8f27f4200f3aULL, 0x0000000000000000ULL },
+    { 0x813f3978f8940984ULL, 0x4000000000000000ULL },
+    { 0xa18f07d736b90be5ULL, 0x5000000000000000ULL },
+    { 0xc9f2c9cd04674edeULL, 0xa400000000000000ULL },
+    { 0xfc6f7c4045812296ULL, 0x4d00000000000000ULL },
+    { 0x9dc5ada82b70b59dULL, 0xf020000000000000ULL },
+    { 0xc5371912364ce305ULL, 0x6c28000000000000ULL },
+    { 0xf684df56c3e01bc6ULL, 0xc732000000000000ULL },
+    { 0x9a130b963a6c115cULL, 0x3c7f400000000000ULL },
+    { 0xc097ce7bc90715b3ULL, 0x4b9f100000000000ULL },
+    { 0xf0bdc21abb48db20ULL, 0x1e86d40000000000ULL },
+    { 0x96769950b50d88f4ULL, 0x1314448000000000ULL },
+    { 0xbc143fa4e250eb31ULL, 0x17d955a000000000ULL },
+    { 0xeb194f8e1ae525fdULL, 0x5dcfab0800000000ULL },
+    { 0x92efd1b8d0cf37beULL, 0x5aa1cae500000000ULL },
+    { 0xb7abc627050305adULL, 0xf14a3d9e40000000ULL },
+    { 0xe596b7b0c643c719ULL, 0x6d9ccd05d0000000ULL },
+    { 0x8f7e32ce7bea5c6fULL, 0xe4820023a2000000ULL },
+    { 0xb35dbf821ae4f38bULL, 0xdda2802c8a800000ULL },
+    { 0xe0352f62a19e306eULL, 0xd50b2037ad200000ULL },
+    { 0x8c213d9da502de45ULL, 0x4526f422cc340000ULL },
+    { 0xaf298d050e4395d6ULL, 0x9670b12b7f410000ULL },
+    { 0xdaf3f04651d47b4cULL, 0x3c0cdd765f114000ULL },
+    { 0x88d8762bf324cd0fULL, 0xa5880a69fb6ac800ULL },
+    { 0xab0e93b6efee0053ULL, 0x8eea0d047a457a00ULL },
+    { 0xd5d238a4abe98068ULL, 0x72a4904598d6d880ULL },
+    { 0x85a36366eb71f041ULL, 0x47a6da2b7f864750ULL },
+    { 0xa70c3c40a64e6c51ULL, 0x999090b65f67d924ULL },
+    { 0xd0cf4b50cfe20765ULL, 0xfff4b4e3f741cf6dULL },
+    { 0x82818f1281ed449fULL, 0xbff8f10e7a8921a4ULL },
+    { 0xa321f2d7226895c7ULL, 0xaff72d52192b6a0dULL },
+    { 0xcbea6f8ceb02bb39ULL, 0x9bf4f8a69f764490ULL },
+    { 0xfee50b7025c36a08ULL, 0x02f236d04753d5b4ULL },
+    { 0x9f4f2726179a2245ULL, 0x01d762422c946590ULL },
+    { 0xc722f0ef9d80aad6ULL, 0x424d3ad2b7b97ef5ULL },
+    { 0xf8ebad2b84e0d58bULL, 0xd2e0898765a7deb2ULL },
+    { 0x9b934c3b330c8577ULL, 0x63cc55f49f88eb2fULL },
+    { 0xc2781f49ffcfa6d5ULL, 0x3cbf6b71c76b25fbULL },
 };
 
-Lisp lisp_make_table(unsigned int capacity, LispContext ctx)
+// 64 x 64 -> 128 bit product
+static uint64_t mul_64(uint64_t a, uint64_t b, uint64_t* high)
+{
+#if defined(__SIZEOF_INT128__)
+    unsigned __int128 r = (unsigned __int128)a * b;
+    *high = (uint64_t)(r >> 64);
+    return (uint64_t)r;
+#else
+    uint64_t a_lo = (uint32_t)a, a_hi = a >> 32;
+    uint64_t b_lo = (uint32_t)b, b_hi = b >> 32;
+    uint64_t lo = a_lo * b_lo;
+    uint64_t mid1 = a_hi * b_lo + (lo >> 32);
+    uint64_t mid2 = a_lo * b_hi + (uint32_t)mid1;
+    *high = a_hi * b_hi + (mid1 >> 32) + (mid2 >> 32);
+    return (mid2 << 32) | (uint32_t)lo;
+#endif
+}
+
+// w * 10^q rounded to the nearest double.
+// returns 0 if it can't be done exactly.
+static int eisel_lemire(uint64_t w, int q, double* out)
 {
-    size_t size = sizeof(Table) + sizeof(Lisp) * capacity;
-    Table* table = gc_alloc(size, LISP_TABLE, ctx);
-    table->size = 0;
-    table->capacity = capacity;
+    if (w == 0)
+    {
+        *out = 0.0;
+        return 1;
+    }
+    if (q < POW5_MIN || q > POW5_MAX) return 0;
 
-    // clear the table
-    for (int i = 0; i < capacity; ++i)
-        table->entries[i] = lisp_make_null();
+    int lz = 0;
+    while (!(w & (1ULL << 63))) { w <<= 1; ++lz; }
 
-    Lisp l;
-    l.type = table->block.type;
-    l.val.ptr_val = table;
-    return l;
-}
+    const uint64_t* pow5 = pow5_table[q - POW5_MIN];
+    uint64_t high;
+    uint64_t low = mul_64(w, pow5[0], &high);
 
-void lisp_table_set(Lisp t, Lisp key, Lisp value, LispContext ctx)
-{
-    Table* table = lisp_table(t);
-    
-    unsigned int index = symbol_hash(key) % table->capacity;
-    Lisp pair = lisp_list_assoc(table->entries[index], key);
+    // 52 mantissa bits + 3 for rounding.
+    // when the rest are all set, the lower half of the power matters.
+    const uint64_t precision_mask = 0xFFFFFFFFFFFFFFFFULL >> 55;
+    if ((high & precision_mask) == precision_mask)
+    {
+        uint64_t second_high;
+        mul_64(w, pow5[1], &second_high);
+        low += second_high;
+        if (second_high > low) ++high;
+        if (low == 0xFFFFFFFFFFFFFFFFULL && (q < -27 || q > 55)) return 0;
+    }
 
-    if (lisp_is_null(pair))
+    int upper_bit = (int)(high >> 63);
+    uint64_t mantissa = high >> (upper_bit + 9);
+    int power2 = (((152170 + 65536) * q) >> 16) + 63 + upper_bit - lz + 1023;
+    if (power2 <= 0) return 0;
+
+    // exactly half way, round to even
+    if (low <= 1 && q >= -4 && q <= 23 && (mantissa & 3) == 1 &&
+        (mantissa << (upper_bit + 9)) == high)
     {
-        // new value. prepend to front of chain
-        pair = lisp_cons(key, value, ctx);
-        table->entries[index] = lisp_cons(pair, table->entries[index], ctx);
-        ++table->size;
+        mantissa &= ~1ULL;
     }
-    else
+
+    mantissa += mantissa & 1;
+    mantissa >>= 1;
+    if (mantissa >= (2ULL << 52))
     {
-        // reassign cdr value (key, val)
-        lisp_set_cdr(pair, value);
+        mantissa = 1ULL << 52;
+        ++power2;
     }
-}
+    mantissa &= ~(1ULL << 52);
+    if (power2 >= 0x7FF) return 0;
 
-Lisp lisp_table_get(Lisp t, Lisp symbol, LispContext ctx)
-{
-    const Table* table = lisp_table(t);
-    unsigned int index = symbol_hash(symbol) % table->capacity;
-    return lisp_list_assoc(table->entries[index], symbol);
+    uint64_t bits = mantissa | ((uint64_t)power2 << 52);
+    memcpy(out, &bits, sizeof(double));
+    return 1;
 }
 
-void lisp_table_add_funcs(Lisp t, const char** names, LispFunc* funcs, LispContext ctx)
+static int decimal_to_double(uint64_t w, int q, double* out)
 {
-    const char** name = names;
+    static const double exact_pow10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
 
-    LispFunc* func = funcs;
+    // both w and 10^|q| are exact doubles, so one rounding
+    if (w <= (1ULL << 53) && q >= -22 && q <= 22)
+    {
+        *out = q < 0 ? (double)w / exact_pow10[-q] : (double)w * exact_pow10[q];
+        return 1;
+    }
+    return eisel_lemire(w, q, out);
+}
 
-    while (*name)
+#define SCRATCH_MAX 1024
+
+static void parse_push(Lexer* lex, Lisp x)
+{
+    if (lex->stack_size == lex->stack_capacity)
     {
-        lisp_table_set(t, lisp_make_symbol(*name, ctx), lisp_make_func(*func), ctx);
-        ++name;
-        ++func;
+        lex->stack_capacity = lex->stack_capacity == 0 ? 256 : lex->stack_capacity * 2;
+        lex->stack = realloc(lex->stack, sizeof(Lisp) * lex->stack_capacity);
     }
+    lex->stack[lex->stack_size++] = x;
 }
 
-Lisp lisp_env_extend(Lisp l, Lisp table, LispContext ctx)
+// pop items above base into a list, ending with tail
+static Lisp parse_pop_list(Lexer* lex, size_t base, Lisp tail, LispContext ctx)
 {
-    return lisp_cons(table, l, ctx);
+    size_t count = lex->stack_size - base;
+    lex->stack_size = base;
+    if (count >= COMPACT_LIST_MIN) return compact_list_make(lex->stack + base, (unsigned int)count, tail, ctx);
+
+    Lisp l = tail;
+    while (count > 0)
+        l = lisp_cons(lex->stack[base + --count], l, ctx);
+    return l;
 }
 
-Lisp lisp_env_lookup(Lisp l, Lisp key, LispContext ctx)
+static Lisp parse_pop_vector(Lexer* lex, size_t base, jmp_buf error_jmp, LispContext ctx)
 {
-    while (lisp_is_pair(l))
+    unsigned int count = (unsigned int)(lex->stack_size - base);
+
+    // vectors store one type for every entry
+    for (unsigned int i = 1; i < count; ++i)
     {
-        Lisp x = lisp_table_get(lisp_car(l), key, ctx);
-        if (!lisp_is_null(x)) return x;
-        l = lisp_cdr(l);
+        if (lisp_type(lex->stack[base + i]) != lisp_type(lex->stack[base]))
+            longjmp(error_jmp, LISP_ERROR_BAD_TOKEN);
     }
-    
-    return lisp_make_null();
+    Lisp v = lisp_make_vector(count, count > 0 ? lex->stack[base] : lisp_make_null(), ctx);
+    for (unsigned int i = 1; i < count; ++i)
+        lisp_vector_set(v, i, lex->stack[base + i]);
+
+    lex->stack_size = base;
+    lisp_vector_index(v, ctx);
+    return v;
 }
 
-void lisp_env_define(Lisp l, Lisp key, Lisp x, LispContext ctx)
+static Lisp parse_pop_typed_vector(Lexer* lex, size_t base, LispTypedKind kind, LispContext ctx)
 {
-    lisp_table_set(lisp_car(l), key, x, ctx);
+    unsigned int count = (unsigned int)(lex->stack_size - base);
+    Lisp v = lisp_make_typed_vector(kind, count, ctx);
+    for (unsigned int i = 0; i < count; ++i)
+        lisp_typed_vector_set(v, i, lex->stack[base + i]);
+
+    lex->stack_size = base;
+    return v;
 }
 
-void lisp_env_set(Lisp l, Lisp key, Lisp x, LispContext ctx)
+// the typed vector kind which can hold every item above base,
+// or -1 if they are not all numbers.
+static int parse_numeric_kind(const Lexer* lex, size_t base)
 {
-    Lisp pair = lisp_env_lookup(l, key, ctx);
-    if (lisp_is_null(pair))
+    int kind = LISP_TYPED_I32;
+    for (size_t i = base; i < lex->stack_size; ++i)
     {
-        fprintf(stderr, "error: unknown variable: %s\n", lisp_symbol(key));
+        switch (lisp_type(lex->stack[i]))
+        {
+            case LISP_FLOAT:
+                kind = LISP_TYPED_F32;
+                break;
+            case LISP_INT:
+                break;
+            default:
+                return -1;
+        }
     }
-    lisp_set_cdr(pair, x);
+    return kind;
 }
 
-static void lisp_print_r(FILE* file, Lisp l, int is_cdr)
-{
-    switch (lisp_type(l))
+static Lisp parse_atom(Lexer* lex, jmp_buf error_jmp,  LispContext ctx)
+{ 
+    char scratch[SCRATCH_MAX];
+    size_t length = lex->scan_length;
+    Lisp l = lisp_make_null();
+
+    // long tokens are copied to the heap
+    char* text = scratch;
+    if (length >= SCRATCH_MAX && lex->token != TOKEN_STRING) text = malloc(length + 1);
+
+    switch (lex->token)
     {
-        case LISP_INT:
-            fprintf(file, "%i", lisp_int(l));
-            break;
-        case LISP_FLOAT:
-            fprintf(file, "%f", lisp_float(l));
-            break;
-        case LISP_NULL:
-            fprintf(file, "NIL");
-            break;
-        case LISP_SYMBOL:
-            fprintf(file, "%s", lisp_symbol(l));
-            break;
-        case LISP_STRING:
-            fprintf(file, "\"%s\"", lisp_string(l));
-            break;
-        case LISP_LAMBDA:
-            fprintf(file, "lambda-%i", lisp_lambda(l)->identifier);
-            break;
-        case LISP_FUNC:
-            fprintf(file, "function-%p", lisp_func(l)); 
-            break;
-        case LISP_TABLE:
+        case TOKEN_INT:
         {
-            const Table* table = lisp_table(l);
-            fprintf(file, "{");
-            for (int i = 0; i < table->capacity; ++i)
+            // ints too large for an int are read as floats instead of wrapping
+            if (lex->exact && lex->digits <= (lex->negative ? (uint64_t)INT_MAX + 1 : INT_MAX))
             {
-                if (lisp_is_null(table->entries[i])) continue;
-                lisp_print_r(file, table->entries[i], 0);
-                fprintf(file, " ");
+                int64_t n = (int64_t)lex->digits;
+                l = lisp_make_int((int)(lex->negative ? -n : n));
+            }
+            else
+            {
+                lexer_copy_token(lex, 0, length, text);
+                text[length] = '\0';
+                l = lisp_make_float((float)strtod(text, NULL));
             }
-            fprintf(file, "}");
             break;
         }
-        case LISP_VECTOR:
+        case TOKEN_FLOAT:
         {
-            fprintf(file, "#(");
-            for (int i = 0; i < lisp_vector_length(l); ++i)
+            double x;
+            if (lex->exact && decimal_to_double(lex->digits, lex->exponent, &x))
             {
-                lisp_print_r(file, lisp_vector_ref(l, i), 0);
-                fprintf(file, " ");
+                l = lisp_make_float((float)(lex->negative ? -x : x));
             }
-            fprintf(file, ")");
-            break;
+            else
+            {
+                lexer_copy_token(lex, 0, length, text);
+                text[length] = '\0';
+                l = lisp_make_float((float)strtod(text, NULL));
+            }
+            break;
         }
-        case LISP_PAIR:
+        case TOKEN_STRING:
+        {
+            // -2 length to skip quotes
+            String* string = string_alloc((unsigned int)length - 2, ctx);
+            lexer_copy_token(lex, 1, length - 2, string->string);
+            
+            l.type = string->block.type;
+            l.val.ptr_val = string;
+            break;
+        }
+        case TOKEN_SYMBOL:
         {
-            if (!is_cdr) fprintf(file, "(");
-            lisp_print_r(file, lisp_car(l), 0);
+            lexer_copy_token(lex, 0, length, text);
 
-            if (lisp_type(lisp_cdr(l)) != LISP_PAIR)
-            {
-                if (!lisp_is_null(lisp_cdr(l)))
-                { 
-                    fprintf(file, " . ");
-                    lisp_print_r(file, lisp_cdr(l), 0);
-                }
+            // always convert symbols to uppercase
+            for (size_t i = 0; i < length; ++i)
+                text[i] = toupper(text[i]);
 
-                fprintf(file, ")");
-            }
-            else
-            {
-                fprintf(file, " ");
-                lisp_print_r(file, lisp_cdr(l), 1);
-            } 
+            l = symbol_intern(text, (unsigned int)length, hash_bytes(text, length), ctx);
             break;
         }
+        default: 
+            if (text != scratch) free(text);
+            longjmp(error_jmp, LISP_ERROR_BAD_TOKEN);
     }
+
+    if (text != scratch) free(text);
+    lexer_next_token(lex);
+    return l;
 }
 
-void lisp_printf(FILE* file, Lisp l) { lisp_print_r(file, l, 0);  }
-void lisp_print(Lisp l) {  lisp_printf(stdout, l); }
+// read the kind name and ( of a typed vector, after the #
+static LispTypedKind parse_typed_kind(Lexer* lex, jmp_buf error_jmp)
+{
+    char name[8];
+    size_t length = lex->scan_length;
+    if (length >= sizeof(name)) longjmp(error_jmp, LISP_ERROR_BAD_TOKEN);
 
-static Lisp eval_r(Lisp x, Lisp env, jmp_buf error_jmp, LispContext ctx)
+    lexer_copy_token(lex, 0, length, name);
+    name[length] = '\0';
+    for (size_t i = 0; i < length; ++i)
+        name[i] = toupper(name[i]);
+
+    int kind = -1;
+    for (int i = 0; i < LISP_TYPED_KIND_COUNT; ++i)
+    {
+        if (strcmp(name, typed_kind_name[i]) == 0) kind = i;
+    }
+    if (kind == -1) longjmp(error_jmp, LISP_ERROR_BAD_TOKEN);
+
+    lexer_next_token(lex);
+    if (lex->token != TOKEN_L_PAREN) longjmp(error_jmp, LISP_ERROR_PAREN_EXPECTED);
+    lexer_next_token(lex);
+    // (
+    return (LispTypedKind)kind;
+}
+
+static Lisp parse_typed_vector(Lexer* lex, jmp_buf error_jmp, LispContext ctx)
+{
+    LispTypedKind kind = parse_typed_kind(lex, error_jmp);
+
+    size_t base = lex->stack_size;
+    while (lex->token != TOKEN_R_PAREN)
+    {
+        if (lex->token != TOKEN_INT && lex->token != TOKEN_FLOAT) longjmp(error_jmp, LISP_ERROR_BAD_TOKEN);
+        Lisp x = parse_atom(lex, error_jmp, ctx);
+        if (!typed_vector_accepts(kind, x)) longjmp(error_jmp, LISP_ERROR_BAD_TOKEN);
+        parse_push(lex, x);
+    }
+    // )
+    lexer_next_token(lex);
+    return parse_pop_typed_vector(lex, base, kind, ctx);
+}
+
+// The reader doesn't recurse. Each open list, vector or quote has a frame
+// which remembers where its items start on the item stack.
+// When an expression is complete it is given to the innermost frame,
+// which may in turn complete (quotes and dotted tails).
+
+typedef enum
+{
+    FRAME_LIST,
+    FRAME_LIST_TAIL, // after the dot, waiting for the cdr
+    FRAME_VECTOR,
+    FRAME_QUOTE,
+} ParseFrameType;
+
+typedef struct ParseFrame
+{
+    ParseFrameType type;
+    size_t base;
+    int item_type; // for event reading
+} ParseFrame;
+
+static void parse_open(Lexer* lex, ParseFrameType type)
+{
+    if (lex->frame_count == lex->frame_capacity)
+    {
+        lex->frame_capacity = lex->frame_capacity == 0 ? 64 : lex->frame_capacity * 2;
+        lex->frames = realloc(lex->frames, sizeof(ParseFrame) * lex->frame_capacity);
+    }
+    ParseFrame* frame = lex->frames + lex->frame_count++;
+    frame->type = type;
+    frame->base = lex->stack_size;
+    frame->item_type = LISP_NULL;
+}
+
+// items are stacked until the ), so the list is built
+// at its exact size as a compact run, or packed if it is numeric.
+static Lisp parse_close_list(Lexer* lex, size_t base, Lisp tail, LispContext ctx)
 {
+    if ((lex->read_flags & LISP_READ_PACK_NUMBERS) && lex->stack_size > base && lisp_is_null(tail))
+    {
+        int kind = parse_numeric_kind(lex, base);
+        if (kind != -1) return parse_pop_typed_vector(lex, base, kind, ctx);
+    }
+    return parse_pop_list(lex, base, tail, ctx);
+}
+
+static int lazy_skip(Lexer* lex, const char* start, Lisp* out, LispContext ctx);
+
+// read one expression, starting at the current token
+static Lisp parse_expr(Lexer* lex, jmp_buf error_jmp, LispContext ctx)
+{
+    size_t outer = lex->frame_count;
+
     while (1)
     {
-        assert(!lisp_is_null(env));
-        
-        switch (lisp_type(x))
+        ParseFrame* top = lex->frame_count > outer ? lex->frames + lex->frame_count - 1 : NULL;
+        Lisp x;
+
+        switch (lex->token)
         {
-            case LISP_INT:
-            case LISP_FLOAT:
-            case LISP_STRING:
-            case LISP_LAMBDA:
-            case LISP_VECTOR:
-            case LISP_NULL: 
-                return x; // atom
-            case LISP_SYMBOL: // variable reference
+            case TOKEN_NONE:
+                longjmp(error_jmp, LISP_ERROR_PAREN_EXPECTED);
+            case TOKEN_DOT:
             {
-                Lisp pair = lisp_env_lookup(env, x, ctx);
-                
-                if (lisp_is_null(pair))
-                {
-                    fprintf(stderr, "cannot find variable: %s\n", lisp_symbol(x));
-                    longjmp(error_jmp, LISP_ERROR_UNKNOWN_VAR); 
-                    return lisp_make_null();
-                }
-                return lisp_cdr(pair);
+                // A dot at the end of a list assigns the cdr
+                if (!top || top->type != FRAME_LIST || lex->stack_size == top->base)
+                    longjmp(error_jmp, LISP_ERROR_DOT_UNEXPECTED);
+
+                lexer_next_token(lex);
+                if (lex->token != TOKEN_R_PAREN) top->type = FRAME_LIST_TAIL;
+                continue;
             }
-            case LISP_PAIR:
+            case TOKEN_L_PAREN:
             {
-                const char* op_name = NULL;
-                if (lisp_type(lisp_car(x)) == LISP_SYMBOL)
-                    op_name = lisp_symbol(lisp_car(x));
-                
-                if (op_name && strcmp(op_name, "IF") == 0) // if conditional statemetns
-                {
-                    Lisp predicate = lisp_list_ref(x, 1);
-                    Lisp conseq = lisp_list_ref(x, 2);
-                    Lisp alt = lisp_list_ref(x, 3);
- 
-                    if (lisp_int(eval_r(predicate, env, error_jmp, ctx)) != 0)
-                    {
-                        x = conseq; // while will eval
-                    }
-                    else
-                    {
-                        x = alt; // while will eval
-                    } 
-                }
-                else if (op_name && strcmp(op_name, "BEGIN") == 0)
-                {
-                    Lisp it = lisp_cdr(x);
-                    if (lisp_is_null(it)) return it;
-                    
-                    // eval all but last
-                    while (lisp_is_pair(lisp_cdr(it)))
-                    {
-                        eval_r(lisp_car(it), env, error_jmp, ctx);
-                        it = lisp_cdr(it);
-                    }
-                    
-                    x = lisp_car(it); // while will eval last
-                }
-                else if (op_name && strcmp(op_name, "QUOTE") == 0)
-                {
-                    return lisp_list_ref(x, 1);
-                }
-                else if (op_name && strcmp(op_name, "DEFINE") == 0) // variable definitions
-                {
-                    Lisp symbol = lisp_list_ref(x, 1);
-                    Lisp value = eval_r(lisp_list_ref(x, 2), env, error_jmp, ctx);
-                    lisp_env_define(env, symbol, value, ctx);
-                    return lisp_make_null();
-                }
-                else if (op_name && strcmp(op_name, "SET!") == 0)
-                {
-                    // mutablity
-                    // like def, but requires existence
-                    // and will search up the environment chain
-                    Lisp symbol = lisp_list_ref(x, 1);
-                    lisp_env_set(env, symbol, eval_r(lisp_list_ref(x, 2), env, error_jmp, ctx), ctx);
-                    return lisp_make_null();
-                }
-                else if (op_name && strcmp(op_name, "LAMBDA") == 0) // lambda defintions (compound procedures)
+                if (lex->lazy && lex->frame_count > outer && lazy_skip(lex, lex->sc, &x, ctx)) break;
+
+                // (
+                lexer_next_token(lex);
+                parse_open(lex, FRAME_LIST);
+                continue;
+            }
+            case TOKEN_R_PAREN:
+            {
+                if (!top || top->type == FRAME_QUOTE) longjmp(error_jmp, LISP_ERROR_PAREN_UNEXPECTED);
+
+                // )
+                lexer_next_token(lex);
+                --lex->frame_count;
+                if (top->type == FRAME_VECTOR)
+                    x = parse_pop_vector(lex, top->base, error_jmp, ctx);
+                else
+                    x = parse_close_list(lex, top->base, lisp_make_null(), ctx);
+                break;
+            }
+            case TOKEN_HASH:
+            {
+                // #
+                const char* hash = lex->sc;
+                lexer_next_token(lex);
+                // #f32( #i32( #u8(
+                if (lex->token == TOKEN_SYMBOL)
                 {
-                    Lisp args = lisp_list_ref(x, 1);
-                    Lisp body = lisp_list_ref(x, 2);
-                    return lisp_make_lambda(args, body, env, ctx);
+                    x = parse_typed_vector(lex, error_jmp, ctx);
+                    break;
                 }
-                else // operator application
-                {
-                    Lisp operator = eval_r(lisp_car(x), env, error_jmp, ctx);
-                    Lisp arg_expr = lisp_cdr(x);
-                    
-                    Lisp args_front = lisp_make_null();
-                    Lisp args_back = lisp_make_null();
-                    
-                    while (lisp_is_pair(arg_expr))
-                    {
-                        Lisp new_arg = eval_r(lisp_car(arg_expr), env, error_jmp, ctx);
-                        back_append(&args_front, &args_back, new_arg, ctx);
-                        arg_expr = lisp_cdr(arg_expr);
-                    }
-                    
-                    switch (lisp_type(operator))
-                    {
-                        case LISP_LAMBDA: // lambda call (compound procedure)
-                        {
-                            const Lambda* lambda = lisp_lambda(operator);
-                            // make a new environment
-                            Lisp new_table = lisp_make_table(13, ctx);
+                if (lex->token != TOKEN_L_PAREN) longjmp(error_jmp, LISP_ERROR_PAREN_EXPECTED);
+                if (lex->lazy && lex->frame_count > outer && lazy_skip(lex, hash, &x, ctx)) break;
+                // (
+                lexer_next_token(lex);
+                parse_open(lex, FRAME_VECTOR);
+                continue;
+            }
+            case TOKEN_QUOTE:
+            {
+                // '
+                lexer_next_token(lex);
+                parse_open(lex, FRAME_QUOTE);
+                continue;
+            }
+            default:
+            {
+                x = parse_atom(lex, error_jmp, ctx);
+                break;
+            }
+        }
 
-                            // bind parameters to arguments
-                            // to pass into function call
-                            Lisp keyIt = lambda->args;
-                            Lisp valIt = args_front;
-                            
-                            while (lisp_is_pair(keyIt))
-                            {
-                                lisp_table_set(new_table, lisp_car(keyIt), lisp_car(valIt), ctx);
-                                keyIt = lisp_cdr(keyIt); 
-                                valIt = lisp_cdr(valIt);
-                            }
-
-                            if (lisp_type(keyIt) == LISP_SYMBOL)
-                            {
-                                // variable length arguments
-                                lisp_table_set(new_table, keyIt, valIt, ctx);
-                            }
-                            
-                            // normally we would eval the body here
-                            // but while will eval
-                            x = lambda->body;
-                            
-                            // extend the environment
-                            env = lisp_env_extend(lambda->env, new_table, ctx);
-                            break;
-                        }
-                        case LISP_FUNC: // call into C functions
-                        {
-                            // no environment required
-                            LispFunc func = lisp_func(operator);
-                            LispError e = LISP_ERROR_NONE;
-                            Lisp result = func(args_front, &e, ctx);
-                            if (e != LISP_ERROR_NONE) longjmp(error_jmp, e);
-                            return result;
-                        }
-                        default:
-                            
-                            fprintf(stderr, "apply error: not an operator %s\n", lisp_type_name[operator.type]);
-                            longjmp(error_jmp, LISP_ERROR_BAD_OP);
-                    }
-                }
+        // give the finished expression to the frames it completes
+        while (1)
+        {
+            if (lex->frame_count == outer) return x;
+
+            top = lex->frames + lex->frame_count - 1;
+            if (top->type == FRAME_QUOTE)
+            {
+                --lex->frame_count;
+                Lisp l = lisp_cons(x, lisp_make_null(), ctx);
+                x = lisp_cons(lisp_make_symbol("QUOTE", ctx), l, ctx);
+            }
+            else if (top->type == FRAME_LIST_TAIL)
+            {
+                if (lex->token != TOKEN_R_PAREN) longjmp(error_jmp, LISP_ERROR_PAREN_EXPECTED);
+                // )
+                lexer_next_token(lex);
+                --lex->frame_count;
+                x = parse_close_list(lex, top->base, x, ctx);
+            }
+            else
+            {
+                parse_push(lex, x);
                 break;
             }
-            default:
-                longjmp(error_jmp, LISP_ERROR_UNKNOWN_EVAL);
         }
     }
 }
 
-Lisp lisp_eval(Lisp l, Lisp env, LispError* out_error, LispContext ctx)
+static Lisp parse(Lexer* lex, LispError* out_error, LispContext ctx)
 {
     jmp_buf error_jmp;
     LispError error = setjmp(error_jmp);
 
-    if (error == LISP_ERROR_NONE)
+    if (error != LISP_ERROR_NONE)
     {
-        Lisp result = eval_r(l, env, error_jmp, ctx);
-
-        if (out_error)
-            *out_error = error;  
-
-        return result; 
+        // drop anything left open
+        lex->stack_size = 0;
+        lex->frame_count = 0;
+        if (out_error) *out_error = error;
+        return lisp_make_null();
     }
-    else
+
+    lexer_next_token(lex);
+    Lisp result = parse_expr(lex, error_jmp, ctx);
+    
+    if (lex->token != TOKEN_NONE)
     {
-        if (out_error)
-            *out_error = error;
+        Lisp back = lisp_cons(result, lisp_make_null(), ctx);
+        Lisp front = lisp_cons(lisp_make_symbol("BEGIN", ctx), back, ctx);
+        
+        while (lex->token != TOKEN_NONE)
+        {
+            Lisp next_result = parse_expr(lex, error_jmp, ctx);
+            back_append(&front, &back, next_result, ctx);
+        } 
 
-        return lisp_make_null();
+       result = front;
     }
-}
 
-Lisp lisp_eval_global(Lisp expr, LispError* out_error, LispContext ctx)
-{
-    return lisp_eval(expr, lisp_env_global(ctx), out_error, ctx);
+    if (out_error) *out_error = error;
+    return result;
 }
 
-static Lisp gc_move(Lisp l, Heap* to)
+static Lisp expand_r(Lisp l, jmp_buf error_jmp, LispContext ctx)
 {
-    switch (l.type)
+    // 1. expand extended syntax into primitive syntax
+    // 2. perform optimizations
+    // 3. check syntax    
+    if (lisp_type(l) == LISP_SYMBOL &&
+        strcmp(lisp_symbol(l), "QUOTE") == 0)
     {
-        case LISP_PAIR:
-        case LISP_SYMBOL:
-        case LISP_STRING:
-        case LISP_LAMBDA:
-        case LISP_VECTOR:
+        // don't expand quotes
+        return l;
+    }
+    else if (lisp_type(l) == LISP_PAIR)
+    {
+        const char* op = NULL;
+        if (lisp_type(lisp_car(l)) == LISP_SYMBOL)
+            op = lisp_symbol(lisp_car(l));
+
+        if (op && strcmp(op, "QUOTE") == 0)
         {
-            Block* block = l.val.ptr_val;
-            if (!(block->gc_flags & GC_MOVED))
-            {
-                // copy the data to new block
-                Block* dest = heap_alloc(block->size, block->type, to);
-                memcpy(dest, block, block->size);
-                dest->gc_flags = GC_CLEAR;
-                
-                // save forwarding address (offset in to)
-                block->forward_address = dest;
-                block->gc_flags = GC_MOVED;
-            }
-            
-            // return the moved block address
-            l.val.ptr_val = block->forward_address;
+            if (lisp_list_length(l) != 2) longjmp(error_jmp, LISP_ERROR_BAD_QUOTE);
+            // don't expand quotes
             return l;
         }
-        case LISP_TABLE:
+        else if (op && strcmp(op, "DEFINE") == 0)
         {
-            Table* table = l.val.ptr_val;
-            if (!(table->block.gc_flags & GC_MOVED))
+            int length = lisp_list_length(l);
+
+            Lisp rest = lisp_cdr(l);
+            Lisp signature = lisp_car(rest);
+
+            switch (lisp_type(signature))
             {
-                float load_factor = table->size / (float)table->capacity;
-                
-                unsigned int new_capacity = table->capacity;
-                
-                if (load_factor > 0.75f || load_factor < 0.1f)
+                case LISP_PAIR:
                 {
-                    new_capacity = (table->size * 3) - 1;
-                    if (new_capacity < 1) new_capacity = 1;
-                }
+                    // (define (<name> <arg0> ... <argn>) <body0> ... <bodyN>)
+                    // -> (define <name> (lambda (<arg0> ... <argn>) <body> ... <bodyN>))
+                  
+                    if (length < 3) longjmp(error_jmp, LISP_ERROR_BAD_DEFINE);
+                    Lisp name = lisp_car(signature);
 
-                size_t new_size = sizeof(Table) + new_capacity * sizeof(Lisp);
-                Table* dest_table = heap_alloc(new_size, LISP_TABLE, to);
-                dest_table->size = table->size;
-                dest_table->capacity = new_capacity;
-                
-                // save forwarding address (offset in to)
-                table->block.forward_address = &dest_table->block;
-                table->block.gc_flags = GC_MOVED;
-                
-                // clear the table
-                for (int i = 0; i < new_capacity; ++i)
-                    dest_table->entries[i] = lisp_make_null();
-                
-                if (LISP_DEBUG && new_capacity != table->capacity)
-                {
-                    printf("resizing table %i -> %i\n", table->capacity, new_capacity);
+                    if (lisp_type(name) != LISP_SYMBOL) longjmp(error_jmp, LISP_ERROR_BAD_DEFINE); 
+
+                    Lisp args = lisp_cdr(signature);
+                    Lisp lambda = lisp_cdr(rest); // start with body
+                    lambda = lisp_cons(args, lambda, ctx);
+                    lambda = lisp_cons(lisp_make_symbol("LAMBDA", ctx), lambda, ctx);
+
+                    lisp_set_cdr(l, lisp_make_listv(ctx,
+                                                    name,
+                                                    expand_r(lambda, error_jmp, ctx),
+                                                    lisp_make_null()));
+                    return l;
                 }
-                
-                for (unsigned int i = 0; i < table->capacity; ++i)
+                case LISP_SYMBOL:
                 {
-                    Lisp it = table->entries[i];
-                    
-                    while (lisp_is_pair(it))
-                    {
-                        unsigned int new_index = i;
-                        
-                        if (new_capacity != table->capacity)
-                            new_index = symbol_hash(lisp_car(lisp_car(it))) % new_capacity;
-                        
-                        Lisp pair = gc_move(lisp_car(it), to);
-
-                        // allocate a new pair in the to space
-                        Pair* cons_block = heap_alloc(sizeof(Pair), LISP_PAIR, to);
-                        cons_block->block.gc_flags = GC_VISITED;
-                        
-                        Lisp new_pair;
-                        new_pair.type = cons_block->block.type;
-                        new_pair.val.ptr_val = cons_block;
-    
-                        // (pair, entry)
-                        lisp_set_car(new_pair, pair);
-                        lisp_set_cdr(new_pair, dest_table->entries[new_index]);
-                        dest_table->entries[new_index] = new_pair;
-                        it = lisp_cdr(it);
-                    }
+                    if (length != 3) longjmp(error_jmp, LISP_ERROR_BAD_DEFINE); 
+                    lisp_set_cdr(rest, expand_r(lisp_cdr(rest), error_jmp, ctx));
+                    return l;
                 }
+                default:
+                    longjmp(error_jmp, LISP_ERROR_BAD_DEFINE);
+                    break;
             }
-            
-            // return the moved table address
-            l.val.ptr_val = table->block.forward_address;
-            return l;
         }
-        default:
-            return l;
-    }
-}
+        else if (op && strcmp(op, "SET!") == 0)
+        {
+            if (lisp_list_length(l) != 3) longjmp(error_jmp, LISP_ERROR_BAD_SET);
 
+            Lisp var = lisp_list_ref(l, 1);
+            if (lisp_type(var) != LISP_SYMBOL) longjmp(error_jmp, LISP_ERROR_BAD_SET);
+            Lisp expr = expand_r(lisp_list_ref(l, 2), error_jmp, ctx);
 
-Lisp lisp_collect(Lisp root_to_save, LispContext ctx)
-{
-    Heap* to = &ctx.impl->to_heap;
+            return lisp_make_listv(ctx,
+                    lisp_list_ref(l, 0), // SET!
+                    var,
+                    expr,
+                    lisp_make_null());
+        }
+        else if (op && strcmp(op, "COND") == 0)
+        {
+            // (COND (<pred0> <expr0>)
+            //       (<pred1> <expr1>)
+            //        ...
+            //        (else <expr-1>)) ->
+            //
+            //  (IF <pred0> <expr0>
+            //      (if <pred1> <expr1>
+            //          ....
+            //      (if <predN> <exprN> <expr-1>)) ... )
 
-    // move root object
-    ctx.impl->symbol_table = gc_move(ctx.impl->symbol_table, to);
-    ctx.impl->global_env = gc_move(ctx.impl->global_env, to);
-    
-    Lisp result = gc_move(root_to_save, to);
+            Lisp conds = lisp_list_reverse(lisp_cdr(l));
+            Lisp outer = lisp_make_null();
 
-    // move references
-    const Page* page = to->first_page;
-    int page_counter = 0;
-    while (page)
-    {
-        size_t offset = 0;
-        while (offset < page->size)
-        {
-            Block* block = (Block*)(page->buffer + offset);
-            if (!(block->gc_flags & GC_VISITED))
+            Lisp cond_pair = lisp_car(conds);
+
+            // error checks
+            if (lisp_type(cond_pair) != LISP_PAIR) longjmp(error_jmp, LISP_ERROR_BAD_COND);
+            if (lisp_list_length(cond_pair) != 2) longjmp(error_jmp, LISP_ERROR_BAD_COND);
+
+            Lisp cond_pred = lisp_car(cond_pair);
+            Lisp cond_expr = lisp_make_null();
+
+            if ((lisp_type(cond_pred) == LISP_SYMBOL) &&
+                    strcmp(lisp_symbol(cond_pred), "ELSE") == 0)
             {
-                switch (block->type)
-                {
-                    // these add to the buffer!
-                    // so lists are handled in a single pass
-                    case LISP_PAIR:
-                    {
-                        // move the CAR and CDR
-                        Pair* pair = (Pair*)block;
-                        pair->car = gc_move(pair->car, to);
-                        pair->cdr = gc_move(pair->cdr, to);
-                        break;
-                    }
-                    case LISP_VECTOR:
-                    {
-                        Vector* vector = (Vector*)block;
-                        Lisp temp;
-                        temp.type = vector->type;
-                        for (int i = 0; i < vector->length; ++i)
-                        {
-                           temp.val = vector->entries[i];
-                           temp = gc_move(temp, to);
-                           vector->entries[i] = temp.val;
-                        }
-                        break;
-                    }
-                    case LISP_LAMBDA:
-                    {
-                        // move the body and args
-                        Lambda* lambda = (Lambda*)block;
-                        lambda->args = gc_move(lambda->args, to);
-                        lambda->body = gc_move(lambda->body, to);
-                        lambda->env = gc_move(lambda->env, to);
-                        break;
-                    }
-                    default: break;
-                }
-                block->gc_flags |= GC_VISITED;
+                cond_expr = expand_r(lisp_car(lisp_cdr(cond_pair)), error_jmp, ctx);
+                outer = cond_expr;
+                conds = lisp_cdr(conds);
             }
-            offset += block->size;
+
+            Lisp if_symbol = lisp_make_symbol("IF", ctx);
+       
+            while (lisp_is_pair(conds))
+            {
+                cond_pair = lisp_car(conds);
+
+                // error checks
+                if (lisp_type(cond_pair) != LISP_PAIR) longjmp(error_jmp, LISP_ERROR_BAD_COND);
+                if (lisp_list_length(cond_pair) != 2) longjmp(error_jmp, LISP_ERROR_BAD_COND);
+
+                cond_pred = expand_r(lisp_car(cond_pair), error_jmp, ctx);
+                cond_expr = expand_r(lisp_car(lisp_cdr(cond_pair)), error_jmp, ctx);
+
+                outer = lisp_make_listv(ctx,
+                                       if_symbol,
+                                       cond_pred,
+                                       cond_expr,
+                                       outer,
+                                       lisp_make_null());
+
+                conds = lisp_cdr(conds);
+            }
+
+            return outer;
         }
-        page = page->next;
-        ++page_counter;
+        else if (op && strcmp(op, "AND") == 0)
+        {
+            // (AND <pred0> <pred1> ... <predN>) 
+            // -> (IF <pred0> 
+            //      (IF <pred1> ...
+            //          (IF <predN> t f)
+            if (lisp_list_length(l) < 2) longjmp(error_jmp, LISP_ERROR_BAD_AND);
+
+            Lisp if_symbol = lisp_make_symbol("IF", ctx);
+
+            Lisp preds = lisp_list_reverse(lisp_cdr(l));
+            Lisp p = expand_r(lisp_car(preds), error_jmp, ctx);
+            
+            Lisp outer = lisp_make_listv(ctx,
+                                        if_symbol,
+                                        p,
+                                        lisp_make_int(1),
+                                        lisp_make_int(0),
+                                        lisp_make_null());
+
+            preds = lisp_cdr(preds);
+
+            while (lisp_is_pair(preds))
+            {
+                p = expand_r(lisp_car(preds), error_jmp, ctx);
+
+                outer = lisp_make_listv(ctx,
+                        if_symbol,
+                        p,
+                        outer,
+                        lisp_make_int(0),
+                        lisp_make_null());
+
+                preds = lisp_cdr(preds);
+            }
+                      
+           return outer;
+        }
+        else if (op && strcmp(op, "OR") == 0)
+        {
+            // (OR <pred0> <pred1> ... <predN>)
+            // -> (IF (<pred0>) t
+            //      (IF <pred1> t ...
+            //          (if <predN> t f))
+            if (lisp_list_length(l) < 2) longjmp(error_jmp, LISP_ERROR_BAD_OR);
+
+            Lisp if_symbol = lisp_make_symbol("IF", ctx);
+
+            Lisp preds = lisp_list_reverse(lisp_cdr(l));
+            Lisp p = expand_r(lisp_car(preds), error_jmp, ctx);
+            
+            Lisp outer = lisp_make_listv(ctx,
+                                        if_symbol,
+                                        p,
+                                        lisp_make_int(1),
+                                        lisp_make_int(0),
+                                        lisp_make_null());
+
+            preds = lisp_cdr(preds);
+
+            while (lisp_is_pair(preds))
+            {
+                p = expand_r(lisp_car(preds), error_jmp, ctx);
+
+                outer = lisp_make_listv(ctx,
+                                        if_symbol,
+                                        p,
+                                        lisp_make_int(1),
+                                        outer,
+                                        lisp_make_null());
+                preds = lisp_cdr(preds);
+            }
+                      
+           return outer;
+
+        }
+        else if (op && strcmp(op, "LET") == 0)
+        {
+            // (LET ((<var0> <expr0>) ... (<varN> <expr1>)) <body0> ... <bodyN>)
+            //  -> ((LAMBDA (<var0> ... <varN>) <body0> ... <bodyN>) <expr0> ... <expr1>)            
+            Lisp pairs = lisp_list_ref(l, 1);
+            if (lisp_type(pairs) != LISP_PAIR) longjmp(error_jmp, LISP_ERROR_BAD_LET);
+
+            Lisp body = lisp_list_advance(l, 2);
+
+            Lisp vars_front = lisp_make_null();
+            Lisp vars_back = vars_front;
+            
+            Lisp exprs_front = lisp_make_null();
+            Lisp exprs_back = exprs_front;
+            
+            while (lisp_is_pair(pairs))
+            {
+                if (!lisp_is_pair(lisp_car(pairs))) longjmp(error_jmp, LISP_ERROR_BAD_LET);
+
+                Lisp var = lisp_list_ref(lisp_car(pairs), 0);
+
+                if (lisp_type(var) != LISP_SYMBOL) longjmp(error_jmp, LISP_ERROR_BAD_LET);
+                back_append(&vars_front, &vars_back, var, ctx);
+
+                Lisp val = expand_r(lisp_list_ref(lisp_car(pairs), 1), error_jmp, ctx);
+                back_append(&exprs_front, &exprs_back, val, ctx);
+                pairs = lisp_cdr(pairs);
+            }
+            
+            Lisp lambda = lisp_make_listv(ctx, 
+                                        lisp_make_symbol("LAMBDA", ctx), 
+                                        vars_front, 
+                                        lisp_make_null());
+
+            lisp_set_cdr(lisp_cdr(lambda), body);
+
+            return lisp_cons(expand_r(lambda, error_jmp, ctx), exprs_front, ctx);
+        }
+        /*
+        else if (op && strcmp(op, "DO") == 0)
+        {
+            // (DO ((<var0> <init0> <step0>) ...) (<test> <result>) <loop>)
+            // -> ((lambda (f)
+            //        (set! f (lambda (<var0> ... <varN>)
+            //                   (if <test>
+            //                       <result>
+            //                       (begin
+            //                          <loop>
+            //                          (f <step0> ... <stepN>)))))
+            //        (f <init0> ... <initN>)) NULL)
+        } */
+        else if (op && strcmp(op, "LAMBDA") == 0)
+        {
+            // (LAMBDA (<var0> ... <varN>) <expr0> ... <exprN>)
+            // (LAMBDA (<var0> ... <varN>) (BEGIN <expr0> ... <expr1>)) 
+            int length = lisp_list_length(l);
+
+            if (length > 3)
+            {
+                Lisp body_exprs = expand_r(lisp_list_advance(l, 2), error_jmp, ctx); 
+                Lisp begin = lisp_cons(lisp_make_symbol("BEGIN", ctx), body_exprs, ctx);
+
+                Lisp vars = lisp_list_ref(l, 1);
+                if (!lisp_is_pair(vars) && !lisp_is_null(vars)) longjmp(error_jmp, LISP_ERROR_BAD_LAMBDA);
+
+                Lisp lambda = lisp_cons(begin, lisp_make_null(), ctx);
+                lambda = lisp_cons(vars, lambda, ctx);
+                lambda = lisp_cons(lisp_car(l), lambda, ctx);
+                return lambda;
+            }
+            else
+            {
+                Lisp body = lisp_list_advance(l, 2);
+                lisp_set_cdr(lisp_cdr(l), expand_r(body, error_jmp, ctx));
+                return l;
+            }
+        }
+        else if (op && strcmp(op, "DEFINE-RECORD") == 0)
+        {
+            // (DEFINE-RECORD <name> <field0> ... <fieldN>)
+            // -> (BEGIN (DEFINE <name> <type>)
+            //           (DEFINE MAKE-<name> (LAMBDA (<field0> ... <fieldN>) (RECORD <type> <field0> ... <fieldN>)))
+            //           (DEFINE <name>? (LAMBDA (R) (RECORD? R <type>)))
+            //           (DEFINE <name>-<field0> (LAMBDA (R) (RECORD-REF R <type> 0)))
+            //           (DEFINE SET-<name>-<field0>! (LAMBDA (R X) (RECORD-SET! R <type> 0 X)))
+            //           ...)
+            // the type is created now, so the accessors refer to it directly, by a constant index.
+            if (lisp_list_length(l) < 2) longjmp(error_jmp, LISP_ERROR_BAD_RECORD);
+
+            Lisp name = lisp_list_ref(l, 1);
+            Lisp fields = lisp_list_advance(l, 2);
+            if (lisp_type(name) != LISP_SYMBOL) longjmp(error_jmp, LISP_ERROR_BAD_RECORD);
+
+            int field_count = 0;
+            for (Lisp it = fields; !lisp_is_null(it); it = lisp_cdr(it), ++field_count)
+            {
+                if (!lisp_is_pair(it) || lisp_type(lisp_car(it)) != LISP_SYMBOL) longjmp(error_jmp, LISP_ERROR_BAD_RECORD);
+
+                // each field name once
+                Lisp other = fields;
+                for (int i = 0; i < field_count; ++i, other = lisp_cdr(other))
+                {
+                    if (lisp_eq(lisp_car(other), lisp_car(it))) longjmp(error_jmp, LISP_ERROR_BAD_RECORD);
+                }
+            }
+
+            Lisp type = lisp_make_record_type(name, fields, ctx);
+            Lisp define = lisp_make_symbol("DEFINE", ctx);
+            Lisp lambda = lisp_make_symbol("LAMBDA", ctx);
+            Lisp r = lisp_make_symbol("R", ctx);
+            Lisp x = lisp_make_symbol("X", ctx);
+
+            Lisp front = lisp_cons(lisp_make_symbol("BEGIN", ctx), lisp_make_null(), ctx);
+            Lisp back = front;
+            char scratch[SCRATCH_MAX];
+
+            back_append(&front, &back, lisp_make_listv(ctx, define, name, type, lisp_make_null()), ctx);
+
+            snprintf(scratch, SCRATCH_MAX, "MAKE-%s", lisp_symbol(name));
+            Lisp construct = lisp_cons(lisp_make_symbol("RECORD", ctx), lisp_cons(type, fields, ctx), ctx);
+            back_append(&front, &back, lisp_make_listv(ctx, define, lisp_make_symbol(scratch, ctx),
+                                                      lisp_cons(lambda, lisp_cons(fields, lisp_cons(construct, lisp_make_null(), ctx), ctx), ctx),
+                                                      lisp_make_null()), ctx);
+
+            snprintf(scratch, SCRATCH_MAX, "%s?", lisp_symbol(name));
+            Lisp test = lisp_make_listv(ctx, lisp_make_symbol("RECORD?", ctx), r, type, lisp_make_null());
+            back_append(&front, &back, lisp_make_listv(ctx, define, lisp_make_symbol(scratch, ctx),
+                                                      lisp_make_listv(ctx, lambda, lisp_cons(r, lisp_make_null(), ctx), test, lisp_make_null()),
+                                                      lisp_make_null()), ctx);
+
+            int index = 0;
+            for (Lisp it = fields; lisp_is_pair(it); it = lisp_cdr(it), ++index)
+            {
+                const char* field = lisp_symbol(lisp_car(it));
+
+                snprintf(scratch, SCRATCH_MAX, "%s-%s", lisp_symbol(name), field);
+                Lisp get = lisp_make_listv(ctx, lisp_make_symbol("RECORD-REF", ctx), r, type, lisp_make_int(index), lisp_make_null());
+                back_append(&front, &back, lisp_make_listv(ctx, define, lisp_make_symbol(scratch, ctx),
+                                                          lisp_make_listv(ctx, lambda, lisp_cons(r, lisp_make_null(), ctx), get, lisp_make_null()),
+                                                          lisp_make_null()), ctx);
+
+                snprintf(scratch, SCRATCH_MAX, "SET-%s-%s!", lisp_symbol(name), field);
+                Lisp set = lisp_make_listv(ctx, lisp_make_symbol("RECORD-SET!", ctx), r, type, lisp_make_int(index), x, lisp_make_null());
+                back_append(&front, &back, lisp_make_listv(ctx, define, lisp_make_symbol(scratch, ctx),
+                                                          lisp_make_listv(ctx, lambda, lisp_make_listv(ctx, r, x, lisp_make_null()), set, lisp_make_null()),
+                                                          lisp_make_null()), ctx);
+            }
+            return expand_r(front, error_jmp, ctx);
+        }
+        else if (op && strcmp(op, "ASSERT") == 0)
+        {
+            Lisp statement = lisp_car(lisp_cdr(l));
+            // here we save a quoted version of the code so we can see
+            // what happened to trigger the assertion
+            Lisp quoted = lisp_make_listv(ctx,
+                                         lisp_make_symbol("QUOTE", ctx),
+                                         statement,
+                                         lisp_make_null());
+            return lisp_make_listv(ctx,
+                                  lisp_car(l),
+                                  expand_r(statement, error_jmp, ctx),
+                                  quoted,
+                                  lisp_make_null());
+                                  
+        }
+        else
+        {
+            Lisp it = l;
+            while (lisp_is_pair(it))
+            {
+                lisp_set_car(it, expand_r(lisp_car(it), error_jmp, ctx));
+                it = lisp_cdr(it);
+            }
+
+            return l;
+        }
+    } 
+    else 
+    {
+        return l;
+    }
+}
+
+Lisp lisp_read(const char* program, LispError* out_error, LispContext ctx)
+{
+    Lexer lex;
+    lexer_init(&lex, program);
+    Lisp l = parse(&lex, out_error, ctx);
+    lexer_shutdown(&lex);
+    return l;
+}
+
+Lisp lisp_read_file(FILE* file, LispError* out_error, LispContext ctx)
+{
+    Lexer lex;
+    lexer_init_file(&lex, file);
+    Lisp l = parse(&lex, out_error, ctx);
+    lexer_shutdown(&lex);
+    return l;
+}
+
+#if LISP_MMAP
+// maps a regular file so it can be lexed like a string.
+// the mapping is followed by zeroed memory, so it ends with '\0'.
+// returns NULL for pipes and other files which can't be mapped.
+static char* file_map(FILE* file, size_t* out_map_size)
+{
+    int fd = fileno(file);
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size == 0) return NULL;
+
+    size_t size = (size_t)info.st_size;
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    size_t map_size = (size / page_size + 1) * page_size;
+
+    // reserve zero pages, then map the file over the front
+    char* data = mmap(NULL, map_size, PROT_READ, MAP_PRIVATE | MAP_ANON, -1, 0);
+    if (data == MAP_FAILED) return NULL;
+
+    if (mmap(data, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)
+    {
+        munmap(data, map_size);
+        return NULL;
+    }
+
+    madvise(data, size, MADV_SEQUENTIAL);
+    *out_map_size = map_size;
+    return data;
+}
+#endif
+
+static Lisp read_path(const char* path, int flags, LispError* out_error, LispContext ctx)
+{
+    FILE* file = fopen(path, "r");
+
+    if (!file)
+    {
+        *out_error = LISP_ERROR_FILE_OPEN;
+        return lisp_make_null();
+    }
+
+    Lexer lex;
+    Lisp l;
+#if LISP_MMAP
+    size_t map_size;
+    char* data = file_map(file, &map_size);
+    if (data)
+    {
+        lexer_init(&lex, data);
+        lex.read_flags = flags;
+        l = parse(&lex, out_error, ctx);
+        lexer_shutdown(&lex);
+        munmap(data, map_size);
+        fclose(file);
+        return l;
+    }
+#endif
+
+    lexer_init_file(&lex, file);
+    lex.read_flags = flags;
+    l = parse(&lex, out_error, ctx);
+    lexer_shutdown(&lex);
+    fclose(file);
+    return l;
+}
+
+Lisp lisp_read_path(const char* path, LispError* out_error, LispContext ctx)
+{
+    return read_path(path, LISP_READ_DEFAULT, out_error, ctx);
+}
+
+Lisp lisp_read_data(const char* text, int flags, LispError* out_error, LispContext ctx)
+{
+    Lexer lex;
+    lexer_init(&lex, text);
+    lex.read_flags = flags;
+    Lisp l = parse(&lex, out_error, ctx);
+    lexer_shutdown(&lex);
+    return l;
+}
+
+Lisp lisp_read_data_file(FILE* file, int flags, LispError* out_error, LispContext ctx)
+{
+    Lexer lex;
+    lexer_init_file(&lex, file);
+    lex.read_flags = flags;
+    Lisp l = parse(&lex, out_error, ctx);
+    lexer_shutdown(&lex);
+    return l;
+}
+
+Lisp lisp_read_data_path(const char* path, int flags, LispError* out_error, LispContext ctx)
+{
+    return read_path(path, flags, out_error, ctx);
+}
+
+// readers use the chunked file lexer rather than a mapping,
+// so memory stays at one buffer however much of the file is read.
+struct LispReader
+{
+    Lexer lex;
+    FILE* file; // opened by the reader
+};
+
+static LispReader* reader_start(LispReader* reader, int flags)
+{
+    // the first token is read ahead, like the rest
+    kernels_init();
+    reader->lex.read_flags = flags;
+    lexer_next_token(&reader->lex);
+    return reader;
+}
+
+LispReader* lisp_reader_open(const char* text, int flags)
+{
+    LispReader* reader = malloc(sizeof(LispReader));
+    reader->file = NULL;
+    lexer_init(&reader->lex, text);
+    return reader_start(reader, flags);
+}
+
+LispReader* lisp_reader_open_file(FILE* file, int flags)
+{
+    LispReader* reader = malloc(sizeof(LispReader));
+    reader->file = NULL;
+    lexer_init_file(&reader->lex, file);
+    return reader_start(reader, flags);
+}
+
+LispReader* lisp_reader_open_path(const char* path, int flags, LispError* out_error)
+{
+    FILE* file = fopen(path, "r");
+    if (!file)
+    {
+        *out_error = LISP_ERROR_FILE_OPEN;
+        return NULL;
+    }
+
+    LispReader* reader = lisp_reader_open_file(file, flags);
+    reader->file = file;
+    return reader;
+}
+
+int lisp_reader_next(LispReader* reader, Lisp* out_form, LispError* out_error, LispContext ctx)
+{
+    Lexer* lex = &reader->lex;
+    *out_error = LISP_ERROR_NONE;
+    *out_form = lisp_make_null();
+
+    jmp_buf error_jmp;
+    LispError error = setjmp(error_jmp);
+
+    if (error != LISP_ERROR_NONE)
+    {
+        // nothing more can be read after an error
+        lex->stack_size = 0;
+        lex->frame_count = 0;
+        lex->token = TOKEN_NONE;
+        *out_error = error;
+        return 0;
+    }
+
+    if (lex->token == TOKEN_NONE) return 0;
+
+    *out_form = parse_expr(lex, error_jmp, ctx);
+    return 1;
+}
+
+void lisp_reader_close(LispReader* reader)
+{
+    lexer_shutdown(&reader->lex);
+    if (reader->file) fclose(reader->file);
+    free(reader);
+}
+
+// Event reading walks the input like parse_expr, but calls back
+// instead of building. Frames are still kept to check the structure.
+// Nothing is stacked, so a frame's base counts its items instead,
+// and vectors remember the type of their items (or EVENT_MIXED).
+
+// longjmp value when a callback stops the read
+#define EVENT_STOPPED (-1)
+#define EVENT_MIXED (-1)
+
+static void event_check(int stop, jmp_buf error_jmp)
+{
+    if (stop) longjmp(error_jmp, EVENT_STOPPED);
+}
+
+static LispType event_atom(Lexer* lex, const LispEvents* events, jmp_buf error_jmp)
+{
+    const char* text = lex->sc;
+    size_t length = lex->scan_length;
+    LispType type;
+
+    switch (lex->token)
+    {
+        case TOKEN_INT:
+            type = LISP_INT;
+            break;
+        case TOKEN_FLOAT:
+            type = LISP_FLOAT;
+            break;
+        case TOKEN_STRING:
+            // skip quotes
+            type = LISP_STRING;
+            ++text;
+            length -= 2;
+            break;
+        case TOKEN_SYMBOL:
+            type = LISP_SYMBOL;
+            break;
+        default:
+            longjmp(error_jmp, LISP_ERROR_BAD_TOKEN);
+    }
+
+    // the token is still in the buffer until the next is read
+    if (events->atom) event_check(events->atom(events->user, type, text, length), error_jmp);
+    lexer_next_token(lex);
+    return type;
+}
+
+static void event_end(const LispEvents* events, jmp_buf error_jmp)
+{
+    if (events->end) event_check(events->end(events->user), error_jmp);
+}
+
+// call back for one expression, starting at the current token
+static void event_expr(Lexer* lex, const LispEvents* events, jmp_buf error_jmp)
+{
+    size_t outer = lex->frame_count;
+    void* user = events->user;
+
+    while (1)
+    {
+        ParseFrame* top = lex->frame_count > outer ? lex->frames + lex->frame_count - 1 : NULL;
+        LispType x;
+
+        switch (lex->token)
+        {
+            case TOKEN_NONE:
+                longjmp(error_jmp, LISP_ERROR_PAREN_EXPECTED);
+            case TOKEN_DOT:
+            {
+                if (!top || top->type != FRAME_LIST || top->base == 0)
+                    longjmp(error_jmp, LISP_ERROR_DOT_UNEXPECTED);
+
+                lexer_next_token(lex);
+                if (lex->token != TOKEN_R_PAREN)
+                {
+                    top->type = FRAME_LIST_TAIL;
+                    if (events->dot) event_check(events->dot(user), error_jmp);
+                }
+                continue;
+            }
+            case TOKEN_L_PAREN:
+            {
+                // (
+                lexer_next_token(lex);
+                parse_open(lex, FRAME_LIST);
+                if (events->list_begin) event_check(events->list_begin(user), error_jmp);
+                continue;
+            }
+            case TOKEN_R_PAREN:
+            {
+                if (!top || top->type == FRAME_QUOTE) longjmp(error_jmp, LISP_ERROR_PAREN_UNEXPECTED);
+
+                // )
+                lexer_next_token(lex);
+                --lex->frame_count;
+                if (top->type == FRAME_VECTOR)
+                {
+                    // vectors store one type for every entry
+                    if (top->item_type == EVENT_MIXED) longjmp(error_jmp, LISP_ERROR_BAD_TOKEN);
+                    x = LISP_VECTOR;
+                }
+                else
+                {
+                    x = top->base == 0 ? LISP_NULL : LISP_PAIR;
+                }
+                event_end(events, error_jmp);
+                break;
+            }
+            case TOKEN_HASH:
+            {
+                // #
+                lexer_next_token(lex);
+                // #f32( #i32( #u8(
+                if (lex->token == TOKEN_SYMBOL)
+                {
+                    LispTypedKind kind = parse_typed_kind(lex, error_jmp);
+                    if (events->vector_begin) event_check(events->vector_begin(user, kind), error_jmp);
+
+                    while (lex->token != TOKEN_R_PAREN)
+                    {
+                        if (lex->token != TOKEN_INT && lex->token != TOKEN_FLOAT) longjmp(error_jmp, LISP_ERROR_BAD_TOKEN);
+                        // bytes are ints from 0 to 255
+                        if (kind == LISP_TYPED_U8 &&
+                            (lex->token != TOKEN_INT || !lex->exact || lex->digits > 255 || (lex->negative && lex->digits != 0)))
+                            longjmp(error_jmp, LISP_ERROR_BAD_TOKEN);
+                        event_atom(lex, events, error_jmp);
+                    }
+                    // )
+                    lexer_next_token(lex);
+                    event_end(events, error_jmp);
+                    x = LISP_TYPED_VECTOR;
+                    break;
+                }
+                if (lex->token != TOKEN_L_PAREN) longjmp(error_jmp, LISP_ERROR_PAREN_EXPECTED);
+                // (
+                lexer_next_token(lex);
+                parse_open(lex, FRAME_VECTOR);
+                if (events->vector_begin) event_check(events->vector_begin(user, -1), error_jmp);
+                continue;
+            }
+            case TOKEN_QUOTE:
+            {
+                // '
+                lexer_next_token(lex);
+                parse_open(lex, FRAME_QUOTE);
+                if (events->list_begin) event_check(events->list_begin(user), error_jmp);
+                if (events->atom) event_check(events->atom(user, LISP_SYMBOL, "QUOTE", 5), error_jmp);
+                continue;
+            }
+            default:
+            {
+                x = event_atom(lex, events, error_jmp);
+                break;
+            }
+        }
+
+        // an expression of type x finished. close the frames it completes
+        while (1)
+        {
+            if (lex->frame_count == outer) return;
+
+            top = lex->frames + lex->frame_count - 1;
+            if (top->type == FRAME_QUOTE)
+            {
+                --lex->frame_count;
+                event_end(events, error_jmp);
+                x = LISP_PAIR;
+            }
+            else if (top->type == FRAME_LIST_TAIL)
+            {
+                if (lex->token != TOKEN_R_PAREN) longjmp(error_jmp, LISP_ERROR_PAREN_EXPECTED);
+                // )
+                lexer_next_token(lex);
+                --lex->frame_count;
+                event_end(events, error_jmp);
+                x = LISP_PAIR;
+            }
+            else
+            {
+                if (top->base == 0) top->item_type = (int)x;
+                else if (top->item_type != (int)x) top->item_type = EVENT_MIXED;
+                ++top->base;
+                break;
+            }
+        }
+    }
+}
+
+static int read_events(Lexer* lex, const LispEvents* events, LispError* out_error)
+{
+    jmp_buf error_jmp;
+    int error = setjmp(error_jmp);
+
+    if (error != LISP_ERROR_NONE)
+    {
+        lex->frame_count = 0;
+        if (out_error) *out_error = error == EVENT_STOPPED ? LISP_ERROR_NONE : (LispError)error;
+        return 0;
+    }
+
+    // each top level expression in turn, like a LispReader
+    kernels_init();
+    lexer_next_token(lex);
+    while (lex->token != TOKEN_NONE)
+        event_expr(lex, events, error_jmp);
+
+    if (out_error) *out_error = LISP_ERROR_NONE;
+    return 1;
+}
+
+int lisp_read_events(const char* text, const LispEvents* events, LispError* out_error)
+{
+    Lexer lex;
+    lexer_init(&lex, text);
+    int done = read_events(&lex, events, out_error);
+    lexer_shutdown(&lex);
+    return done;
+}
+
+int lisp_read_events_file(FILE* file, const LispEvents* events, LispError* out_error)
+{
+    Lexer lex;
+    lexer_init_file(&lex, file);
+    int done = read_events(&lex, events, out_error);
+    lexer_shutdown(&lex);
+    return done;
+}
+
+// the file is read in chunks, rather than mapped, as by a LispReader
+int lisp_read_events_path(const char* path, const LispEvents* events, LispError* out_error)
+{
+    FILE* file = fopen(path, "r");
+    if (!file)
+    {
+        if (out_error) *out_error = LISP_ERROR_FILE_OPEN;
+        return 0;
+    }
+
+    int done = lisp_read_events_file(file, events, out_error);
+    fclose(file);
+    return done;
+}
+
+// Reading on several threads.
+// A pre-scan follows the structure of a file holding one list or vector,
+// and picks where to cut its items into runs. Each run is read by
+// a worker into a context of its own. The workers' pages are then given
+// to ctx, after their references to the worker's symbols are swapped for ctx's.
+
+// runs shorter than this aren't worth a thread
+#define PARALLEL_RUN_MIN (256 * 1024)
+
+typedef struct
+{
+    const char* text;
+    const char* end; // the NUL
+    int depth;
+    const char* close; // of the top level list or vector
+
+    // where to cut. the next run starts at the first item after next_cut.
+    char** runs;
+    int run_count;
+    int count;
+    const char* next_cut;
+} Prescan;
+
+// first byte not in the classes
+static const char* prescan_skip(const char* p, unsigned char classes)
+{
+    while (lex_class_table[(unsigned char)*p] & classes) ++p;
+    return p;
+}
+
+static const char* prescan_skip_empty(const char* p)
+{
+    while (1)
+    {
+        p = prescan_skip(p, 1 << LEX_SPACE);
+        if (*p != ';') return p;
+        while (*p != '\n' && *p != '\0') ++p;
+    }
+}
+
+static void prescan_cut(Prescan* scan, const char* p)
+{
+    scan->runs[scan->run_count++] = (char*)p;
+    if (scan->run_count < scan->count)
+        scan->next_cut = scan->text + (scan->end - scan->text) * scan->run_count / scan->count;
+    else
+        scan->next_cut = scan->end + 1;
+}
+
+// skips tokens as lexer_next_token would read them, from p (between tokens)
+// until the first token ending at or past limit, and returns where that is.
+// returns NULL if the text can't be split.
+static const char* prescan_tokens(Prescan* scan, const char* p, const char* limit)
+{
+    // the last token was # ' or a dot, so the item isn't complete.
+    // nothing is known about the token before p.
+    int prefix = '?';
+
+    while (p < limit && !scan->close)
+    {
+        p = prescan_skip_empty(p);
+        char c = *p;
+
+        if (p >= scan->next_cut && scan->depth == 1 && !prefix && c != ')' && c != '\0' &&
+            (lex_class_table[(unsigned char)p[-1]] & (1 << LEX_SPACE)))
+        {
+            prescan_cut(scan, p);
+        }
+
+        int symbol = 0;
+        switch (c)
+        {
+            case '\0':
+                return NULL;
+            case '(':
+                ++scan->depth;
+                ++p;
+                break;
+            case ')':
+                if (--scan->depth == 0) scan->close = p;
+                ++p;
+                break;
+            case '#':
+            case '\'':
+                ++p;
+                break;
+            case '.':
+                // a dotted list
+                if (scan->depth == 1) return NULL;
+                ++p;
+                break;
+            case '"':
+            {
+                // strings end on the same line, or are symbols
+                const char* end = p + 1;
+                while (*end != '"' && *end != '\n' && *end != '\0') ++end;
+                if (*end == '"')
+                {
+                    p = end + 1;
+                }
+                else
+                {
+                    p = prescan_skip(p, 1 << LEX_SYMBOL);
+                    symbol = 1;
+                }
+                break;
+            }
+            default:
+            {
+                const char* digits = (c == '-' || c == '+') ? p + 1 : p;
+                if (isdigit((unsigned char)*digits))
+                {
+                    p = prescan_skip(digits, (1 << LEX_DIGIT) | (1 << LEX_DOT));
+                }
+                else if (lex_is_symbol(c))
+                {
+                    p = prescan_skip(p, 1 << LEX_SYMBOL);
+                    symbol = 1;
+                }
+                else
+                {
+                    return NULL;
+                }
+                break;
+            }
+        }
+
+        // #F32( is a hash, a symbol and then the paren
+        if (c == '#' || c == '\'' || c == '.') prefix = c;
+        else if (!((prefix == '#' || prefix == '?') && symbol)) prefix = 0;
+    }
+    return p;
+}
+
+// inclusive prefix xor: bit i is the parity of bits 0 to i
+static uint64_t word_prefix_xor(uint64_t x)
+{
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+// the lowest depth reached in a block
+static int prescan_min_depth(int depth, uint64_t open, uint64_t close)
+{
+    int min = depth;
+    uint64_t parens = open | close;
+    while (parens)
+    {
+        unsigned int i = word_first_bit(parens);
+        depth += (open >> i) & 1 ? 1 : -1;
+        if (depth < min) min = depth;
+        parens &= parens - 1;
+    }
+    return min;
+}
+
+// finds where to cut the items of the list or vector in text into at most count runs.
+// each run after the first starts at an item with whitespace before it.
+// returns the number of runs, or 0 if the text is anything else
+// (an atom, several forms, a dotted list or a syntax error).
+//
+// Most blocks are scanned with masks. Strings are found by pairing quotes,
+// and parens outside of them are counted. This only holds when every
+// opening quote starts a token, which is sure when it follows whitespace,
+// a paren or #, and when no string runs into a newline (making it a symbol).
+// Blocks where that isn't sure, or which may hold a cut or the end,
+// are read token by token from the last boundary before them.
+static int prescan_split(const char* text, int count, char** out_runs, const char** out_close, int* out_vector)
+{
+    Prescan scan;
+    scan.text = text;
+    scan.end = text + strlen(text);
+    scan.close = NULL;
+    scan.runs = out_runs;
+    scan.run_count = 0;
+    scan.count = count;
+
+    const char* p = prescan_skip_empty(text);
+    if (p[0] == '(')
+    {
+        *out_vector = 0;
+        p += 1;
+    }
+    else if (p[0] == '#' && p[1] == '(')
+    {
+        *out_vector = 1;
+        p += 2;
+    }
+    else
+    {
+        return 0;
+    }
+
+    scan.depth = 1;
+    prescan_cut(&scan, p);
+
+    // the last token boundary outside of strings, and its depth.
+    // it is found in the last block with one when it is needed.
+    const char* resume = p;
+    int resume_depth = 1;
+    const char* last_block = NULL;
+    int last_depth = 0;
+    uint64_t last_open = 0, last_close = 0, last_boundary = 0;
+    int in_string = 0;
+
+    while (!scan.close)
+    {
+        uint64_t masks[SCAN_CLASS_COUNT];
+        if (scan.end - p >= LEX_BLOCK)
+        {
+            lex_structure(p, masks);
+        }
+        else
+        {
+            char tail[LEX_BLOCK] = { 0 };
+            memcpy(tail, p, scan.end - p);
+            lex_structure(tail, masks);
+        }
+
+        uint64_t inside = word_prefix_xor(masks[SCAN_QUOTE]) ^ (in_string ? ~0ULL : 0);
+        uint64_t opening = masks[SCAN_QUOTE] & inside;
+        uint64_t after_boundary = (masks[SCAN_BOUNDARY] << 1) | ((lex_structure_table[(unsigned char)p[-1]] >> SCAN_BOUNDARY) & 1);
+        uint64_t open = masks[SCAN_OPEN] & ~inside;
+        uint64_t close = masks[SCAN_CLOSE] & ~inside;
+
+        int sure = !(opening & ~after_boundary) && !(masks[SCAN_LINE_END] & inside) && !(masks[SCAN_UNSAFE] & ~inside);
+
+        // the top level doesn't close here, and is not
+        // reached where a cut may be made.
+        int closes = (int)word_count_bits(close);
+        int min_depth = p + LEX_BLOCK <= scan.next_cut ? 1 : 2;
+        int skip = scan.depth - closes >= min_depth ||
+                   prescan_min_depth(scan.depth, open, close) >= min_depth;
+
+        if (sure && skip)
+        {
+            uint64_t boundary = masks[SCAN_BOUNDARY] & ~inside;
+            if (boundary)
+            {
+                last_block = p;
+                last_depth = scan.depth;
+                last_open = open;
+                last_close = close;
+                last_boundary = boundary;
+            }
+            scan.depth += (int)word_count_bits(open) - closes;
+            in_string = (int)(inside >> 63);
+            p += LEX_BLOCK;
+        }
+        else
+        {
+            if (last_block)
+            {
+                unsigned int i = word_last_bit(last_boundary);
+                uint64_t before = ((uint64_t)1 << i) - 1;
+                resume = last_block + i;
+                resume_depth = last_depth + (int)word_count_bits(last_open & before) - (int)word_count_bits(last_close & before);
+                last_block = NULL;
+            }
+
+            scan.depth = resume_depth;
+            p = prescan_tokens(&scan, resume, p + LEX_BLOCK);
+            if (!p) return 0;
+            resume = p;
+            resume_depth = scan.depth;
+            in_string = 0;
+        }
+    }
+
+    // only one form
+    if (*prescan_skip_empty(scan.close + 1) != '\0' || scan.run_count < 2) return 0;
+
+    *out_close = scan.close;
+    return scan.run_count;
+}
+
+typedef struct
+{
+    LispContext ctx; // the worker's own heap and symbols
+    struct LispImpl* owner; // the context being read into
+    const char* text;
+    int flags;
+    Lexer lex; // items which were read are left on the stack
+    LispError error;
+    Symbol** symbols; // symbol in owner for each slot of the worker's table
+} ReadWorker;
+
+static void* read_worker_parse(void* arg)
+{
+    ReadWorker* worker = arg;
+    Lexer* lex = &worker->lex;
+    lexer_init(lex, worker->text);
+    lex->read_flags = worker->flags;
+
+    jmp_buf error_jmp;
+    LispError error = setjmp(error_jmp);
+    if (error != LISP_ERROR_NONE)
+    {
+        worker->error = error;
+        return NULL;
+    }
+
+    lexer_next_token(lex);
+    while (lex->token != TOKEN_NONE)
+        parse_push(lex, parse_expr(lex, error_jmp, worker->ctx));
+    return NULL;
+}
+
+static Lisp read_worker_symbol(const ReadWorker* worker, Lisp l)
+{
+    if (l.type != LISP_SYMBOL) return l;
+
+    const InternTable* table = &worker->ctx.impl->symbol_table;
+    const Symbol* symbol = l.val.ptr_val;
+    unsigned int mask = table->capacity - 1;
+    unsigned int index = symbol->hash & mask;
+    while (table->slots[index].symbol != symbol) index = (index + 1) & mask;
+
+    l.val.ptr_val = worker->symbols[index];
+    return l;
+}
+
+// the reader only makes these blocks,
+// so they are the only ones which need their references swapped.
+static void* read_worker_relink(void* arg)
+{
+    ReadWorker* worker = arg;
+    const Page* page = worker->ctx.impl->heap.first_page;
+    while (page)
+    {
+        size_t offset = 0;
+        while (offset < page->size)
+        {
+            Block* block = (Block*)(page->buffer + offset);
+            switch (block->type)
+            {
+                case LISP_PAIR:
+                {
+                    Pair* pair = (Pair*)block;
+                    pair->car = read_worker_symbol(worker, pair->car);
+                    pair->cdr = read_worker_symbol(worker, pair->cdr);
+                    break;
+                }
+                case LISP_VECTOR:
+                {
+                    Vector* vector = (Vector*)block;
+                    if (vector->type != LISP_SYMBOL) break;
+
+                    Lisp temp;
+                    temp.type = LISP_SYMBOL;
+                    for (unsigned int i = 0; i < vector->length; ++i)
+                    {
+                        temp.val = vector->entries[i];
+                        vector->entries[i] = read_worker_symbol(worker, temp).val;
+                    }
+                    break;
+                }
+                case BLOCK_COMPACT_LIST:
+                {
+                    CompactList* list = (CompactList*)block;
+                    for (unsigned int i = 0; i < list->length; ++i)
+                    {
+                        CompactSlot* slot = list->slots + i;
+                        if (slot->forwarded || slot->type != LISP_SYMBOL) continue;
+
+                        Lisp temp;
+                        temp.type = LISP_SYMBOL;
+                        temp.val = slot->car;
+                        slot->car = read_worker_symbol(worker, temp).val;
+                    }
+                    list->tail = read_worker_symbol(worker, list->tail);
+                    list->owner = worker->owner;
+                    break;
+                }
+                default: break;
+            }
+            offset += block->size;
+        }
+        page = page->next;
+    }
+
+    Lexer* lex = &worker->lex;
+    for (size_t i = 0; i < lex->stack_size; ++i)
+        lex->stack[i] = read_worker_symbol(worker, lex->stack[i]);
+    return NULL;
+}
+
+static void read_workers_run(ReadWorker* workers, int count, void* (*run)(void*))
+{
+#if LISP_THREADS
+    pthread_t* threads = malloc(sizeof(pthread_t) * count);
+    int* started = calloc(count, sizeof(int));
+    for (int i = 1; i < count; ++i)
+        started[i] = pthread_create(threads + i, NULL, run, workers + i) == 0;
+
+    // this thread takes the first, and any which couldn't be started
+    for (int i = 0; i < count; ++i)
+    {
+        if (!started[i]) run(workers + i);
+    }
+    for (int i = 1; i < count; ++i)
+    {
+        if (started[i]) pthread_join(threads[i], NULL);
+    }
+    free(started);
+    free(threads);
+#else
+    for (int i = 0; i < count; ++i) run(workers + i);
+#endif
+}
+
+// moves every page of from to the end of heap
+static void heap_adopt(Heap* heap, Heap* from)
+{
+    if (!from->first_page) return;
+
+    if (heap->page)
+        heap->page->next = from->first_page;
+    else
+        heap->first_page = from->first_page;
+
+    heap->page = from->page;
+    heap->page_count += from->page_count;
+    heap->size += from->size;
+    heap_init(from, from->page_size);
+}
+
+// the whole file, ending with '\0'.
+// NULL if it can't be read, such as from a pipe.
+static char* read_text(FILE* file, size_t* out_size)
+{
+    if (fseek(file, 0, SEEK_END) != 0) return NULL;
+    long size = ftell(file);
+    if (size < 0 || fseek(file, 0, SEEK_SET) != 0) return NULL;
+
+    char* text = malloc((size_t)size + 1);
+    size_t read = fread(text, 1, (size_t)size, file);
+    text[read] = '\0';
+    *out_size = read;
+    return text;
+}
+
+static Lisp read_parallel(char* text, size_t size, int thread_count, int flags, LispError* out_error, LispContext ctx)
+{
+    if (thread_count <= 0)
+    {
+#if LISP_THREADS
+        thread_count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#else
+        thread_count = 1;
+#endif
+    }
+    if ((size_t)thread_count > size / PARALLEL_RUN_MIN) thread_count = (int)(size / PARALLEL_RUN_MIN);
+    if (thread_count < 2) return lisp_read_data(text, flags, out_error, ctx);
+
+    int vector;
+    const char* close;
+    char** runs = malloc(sizeof(char*) * thread_count);
+    int count = prescan_split(text, thread_count, runs, &close, &vector);
+    if (count == 0)
+    {
+        free(runs);
+        return lisp_read_data(text, flags, out_error, ctx);
+    }
+
+    // each run ends with a NUL written over the whitespace before the next,
+    // and the last over the close paren.
+    char* cut_bytes = malloc(count);
+    for (int i = 1; i < count; ++i)
+    {
+        cut_bytes[i - 1] = runs[i][-1];
+        runs[i][-1] = '\0';
+    }
+    cut_bytes[count - 1] = *close;
+    text[close - text] = '\0';
+
+    // contexts are made here, so nothing is shared while the workers run
+    ReadWorker* workers = malloc(sizeof(ReadWorker) * count);
+    for (int i = 0; i < count; ++i)
+    {
+        ReadWorker* worker = workers + i;
+        worker->ctx = lisp_init_empty_opt(ctx.impl->symbol_table_size, ctx.impl->heap.page_size);
+        worker->owner = ctx.impl;
+        worker->text = runs[i];
+        worker->flags = flags;
+        worker->error = LISP_ERROR_NONE;
+        worker->symbols = NULL;
+    }
+
+    read_workers_run(workers, count, read_worker_parse);
+
+    int failed = 0;
+    for (int i = 0; i < count; ++i)
+        failed |= workers[i].error != LISP_ERROR_NONE;
+
+    Lisp result = lisp_make_null();
+    LispError error = LISP_ERROR_NONE;
+    if (failed)
+    {
+        // read it again in one piece, so the error is the one
+        // reading alone would give. (the scan lets some through,
+        // such as a dotted list)
+        for (int i = 1; i < count; ++i) runs[i][-1] = cut_bytes[i - 1];
+        text[close - text] = cut_bytes[count - 1];
+        result = lisp_read_data(text, flags, &error, ctx);
+    }
+    else
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            const InternTable* table = &workers[i].ctx.impl->symbol_table;
+            workers[i].symbols = malloc(sizeof(Symbol*) * table->capacity);
+            for (unsigned int j = 0; j < table->capacity; ++j)
+            {
+                const Symbol* symbol = table->slots[j].symbol;
+                if (!symbol) continue;
+                workers[i].symbols[j] = symbol_intern(symbol->string, symbol->length, symbol->hash, ctx).val.ptr_val;
+            }
+        }
+
+        read_workers_run(workers, count, read_worker_relink);
+
+        // the items are closed as one list or vector
+        Lexer lex;
+        lexer_init(&lex, "");
+        lex.read_flags = flags;
+        for (int i = 0; i < count; ++i)
+        {
+            for (size_t j = 0; j < workers[i].lex.stack_size; ++j)
+                parse_push(&lex, workers[i].lex.stack[j]);
+            heap_adopt(&ctx.impl->heap, &workers[i].ctx.impl->heap);
+        }
+
+        jmp_buf error_jmp;
+        error = setjmp(error_jmp);
+        if (error == LISP_ERROR_NONE)
+        {
+            if (vector)
+                result = parse_pop_vector(&lex, 0, error_jmp, ctx);
+            else
+                result = parse_close_list(&lex, 0, lisp_make_null(), ctx);
+        }
+        lexer_shutdown(&lex);
+    }
+
+    for (int i = 0; i < count; ++i)
+    {
+        lexer_shutdown(&workers[i].lex);
+        free(workers[i].symbols);
+        lisp_shutdown(workers[i].ctx);
+    }
+    free(workers);
+    free(cut_bytes);
+    free(runs);
+
+    *out_error = error;
+    return result;
+}
+
+Lisp lisp_read_path_parallel(const char* path, int thread_count, int flags, LispError* out_error, LispContext ctx)
+{
+    FILE* file = fopen(path, "rb");
+    if (!file)
+    {
+        *out_error = LISP_ERROR_FILE_OPEN;
+        return lisp_make_null();
+    }
+
+    size_t size;
+    char* text = read_text(file, &size);
+    fclose(file);
+    if (!text) return read_path(path, flags, out_error, ctx);
+
+    Lisp l = read_parallel(text, size, thread_count, flags, out_error, ctx);
+    free(text);
+    return l;
+}
+
+// Lazy reading.
+// A first pass checks the text as parse_expr would read it, without building
+// anything, and notes on a tape where each list and vector closes and what it reads as.
+// Then only the top level one is read. Lists and vectors inside it become LazyNodes,
+// which are read the same way when CAR, VECTOR-REF and the like first reach them,
+// and forward to what they read from then on.
+// Collection replaces nodes which have been read with their values,
+// and frees a tape once no nodes refer to it.
+
+// lists and vectors with nothing nested, shorter than this, are read with their parent
+#define LAZY_INLINE_MAX 512
+
+typedef struct
+{
+    unsigned int close; // offset of the )
+    unsigned int next; // entry after the ones nested in it
+} LazySpan;
+
+typedef struct LazyTape
+{
+    struct LazyTape* next;
+    char* text;
+    size_t length;
+    int flags;
+    int marked; // reached by the last collection
+
+    // an entry for each list and vector (not typed vector), in the order they open
+    LazySpan* spans;
+    unsigned char* types; // what each reads as
+    unsigned int count;
+    unsigned int capacity;
+} LazyTape;
+
+typedef struct
+{
+    Block block;
+    Lisp value; // once it has been read
+    LazyTape* tape;
+    struct LispImpl* owner; // heap for what it reads
+    unsigned int start; // offset of its ( or #
+    unsigned int span;
+} LazyNode;
+
+static void lazy_tape_free(LazyTape* tape)
+{
+    free(tape->text);
+    free(tape->spans);
+    free(tape->types);
+    free(tape);
+}
+
+static unsigned int lazy_tape_open(LazyTape* tape)
+{
+    if (tape->count == tape->capacity)
+    {
+        tape->capacity = tape->capacity == 0 ? 256 : tape->capacity * 2;
+        tape->spans = realloc(tape->spans, sizeof(LazySpan) * tape->capacity);
+        tape->types = realloc(tape->types, tape->capacity);
+    }
+    return tape->count++;
+}
+
+static void lazy_tape_close(LazyTape* tape, unsigned int span, const char* p, int type)
+{
+    tape->spans[span].close = (unsigned int)(p - tape->text);
+    tape->spans[span].next = tape->count;
+    tape->types[span] = (unsigned char)type;
+}
+
+typedef struct
+{
+    ParseFrameType type;
+    unsigned int span; // of lists and vectors
+    unsigned int count; // items so far
+    int item_type; // of vectors: the type of every item, or -1 if they differ
+    int numeric; // of lists: every item is a number
+} LazyFrame;
+
+// what a list reads as. (see parse_close_list)
+static int lazy_list_type(const LazyTape* tape, const LazyFrame* frame, int tail_type)
+{
+    if (frame->count == 0) return LISP_NULL;
+    if ((tape->flags & LISP_READ_PACK_NUMBERS) && frame->numeric && tail_type == LISP_NULL) return LISP_TYPED_VECTOR;
+    return LISP_PAIR;
+}
+
+// past a number or symbol token at p, as lexer_next_token reads it.
+// returns NULL if there is no token.
+static const char* lazy_scan_atom(const char* p, int* out_type)
+{
+    const char* digits = (*p == '-' || *p == '+') ? p + 1 : p;
+    if (isdigit((unsigned char)*digits))
+    {
+        // a number is a float if it has a decimal
+        p = prescan_skip(digits, 1 << LEX_DIGIT);
+        if (*p != '.')
+        {
+            *out_type = LISP_INT;
+            return p;
+        }
+        *out_type = LISP_FLOAT;
+        return prescan_skip(p, (1 << LEX_DIGIT) | (1 << LEX_DOT));
+    }
+
+    if (!lex_is_symbol(*p)) return NULL;
+    *out_type = LISP_SYMBOL;
+    return prescan_skip(p, 1 << LEX_SYMBOL);
+}
+
+// past a typed vector, from the kind name after its #.
+// returns NULL if it doesn't read. (see parse_typed_vector)
+static const char* lazy_scan_typed(const char* p)
+{
+    if (!isalpha((unsigned char)*p)) return NULL;
+    const char* end = prescan_skip(p, 1 << LEX_SYMBOL);
+
+    char name[8];
+    size_t length = end - p;
+    if (length >= sizeof(name)) return NULL;
+    for (size_t i = 0; i < length; ++i)
+        name[i] = toupper(p[i]);
+    name[length] = '\0';
+
+    int kind = -1;
+    for (int i = 0; i < LISP_TYPED_KIND_COUNT; ++i)
+    {
+        if (strcmp(name, typed_kind_name[i]) == 0) kind = i;
+    }
+    if (kind == -1) return NULL;
+
+    p = prescan_skip_empty(end);
+    if (*p != '(') return NULL;
+    ++p;
+
+    while (1)
+    {
+        p = prescan_skip_empty(p);
+        if (*p == ')') return p + 1;
+
+        int type;
+        const char* start = p;
+        p = lazy_scan_atom(p, &type);
+        if (!p || type == LISP_SYMBOL) return NULL;
+
+        if (kind == LISP_TYPED_U8)
+        {
+            long x = strtol(start, NULL, 10);
+            if (type != LISP_INT || x < 0 || x > 255) return NULL;
+        }
+    }
+}
+
+// fills the tape. returns 0 unless the text is one list or vector,
+// which would read without error.
+static int lazy_scan(LazyTape* tape)
+{
+    const char* p = prescan_skip_empty(tape->text);
+    if (*p != '(' && !(*p == '#' && *prescan_skip_empty(p + 1) == '(')) return 0;
+
+    LazyFrame* frames = NULL;
+    size_t frame_count = 0;
+    size_t frame_capacity = 0;
+    int ok = 0;
+
+    while (1)
+    {
+        p = prescan_skip_empty(p);
+        LazyFrame* top = frame_count > 0 ? frames + frame_count - 1 : NULL;
+        ParseFrameType open;
+        int type;
+
+        switch (*p)
+        {
+            case '#':
+            {
+                const char* paren = prescan_skip_empty(p + 1);
+                if (*paren != '(')
+                {
+                    // #f32( and the like
+                    p = lazy_scan_typed(paren);
+                    if (!p) goto done;
+                    type = LISP_TYPED_VECTOR;
+                    break;
+                }
+                p = paren + 1;
+                open = FRAME_VECTOR;
+                goto open_frame;
+            }
+            case '(':
+                ++p;
+                open = FRAME_LIST;
+                goto open_frame;
+            case '\'':
+                ++p;
+                open = FRAME_QUOTE;
+                goto open_frame;
+            case ')':
+            {
+                if (!top || top->type == FRAME_QUOTE) goto done;
+                --frame_count;
+                if (top->type == FRAME_VECTOR)
+                {
+                    if (top->item_type == -1) goto done;
+                    type = LISP_VECTOR;
+                }
+                else
+                {
+                    type = lazy_list_type(tape, top, LISP_NULL);
+                }
+                lazy_tape_close(tape, top->span, p, type);
+                ++p;
+                break;
+            }
+            case '.':
+            {
+                // A dot at the end of a list assigns the cdr
+                if (!top || top->type != FRAME_LIST || top->count == 0) goto done;
+                ++p;
+                if (*prescan_skip_empty(p) != ')') top->type = FRAME_LIST_TAIL;
+                continue;
+            }
+            case '"':
+            {
+                // strings end on the same line, or are symbols
+                const char* end = p + 1;
+                while (*end != '"' && *end != '\n' && *end != '\0') ++end;
+                if (*end == '"')
+                {
+                    type = LISP_STRING;
+                    p = end + 1;
+                }
+                else
+                {
+                    type = LISP_SYMBOL;
+                    p = prescan_skip(p, 1 << LEX_SYMBOL);
+                }
+                break;
+            }
+            default:
+            {
+                p = lazy_scan_atom(p, &type);
+                if (!p) goto done;
+                break;
+            }
+        }
+
+        // give the finished expression to the frames it completes
+        while (1)
+        {
+            if (frame_count == 0)
+            {
+                ok = *prescan_skip_empty(p) == '\0';
+                goto done;
+            }
+
+            top = frames + frame_count - 1;
+            if (top->type == FRAME_QUOTE)
+            {
+                --frame_count;
+                type = LISP_PAIR;
+            }
+            else if (top->type == FRAME_LIST_TAIL)
+            {
+                p = prescan_skip_empty(p);
+                if (*p != ')') goto done;
+                --frame_count;
+                type = lazy_list_type(tape, top, type);
+                lazy_tape_close(tape, top->span, p, type);
+                ++p;
+            }
+            else
+            {
+                if (type != LISP_INT && type != LISP_FLOAT) top->numeric = 0;
+                if (top->count++ == 0) top->item_type = type;
+                else if (top->item_type != type) top->item_type = -1;
+                break;
+            }
+        }
+        continue;
+
+    open_frame:
+        if (frame_count == frame_capacity)
+        {
+            frame_capacity = frame_capacity == 0 ? 64 : frame_capacity * 2;
+            frames = realloc(frames, sizeof(LazyFrame) * frame_capacity);
+        }
+        top = frames + frame_count++;
+        top->type = open;
+        top->span = open == FRAME_QUOTE ? 0 : lazy_tape_open(tape);
+        top->count = 0;
+        top->item_type = LISP_NULL;
+        top->numeric = 1;
+    }
+
+done:
+    free(frames);
+    return ok;
+}
+
+// read the list or vector at start (its ( or #), with what is nested in it left lazy.
+// the scan should only pass text which reads, but errors are still reported.
+static Lisp lazy_read(LazyTape* tape, unsigned int start, unsigned int span, LispError* out_error, LispContext ctx)
+{
+    Lexer lex;
+    lexer_init_n(&lex, tape->text, tape->length);
+    lex.sc = lex.c = tape->text + start;
+    lex.read_flags = tape->flags;
+    lex.lazy = tape;
+    lex.lazy_span = span + 1;
+
+    jmp_buf error_jmp;
+    LispError error = setjmp(error_jmp);
+    if (error != LISP_ERROR_NONE)
+    {
+        lexer_shutdown(&lex);
+        if (out_error) *out_error = error;
+        return lisp_make_null();
+    }
+
+    lexer_next_token(&lex);
+    Lisp x = parse_expr(&lex, error_jmp, ctx);
+    if (lisp_type(x) != tape->types[span]) longjmp(error_jmp, LISP_ERROR_BAD_TOKEN);
+    lexer_shutdown(&lex);
+    if (out_error) *out_error = LISP_ERROR_NONE;
+    return x;
+}
+
+static LazyNode* lazy_node(Lisp p)
+{
+    return (LazyNode*)((char*)p.val.ptr_val - LAZY_TAG);
+}
+
+static Lisp lazy_force(Lisp p)
+{
+    LazyNode* node = lazy_node(p);
+    if (lisp_is_null(node->value))
+    {
+        LispContext ctx;
+        ctx.impl = node->owner;
+        // an error has nowhere to go from CAR and the like.
+        // the node reads as () and stays unread.
+        node->value = lazy_read(node->tape, node->start, node->span, NULL, ctx);
+    }
+    return node->value;
+}
+
+// the list or vector opening at start is left as a node,
+// unless it is small, and the text is skipped to after it.
+// returns 0 if it should be read now.
+static int lazy_skip(Lexer* lex, const char* start, Lisp* out, LispContext ctx)
+{
+    LazyTape* tape = lex->lazy;
+    unsigned int span = lex->lazy_span;
+    const LazySpan* s = tape->spans + span;
+    int type = tape->types[span];
+    unsigned int offset = (unsigned int)(start - tape->text);
+
+    // () and packed numbers have nothing nested
+    if ((type != LISP_PAIR && type != LISP_VECTOR) ||
+        (s->next == span + 1 && s->close - offset < LAZY_INLINE_MAX))
+    {
+        ++lex->lazy_span;
+        return 0;
+    }
+
+    LazyNode* node = gc_alloc(sizeof(LazyNode), LISP_PAIR, ctx);
+    node->block.type = BLOCK_LAZY;
+    node->value = lisp_make_null();
+    node->tape = tape;
+    node->owner = ctx.impl;
+    node->start = offset;
+    node->span = span;
+
+    out->type = type;
+    out->val.ptr_val = (char*)node + LAZY_TAG;
+
+    lex->lazy_span = s->next;
+    lex->sc = lex->c = tape->text + s->close + 1;
+    lex->scan_length = 0;
+    lexer_next_token(lex);
+    return 1;
+}
+
+// free the tapes no nodes were found for
+static void lazy_sweep(LispContext ctx)
+{
+    LazyTape** link = &ctx.impl->lazy_tapes;
+    while (*link)
+    {
+        LazyTape* tape = *link;
+        if (tape->marked)
+        {
+            tape->marked = 0;
+            link = &tape->next;
+        }
+        else
+        {
+            *link = tape->next;
+            lazy_tape_free(tape);
+        }
+    }
+}
+
+// takes the text, which is size bytes followed by '\0'
+static Lisp read_lazy(char* text, size_t size, int flags, LispError* out_error, LispContext ctx)
+{
+    LazyTape* tape = malloc(sizeof(LazyTape));
+    tape->next = NULL;
+    tape->text = text;
+    tape->length = size;
+    tape->flags = flags;
+    tape->marked = 0;
+    tape->spans = NULL;
+    tape->types = NULL;
+    tape->count = 0;
+    tape->capacity = 0;
+
+    if (size >= (unsigned int)-1 || !lazy_scan(tape))
+    {
+        // anything else is read as usual, and errors are found that way
+        Lisp l = lisp_read_data(text, flags, out_error, ctx);
+        lazy_tape_free(tape);
+        return l;
+    }
+
+    tape->next = ctx.impl->lazy_tapes;
+    ctx.impl->lazy_tapes = tape;
+
+    const char* start = prescan_skip_empty(text);
+    return lazy_read(tape, (unsigned int)(start - text), 0, out_error, ctx);
+}
+
+Lisp lisp_read_lazy(const char* text, int flags, LispError* out_error, LispContext ctx)
+{
+    size_t size = strlen(text);
+    char* copy = malloc(size + 1);
+    memcpy(copy, text, size + 1);
+    return read_lazy(copy, size, flags, out_error, ctx);
+}
+
+Lisp lisp_read_path_lazy(const char* path, int flags, LispError* out_error, LispContext ctx)
+{
+    FILE* file = fopen(path, "rb");
+    if (!file)
+    {
+        if (out_error) *out_error = LISP_ERROR_FILE_OPEN;
+        return lisp_make_null();
+    }
+
+    size_t size;
+    char* text = read_text(file, &size);
+    fclose(file);
+    if (!text) return read_path(path, flags, out_error, ctx);
+
+    return read_lazy(text, size, flags, out_error, ctx);
+}
+
+Lisp lisp_expand(Lisp lisp, LispError* out_error, LispContext ctx)
+{
+    jmp_buf error_jmp;
+    LispError error = setjmp(error_jmp);
+
+    if (error == LISP_ERROR_NONE)
+    {
+        Lisp result = expand_r(lisp, error_jmp, ctx);
+        *out_error = error;
+        return result;
+    }
+    else
+    {
+        *out_error = error;
+        return lisp_make_null();
+    }
+}
+
+Lisp lisp_read_expand(const char* text, LispError* out_error, LispContext ctx)
+{
+    LispError e;
+    Lisp data = lisp_read(text, &e, ctx);
+
+    if (e != LISP_ERROR_NONE) 
+    {
+        if (out_error) *out_error = e;
+        return lisp_make_null();
+    }
+
+    return lisp_expand(data, out_error, ctx);
+}
+
+Lisp lisp_read_expand_file(FILE* file, LispError* out_error, LispContext ctx)
+{
+    LispError e;
+    Lisp data = lisp_read_file(file, &e, ctx);
+    
+    if (e != LISP_ERROR_NONE)
+    {
+        if (out_error) *out_error = e;
+        return lisp_make_null();
+    }
+    
+    return lisp_expand(data, out_error, ctx);
+}
+
+Lisp lisp_read_expand_path(const char* path, LispError* out_error, LispContext ctx)
+{
+    LispError e;
+    Lisp data = lisp_read_path(path, &e, ctx);
+    
+    if (e != LISP_ERROR_NONE)
+    {
+        if (out_error) *out_error = e;
+        return lisp_make_null();
+    }
+    
+    return lisp_expand(data, out_error, ctx);
+}
+
+// TODO?
+static const char* lisp_type_name[] = {
+    "NULL",
+    "FLOAT",
+    "INT",
+    "PAIR",
+    "SYMBOL",
+    "STRING",
+    "LAMBDA",
+    "PROCEDURE",
+    "ENV",
+    "VECTOR",
+    "HASH-TABLE",
+    "TYPED-VECTOR",
+    "STRING-BUILDER",
+    "RECORD",
+    "RECORD-TYPE",
+    "PMAP",
+    "PVECTOR",
+    "PRIORITY-QUEUE",
+    "DEQUE",
+    "BITVECTOR",
+};
+
+typedef struct
+{
+    Block block;
+    Lisp name;
+    Lisp field_names;
+    unsigned int field_count;
+} RecordType;
+
+typedef struct
+{
+    Block block;
+    Lisp type;
+    unsigned int field_count;
+    Lisp fields[];
+} Record;
+
+Lisp lisp_make_record_type(Lisp name, Lisp field_names, LispContext ctx)
+{
+    RecordType* type = gc_alloc(sizeof(RecordType), LISP_RECORD_TYPE, ctx);
+    type->name = name;
+    type->field_names = field_names;
+    type->field_count = lisp_list_length(field_names);
+
+    Lisp l;
+    l.type = type->block.type;
+    l.val.ptr_val = type;
+    return l;
+}
+
+static RecordType* lisp_record_type_get(Lisp l)
+{
+    assert(lisp_type(l) == LISP_RECORD_TYPE);
+    return l.val.ptr_val;
+}
+
+int lisp_record_type_field_count(Lisp type)
+{
+    return lisp_record_type_get(type)->field_count;
+}
+
+int lisp_record_type_field_index(Lisp type, Lisp field_name)
+{
+    return lisp_list_index_of(lisp_record_type_get(type)->field_names, field_name);
+}
+
+Lisp lisp_make_record(Lisp type, LispContext ctx)
+{
+    unsigned int n = lisp_record_type_get(type)->field_count;
+    Record* record = gc_alloc(sizeof(Record) + sizeof(Lisp) * n, LISP_RECORD, ctx);
+    record->type = type;
+    record->field_count = n;
+    for (unsigned int i = 0; i < n; ++i)
+        record->fields[i] = lisp_make_null();
+
+    Lisp l;
+    l.type = record->block.type;
+    l.val.ptr_val = record;
+    return l;
+}
+
+static Record* lisp_record(Lisp l)
+{
+    assert(lisp_type(l) == LISP_RECORD);
+    return l.val.ptr_val;
+}
+
+Lisp lisp_record_type(Lisp r)
+{
+    return lisp_record(r)->type;
+}
+
+Lisp lisp_record_ref(Lisp r, int i)
+{
+    const Record* record = lisp_record(r);
+    assert(i >= 0 && i < record->field_count);
+    return record->fields[i];
+}
+
+void lisp_record_set(Lisp r, int i, Lisp x)
+{
+    Record* record = lisp_record(r);
+    assert(i >= 0 && i < record->field_count);
+    record->fields[i] = x;
+}
+
+// PERSISTENT MAPS AND VECTORS
+// -----------------------------------------
+// Updates copy the path from the root to the changed entry
+// and share everything else with the previous version.
+// Transients own the nodes stamped with their edit number,
+// and change those in place.
+
+#define TRIE_BITS 5
+#define TRIE_WIDTH (1 << TRIE_BITS)
+#define TRIE_MASK (TRIE_WIDTH - 1)
+
+static unsigned int bit_count(unsigned int x)
+{
+    x = x - ((x >> 1) & 0x55555555);
+    x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
+    x = (x + (x >> 4)) & 0x0F0F0F0F;
+    return (x * 0x01010101) >> 24;
+}
+
+static unsigned int next_edit(LispContext ctx)
+{
+    // 0 means persistent
+    if (++ctx.impl->edit_counter == 0) ++ctx.impl->edit_counter;
+    return ctx.impl->edit_counter;
+}
+
+// hash array mapped trie.
+// datamap marks slots holding a key/value pair,
+// nodemap marks slots holding a child node.
+// pairs are stored first, then children, both in slot order.
+typedef struct HamtNode
+{
+    Block block;
+    unsigned int edit;
+    unsigned int datamap; // count of pairs in a collision node
+    unsigned int nodemap;
+    unsigned int hash; // shared hash of a collision node
+    Lisp entries[];
+} HamtNode;
+
+typedef struct
+{
+    Block block;
+    unsigned int count;
+    unsigned int edit;
+    HamtNode* root;
+} PMap;
+
+static unsigned int hamt_pair_count(const HamtNode* node)
+{
+    return node->block.type == BLOCK_HAMT_COLLISION ? node->datamap : bit_count(node->datamap);
+}
+
+static unsigned int hamt_child_count(const HamtNode* node)
+{
+    return node->block.type == BLOCK_HAMT_COLLISION ? 0 : bit_count(node->nodemap);
+}
+
+static HamtNode** hamt_children(HamtNode* node)
+{
+    return (HamtNode**)(node->entries + hamt_pair_count(node) * 2);
+}
+
+static HamtNode* hamt_alloc(int type, unsigned int pairs, unsigned int children, unsigned int edit, LispContext ctx)
+{
+    size_t size = sizeof(HamtNode) + sizeof(Lisp) * 2 * pairs + sizeof(HamtNode*) * children;
+    HamtNode* node = gc_alloc(size, type, ctx);
+    node->edit = edit;
+    node->datamap = 0;
+    node->nodemap = 0;
+    node->hash = 0;
+    return node;
+}
+
+static HamtNode* hamt_copy(HamtNode* node, unsigned int edit, LispContext ctx)
+{
+    HamtNode* copy = gc_alloc(node->block.size, node->block.type, ctx);
+    memcpy((char*)copy + sizeof(Block), (char*)node + sizeof(Block), node->block.size - sizeof(Block));
+    copy->edit = edit;
+    return copy;
+}
+
+static int hamt_editable(const HamtNode* node, unsigned int edit)
+{
+    return edit != 0 && node->edit == edit;
+}
+
+static unsigned int hamt_bit(unsigned int hash, unsigned int shift)
+{
+    return 1u << ((hash >> shift) & TRIE_MASK);
+}
+
+static unsigned int hamt_index(unsigned int map, unsigned int bit)
+{
+    return bit_count(map & (bit - 1));
+}
+
+// copy of node with one pair inserted, removed, or moved to/from a child.
+// (the other arguments are ignored when bit is 0)
+static HamtNode* hamt_reshape(HamtNode* node,
+                              unsigned int add_pair, Lisp key, Lisp x,
+                              unsigned int remove_pair,
+                              unsigned int add_child, HamtNode* child,
+                              unsigned int remove_child,
+                              unsigned int edit, LispContext ctx)
+{
+    unsigned int datamap = (node->datamap | add_pair) & ~remove_pair;
+    unsigned int nodemap = (node->nodemap | add_child) & ~remove_child;
+
+    HamtNode* result = hamt_alloc(BLOCK_HAMT_NODE, bit_count(datamap), bit_count(nodemap), edit, ctx);
+    result->datamap = datamap;
+    result->nodemap = nodemap;
+
+    HamtNode** children = hamt_children(node);
+    HamtNode** result_children = hamt_children(result);
+
+    for (unsigned int i = 0, j = 0, k = 0; i < TRIE_WIDTH; ++i)
+    {
+        unsigned int bit = 1u << i;
+        if (bit == add_pair)
+        {
+            result->entries[k * 2] = key;
+            result->entries[k * 2 + 1] = x;
+            ++k;
+        }
+        else if (node->datamap & bit)
+        {
+            if (bit != remove_pair)
+            {
+                result->entries[k * 2] = node->entries[j * 2];
+                result->entries[k * 2 + 1] = node->entries[j * 2 + 1];
+                ++k;
+            }
+            ++j;
+        }
+    }
+
+    for (unsigned int i = 0, j = 0, k = 0; i < TRIE_WIDTH; ++i)
+    {
+        unsigned int bit = 1u << i;
+        if (bit == add_child)
+            result_children[k++] = child;
+        else if (node->nodemap & bit)
+        {
+            if (bit != remove_child) result_children[k++] = children[j];
+            ++j;
+        }
+    }
+    return result;
+}
+
+static HamtNode* hamt_merge(Lisp key_a, Lisp x_a, unsigned int hash_a,
+                            Lisp key_b, Lisp x_b, unsigned int hash_b,
+                            unsigned int shift, unsigned int edit, LispContext ctx)
+{
+    if (shift >= 32)
+    {
+        // out of hash bits
+        HamtNode* node = hamt_alloc(BLOCK_HAMT_COLLISION, 2, 0, edit, ctx);
+        node->datamap = 2;
+        node->hash = hash_a;
+        node->entries[0] = key_a;
+        node->entries[1] = x_a;
+        node->entries[2] = key_b;
+        node->entries[3] = x_b;
+        return node;
+    }
+
+    unsigned int bit_a = hamt_bit(hash_a, shift);
+    unsigned int bit_b = hamt_bit(hash_b, shift);
+
+    if (bit_a == bit_b)
+    {
+        HamtNode* node = hamt_alloc(BLOCK_HAMT_NODE, 0, 1, edit, ctx);
+        node->nodemap = bit_a;
+        hamt_children(node)[0] = hamt_merge(key_a, x_a, hash_a, key_b, x_b, hash_b, shift + TRIE_BITS, edit, ctx);
+        return node;
+    }
+    else
+    {
+        HamtNode* node = hamt_alloc(BLOCK_HAMT_NODE, 2, 0, edit, ctx);
+        node->datamap = bit_a | bit_b;
+        int a = bit_a < bit_b ? 0 : 1;
+        node->entries[a * 2] = key_a;
+        node->entries[a * 2 + 1] = x_a;
+        node->entries[(1 - a) * 2] = key_b;
+        node->entries[(1 - a) * 2 + 1] = x_b;
+        return node;
+    }
+}
+
+static const Lisp* hamt_find(HamtNode* node, Lisp key, unsigned int hash)
+{
+    unsigned int shift = 0;
+    while (node)
+    {
+        if (node->block.type == BLOCK_HAMT_COLLISION)
+        {
+            for (unsigned int i = 0; i < node->datamap; ++i)
+            {
+                if (key_equal(node->entries[i * 2], key)) return node->entries + i * 2;
+            }
+            return NULL;
+        }
+
+        unsigned int bit = hamt_bit(hash, shift);
+        if (node->datamap & bit)
+        {
+            const Lisp* pair = node->entries + hamt_index(node->datamap, bit) * 2;
+            return key_equal(pair[0], key) ? pair : NULL;
+        }
+        else if (node->nodemap & bit)
+        {
+            node = hamt_children(node)[hamt_index(node->nodemap, bit)];
+            shift += TRIE_BITS;
+        }
+        else
+        {
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
+static HamtNode* hamt_set(HamtNode* node, unsigned int shift, Lisp key, unsigned int hash, Lisp x, unsigned int edit, int* added, LispContext ctx)
+{
+    if (!node)
+    {
+        *added = 1;
+        node = hamt_alloc(BLOCK_HAMT_NODE, 1, 0, edit, ctx);
+        node->datamap = hamt_bit(hash, shift);
+        node->entries[0] = key;
+        node->entries[1] = x;
+        return node;
+    }
+
+    if (node->block.type == BLOCK_HAMT_COLLISION)
+    {
+        unsigned int n = node->datamap;
+        for (unsigned int i = 0; i < n; ++i)
+        {
+            if (key_equal(node->entries[i * 2], key))
+            {
+                if (!hamt_editable(node, edit)) node = hamt_copy(node, edit, ctx);
+                node->entries[i * 2 + 1] = x;
+                return node;
+            }
+        }
+
+        *added = 1;
+        HamtNode* result = hamt_alloc(BLOCK_HAMT_COLLISION, n + 1, 0, edit, ctx);
+        memcpy(result->entries, node->entries, sizeof(Lisp) * 2 * n);
+        result->datamap = n + 1;
+        result->hash = node->hash;
+        result->entries[n * 2] = key;
+        result->entries[n * 2 + 1] = x;
+        return result;
+    }
+
+    unsigned int bit = hamt_bit(hash, shift);
+    if (node->datamap & bit)
+    {
+        unsigned int i = hamt_index(node->datamap, bit);
+        Lisp old_key = node->entries[i * 2];
+        if (key_equal(old_key, key))
+        {
+            if (!hamt_editable(node, edit)) node = hamt_copy(node, edit, ctx);
+            node->entries[i * 2 + 1] = x;
+            return node;
+        }
+
+        // push both pairs down into a new child
+        *added = 1;
+        HamtNode* child = hamt_merge(old_key, node->entries[i * 2 + 1], key_hash(old_key),
+                                     key, x, hash, shift + TRIE_BITS, edit, ctx);
+        Lisp null = lisp_make_null();
+        return hamt_reshape(node, 0, null, null, bit, bit, child, 0, edit, ctx);
+    }
+    else if (node->nodemap & bit)
+    {
+        unsigned int i = hamt_index(node->nodemap, bit);
+        HamtNode* child = hamt_children(node)[i];
+        HamtNode* new_child = hamt_set(child, shift + TRIE_BITS, key, hash, x, edit, added, ctx);
+        if (new_child == child) return node;
+
+        if (!hamt_editable(node, edit)) node = hamt_copy(node, edit, ctx);
+        hamt_children(node)[i] = new_child;
+        return node;
+    }
+    else
+    {
+        *added = 1;
+        return hamt_reshape(node, bit, key, x, 0, 0, NULL, 0, edit, ctx);
+    }
+}
+
+// returns NULL when the node becomes empty
+static HamtNode* hamt_delete(HamtNode* node, unsigned int shift, Lisp key, unsigned int hash, unsigned int edit, int* removed, LispContext ctx)
+{
+    if (node->block.type == BLOCK_HAMT_COLLISION)
+    {
+        unsigned int n = node->datamap;
+        for (unsigned int i = 0; i < n; ++i)
+        {
+            if (key_equal(node->entries[i * 2], key))
+            {
+                *removed = 1;
+                HamtNode* result = hamt_alloc(BLOCK_HAMT_COLLISION, n - 1, 0, edit, ctx);
+                memcpy(result->entries, node->entries, sizeof(Lisp) * 2 * i);
+                memcpy(result->entries + i * 2, node->entries + (i + 1) * 2, sizeof(Lisp) * 2 * (n - i - 1));
+                result->datamap = n - 1;
+                result->hash = node->hash;
+                return result;
+            }
+        }
+        return node;
+    }
+
+    Lisp null = lisp_make_null();
+    unsigned int bit = hamt_bit(hash, shift);
+    if (node->datamap & bit)
+    {
+        unsigned int i = hamt_index(node->datamap, bit);
+        if (!key_equal(node->entries[i * 2], key)) return node;
+
+        *removed = 1;
+        if (node->datamap == bit && node->nodemap == 0) return NULL;
+        return hamt_reshape(node, 0, null, null, bit, 0, NULL, 0, edit, ctx);
+    }
+    else if (node->nodemap & bit)
+    {
+        unsigned int i = hamt_index(node->nodemap, bit);
+        HamtNode* child = hamt_children(node)[i];
+        HamtNode* new_child = hamt_delete(child, shift + TRIE_BITS, key, hash, edit, removed, ctx);
+        if (new_child == child) return node;
+
+        if (!new_child)
+        {
+            if (node->nodemap == bit && node->datamap == 0) return NULL;
+            return hamt_reshape(node, 0, null, null, 0, 0, NULL, bit, edit, ctx);
+        }
+
+        if (hamt_pair_count(new_child) == 1 && hamt_child_count(new_child) == 0)
+        {
+            // a single pair moves up, so each map has one shape
+            return hamt_reshape(node, bit, new_child->entries[0], new_child->entries[1],
+                                0, 0, NULL, bit, edit, ctx);
+        }
+
+        if (!hamt_editable(node, edit)) node = hamt_copy(node, edit, ctx);
+        hamt_children(node)[i] = new_child;
+        return node;
+    }
+    return node;
+}
+
+static void hamt_to_list(HamtNode* node, Lisp* front, Lisp* back, LispContext ctx)
+{
+    if (!node) return;
+
+    unsigned int pairs = hamt_pair_count(node);
+    for (unsigned int i = 0; i < pairs; ++i)
+        back_append(front, back, lisp_cons(node->entries[i * 2], node->entries[i * 2 + 1], ctx), ctx);
+
+    unsigned int children = hamt_child_count(node);
+    for (unsigned int i = 0; i < children; ++i)
+        hamt_to_list(hamt_children(node)[i], front, back, ctx);
+}
+
+static PMap* lisp_pmap_get_impl(Lisp m)
+{
+    assert(lisp_type(m) == LISP_PMAP);
+    return m.val.ptr_val;
+}
+
+static Lisp pmap_make(unsigned int count, unsigned int edit, HamtNode* root, LispContext ctx)
+{
+    PMap* map = gc_alloc(sizeof(PMap), LISP_PMAP, ctx);
+    map->count = count;
+    map->edit = edit;
+    map->root = root;
+
+    Lisp l;
+    l.type = map->block.type;
+    l.val.ptr_val = map;
+    return l;
+}
+
+Lisp lisp_make_pmap(LispContext ctx)
+{
+    return pmap_make(0, 0, NULL, ctx);
+}
+
+int lisp_pmap_count(Lisp m)
+{
+    return lisp_pmap_get_impl(m)->count;
+}
+
+int lisp_pmap_get(Lisp m, Lisp key, Lisp* out_x)
+{
+    assert(is_hashable(key));
+    const Lisp* pair = hamt_find(lisp_pmap_get_impl(m)->root, key, key_hash(key));
+    if (!pair) return 0;
+    if (out_x) *out_x = pair[1];
+    return 1;
+}
+
+Lisp lisp_pmap_set(Lisp m, Lisp key, Lisp x, LispContext ctx)
+{
+    assert(is_hashable(key));
+    const PMap* map = lisp_pmap_get_impl(m);
+    assert(map->edit == 0);
+    int added = 0;
+    key = key_own(key, ctx);
+    HamtNode* root = hamt_set(map->root, 0, key, key_hash(key), x, 0, &added, ctx);
+    return pmap_make(map->count + added, 0, root, ctx);
+}
+
+Lisp lisp_pmap_delete(Lisp m, Lisp key, LispContext ctx)
+{
+    const PMap* map = lisp_pmap_get_impl(m);
+    assert(map->edit == 0);
+    if (!map->root || !is_hashable(key)) return m;
+
+    int removed = 0;
+    HamtNode* root = hamt_delete(map->root, 0, key, key_hash(key), 0, &removed, ctx);
+    if (!removed) return m;
+    return pmap_make(map->count - 1, 0, root, ctx);
+}
+
+Lisp lisp_pmap_to_list(Lisp m, LispContext ctx)
+{
+    Lisp front = lisp_make_null();
+    Lisp back = front;
+    hamt_to_list(lisp_pmap_get_impl(m)->root, &front, &back, ctx);
+    return front;
+}
+
+Lisp lisp_pmap_transient(Lisp m, LispContext ctx)
+{
+    const PMap* map = lisp_pmap_get_impl(m);
+    assert(map->edit == 0);
+    return pmap_make(map->count, next_edit(ctx), map->root, ctx);
+}
+
+int lisp_pmap_is_transient(Lisp m)
+{
+    return lisp_pmap_get_impl(m)->edit != 0;
+}
+
+void lisp_pmap_set_in_place(Lisp t, Lisp key, Lisp x, LispContext ctx)
+{
+    assert(is_hashable(key));
+    PMap* map = lisp_pmap_get_impl(t);
+    assert(map->edit != 0);
+    int added = 0;
+    key = key_own(key, ctx);
+    map->root = hamt_set(map->root, 0, key, key_hash(key), x, map->edit, &added, ctx);
+    map->count += added;
+}
+
+int lisp_pmap_delete_in_place(Lisp t, Lisp key, LispContext ctx)
+{
+    PMap* map = lisp_pmap_get_impl(t);
+    assert(map->edit != 0);
+    if (!map->root || !is_hashable(key)) return 0;
+
+    int removed = 0;
+    map->root = hamt_delete(map->root, 0, key, key_hash(key), map->edit, &removed, ctx);
+    map->count -= removed;
+    return removed;
+}
+
+Lisp lisp_pmap_persistent(Lisp t)
+{
+    lisp_pmap_get_impl(t)->edit = 0;
+    return t;
+}
+
+// bitmapped vector trie.
+// the last (up to 32) elements are kept in a tail leaf,
+// so most pushes don't touch the trie.
+typedef struct
+{
+    Block block;
+    unsigned int edit;
+    void* children[TRIE_WIDTH];
+} TrieBranch;
+
+typedef struct
+{
+    Block block;
+    unsigned int edit;
+    Lisp values[TRIE_WIDTH];
+} TrieLeaf;
+
+typedef struct
+{
+    Block block;
+    unsigned int count;
+    unsigned int shift;
+    unsigned int edit;
+    TrieBranch* root;
+    TrieLeaf* tail;
+} PVector;
+
+static TrieBranch* trie_branch_alloc(unsigned int edit, LispContext ctx)
+{
+    TrieBranch* branch = gc_alloc(sizeof(TrieBranch), BLOCK_TRIE_BRANCH, ctx);
+    branch->edit = edit;
+    for (int i = 0; i < TRIE_WIDTH; ++i)
+        branch->children[i] = NULL;
+    return branch;
+}
+
+static TrieLeaf* trie_leaf_alloc(unsigned int edit, LispContext ctx)
+{
+    TrieLeaf* leaf = gc_alloc(sizeof(TrieLeaf), BLOCK_TRIE_LEAF, ctx);
+    leaf->edit = edit;
+    for (int i = 0; i < TRIE_WIDTH; ++i)
+        leaf->values[i] = lisp_make_null();
+    return leaf;
+}
+
+// copies either kind of node, unless the edit owns it
+static void* trie_editable(void* node, unsigned int edit, LispContext ctx)
+{
+    Block* block = node;
+    unsigned int* node_edit = (unsigned int*)(block + 1);
+    if (edit != 0 && *node_edit == edit) return node;
+
+    Block* copy = gc_alloc(block->size, block->type, ctx);
+    memcpy(copy + 1, block + 1, block->size - sizeof(Block));
+    *(unsigned int*)(copy + 1) = edit;
+    return copy;
+}
+
+static unsigned int pvector_tail_offset(const PVector* vector)
+{
+    return vector->count < TRIE_WIDTH ? 0 : ((vector->count - 1) >> TRIE_BITS) << TRIE_BITS;
+}
+
+static TrieLeaf* pvector_leaf_for(const PVector* vector, unsigned int i)
+{
+    if (i >= pvector_tail_offset(vector)) return vector->tail;
+
+    void* node = vector->root;
+    for (unsigned int level = vector->shift; level > 0; level -= TRIE_BITS)
+        node = ((TrieBranch*)node)->children[(i >> level) & TRIE_MASK];
+    return node;
+}
+
+static void* trie_set(void* node, unsigned int level, unsigned int i, Lisp x, unsigned int edit, LispContext ctx)
+{
+    node = trie_editable(node, edit, ctx);
+    if (level == 0)
+    {
+        ((TrieLeaf*)node)->values[i & TRIE_MASK] = x;
+    }
+    else
+    {
+        TrieBranch* branch = node;
+        unsigned int slot = (i >> level) & TRIE_MASK;
+        branch->children[slot] = trie_set(branch->children[slot], level - TRIE_BITS, i, x, edit, ctx);
+    }
+    return node;
+}
+
+static void* trie_new_path(unsigned int level, void* node, unsigned int edit, LispContext ctx)
+{
+    while (level > 0)
+    {
+        TrieBranch* branch = trie_branch_alloc(edit, ctx);
+        branch->children[0] = node;
+        node = branch;
+        level -= TRIE_BITS;
+    }
+    return node;
+}
+
+// adds a full tail leaf as the last leaf of the trie
+static TrieBranch* trie_push_tail(const PVector* vector, unsigned int level, TrieBranch* parent, TrieLeaf* tail, unsigned int edit, LispContext ctx)
+{
+    TrieBranch* result = trie_editable(parent, edit, ctx);
+    unsigned int slot = ((vector->count - 1) >> level) & TRIE_MASK;
+
+    if (level == TRIE_BITS)
+    {
+        result->children[slot] = tail;
+    }
+    else
+    {
+        TrieBranch* child = parent->children[slot];
+        result->children[slot] = child
+            ? trie_push_tail(vector, level - TRIE_BITS, child, tail, edit, ctx)
+            : trie_new_path(level - TRIE_BITS, tail, edit, ctx);
+    }
+    return result;
+}
+
+static void pvector_push(PVector* vector, Lisp x, LispContext ctx)
+{
+    unsigned int edit = vector->edit;
+    if (vector->count - pvector_tail_offset(vector) < TRIE_WIDTH)
+    {
+        vector->tail = trie_editable(vector->tail, edit, ctx);
+        vector->tail->values[vector->count & TRIE_MASK] = x;
+        ++vector->count;
+        return;
+    }
+
+    // the tail is full, move it into the trie
+    if ((vector->count >> TRIE_BITS) > (1u << vector->shift))
+    {
+        TrieBranch* root = trie_branch_alloc(edit, ctx);
+        root->children[0] = vector->root;
+        root->children[1] = trie_new_path(vector->shift, vector->tail, edit, ctx);
+        vector->root = root;
+        vector->shift += TRIE_BITS;
+    }
+    else
+    {
+        vector->root = trie_push_tail(vector, vector->shift, vector->root, vector->tail, edit, ctx);
+    }
+
+    vector->tail = trie_leaf_alloc(edit, ctx);
+    vector->tail->values[0] = x;
+    ++vector->count;
+}
+
+static PVector* lisp_pvector_get_impl(Lisp v)
+{
+    assert(lisp_type(v) == LISP_PVECTOR);
+    return v.val.ptr_val;
+}
+
+static Lisp pvector_copy(const PVector* vector, unsigned int edit, LispContext ctx)
+{
+    PVector* copy = gc_alloc(sizeof(PVector), LISP_PVECTOR, ctx);
+    copy->count = vector->count;
+    copy->shift = vector->shift;
+    copy->edit = edit;
+    copy->root = vector->root;
+    copy->tail = vector->tail;
+
+    Lisp l;
+    l.type = copy->block.type;
+    l.val.ptr_val = copy;
+    return l;
+}
+
+Lisp lisp_make_pvector(LispContext ctx)
+{
+    PVector vector;
+    vector.count = 0;
+    vector.shift = TRIE_BITS;
+    vector.root = trie_branch_alloc(0, ctx);
+    vector.tail = trie_leaf_alloc(0, ctx);
+    return pvector_copy(&vector, 0, ctx);
+}
+
+int lisp_pvector_length(Lisp v)
+{
+    return lisp_pvector_get_impl(v)->count;
+}
+
+Lisp lisp_pvector_ref(Lisp v, unsigned int i)
+{
+    const PVector* vector = lisp_pvector_get_impl(v);
+    assert(i < vector->count);
+    return pvector_leaf_for(vector, i)->values[i & TRIE_MASK];
+}
+
+static void pvector_set(PVector* vector, unsigned int i, Lisp x, LispContext ctx)
+{
+    if (i >= pvector_tail_offset(vector))
+    {
+        vector->tail = trie_editable(vector->tail, vector->edit, ctx);
+        vector->tail->values[i & TRIE_MASK] = x;
+    }
+    else
+    {
+        vector->root = trie_set(vector->root, vector->shift, i, x, vector->edit, ctx);
+    }
+}
+
+Lisp lisp_pvector_set(Lisp v, unsigned int i, Lisp x, LispContext ctx)
+{
+    assert(lisp_pvector_get_impl(v)->edit == 0 && i < lisp_pvector_get_impl(v)->count);
+    Lisp result = pvector_copy(lisp_pvector_get_impl(v), 0, ctx);
+    pvector_set(result.val.ptr_val, i, x, ctx);
+    return result;
+}
+
+Lisp lisp_pvector_push(Lisp v, Lisp x, LispContext ctx)
+{
+    assert(lisp_pvector_get_impl(v)->edit == 0);
+    Lisp result = pvector_copy(lisp_pvector_get_impl(v), 0, ctx);
+    pvector_push(result.val.ptr_val, x, ctx);
+    return result;
+}
+
+Lisp lisp_pvector_to_list(Lisp v, LispContext ctx)
+{
+    const PVector* vector = lisp_pvector_get_impl(v);
+    Lisp front = lisp_make_null();
+    Lisp back = front;
+    for (unsigned int i = 0; i < vector->count; ++i)
+        back_append(&front, &back, pvector_leaf_for(vector, i)->values[i & TRIE_MASK], ctx);
+    return front;
+}
+
+Lisp lisp_pvector_transient(Lisp v, LispContext ctx)
+{
+    assert(lisp_pvector_get_impl(v)->edit == 0);
+    return pvector_copy(lisp_pvector_get_impl(v), next_edit(ctx), ctx);
+}
+
+int lisp_pvector_is_transient(Lisp v)
+{
+    return lisp_pvector_get_impl(v)->edit != 0;
+}
+
+void lisp_pvector_set_in_place(Lisp t, unsigned int i, Lisp x, LispContext ctx)
+{
+    PVector* vector = lisp_pvector_get_impl(t);
+    assert(vector->edit != 0 && i < vector->count);
+    pvector_set(vector, i, x, ctx);
+}
+
+void lisp_pvector_push_in_place(Lisp t, Lisp x, LispContext ctx)
+{
+    PVector* vector = lisp_pvector_get_impl(t);
+    assert(vector->edit != 0);
+    pvector_push(vector, x, ctx);
+}
+
+Lisp lisp_pvector_persistent(Lisp t)
+{
+    lisp_pvector_get_impl(t)->edit = 0;
+    return t;
+}
+
+// QUEUES
+// -----------------------------------------
+// a run of values which grows geometrically.
+// unused slots are kept null, so the collector can scan all of them.
+typedef struct
+{
+    Block block;
+    unsigned int capacity;
+    Lisp entries[];
+} Slots;
+
+static Slots* slots_alloc(unsigned int capacity, LispContext ctx)
+{
+    Slots* slots = gc_alloc(sizeof(Slots) + sizeof(Lisp) * capacity, BLOCK_SLOTS, ctx);
+    slots->capacity = capacity;
+    for (unsigned int i = 0; i < capacity; ++i)
+        slots->entries[i] = lisp_make_null();
+    return slots;
+}
+
+// binary min heap of (priority, value) entries
+typedef struct
+{
+    Block block;
+    unsigned int count;
+    Lisp compare; // null for numbers
+    Slots* slots;
+} PriorityQueue;
+
+static PriorityQueue* lisp_priority_queue(Lisp l)
+{
+    assert(lisp_type(l) == LISP_PRIORITY_QUEUE);
+    return l.val.ptr_val;
+}
+
+Lisp lisp_make_priority_queue(Lisp compare, LispContext ctx)
+{
+    PriorityQueue* queue = gc_alloc(sizeof(PriorityQueue), LISP_PRIORITY_QUEUE, ctx);
+    queue->count = 0;
+    queue->compare = compare;
+    queue->slots = slots_alloc(16, ctx);
+
+    Lisp l;
+    l.type = queue->block.type;
+    l.val.ptr_val = queue;
+    return l;
+}
+
+int lisp_priority_queue_count(Lisp q)
+{
+    return lisp_priority_queue(q)->count;
+}
+
+// does a come out before b?
+static int priority_before(const PriorityQueue* queue, Lisp a, Lisp b, LispError* e, LispContext ctx)
+{
+    if (lisp_is_null(queue->compare))
+    {
+        if (lisp_type(a) == LISP_INT && lisp_type(b) == LISP_INT)
+            return lisp_int(a) < lisp_int(b);
+
+        float fa = lisp_type(a) == LISP_INT ? (float)lisp_int(a) : lisp_float(a);
+        float fb = lisp_type(b) == LISP_INT ? (float)lisp_int(b) : lisp_float(b);
+        return fa < fb;
+    }
+
+    // (compare a b)
+    Lisp args = lisp_make_listv(ctx, a, b, lisp_make_null());
+    Lisp result = apply_procedure(queue->compare, args, e, ctx);
+    return *e == LISP_ERROR_NONE && lisp_int(result) != 0;
+}
+
+static void priority_queue_swap(Slots* slots, unsigned int i, unsigned int j)
+{
+    Lisp priority = slots->entries[i * 2];
+    Lisp x = slots->entries[i * 2 + 1];
+    slots->entries[i * 2] = slots->entries[j * 2];
+    slots->entries[i * 2 + 1] = slots->entries[j * 2 + 1];
+    slots->entries[j * 2] = priority;
+    slots->entries[j * 2 + 1] = x;
+}
+
+void lisp_priority_queue_push(Lisp q, Lisp x, Lisp priority, LispError* out_error, LispContext ctx)
+{
+    PriorityQueue* queue = lisp_priority_queue(q);
+    assert(!lisp_is_null(queue->compare) || lisp_type(priority) == LISP_INT || lisp_type(priority) == LISP_FLOAT);
+
+    LispError e = LISP_ERROR_NONE;
+    Slots* slots = queue->slots;
+    if ((queue->count + 1) * 2 > slots->capacity)
+    {
+        Slots* new_slots = slots_alloc(slots->capacity * 2, ctx);
+        memcpy(new_slots->entries, slots->entries, sizeof(Lisp) * queue->count * 2);
+        queue->slots = new_slots;
+        slots = new_slots;
+    }
+
+    unsigned int i = queue->count++;
+    slots->entries[i * 2] = priority;
+    slots->entries[i * 2 + 1] = x;
+
+    // sift up
+    while (i > 0)
+    {
+        unsigned int parent = (i - 1) / 2;
+        // priority_before is 0 after an error, so that stops here too
+        if (!priority_before(queue, slots->entries[i * 2], slots->entries[parent * 2], &e, ctx)) break;
+        priority_queue_swap(slots, i, parent);
+        i = parent;
+    }
+
+    if (out_error) *out_error = e;
+}
+
+Lisp lisp_priority_queue_peek(Lisp q)
+{
+    const PriorityQueue* queue = lisp_priority_queue(q);
+    assert(queue->count > 0);
+    return queue->slots->entries[1];
+}
+
+Lisp lisp_priority_queue_pop(Lisp q, LispError* out_error, LispContext ctx)
+{
+    PriorityQueue* queue = lisp_priority_queue(q);
+    assert(queue->count > 0);
+
+    LispError e = LISP_ERROR_NONE;
+    Slots* slots = queue->slots;
+    Lisp result = slots->entries[1];
+
+    unsigned int n = --queue->count;
+    priority_queue_swap(slots, 0, n);
+    slots->entries[n * 2] = lisp_make_null();
+    slots->entries[n * 2 + 1] = lisp_make_null();
+
+    // sift down
+    unsigned int i = 0;
+    while (1)
+    {
+        unsigned int child = i * 2 + 1;
+        if (child >= n) break;
+        if (child + 1 < n && priority_before(queue, slots->entries[(child + 1) * 2], slots->entries[child * 2], &e, ctx))
+            ++child;
+        // stop at the first error rather than comparing again
+        if (e != LISP_ERROR_NONE) break;
+        if (!priority_before(queue, slots->entries[child * 2], slots->entries[i * 2], &e, ctx)) break;
+        priority_queue_swap(slots, i, child);
+        i = child;
+    }
+
+    if (out_error) *out_error = e;
+    return result;
+}
+
+// ring buffer with a power of 2 capacity
+typedef struct
+{
+    Block block;
+    unsigned int count;
+    unsigned int head;
+    Slots* slots;
+} Deque;
+
+static Deque* lisp_deque(Lisp l)
+{
+    assert(lisp_type(l) == LISP_DEQUE);
+    return l.val.ptr_val;
+}
+
+Lisp lisp_make_deque(unsigned int capacity, LispContext ctx)
+{
+    unsigned int size = 8;
+    while (size < capacity) size *= 2;
+
+    Deque* deque = gc_alloc(sizeof(Deque), LISP_DEQUE, ctx);
+    deque->count = 0;
+    deque->head = 0;
+    deque->slots = slots_alloc(size, ctx);
+
+    Lisp l;
+    l.type = deque->block.type;
+    l.val.ptr_val = deque;
+    return l;
+}
+
+int lisp_deque_count(Lisp d)
+{
+    return lisp_deque(d)->count;
+}
+
+static Lisp* deque_slot(const Deque* deque, unsigned int i)
+{
+    return deque->slots->entries + ((deque->head + i) & (deque->slots->capacity - 1));
+}
+
+Lisp lisp_deque_ref(Lisp d, unsigned int i)
+{
+    const Deque* deque = lisp_deque(d);
+    assert(i < deque->count);
+    return *deque_slot(deque, i);
+}
+
+static void deque_reserve(Deque* deque, LispContext ctx)
+{
+    if (deque->count < deque->slots->capacity) return;
+
+    // unwrap into the new slots
+    Slots* slots = slots_alloc(deque->slots->capacity * 2, ctx);
+    for (unsigned int i = 0; i < deque->count; ++i)
+        slots->entries[i] = *deque_slot(deque, i);
+    deque->slots = slots;
+    deque->head = 0;
+}
+
+void lisp_deque_push_back(Lisp d, Lisp x, LispContext ctx)
+{
+    Deque* deque = lisp_deque(d);
+    deque_reserve(deque, ctx);
+    *deque_slot(deque, deque->count++) = x;
+}
+
+void lisp_deque_push_front(Lisp d, Lisp x, LispContext ctx)
+{
+    Deque* deque = lisp_deque(d);
+    deque_reserve(deque, ctx);
+    deque->head = (deque->head - 1) & (deque->slots->capacity - 1);
+    ++deque->count;
+    *deque_slot(deque, 0) = x;
+}
+
+Lisp lisp_deque_pop_back(Lisp d)
+{
+    Deque* deque = lisp_deque(d);
+    assert(deque->count > 0);
+    Lisp* slot = deque_slot(deque, --deque->count);
+    Lisp x = *slot;
+    *slot = lisp_make_null();
+    return x;
+}
+
+Lisp lisp_deque_pop_front(Lisp d)
+{
+    Deque* deque = lisp_deque(d);
+    assert(deque->count > 0);
+    Lisp* slot = deque_slot(deque, 0);
+    Lisp x = *slot;
+    *slot = lisp_make_null();
+    deque->head = (deque->head + 1) & (deque->slots->capacity - 1);
+    --deque->count;
+    return x;
+}
+
+Lisp lisp_make_table(unsigned int capacity, LispContext ctx)
+{
+    size_t size = sizeof(Table) + sizeof(Lisp) * capacity;
+    Table* table = gc_alloc(size, LISP_TABLE, ctx);
+    table->size = 0;
+    table->capacity = capacity;
+
+    // clear the table
+    for (int i = 0; i < capacity; ++i)
+        table->entries[i] = lisp_make_null();
+
+    Lisp l;
+    l.type = table->block.type;
+    l.val.ptr_val = table;
+    return l;
+}
+
+void lisp_table_set(Lisp t, Lisp key, Lisp value, LispContext ctx)
+{
+    Table* table = lisp_table(t);
+    
+    unsigned int index = symbol_hash(key) % table->capacity;
+    Lisp pair = lisp_list_assoc(table->entries[index], key);
+
+    if (lisp_is_null(pair))
+    {
+        // new value. prepend to front of chain
+        pair = lisp_cons(key, value, ctx);
+        table->entries[index] = lisp_cons(pair, table->entries[index], ctx);
+        ++table->size;
+    }
+    else
+    {
+        // reassign cdr value (key, val)
+        lisp_set_cdr(pair, value);
+    }
+}
+
+Lisp lisp_table_get(Lisp t, Lisp symbol, LispContext ctx)
+{
+    const Table* table = lisp_table(t);
+    unsigned int index = symbol_hash(symbol) % table->capacity;
+    return lisp_list_assoc(table->entries[index], symbol);
+}
+
+void lisp_table_add_funcs(Lisp t, const char** names, LispFunc* funcs, LispContext ctx)
+{
+    const char** name = names;
+
+    LispFunc* func = funcs;
+
+    while (*name)
+    {
+        lisp_table_set(t, lisp_make_symbol(*name, ctx), lisp_make_func(*func), ctx);
+        ++name;
+        ++func;
+    }
+}
+
+// hash table with content keys.
+// The buckets are a table with (key . value) chains.
+// When it grows, the chains are moved to a new table a few buckets
+// at a time by each change, so no one insert pays for all of them.
+typedef struct
+{
+    Block block;
+    Lisp table;
+    // the table before growing, until its chains have moved.
+    // buckets below migrated are empty.
+    Lisp old;
+    unsigned int migrated;
+} HashTable;
+
+// buckets moved by each change while growing
+#define HASH_TABLE_MIGRATE_STEP 4
+
+static HashTable* lisp_hash_table(Lisp h)
+{
+    assert(lisp_type(h) == LISP_HASH_TABLE);
+    return h.val.ptr_val;
+}
+
+Lisp lisp_make_hash_table(unsigned int capacity, LispContext ctx)
+{
+    if (capacity < 1) capacity = 1;
+    Lisp table = lisp_make_table(capacity, ctx);
+
+    HashTable* hash_table = gc_alloc(sizeof(HashTable), LISP_HASH_TABLE, ctx);
+    hash_table->table = table;
+    hash_table->old = lisp_make_null();
+    hash_table->migrated = 0;
+
+    Lisp l;
+    l.type = hash_table->block.type;
+    l.val.ptr_val = hash_table;
+    return l;
+}
+
+static Lisp hash_table_chain_find(Lisp it, Lisp key)
+{
+    while (lisp_is_pair(it))
+    {
+        Lisp pair = lisp_car(it);
+        if (key_equal(lisp_car(pair), key)) return it;
+        it = lisp_cdr(it);
+    }
+    return lisp_make_null();
+}
+
+// relink the chains of up to count old buckets into the new table
+static void hash_table_migrate(HashTable* hash_table, unsigned int count)
+{
+    if (lisp_is_null(hash_table->old)) return;
+    Table* old = lisp_table(hash_table->old);
+    Table* table = lisp_table(hash_table->table);
+
+    for (; count > 0 && hash_table->migrated < old->capacity; --count, ++hash_table->migrated)
+    {
+        Lisp it = old->entries[hash_table->migrated];
+        old->entries[hash_table->migrated] = lisp_make_null();
+        while (lisp_is_pair(it))
+        {
+            Lisp next = lisp_cdr(it);
+            unsigned int index = key_hash(lisp_car(lisp_car(it))) % table->capacity;
+            lisp_set_cdr(it, table->entries[index]);
+            table->entries[index] = it;
+            ++table->size;
+            --old->size;
+            it = next;
+        }
+    }
+
+    if (hash_table->migrated == old->capacity) hash_table->old = lisp_make_null();
+}
+
+static void hash_table_grow(HashTable* hash_table, LispContext ctx)
+{
+    // finish the last growth first
+    hash_table_migrate(hash_table, UINT_MAX);
+
+    const Table* table = lisp_table(hash_table->table);
+    hash_table->old = hash_table->table;
+    hash_table->table = lisp_make_table(table->capacity * 2 + 1, ctx);
+    hash_table->migrated = 0;
+}
+
+// the chain cell holding key, in the new table or the part of the old one yet to move
+static Lisp hash_table_find(const HashTable* hash_table, Lisp key, unsigned int hash)
+{
+    const Table* table = lisp_table(hash_table->table);
+    Lisp it = hash_table_chain_find(table->entries[hash % table->capacity], key);
+    if (lisp_is_null(it) && !lisp_is_null(hash_table->old))
+    {
+        const Table* old = lisp_table(hash_table->old);
+        it = hash_table_chain_find(old->entries[hash % old->capacity], key);
+    }
+    return it;
+}
+
+static int hash_table_chain_delete(Table* table, unsigned int index, Lisp key)
+{
+    Lisp prev = lisp_make_null();
+    Lisp it = table->entries[index];
+
+    while (lisp_is_pair(it))
+    {
+        if (key_equal(lisp_car(lisp_car(it)), key))
+        {
+            if (lisp_is_null(prev))
+                table->entries[index] = lisp_cdr(it);
+            else
+                lisp_set_cdr(prev, lisp_cdr(it));
+
+            --table->size;
+            return 1;
+        }
+        prev = it;
+        it = lisp_cdr(it);
+    }
+    return 0;
+}
+
+void lisp_hash_table_set(Lisp h, Lisp key, Lisp x, LispContext ctx)
+{
+    assert(is_hashable(key));
+    HashTable* hash_table = lisp_hash_table(h);
+    hash_table_migrate(hash_table, HASH_TABLE_MIGRATE_STEP);
+
+    unsigned int hash = key_hash(key);
+    Lisp it = hash_table_find(hash_table, key, hash);
+
+    if (lisp_is_null(it))
+    {
+        Table* table = lisp_table(hash_table->table);
+        if (lisp_hash_table_count(h) + 1 > (table->capacity * 3) / 4)
+        {
+            hash_table_grow(hash_table, ctx);
+            table = lisp_table(hash_table->table);
+        }
+        unsigned int index = hash % table->capacity;
+
+        // new value. prepend to front of chain
+        Lisp pair = lisp_cons(key_own(key, ctx), x, ctx);
+        table->entries[index] = lisp_cons(pair, table->entries[index], ctx);
+        ++table->size;
+    }
+    else
+    {
+        lisp_set_cdr(lisp_car(it), x);
+    }
+}
+
+Lisp lisp_hash_table_get(Lisp h, Lisp key)
+{
+    if (!is_hashable(key)) return lisp_make_null();
+    Lisp it = hash_table_find(lisp_hash_table(h), key, key_hash(key));
+    return lisp_is_null(it) ? it : lisp_car(it);
+}
+
+int lisp_hash_table_delete(Lisp h, Lisp key)
+{
+    if (!is_hashable(key)) return 0;
+    HashTable* hash_table = lisp_hash_table(h);
+    hash_table_migrate(hash_table, HASH_TABLE_MIGRATE_STEP);
+
+    unsigned int hash = key_hash(key);
+    Table* table = lisp_table(hash_table->table);
+    if (hash_table_chain_delete(table, hash % table->capacity, key)) return 1;
+    if (lisp_is_null(hash_table->old)) return 0;
+
+    Table* old = lisp_table(hash_table->old);
+    return hash_table_chain_delete(old, hash % old->capacity, key);
+}
+
+int lisp_hash_table_count(Lisp h)
+{
+    const HashTable* hash_table = lisp_hash_table(h);
+    int count = lisp_table(hash_table->table)->size;
+    if (!lisp_is_null(hash_table->old)) count += lisp_table(hash_table->old)->size;
+    return count;
+}
+
+Lisp lisp_hash_table_to_list(Lisp h, LispContext ctx)
+{
+    const HashTable* hash_table = lisp_hash_table(h);
+
+    Lisp front = lisp_make_null();
+    Lisp back = front;
+
+    Lisp tables[] = { hash_table->table, hash_table->old };
+    for (int t = 0; t < 2; ++t)
+    {
+        if (lisp_is_null(tables[t])) continue;
+        const Table* table = lisp_table(tables[t]);
+        for (unsigned int i = 0; i < table->capacity; ++i)
+        {
+            Lisp it = table->entries[i];
+            while (lisp_is_pair(it))
+            {
+                back_append(&front, &back, lisp_car(it), ctx);
+                it = lisp_cdr(it);
+            }
+        }
+    }
+    return front;
+}
+
+Lisp lisp_env_extend(Lisp l, Lisp table, LispContext ctx)
+{
+    return lisp_cons(table, l, ctx);
+}
+
+Lisp lisp_env_lookup(Lisp l, Lisp key, LispContext ctx)
+{
+    while (lisp_is_pair(l))
+    {
+        Lisp x = lisp_table_get(lisp_car(l), key, ctx);
+        if (!lisp_is_null(x)) return x;
+        l = lisp_cdr(l);
+    }
+    
+    return lisp_make_null();
+}
+
+void lisp_env_define(Lisp l, Lisp key, Lisp x, LispContext ctx)
+{
+    lisp_table_set(lisp_car(l), key, x, ctx);
+}
+
+void lisp_env_set(Lisp l, Lisp key, Lisp x, LispContext ctx)
+{
+    Lisp pair = lisp_env_lookup(l, key, ctx);
+    if (lisp_is_null(pair))
+    {
+        fprintf(stderr, "error: unknown variable: %s\n", lisp_symbol(key));
+    }
+    lisp_set_cdr(pair, x);
+}
+
+// Printing works through a stack of tasks instead of recursion,
+// so long lists and deep nesting don't overflow the C stack.
+// A container prints its opening, then an items task prints
+// its items, putting itself back when one of them nests.
+// Nested items are printed directly while the C stack is shallow,
+// so most data never touches the task stack.
+
+typedef enum
+{
+    PRINT_VALUE,
+    PRINT_ITEMS, // items of the value from index on
+    PRINT_HAMT, // pairs and then children of node from index on
+    PRINT_TEXT,
+} PrintTaskKind;
+
+typedef struct
+{
+    PrintTaskKind kind;
+    int index;
+    Lisp value;
+    const void* ptr; // node or text
+} PrintTask;
+
+#define PRINT_LOCAL_TASKS 64
+#define PRINT_MAX_DEPTH 32
+
+typedef struct
+{
+    PrintTask* tasks;
+    size_t count;
+    size_t capacity;
+    int depth;
+    PrintTask local[PRINT_LOCAL_TASKS];
+} Printer;
+
+static void print_push(Printer* printer, PrintTaskKind kind, Lisp value, int index, const void* ptr)
+{
+    if (printer->count == printer->capacity)
+    {
+        printer->capacity *= 2;
+        if (printer->tasks == printer->local)
+        {
+            printer->tasks = malloc(sizeof(PrintTask) * printer->capacity);
+            memcpy(printer->tasks, printer->local, sizeof(printer->local));
+        }
+        else
+        {
+            printer->tasks = realloc(printer->tasks, sizeof(PrintTask) * printer->capacity);
+        }
+    }
+    PrintTask* task = printer->tasks + printer->count++;
+    task->kind = kind;
+    task->index = index;
+    task->value = value;
+    task->ptr = ptr;
+}
+
+static void print_value(FILE* file, Printer* printer, Lisp l);
+static void print_items(FILE* file, Printer* printer, Lisp l, int i);
+
+// atoms don't nest, so they are printed straight away.
+// returns 0 if l is not an atom.
+static int print_atom(FILE* file, Lisp l)
+{
+    switch (lisp_type(l))
+    {
+        case LISP_INT:
+            fprintf(file, "%i", lisp_int(l));
+            return 1;
+        case LISP_FLOAT:
+            fprintf(file, "%f", lisp_float(l));
+            return 1;
+        case LISP_NULL:
+            fprintf(file, "NIL");
+            return 1;
+        case LISP_SYMBOL:
+            fprintf(file, "%s", lisp_symbol(l));
+            return 1;
+        case LISP_STRING:
+            fputc('"', file);
+            fwrite(lisp_string(l), 1, lisp_string_length(l), file);
+            fputc('"', file);
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+// print x, as the item of l before next.
+// if x is left unfinished, the task which carries on with l
+// is put below the tasks x stacked, and 0 is returned.
+static int print_item(FILE* file, Printer* printer, Lisp x, Lisp l, int next)
+{
+    if (print_atom(file, x)) return 1;
+
+    if (printer->depth == PRINT_MAX_DEPTH)
+    {
+        print_push(printer, PRINT_ITEMS, l, next, NULL);
+        print_push(printer, PRINT_VALUE, x, 0, NULL);
+        return 0;
+    }
+
+    size_t count = printer->count;
+    ++printer->depth;
+    print_value(file, printer, x);
+    --printer->depth;
+    if (printer->count == count) return 1;
+
+    print_push(printer, PRINT_ITEMS, l, next, NULL);
+    PrintTask task = printer->tasks[printer->count - 1];
+    memmove(printer->tasks + count + 1, printer->tasks + count, sizeof(PrintTask) * (printer->count - 1 - count));
+    printer->tasks[count] = task;
+    return 0;
+}
+
+// print the list from the car of l on.
+// items of a pair are 0 for the car and 1 for a dotted cdr.
+static void print_list(FILE* file, Printer* printer, Lisp l)
+{
+    while (1)
+    {
+        if (!print_item(file, printer, lisp_car(l), l, 0)) return;
+
+        Lisp rest = lisp_cdr(l);
+        if (lisp_type(rest) != LISP_PAIR)
+        {
+            if (!lisp_is_null(rest))
+            {
+                // A dot at the end of a list is the cdr
+                fprintf(file, " . ");
+                if (!print_item(file, printer, rest, l, 1)) return;
+            }
+            fputc(')', file);
+            return;
+        }
+        fputc(' ', file);
+        l = rest;
+    }
+}
+
+// anything other than an atom
+static void print_value(FILE* file, Printer* printer, Lisp l)
+{
+    Lisp null = lisp_make_null();
+    switch (lisp_type(l))
+    {
+        case LISP_STRING_BUILDER:
+        {
+            const StringBuilder* builder = lisp_string_builder(l);
+            fprintf(file, "#<STRING-BUILDER \"");
+            fwrite(lisp_string(builder->buffer), 1, builder->length, file);
+            fprintf(file, "\">");
+            break;
+        }
+        case LISP_LAMBDA:
+            fprintf(file, "lambda-%i", lisp_lambda(l)->identifier);
+            break;
+        case LISP_FUNC:
+            fprintf(file, "function-%p", lisp_func(l)); 
+            break;
+        case LISP_TABLE:
+            fputc('{', file);
+            print_items(file, printer, l, 0);
+            break;
+        case LISP_HASH_TABLE:
+        {
+            // all in one table to print
+            HashTable* hash_table = lisp_hash_table(l);
+            hash_table_migrate(hash_table, UINT_MAX);
+            print_value(file, printer, hash_table->table);
+            break;
+        }
+        case LISP_RECORD:
+            fprintf(file, "#<%s", lisp_symbol(lisp_record_type_get(lisp_record(l)->type)->name));
+            print_items(file, printer, l, 0);
+            break;
+        case LISP_PMAP:
+        {
+            fprintf(file, "#<PMAP");
+            print_push(printer, PRINT_TEXT, null, 0, ">");
+            const HamtNode* root = lisp_pmap_get_impl(l)->root;
+            if (root) print_push(printer, PRINT_HAMT, null, 0, root);
+            break;
+        }
+        case LISP_PVECTOR:
+            fprintf(file, "#<PVECTOR");
+            print_items(file, printer, l, 0);
+            break;
+        case LISP_PRIORITY_QUEUE:
+            fprintf(file, "#<PRIORITY-QUEUE %i>", lisp_priority_queue_count(l));
+            break;
+        case LISP_BITVECTOR:
+        {
+            fprintf(file, "#*");
+            for (int i = 0; i < lisp_bitvector_length(l); ++i)
+                fputc(lisp_bitvector_ref(l, i) ? '1' : '0', file);
+            break;
+        }
+        case LISP_DEQUE:
+            fprintf(file, "#<DEQUE");
+            print_items(file, printer, l, 0);
+            break;
+        case LISP_RECORD_TYPE:
+            fprintf(file, "#<RECORD-TYPE %s>", lisp_symbol(lisp_record_type_get(l)->name));
+            break;
+        case LISP_TYPED_VECTOR:
+        {
+            // items are numbers, so there is nothing to nest
+            fprintf(file, "#%s(", typed_kind_name[lisp_typed_vector_kind(l)]);
+            for (int i = 0; i < lisp_typed_vector_length(l); ++i)
+            {
+                if (i > 0) fputc(' ', file);
+                print_atom(file, lisp_typed_vector_ref(l, i));
+            }
+            fputc(')', file);
+            break;
+        }
+        case LISP_VECTOR:
+            fprintf(file, "#(");
+            print_items(file, printer, l, 0);
+            break;
+        case LISP_PAIR:
+            fputc('(', file);
+            print_list(file, printer, l);
+            break;
+        default:
+            break;
+    }
+}
+
+// print the items of l from i on.
+// after an item which was left unfinished,
+// its separator is printed when the task is resumed.
+static void print_items(FILE* file, Printer* printer, Lisp l, int i)
+{
+    switch (lisp_type(l))
+    {
+        case LISP_TABLE:
+        {
+            const Table* table = lisp_table(l);
+            if (i > 0) fputc(' ', file);
+            for (; i < table->capacity; ++i)
+            {
+                if (lisp_is_null(table->entries[i])) continue;
+                if (!print_item(file, printer, table->entries[i], l, i + 1)) return;
+                fputc(' ', file);
+            }
+            fputc('}', file);
+            break;
+        }
+        case LISP_RECORD:
+        {
+            const Record* record = lisp_record(l);
+            for (; (unsigned int)i < record->field_count; ++i)
+            {
+                fputc(' ', file);
+                if (!print_item(file, printer, record->fields[i], l, i + 1)) return;
+            }
+            fputc('>', file);
+            break;
+        }
+        case LISP_PVECTOR:
+        {
+            const PVector* vector = lisp_pvector_get_impl(l);
+            for (; (unsigned int)i < vector->count; ++i)
+            {
+                fputc(' ', file);
+                Lisp x = pvector_leaf_for(vector, i)->values[i & TRIE_MASK];
+                if (!print_item(file, printer, x, l, i + 1)) return;
+            }
+            fputc('>', file);
+            break;
+        }
+        case LISP_DEQUE:
+        {
+            for (; i < lisp_deque_count(l); ++i)
+            {
+                fputc(' ', file);
+                if (!print_item(file, printer, lisp_deque_ref(l, i), l, i + 1)) return;
+            }
+            fputc('>', file);
+            break;
+        }
+        case LISP_VECTOR:
+        {
+            if (i > 0) fputc(' ', file);
+            for (; i < lisp_vector_length(l); ++i)
+            {
+                if (!print_item(file, printer, lisp_vector_ref(l, i), l, i + 1)) return;
+                fputc(' ', file);
+            }
+            fputc(')', file);
+            break;
+        }
+        case LISP_PAIR:
+        {
+            // the dotted cdr has been printed
+            if (i == 1)
+            {
+                fputc(')', file);
+                break;
+            }
+
+            // the car has been printed
+            Lisp rest = lisp_cdr(l);
+            if (lisp_type(rest) == LISP_PAIR)
+            {
+                fputc(' ', file);
+                print_list(file, printer, rest);
+            }
+            else if (!lisp_is_null(rest))
+            {
+                fprintf(file, " . ");
+                if (print_item(file, printer, rest, l, 1)) fputc(')', file);
+            }
+            else
+            {
+                fputc(')', file);
+            }
+            break;
+        }
+        default:
+            assert(0);
+            break;
+    }
+}
+
+static void print_hamt(FILE* file, Printer* printer, const HamtNode* node, int i)
+{
+    unsigned int pairs = hamt_pair_count(node);
+    Lisp null = lisp_make_null();
+    if ((unsigned int)i < pairs)
+    {
+        fprintf(file, " (");
+        print_push(printer, PRINT_HAMT, null, i + 1, node);
+        print_push(printer, PRINT_TEXT, null, 0, ")");
+        print_push(printer, PRINT_VALUE, node->entries[i * 2 + 1], 0, NULL);
+        print_push(printer, PRINT_TEXT, null, 0, " . ");
+        print_push(printer, PRINT_VALUE, node->entries[i * 2], 0, NULL);
+    }
+    else if ((unsigned int)i < pairs + hamt_child_count(node))
+    {
+        print_push(printer, PRINT_HAMT, null, i + 1, node);
+        print_push(printer, PRINT_HAMT, null, 0, hamt_children((HamtNode*)node)[i - pairs]);
+    }
+}
+
+void lisp_printf(FILE* file, Lisp l)
+{
+    Printer printer;
+    printer.tasks = printer.local;
+    printer.count = 0;
+    printer.capacity = PRINT_LOCAL_TASKS;
+    printer.depth = 0;
+
+    print_push(&printer, PRINT_VALUE, l, 0, NULL);
+    while (printer.count > 0)
+    {
+        PrintTask task = printer.tasks[--printer.count];
+        switch (task.kind)
+        {
+            case PRINT_VALUE:
+                if (!print_atom(file, task.value)) print_value(file, &printer, task.value);
+                break;
+            case PRINT_ITEMS:
+                print_items(file, &printer, task.value, task.index);
+                break;
+            case PRINT_HAMT:
+                print_hamt(file, &printer, task.ptr, task.index);
+                break;
+            case PRINT_TEXT:
+                fputs(task.ptr, file);
+                break;
+        }
+    }
+
+    if (printer.tasks != printer.local) free(printer.tasks);
+}
+
+void lisp_print(Lisp l) {  lisp_printf(stdout, l); }
+
+// Binary data.
+// A header, then one value. Each value is a tag, followed by:
+//   INT         zigzag varint
+//   FLOAT       4 bytes
+//   SYMBOL      varint index of a symbol written before
+//   SYMBOL_NEW  varint length and the bytes. it takes the next index.
+//   STRING      varint length and the bytes
+//   LIST        varint count (at least 1), the items, and then the tail
+//   VECTOR      varint count and the items
+//   TYPED       kind, varint count and the elements
+// Numbers are little endian.
+// Lists and vectors are built at their final size, as the reader would.
+
+enum
+{
+    BINARY_NULL = 0,
+    BINARY_INT,
+    BINARY_FLOAT,
+    BINARY_SYMBOL,
+    BINARY_SYMBOL_NEW,
+    BINARY_STRING,
+    BINARY_LIST,
+    BINARY_VECTOR,
+    BINARY_TYPED,
+};
+
+static const unsigned char binary_magic[4] = { 'L', 'S', 'B', 1 };
+
+#define BINARY_BUFFER_SIZE 4096
+
+typedef struct
+{
+    const Symbol* symbol;
+    unsigned int index;
+} BinarySymbol;
+
+typedef struct
+{
+    FILE* file;
+    unsigned char buffer[BINARY_BUFFER_SIZE];
+    size_t used;
+
+    // symbols written so far, by address
+    BinarySymbol* symbols;
+    unsigned int symbol_count;
+    unsigned int symbol_capacity;
+} BinaryWriter;
+
+static void binary_flush(BinaryWriter* w)
+{
+    fwrite(w->buffer, 1, w->used, w->file);
+    w->used = 0;
+}
+
+static void binary_put(BinaryWriter* w, unsigned char c)
+{
+    if (w->used == BINARY_BUFFER_SIZE) binary_flush(w);
+    w->buffer[w->used++] = c;
+}
+
+static void binary_put_bytes(BinaryWriter* w, const void* bytes, size_t length)
+{
+    if (w->used + length > BINARY_BUFFER_SIZE)
+    {
+        binary_flush(w);
+        if (length > BINARY_BUFFER_SIZE)
+        {
+            fwrite(bytes, 1, length, w->file);
+            return;
+        }
+    }
+    memcpy(w->buffer + w->used, bytes, length);
+    w->used += length;
+}
+
+static void binary_put_varint(BinaryWriter* w, uint64_t x)
+{
+    while (x >= 0x80)
+    {
+        binary_put(w, (unsigned char)(x | 0x80));
+        x >>= 7;
+    }
+    binary_put(w, (unsigned char)x);
+}
+
+static void binary_put_u32(BinaryWriter* w, uint32_t x)
+{
+    for (int i = 0; i < 4; ++i)
+        binary_put(w, (unsigned char)(x >> (i * 8)));
+}
+
+static uint32_t float_bits(float x)
+{
+    uint32_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    return bits;
+}
+
+// index of a symbol written before, or -1 after adding it
+static int binary_symbol_find(BinaryWriter* w, const Symbol* symbol)
+{
+    if (w->symbol_count * 2 >= w->symbol_capacity)
+    {
+        unsigned int old_capacity = w->symbol_capacity;
+        BinarySymbol* old = w->symbols;
+
+        w->symbol_capacity = old_capacity == 0 ? 256 : old_capacity * 2;
+        w->symbols = calloc(w->symbol_capacity, sizeof(BinarySymbol));
+        for (unsigned int i = 0; i < old_capacity; ++i)
+        {
+            if (!old[i].symbol) continue;
+            unsigned int j = old[i].symbol->hash & (w->symbol_capacity - 1);
+            while (w->symbols[j].symbol) j = (j + 1) & (w->symbol_capacity - 1);
+            w->symbols[j] = old[i];
+        }
+        free(old);
+    }
+
+    unsigned int j = symbol->hash & (w->symbol_capacity - 1);
+    while (w->symbols[j].symbol)
+    {
+        if (w->symbols[j].symbol == symbol) return (int)w->symbols[j].index;
+        j = (j + 1) & (w->symbol_capacity - 1);
+    }
+    w->symbols[j].symbol = symbol;
+    w->symbols[j].index = w->symbol_count++;
+    return -1;
+}
+
+// write everything but lists and vectors.
+// returns 0 for values which can't be written.
+static int binary_put_atom(BinaryWriter* w, Lisp x)
+{
+    switch (lisp_type(x))
+    {
+        case LISP_NULL:
+            binary_put(w, BINARY_NULL);
+            return 1;
+        case LISP_INT:
+        {
+            int n = lisp_int(x);
+            binary_put(w, BINARY_INT);
+            binary_put_varint(w, ((uint32_t)n << 1) ^ (uint32_t)(n >> 31));
+            return 1;
+        }
+        case LISP_FLOAT:
+            binary_put(w, BINARY_FLOAT);
+            binary_put_u32(w, float_bits(lisp_float(x)));
+            return 1;
+        case LISP_SYMBOL:
+        {
+            const Symbol* symbol = x.val.ptr_val;
+            int index = binary_symbol_find(w, symbol);
+            if (index >= 0)
+            {
+                binary_put(w, BINARY_SYMBOL);
+                binary_put_varint(w, (uint64_t)index);
+            }
+            else
+            {
+                binary_put(w, BINARY_SYMBOL_NEW);
+                binary_put_varint(w, symbol->length);
+                binary_put_bytes(w, symbol->string, symbol->length);
+            }
+            return 1;
+        }
+        case LISP_STRING:
+            binary_put(w, BINARY_STRING);
+            binary_put_varint(w, (uint64_t)lisp_string_length(x));
+            binary_put_bytes(w, lisp_string(x), (size_t)lisp_string_length(x));
+            return 1;
+        case LISP_TYPED_VECTOR:
+        {
+            LispTypedKind kind = lisp_typed_vector_kind(x);
+            int n;
+            const unsigned char* data = lisp_typed_vector_data(x, &n);
+            binary_put(w, BINARY_TYPED);
+            binary_put(w, (unsigned char)kind);
+            binary_put_varint(w, (uint64_t)n);
+
+            if (kind == LISP_TYPED_U8)
+            {
+                binary_put_bytes(w, data, (size_t)n);
+            }
+            else
+            {
+                for (int i = 0; i < n; ++i)
+                {
+                    uint32_t bits;
+                    memcpy(&bits, data + i * 4, 4);
+                    binary_put_u32(w, bits);
+                }
+            }
+            return 1;
+        }
+        default:
+            return 0;
+    }
+}
+
+int lisp_write_binary(FILE* file, Lisp l)
+{
+    BinaryWriter w;
+    w.file = file;
+    w.used = 0;
+    w.symbols = NULL;
+    w.symbol_count = 0;
+    w.symbol_capacity = 0;
+    binary_put_bytes(&w, binary_magic, sizeof(binary_magic));
+
+    // like the printer, nesting is kept on a stack of tasks.
+    // an items task writes the item at index and puts itself back for the next.
+    Printer tasks;
+    tasks.tasks = tasks.local;
+    tasks.count = 0;
+    tasks.capacity = PRINT_LOCAL_TASKS;
+    print_push(&tasks, PRINT_VALUE, l, 0, NULL);
+
+    int ok = 1;
+    while (ok && tasks.count > 0)
+    {
+        PrintTask task = tasks.tasks[--tasks.count];
+        Lisp x = task.value;
+
+        if (task.kind == PRINT_ITEMS)
+        {
+            if (lisp_type(x) == LISP_VECTOR)
+            {
+                if (task.index + 1 < lisp_vector_length(x)) print_push(&tasks, PRINT_ITEMS, x, task.index + 1, NULL);
+                x = lisp_vector_ref(x, task.index);
+            }
+            else
+            {
+                // the rest of the list, or its tail
+                Lisp rest = lisp_cdr(x);
+                print_push(&tasks, lisp_type(rest) == LISP_PAIR ? PRINT_ITEMS : PRINT_VALUE, rest, 0, NULL);
+                x = lisp_car(x);
+            }
+        }
+
+        switch (lisp_type(x))
+        {
+            case LISP_PAIR:
+            {
+                uint64_t count = 0;
+                for (Lisp it = x; lisp_type(it) == LISP_PAIR; it = lisp_cdr(it)) ++count;
+                binary_put(&w, BINARY_LIST);
+                binary_put_varint(&w, count);
+                print_push(&tasks, PRINT_ITEMS, x, 0, NULL);
+                break;
+            }
+            case LISP_VECTOR:
+                binary_put(&w, BINARY_VECTOR);
+                binary_put_varint(&w, (uint64_t)lisp_vector_length(x));
+                if (lisp_vector_length(x) > 0) print_push(&tasks, PRINT_ITEMS, x, 0, NULL);
+                break;
+            default:
+                ok = binary_put_atom(&w, x);
+                break;
+        }
+    }
+
+    binary_flush(&w);
+    free(w.symbols);
+    if (tasks.tasks != tasks.local) free(tasks.tasks);
+    return ok;
+}
+
+typedef struct
+{
+    Lisp container;
+    unsigned int index;
+    unsigned int count;
+} BinaryFrame;
+
+typedef struct
+{
+    const unsigned char* p;
+    const unsigned char* end;
+    jmp_buf* error_jmp;
+
+    // symbols read so far, by index
+    Lisp* symbols;
+    size_t symbol_count;
+    size_t symbol_capacity;
+
+    BinaryFrame* frames;
+    size_t frame_count;
+    size_t frame_capacity;
+} BinaryReader;
+
+static void binary_need(BinaryReader* r, uint64_t length)
+{
+    if (length > (uint64_t)(r->end - r->p)) longjmp(*r->error_jmp, LISP_ERROR_BAD_TOKEN);
+}
+
+static unsigned char binary_get(BinaryReader* r)
+{
+    binary_need(r, 1);
+    return *r->p++;
+}
+
+static uint64_t binary_get_varint(BinaryReader* r)
+{
+    uint64_t x = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        unsigned char c = binary_get(r);
+        x |= (uint64_t)(c & 0x7f) << shift;
+        if (!(c & 0x80)) return x;
+    }
+    longjmp(*r->error_jmp, LISP_ERROR_BAD_TOKEN);
+}
+
+// a length or count, which must fit in what is left
+static unsigned int binary_get_count(BinaryReader* r, size_t item_size)
+{
+    uint64_t n = binary_get_varint(r);
+    if (n > UINT32_MAX) longjmp(*r->error_jmp, LISP_ERROR_BAD_TOKEN);
+    binary_need(r, n * item_size);
+    return (unsigned int)n;
+}
+
+static uint32_t binary_get_u32(BinaryReader* r)
+{
+    binary_need(r, 4);
+    const unsigned char* p = r->p;
+    r->p += 4;
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void binary_open(BinaryReader* r, Lisp container, unsigned int count)
+{
+    if (r->frame_count == r->frame_capacity)
+    {
+        r->frame_capacity = r->frame_capacity == 0 ? 64 : r->frame_capacity * 2;
+        r->frames = realloc(r->frames, sizeof(BinaryFrame) * r->frame_capacity);
+    }
+    BinaryFrame* frame = r->frames + r->frame_count++;
+    frame->container = container;
+    frame->index = 0;
+    frame->count = count;
+}
+
+// read one value. lists and vectors are opened,
+// and return 0 until their items are read.
+static int binary_get_value(BinaryReader* r, Lisp* out, LispContext ctx)
+{
+    unsigned char tag = binary_get(r);
+    switch (tag)
+    {
+        case BINARY_NULL:
+            *out = lisp_make_null();
+            return 1;
+        case BINARY_INT:
+        {
+            uint32_t n = (uint32_t)binary_get_varint(r);
+            *out = lisp_make_int((int)((n >> 1) ^ (0u - (n & 1))));
+            return 1;
+        }
+        case BINARY_FLOAT:
+        {
+            uint32_t bits = binary_get_u32(r);
+            float x;
+            memcpy(&x, &bits, sizeof(x));
+            *out = lisp_make_float(x);
+            return 1;
+        }
+        case BINARY_SYMBOL:
+        {
+            uint64_t index = binary_get_varint(r);
+            if (index >= r->symbol_count) longjmp(*r->error_jmp, LISP_ERROR_BAD_TOKEN);
+            *out = r->symbols[index];
+            return 1;
+        }
+        case BINARY_SYMBOL_NEW:
+        {
+            unsigned int length = binary_get_count(r, 1);
+            const char* text = (const char*)r->p;
+            r->p += length;
+
+            if (r->symbol_count == r->symbol_capacity)
+            {
+                r->symbol_capacity = r->symbol_capacity == 0 ? 256 : r->symbol_capacity * 2;
+                r->symbols = realloc(r->symbols, sizeof(Lisp) * r->symbol_capacity);
+            }
+            *out = symbol_intern(text, length, hash_bytes(text, length), ctx);
+            r->symbols[r->symbol_count++] = *out;
+            return 1;
+        }
+        case BINARY_STRING:
+        {
+            unsigned int length = binary_get_count(r, 1);
+            *out = lisp_make_string_n((const char*)r->p, length, ctx);
+            r->p += length;
+            return 1;
+        }
+        case BINARY_LIST:
+        {
+            unsigned int count = binary_get_count(r, 1);
+            if (count == 0) longjmp(*r->error_jmp, LISP_ERROR_BAD_TOKEN);
+            if (count < COMPACT_LIST_MIN)
+                *out = lisp_cons(lisp_make_null(), lisp_make_null(), ctx);
+            else
+                *out = compact_list_make(NULL, count, lisp_make_null(), ctx);
+            binary_open(r, *out, count);
+            return 0;
+        }
+        case BINARY_VECTOR:
+        {
+            unsigned int count = binary_get_count(r, 1);
+            *out = lisp_make_vector(count, lisp_make_null(), ctx);
+            if (count == 0) return 1;
+            binary_open(r, *out, count);
+            return 0;
+        }
+        case BINARY_TYPED:
+        {
+            unsigned char kind = binary_get(r);
+            if (kind >= LISP_TYPED_KIND_COUNT) longjmp(*r->error_jmp, LISP_ERROR_BAD_TOKEN);
+            size_t size = typed_element_size[kind];
+            unsigned int count = binary_get_count(r, size);
+
+            *out = lisp_make_typed_vector((LispTypedKind)kind, count, ctx);
+            unsigned char* data = lisp_typed_vector(*out)->data;
+            if (kind == LISP_TYPED_U8)
+            {
+                memcpy(data, r->p, count);
+                r->p += count;
+            }
+            else
+            {
+                for (unsigned int i = 0; i < count; ++i)
+                {
+                    uint32_t bits = binary_get_u32(r);
+                    memcpy(data + i * 4, &bits, 4);
+                }
+            }
+            return 1;
+        }
+        default:
+            longjmp(*r->error_jmp, LISP_ERROR_BAD_TOKEN);
+    }
+}
+
+static Lisp binary_read(BinaryReader* r, LispContext ctx)
+{
+    binary_need(r, sizeof(binary_magic));
+    if (memcmp(r->p, binary_magic, sizeof(binary_magic)) != 0) longjmp(*r->error_jmp, LISP_ERROR_BAD_TOKEN);
+    r->p += sizeof(binary_magic);
+
+    while (1)
+    {
+        Lisp x;
+        if (!binary_get_value(r, &x, ctx)) continue;
+
+        // give the value to the containers it completes
+        while (1)
+        {
+            if (r->frame_count == 0) return x;
+
+            BinaryFrame* top = r->frames + r->frame_count - 1;
+            if (lisp_type(top->container) == LISP_VECTOR)
+            {
+                Vector* vector = lisp_vector(top->container);
+                // vectors store one type for every entry
+                if (top->index == 0) vector->type = lisp_type(x);
+                else if (vector->type != lisp_type(x)) longjmp(*r->error_jmp, LISP_ERROR_BAD_TOKEN);
+
+                vector->entries[top->index++] = x.val;
+                if (top->index < top->count) break;
+
+                lisp_vector_index(top->container, ctx);
+            }
+            else if (top->count == 1)
+            {
+                // a Pair
+                Pair* pair = top->container.val.ptr_val;
+                if (top->index++ == 0)
+                {
+                    pair->car = x;
+                    break;
+                }
+                pair->cdr = x;
+            }
+            else
+            {
+                CompactList* list = compact_list(compact_slot(top->container));
+                if (top->index < top->count)
+                {
+                    list->slots[top->index].car = x.val;
+                    list->slots[top->index].type = lisp_type(x);
+                    ++top->index;
+                    break;
+                }
+                list->tail = x;
+            }
+
+            x = top->container;
+            --r->frame_count;
+        }
+    }
+}
+
+Lisp lisp_read_binary(const void* data, size_t size, LispError* out_error, LispContext ctx)
+{
+    jmp_buf error_jmp;
+    BinaryReader r;
+    r.p = data;
+    r.end = r.p + size;
+    r.error_jmp = &error_jmp;
+    r.symbols = NULL;
+    r.symbol_count = 0;
+    r.symbol_capacity = 0;
+    r.frames = NULL;
+    r.frame_count = 0;
+    r.frame_capacity = 0;
+
+    Lisp result = lisp_make_null();
+    LispError error = setjmp(error_jmp);
+    if (error == LISP_ERROR_NONE)
+    {
+        result = binary_read(&r, ctx);
+        // there is one value
+        if (r.p != r.end) error = LISP_ERROR_BAD_TOKEN;
+    }
+    if (error != LISP_ERROR_NONE) result = lisp_make_null();
+
+    free(r.symbols);
+    free(r.frames);
+    if (out_error) *out_error = error;
+    return result;
+}
+
+Lisp lisp_read_binary_file(FILE* file, LispError* out_error, LispContext ctx)
+{
+    size_t size = 0;
+    size_t capacity = LISP_FILE_CHUNK_SIZE;
+    unsigned char* data = malloc(capacity);
+
+    size_t read;
+    while ((read = fread(data + size, 1, capacity - size, file)) > 0)
+    {
+        size += read;
+        if (size == capacity)
+        {
+            capacity *= 2;
+            data = realloc(data, capacity);
+        }
+    }
+
+    Lisp l = lisp_read_binary(data, size, out_error, ctx);
+    free(data);
+    return l;
+}
+
+Lisp lisp_read_binary_path(const char* path, LispError* out_error, LispContext ctx)
+{
+    FILE* file = fopen(path, "rb");
+    if (!file)
+    {
+        if (out_error) *out_error = LISP_ERROR_FILE_OPEN;
+        return lisp_make_null();
+    }
+
+    Lisp l;
+#if LISP_MMAP
+    size_t map_size;
+    char* data = file_map(file, &map_size);
+    if (data)
+    {
+        struct stat info;
+        fstat(fileno(file), &info);
+        l = lisp_read_binary(data, (size_t)info.st_size, out_error, ctx);
+        munmap(data, map_size);
+        fclose(file);
+        return l;
+    }
+#endif
+
+    l = lisp_read_binary_file(file, out_error, ctx);
+    fclose(file);
+    return l;
+}
+
+// JSON is read as tools/json-to-lisp.py would convert it.
+// Objects are vectors of (key . value) pairs with symbol keys,
+// arrays are lists, and true and false are symbols.
+// null is NIL, as is []. Strings have their escapes decoded.
+// Items are stacked as in the s-expression reader, using a Lexer's stack.
+
+typedef struct
+{
+    const char* p;
+    jmp_buf* error_jmp;
+    Lexer lex;
+
+    // strings with escapes are decoded here
+    char* buffer;
+    size_t buffer_capacity;
+
+    Lisp true_symbol;
+    Lisp false_symbol;
+} JsonReader;
+
+static const char* json_skip_space(const char* p)
+{
+    while (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t') ++p;
+    return p;
+}
+
+static void json_expect(JsonReader* r, const char* word)
+{
+    size_t length = strlen(word);
+    if (strncmp(r->p, word, length) != 0) longjmp(*r->error_jmp, LISP_ERROR_BAD_TOKEN);
+    r->p += length;
+}
+
+static void json_buffer_put(JsonReader* r, size_t* length, const char* bytes, size_t count)
+{
+    if (count == 0) return;
+    if (*length + count > r->buffer_capacity)
+    {
+        while (*length + count > r->buffer_capacity)
+            r->buffer_capacity = r->buffer_capacity == 0 ? 256 : r->buffer_capacity * 2;
+        r->buffer = realloc(r->buffer, r->buffer_capacity);
+    }
+    memcpy(r->buffer + *length, bytes, count);
+    *length += count;
+}
+
+static unsigned int json_hex4(JsonReader* r)
+{
+    unsigned int x = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        char c = *r->p++;
+        x <<= 4;
+        if (c >= '0' && c <= '9') x |= c - '0';
+        else if (c >= 'a' && c <= 'f') x |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') x |= c - 'A' + 10;
+        else longjmp(*r->error_jmp, LISP_ERROR_BAD_TOKEN);
+    }
+    return x;
+}
+
+// the string after the opening quote.
+// its bytes are in the text, unless there were escapes.
+static const char* json_string(JsonReader* r, size_t* out_length)
+{
+    const char* start = r->p;
+    const char* p = start;
+    while (*p != '"' && *p != '\\' && (unsigned char)*p >= 0x20) ++p;
+
+    if (*p == '"')
+    {
+        *out_length = p - start;
+        r->p = p + 1;
+        return start;
+    }
+
+    size_t length = 0;
+    while (1)
+    {
+        json_buffer_put(r, &length, start, p - start);
+        if (*p == '"') break;
+        // control characters (and the end of the text) can't be in strings
+        if (*p != '\\') longjmp(*r->error_jmp, LISP_ERROR_BAD_TOKEN);
+
+        char c = p[1];
+        p += 2;
+        switch (c)
+        {
+            case '"': case '\\': case '/':
+                json_buffer_put(r, &length, &c, 1);
+                break;
+            case 'b': json_buffer_put(r, &length, "\b", 1); break;
+            case 'f': json_buffer_put(r, &length, "\f", 1); break;
+            case 'n': json_buffer_put(r, &length, "\n", 1); break;
+            case 'r': json_buffer_put(r, &length, "\r", 1); break;
+            case 't': json_buffer_put(r, &length, "\t", 1); break;
+            case 'u':
+            {
+                r->p = p;
+                unsigned int code = json_hex4(r);
+                // a surrogate pair
+                if (code >= 0xD800 && code < 0xDC00 && r->p[0] == '\\' && r->p[1] == 'u')
+                {
+                    r->p += 2;
+                    unsigned int low = json_hex4(r);
+                    if (low < 0xDC00 || low >= 0xE000) longjmp(*r->error_jmp, LISP_ERROR_BAD_TOKEN);
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                }
+                p = r->p;
+
+                // UTF-8
+                char utf8[4];
+                size_t n;
+                if (code < 0x80)
+                {
+                    utf8[0] = (char)code;
+                    n = 1;
+                }
+                else if (code < 0x800)
+                {
+                    utf8[0] = (char)(0xC0 | (code >> 6));
+                    utf8[1] = (char)(0x80 | (code & 0x3F));
+                    n = 2;
+                }
+                else if (code < 0x10000)
+                {
+                    utf8[0] = (char)(0xE0 | (code >> 12));
+                    utf8[1] = (char)(0x80 | ((code >> 6) & 0x3F));
+                    utf8[2] = (char)(0x80 | (code & 0x3F));
+                    n = 3;
+                }
+                else
+                {
+                    utf8[0] = (char)(0xF0 | (code >> 18));
+                    utf8[1] = (char)(0x80 | ((code >> 12) & 0x3F));
+                    utf8[2] = (char)(0x80 | ((code >> 6) & 0x3F));
+                    utf8[3] = (char)(0x80 | (code & 0x3F));
+                    n = 4;
+                }
+                json_buffer_put(r, &length, utf8, n);
+                break;
+            }
+            default:
+                longjmp(*r->error_jmp, LISP_ERROR_BAD_TOKEN);
+        }
+
+        start = p;
+        while (*p != '"' && *p != '\\' && (unsigned char)*p >= 0x20) ++p;
+    }
+
+    *out_length = length;
+    r->p = p + 1;
+    return r->buffer;
+}
+
+// an object key, followed by :
+static Lisp json_key(JsonReader* r, LispContext ctx)
+{
+    r->p = json_skip_space(r->p);
+    if (*r->p != '"') longjmp(*r->error_jmp, LISP_ERROR_BAD_TOKEN);
+    ++r->p;
+
+    size_t length;
+    const char* text = json_string(r, &length);
+
+    // keys are symbols, which are uppercase
+    char scratch[SYMBOL_SCRATCH_MAX];
+    char* upper = length < SYMBOL_SCRATCH_MAX ? scratch : malloc(length);
+    for (size_t i = 0; i < length; ++i)
+        upper[i] = toupper(text[i]);
+    Lisp key = symbol_intern(upper, (unsigned int)length, hash_bytes(upper, length), ctx);
+    if (upper != scratch) free(upper);
+
+    r->p = json_skip_space(r->p);
+    if (*r->p != ':') longjmp(*r->error_jmp, LISP_ERROR_BAD_TOKEN);
+    ++r->p;
+    return key;
+}
+
+// numbers convert as the lexer does: ints without a fraction or exponent, otherwise floats
+static Lisp json_number(JsonReader* r)
+{
+    const char* start = r->p;
+    const char* p = start;
+    int negative = *p == '-';
+    if (negative) ++p;
+    if (!isdigit(*p)) longjmp(*r->error_jmp, LISP_ERROR_BAD_TOKEN);
+    // JSON has no leading zeros
+    if (*p == '0' && isdigit(p[1])) longjmp(*r->error_jmp, LISP_ERROR_BAD_TOKEN);
+
+    uint64_t digits = 0;
+    int exponent = 0;
+    int significant = 0;
+    int exact = 1;
+    int is_float = 0;
+
+    for (int fraction = 0; fraction < 2; ++fraction)
+    {
+        for (; isdigit(*p); ++p)
+        {
+            if (significant < LEX_DIGITS_MAX)
+            {
+                digits = digits * 10 + (unsigned int)(*p - '0');
+                if (digits) ++significant;
+                if (fraction) --exponent;
+            }
+            else
+            {
+                exact = 0;
+            }
+        }
+
+        if (fraction || *p != '.') break;
+        ++p;
+        if (!isdigit(*p)) longjmp(*r->error_jmp, LISP_ERROR_BAD_TOKEN);
+        is_float = 1;
+    }
+
+    if (*p == 'e' || *p == 'E')
+    {
+        ++p;
+        int exponent_negative = *p == '-';
+        if (*p == '-' || *p == '+') ++p;
+        if (!isdigit(*p)) longjmp(*r->error_jmp, LISP_ERROR_BAD_TOKEN);
+
+        int e = 0;
+        for (; isdigit(*p); ++p)
+            if (e < 100000) e = e * 10 + (*p - '0');
+        exponent += exponent_negative ? -e : e;
+        is_float = 1;
+    }
+    r->p = p;
+
+    // ints which don't fit fall through and are read as floats
+    if (!is_float && exact && digits <= (negative ? (uint64_t)INT_MAX + 1 : INT_MAX))
+    {
+        int64_t n = (int64_t)digits;
+        return lisp_make_int((int)(negative ? -n : n));
+    }
+
+    double x;
+    if (exact && decimal_to_double(digits, exponent, &x)) return lisp_make_float((float)(negative ? -x : x));
+    // the number ends where strtod stops
+    return lisp_make_float((float)strtod(start, NULL));
+}
+
+static Lisp json_read(JsonReader* r, LispContext ctx)
+{
+    Lexer* lex = &r->lex;
+
+    while (1)
+    {
+        Lisp x;
+        r->p = json_skip_space(r->p);
+
+        switch (*r->p)
+        {
+            case '{':
+                ++r->p;
+                parse_open(lex, FRAME_VECTOR);
+                r->p = json_skip_space(r->p);
+                if (*r->p != '}')
+                {
+                    parse_push(lex, json_key(r, ctx));
+                    continue;
+                }
+                ++r->p;
+                --lex->frame_count;
+                x = parse_pop_vector(lex, lex->stack_size, *r->error_jmp, ctx);
+                break;
+            case '[':
+                ++r->p;
+                parse_open(lex, FRAME_LIST);
+                r->p = json_skip_space(r->p);
+                if (*r->p != ']') continue;
+                ++r->p;
+                --lex->frame_count;
+                x = lisp_make_null();
+                break;
+            case '"':
+            {
+                ++r->p;
+                size_t length;
+                const char* text = json_string(r, &length);
+                x = lisp_make_string_n(text, (unsigned int)length, ctx);
+                break;
+            }
+            case 't':
+                json_expect(r, "true");
+                x = r->true_symbol;
+                break;
+            case 'f':
+                json_expect(r, "false");
+                x = r->false_symbol;
+                break;
+            case 'n':
+                json_expect(r, "null");
+                x = lisp_make_null();
+                break;
+            case '\0':
+                longjmp(*r->error_jmp, LISP_ERROR_PAREN_EXPECTED);
+            default:
+                x = json_number(r);
+                break;
+        }
+
+        // give the value to the open arrays and objects,
+        // closing those which end after it.
+        while (1)
+        {
+            if (lex->frame_count == 0) return x;
+
+            ParseFrame* top = lex->frames + lex->frame_count - 1;
+            int object = top->type == FRAME_VECTOR;
+            if (object)
+            {
+                Lisp* key = lex->stack + lex->stack_size - 1;
+                *key = lisp_cons(*key, x, ctx);
+            }
+            else
+            {
+                parse_push(lex, x);
+            }
+
+            r->p = json_skip_space(r->p);
+            char c = *r->p++;
+            if (c == ',')
+            {
+                if (object) parse_push(lex, json_key(r, ctx));
+                break;
+            }
+
+            if (c == '\0') longjmp(*r->error_jmp, LISP_ERROR_PAREN_EXPECTED);
+            if (c != (object ? '}' : ']')) longjmp(*r->error_jmp, LISP_ERROR_PAREN_UNEXPECTED);
+
+            --lex->frame_count;
+            if (object)
+                x = parse_pop_vector(lex, top->base, *r->error_jmp, ctx);
+            else
+                x = parse_close_list(lex, top->base, lisp_make_null(), ctx);
+        }
+    }
+}
+
+Lisp lisp_read_json(const char* text, int flags, LispError* out_error, LispContext ctx)
+{
+    jmp_buf error_jmp;
+    JsonReader r;
+    r.p = text;
+    r.error_jmp = &error_jmp;
+    r.buffer = NULL;
+    r.buffer_capacity = 0;
+    r.true_symbol = lisp_make_symbol("TRUE", ctx);
+    r.false_symbol = lisp_make_symbol("FALSE", ctx);
+    lexer_init(&r.lex, "");
+    r.lex.read_flags = flags;
+
+    Lisp result = lisp_make_null();
+    LispError error = setjmp(error_jmp);
+    if (error == LISP_ERROR_NONE)
+    {
+        result = json_read(&r, ctx);
+        // there is one value
+        if (*json_skip_space(r.p) != '\0') error = LISP_ERROR_BAD_TOKEN;
+    }
+    if (error != LISP_ERROR_NONE) result = lisp_make_null();
+
+    free(r.buffer);
+    lexer_shutdown(&r.lex);
+    if (out_error) *out_error = error;
+    return result;
+}
+
+Lisp lisp_read_json_file(FILE* file, int flags, LispError* out_error, LispContext ctx)
+{
+    size_t size = 0;
+    size_t capacity = LISP_FILE_CHUNK_SIZE;
+    char* text = malloc(capacity + 1);
+
+    size_t read;
+    while ((read = fread(text + size, 1, capacity - size, file)) > 0)
+    {
+        size += read;
+        if (size == capacity)
+        {
+            capacity *= 2;
+            text = realloc(text, capacity + 1);
+        }
+    }
+    text[size] = '\0';
+
+    Lisp l = lisp_read_json(text, flags, out_error, ctx);
+    free(text);
+    return l;
+}
+
+Lisp lisp_read_json_path(const char* path, int flags, LispError* out_error, LispContext ctx)
+{
+    FILE* file = fopen(path, "rb");
+    if (!file)
+    {
+        if (out_error) *out_error = LISP_ERROR_FILE_OPEN;
+        return lisp_make_null();
+    }
+
+    Lisp l;
+#if LISP_MMAP
+    size_t map_size;
+    char* data = file_map(file, &map_size);
+    if (data)
+    {
+        l = lisp_read_json(data, flags, out_error, ctx);
+        munmap(data, map_size);
+        fclose(file);
+        return l;
+    }
+#endif
+
+    l = lisp_read_json_file(file, flags, out_error, ctx);
+    fclose(file);
+    return l;
+}
+
+static void json_put_string(FILE* file, const char* s, size_t length)
+{
+    fputc('"', file);
+    size_t start = 0;
+    for (size_t i = 0; i < length; ++i)
+    {
+        unsigned char c = (unsigned char)s[i];
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+
+        fwrite(s + start, 1, i - start, file);
+        start = i + 1;
+        switch (c)
+        {
+            case '"': fputs("\\\"", file); break;
+            case '\\': fputs("\\\\", file); break;
+            case '\n': fputs("\\n", file); break;
+            case '\r': fputs("\\r", file); break;
+            case '\t': fputs("\\t", file); break;
+            default: fprintf(file, "\\u%04x", c); break;
+        }
+    }
+    fwrite(s + start, 1, length - start, file);
+    fputc('"', file);
+}
+
+// the shortest digits which read back as the same float.
+// digits are found by scaling with an exact power of ten
+// and checked with the reader's conversion, which is exact.
+static void json_put_float(FILE* file, float x)
+{
+    static const double exact_pow10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    if (isnan(x) || isinf(x))
+    {
+        fputs("null", file);
+        return;
+    }
+
+    double d = fabs((double)x);
+    if (d == 0.0)
+    {
+        fputs(signbit(x) ? "-0.0" : "0.0", file);
+        return;
+    }
+
+    int magnitude = (int)floor(log10(d));
+    uint64_t digits = 0;
+    int q = 0;
+    int found = 0;
+    for (int precision = 1; precision <= 9 && !found; ++precision)
+    {
+        q = magnitude - precision + 1;
+        if (q < -22 || q > 22) break;
+
+        digits = (uint64_t)llround(q < 0 ? d * exact_pow10[-q] : d / exact_pow10[q]);
+        double y;
+        found = decimal_to_double(digits, q, &y) && (float)y == (float)d;
+    }
+
+    if (!found)
+    {
+        char text[32];
+        for (int precision = 1; precision <= 9; ++precision)
+        {
+            snprintf(text, sizeof(text), "%.*g", precision, x);
+            if ((float)strtod(text, NULL) == x) break;
+        }
+        fputs(text, file);
+        // so it reads back as a float
+        if (!strpbrk(text, ".e")) fputs(".0", file);
+        return;
+    }
+
+    while (digits % 10 == 0)
+    {
+        digits /= 10;
+        ++q;
+    }
+
+    char text[24];
+    int n = snprintf(text, sizeof(text), "%llu", (unsigned long long)digits);
+    // where the decimal point goes among the digits
+    int point = n + q;
+
+    if (x < 0) fputc('-', file);
+    if (q >= 0 && point <= 16)
+    {
+        fputs(text, file);
+        for (int i = 0; i < q; ++i) fputc('0', file);
+        fputs(".0", file);
+    }
+    else if (point > 0 && q < 0)
+    {
+        fwrite(text, 1, point, file);
+        fputc('.', file);
+        fputs(text + point, file);
+    }
+    else if (point > -5 && q < 0)
+    {
+        fputs("0.", file);
+        for (int i = point; i < 0; ++i) fputc('0', file);
+        fputs(text, file);
+    }
+    else
+    {
+        fputc(text[0], file);
+        if (n > 1)
+        {
+            fputc('.', file);
+            fputs(text + 1, file);
+        }
+        fprintf(file, "e%i", point - 1);
+    }
+}
+
+// a vector of pairs with symbol keys is an object
+static int json_is_object(Lisp v)
+{
+    int n = lisp_vector_length(v);
+    for (int i = 0; i < n; ++i)
+    {
+        Lisp x = lisp_vector_ref(v, i);
+        if (lisp_type(x) != LISP_PAIR || lisp_type(lisp_car(x)) != LISP_SYMBOL) return 0;
+    }
+    return 1;
+}
+
+// write a value, or open it and stack a task for its items
+static int json_put_value(FILE* file, Printer* tasks, Lisp x)
+{
+    switch (lisp_type(x))
+    {
+        case LISP_NULL:
+            fputs("null", file);
+            return 1;
+        case LISP_INT:
+            fprintf(file, "%i", lisp_int(x));
+            return 1;
+        case LISP_FLOAT:
+            json_put_float(file, lisp_float(x));
+            return 1;
+        case LISP_STRING:
+            json_put_string(file, lisp_string(x), (size_t)lisp_string_length(x));
+            return 1;
+        case LISP_SYMBOL:
+        {
+            const Symbol* symbol = x.val.ptr_val;
+            if (strcmp(symbol->string, "TRUE") == 0) fputs("true", file);
+            else if (strcmp(symbol->string, "FALSE") == 0) fputs("false", file);
+            else json_put_string(file, symbol->string, symbol->length);
+            return 1;
+        }
+        case LISP_TYPED_VECTOR:
+        {
+            fputc('[', file);
+            for (int i = 0; i < lisp_typed_vector_length(x); ++i)
+            {
+                if (i > 0) fputc(',', file);
+                json_put_value(file, tasks, lisp_typed_vector_ref(x, i));
+            }
+            fputc(']', file);
+            return 1;
+        }
+        case LISP_VECTOR:
+        {
+            // the closing text goes with the task
+            const char* close = json_is_object(x) ? "}" : "]";
+            fputc(close[0] == '}' ? '{' : '[', file);
+            print_push(tasks, PRINT_ITEMS, x, 0, close);
+            return 1;
+        }
+        case LISP_PAIR:
+            fputc('[', file);
+            print_push(tasks, PRINT_ITEMS, x, 0, NULL);
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+int lisp_write_json(FILE* file, Lisp l)
+{
+    // nesting is kept on a stack of tasks, as in the printer.
+    Printer tasks;
+    tasks.tasks = tasks.local;
+    tasks.count = 0;
+    tasks.capacity = PRINT_LOCAL_TASKS;
+    print_push(&tasks, PRINT_VALUE, l, 0, NULL);
+
+    int ok = 1;
+    while (ok && tasks.count > 0)
+    {
+        PrintTask task = tasks.tasks[--tasks.count];
+        Lisp x = task.value;
+
+        switch (task.kind)
+        {
+            case PRINT_TEXT:
+                fputs(task.ptr, file);
+                continue;
+            case PRINT_ITEMS:
+                if (lisp_type(x) == LISP_VECTOR)
+                {
+                    const char* close = task.ptr;
+                    if (task.index == lisp_vector_length(x))
+                    {
+                        fputs(close, file);
+                        continue;
+                    }
+                    if (task.index > 0) fputc(',', file);
+
+                    print_push(&tasks, PRINT_ITEMS, x, task.index + 1, close);
+                    x = lisp_vector_ref(x, task.index);
+                    if (close[0] == '}')
+                    {
+                        const Symbol* key = lisp_car(x).val.ptr_val;
+                        json_put_string(file, key->string, key->length);
+                        fputc(':', file);
+                        x = lisp_cdr(x);
+                    }
+                }
+                else
+                {
+                    if (task.index > 0) fputc(',', file);
+
+                    // lists must end with NIL
+                    Lisp rest = lisp_cdr(x);
+                    if (lisp_type(rest) == LISP_PAIR) print_push(&tasks, PRINT_ITEMS, rest, 1, NULL);
+                    else if (lisp_is_null(rest)) print_push(&tasks, PRINT_TEXT, rest, 0, "]");
+                    else ok = 0;
+                    x = lisp_car(x);
+                }
+                break;
+            default:
+                break;
+        }
+
+        ok = ok && json_put_value(file, &tasks, x);
+    }
+
+    if (tasks.tasks != tasks.local) free(tasks.tasks);
+    return ok;
+}
+
+static Lisp eval_r(Lisp x, Lisp env, jmp_buf error_jmp, LispContext ctx)
+{
+    while (1)
+    {
+        assert(!lisp_is_null(env));
+        
+        switch (lisp_type(x))
+        {
+            case LISP_INT:
+            case LISP_FLOAT:
+            case LISP_STRING:
+            case LISP_LAMBDA:
+            case LISP_VECTOR:
+            case LISP_HASH_TABLE:
+            case LISP_TYPED_VECTOR:
+            case LISP_STRING_BUILDER:
+            case LISP_RECORD:
+            case LISP_RECORD_TYPE:
+            case LISP_PMAP:
+            case LISP_PVECTOR:
+            case LISP_PRIORITY_QUEUE:
+            case LISP_DEQUE:
+            case LISP_BITVECTOR:
+            case LISP_NULL: 
+                return x; // atom
+            case LISP_SYMBOL: // variable reference
+            {
+                Lisp pair = lisp_env_lookup(env, x, ctx);
+                
+                if (lisp_is_null(pair))
+                {
+                    fprintf(stderr, "cannot find variable: %s\n", lisp_symbol(x));
+                    longjmp(error_jmp, LISP_ERROR_UNKNOWN_VAR); 
+                    return lisp_make_null();
+                }
+                return lisp_cdr(pair);
+            }
+            case LISP_PAIR:
+            {
+                const char* op_name = NULL;
+                if (lisp_type(lisp_car(x)) == LISP_SYMBOL)
+                    op_name = lisp_symbol(lisp_car(x));
+                
+                if (op_name && strcmp(op_name, "IF") == 0) // if conditional statemetns
+                {
+                    Lisp predicate = lisp_list_ref(x, 1);
+                    Lisp conseq = lisp_list_ref(x, 2);
+                    Lisp alt = lisp_list_ref(x, 3);
+ 
+                    if (lisp_int(eval_r(predicate, env, error_jmp, ctx)) != 0)
+                    {
+                        x = conseq; // while will eval
+                    }
+                    else
+                    {
+                        x = alt; // while will eval
+                    } 
+                }
+                else if (op_name && strcmp(op_name, "BEGIN") == 0)
+                {
+                    Lisp it = lisp_cdr(x);
+                    if (lisp_is_null(it)) return it;
+                    
+                    // eval all but last
+                    while (lisp_is_pair(lisp_cdr(it)))
+                    {
+                        eval_r(lisp_car(it), env, error_jmp, ctx);
+                        it = lisp_cdr(it);
+                    }
+                    
+                    x = lisp_car(it); // while will eval last
+                }
+                else if (op_name && strcmp(op_name, "QUOTE") == 0)
+                {
+                    return lisp_list_ref(x, 1);
+                }
+                else if (op_name && strcmp(op_name, "DEFINE") == 0) // variable definitions
+                {
+                    Lisp symbol = lisp_list_ref(x, 1);
+                    Lisp value = eval_r(lisp_list_ref(x, 2), env, error_jmp, ctx);
+                    lisp_env_define(env, symbol, value, ctx);
+                    return lisp_make_null();
+                }
+                else if (op_name && strcmp(op_name, "SET!") == 0)
+                {
+                    // mutablity
+                    // like def, but requires existence
+                    // and will search up the environment chain
+                    Lisp symbol = lisp_list_ref(x, 1);
+                    lisp_env_set(env, symbol, eval_r(lisp_list_ref(x, 2), env, error_jmp, ctx), ctx);
+                    return lisp_make_null();
+                }
+                else if (op_name && strcmp(op_name, "LAMBDA") == 0) // lambda defintions (compound procedures)
+                {
+                    Lisp args = lisp_list_ref(x, 1);
+                    Lisp body = lisp_list_ref(x, 2);
+                    return lisp_make_lambda(args, body, env, ctx);
+                }
+                else // operator application
+                {
+                    Lisp operator = eval_r(lisp_car(x), env, error_jmp, ctx);
+                    Lisp arg_expr = lisp_cdr(x);
+                    
+                    Lisp args_front = lisp_make_null();
+                    Lisp args_back = lisp_make_null();
+                    
+                    while (lisp_is_pair(arg_expr))
+                    {
+                        Lisp new_arg = eval_r(lisp_car(arg_expr), env, error_jmp, ctx);
+                        back_append(&args_front, &args_back, new_arg, ctx);
+                        arg_expr = lisp_cdr(arg_expr);
+                    }
+                    
+                    switch (lisp_type(operator))
+                    {
+                        case LISP_LAMBDA: // lambda call (compound procedure)
+                        {
+                            const Lambda* lambda = lisp_lambda(operator);
+
+                            // normally we would eval the body here
+                            // but while will eval
+                            x = lambda->body;
+                            
+                            // a new environment with the parameters bound to the arguments
+                            env = lambda_env(lambda, args_front, ctx);
+                            break;
+                        }
+                        case LISP_FUNC: // call into C functions
+                        {
+                            // no environment required
+                            LispFunc func = lisp_func(operator);
+                            LispError e = LISP_ERROR_NONE;
+                            Lisp result = func(args_front, &e, ctx);
+                            if (e != LISP_ERROR_NONE) longjmp(error_jmp, e);
+                            return result;
+                        }
+                        default:
+                            
+                            fprintf(stderr, "apply error: not an operator %s\n", lisp_type_name[operator.type]);
+                            longjmp(error_jmp, LISP_ERROR_BAD_OP);
+                    }
+                }
+                break;
+            }
+            default:
+                longjmp(error_jmp, LISP_ERROR_UNKNOWN_EVAL);
+        }
+    }
+}
+
+Lisp lisp_eval(Lisp l, Lisp env, LispError* out_error, LispContext ctx)
+{
+    jmp_buf error_jmp;
+    LispError error = setjmp(error_jmp);
+
+    if (error == LISP_ERROR_NONE)
+    {
+        Lisp result = eval_r(l, env, error_jmp, ctx);
+
+        if (out_error)
+            *out_error = error;  
+
+        return result; 
+    }
+    else
+    {
+        if (out_error)
+            *out_error = error;
+
+        return lisp_make_null();
+    }
+}
+
+Lisp lisp_eval_global(Lisp expr, LispError* out_error, LispContext ctx)
+{
+    return lisp_eval(expr, lisp_env_global(ctx), out_error, ctx);
+}
+
+static unsigned int table_gc_capacity(unsigned int size, unsigned int capacity)
+{
+    float load_factor = size / (float)capacity;
+
+    if (load_factor > 0.75f || load_factor < 0.1f)
+    {
+        capacity = size * 3;
+        if (capacity > 1) --capacity;
+        if (capacity < 1) capacity = 1;
+    }
+    return capacity;
+}
+
+// moves a block with no special handling,
+// and returns its new address
+static void* gc_move_block(Block* block, Heap* to)
+{
+    if (!(block->gc_flags & GC_MOVED))
+    {
+        // copy the data to new block
+        Block* dest = heap_alloc(block->size, block->type, to);
+        memcpy(dest, block, block->size);
+        dest->gc_flags = GC_CLEAR;
+        
+        // save forwarding address (offset in to)
+        block->forward_address = dest;
+        block->gc_flags = GC_MOVED;
+    }
+    return block->forward_address;
+}
+
+static Lisp gc_move(Lisp l, Heap* to)
+{
+    if ((l.type == LISP_PAIR || l.type == LISP_VECTOR) && is_lazy(l))
+    {
+        // once read, the node is replaced by what it read
+        LazyNode* node = lazy_node(l);
+        if (!(node->block.gc_flags & GC_MOVED) && !lisp_is_null(node->value)) return gc_move(node->value, to);
+
+        Lisp moved = l;
+        moved.val.ptr_val = (char*)gc_move_block(&node->block, to) + LAZY_TAG;
+        return moved;
+    }
+
+    if (l.type == LISP_PAIR && is_compact(l))
+    {
+        // move the whole run, and point at the same slot in it.
+        // (the slot index is still readable after the header is overwritten)
+        CompactSlot* slot = compact_slot(l);
+        CompactList* list = compact_list(slot);
+        if (!(list->block.gc_flags & GC_MOVED))
+        {
+            Block* dest = heap_alloc(list->block.size, list->block.type, to);
+            memcpy(dest, list, list->block.size);
+            dest->gc_flags = GC_CLEAR;
+
+            list->block.forward_address = dest;
+            list->block.gc_flags = GC_MOVED;
+        }
+
+        CompactList* dest_list = (CompactList*)list->block.forward_address;
+        return compact_ref(dest_list->slots + slot->index);
+    }
+
+    switch (l.type)
+    {
+        case LISP_STRING: // views are given their parent at the end of lisp_collect
+        case LISP_PAIR:
+        case LISP_SYMBOL:
+        case LISP_LAMBDA:
+        case LISP_VECTOR:
+        case LISP_HASH_TABLE:
+        case LISP_TYPED_VECTOR: // no pointers to scan
+        case LISP_BITVECTOR: // no pointers to scan
+        case LISP_STRING_BUILDER:
+        case LISP_RECORD:
+        case LISP_RECORD_TYPE:
+        case LISP_PMAP:
+        case LISP_PVECTOR:
+        case LISP_PRIORITY_QUEUE:
+        case LISP_DEQUE:
+        {
+            l.val.ptr_val = gc_move_block(l.val.ptr_val, to);
+            return l;
+        }
+        case LISP_TABLE:
+        {
+            Table* table = l.val.ptr_val;
+            if (!(table->block.gc_flags & GC_MOVED))
+            {
+                unsigned int new_capacity = table_gc_capacity(table->size, table->capacity);
+
+                size_t new_size = sizeof(Table) + new_capacity * sizeof(Lisp);
+                Table* dest_table = heap_alloc(new_size, LISP_TABLE, to);
+                dest_table->size = table->size;
+                dest_table->capacity = new_capacity;
+                
+                // save forwarding address (offset in to)
+                table->block.forward_address = &dest_table->block;
+                table->block.gc_flags = GC_MOVED;
+                
+                // clear the table
+                for (int i = 0; i < new_capacity; ++i)
+                    dest_table->entries[i] = lisp_make_null();
+                
+                if (LISP_DEBUG && new_capacity != table->capacity)
+                {
+                    printf("resizing table %i -> %i\n", table->capacity, new_capacity);
+                }
+                
+                for (unsigned int i = 0; i < table->capacity; ++i)
+                {
+                    Lisp it = table->entries[i];
+                    
+                    while (lisp_is_pair(it))
+                    {
+                        unsigned int new_index = i;
+                        
+                        if (new_capacity != table->capacity)
+                            new_index = key_hash(lisp_car(lisp_car(it))) % new_capacity;
+                        
+                        Lisp pair = gc_move(lisp_car(it), to);
+
+                        // allocate a new pair in the to space
+                        Pair* cons_block = heap_alloc(sizeof(Pair), LISP_PAIR, to);
+                        cons_block->block.gc_flags = GC_VISITED;
+                        
+                        Lisp new_pair;
+                        new_pair.type = cons_block->block.type;
+                        new_pair.val.ptr_val = cons_block;
+    
+                        // (pair, entry)
+                        lisp_set_car(new_pair, pair);
+                        lisp_set_cdr(new_pair, dest_table->entries[new_index]);
+                        dest_table->entries[new_index] = new_pair;
+                        it = lisp_cdr(it);
+                    }
+                }
+            }
+            
+            // return the moved table address
+            l.val.ptr_val = table->block.forward_address;
+            return l;
+        }
+        default:
+            return l;
+    }
+}
+
+static void gc_move_symbol_table(InternTable* table, unsigned int min_capacity, Heap* to)
+{
+    // The symbol table does not keep symbols alive.
+    // After all the reachable objects have been moved, only symbols
+    // which were moved (or are pinned) are kept in the table.
+    // Symbols don't point to anything, so no additional scan is needed.
+    unsigned int size = 0;
+    for (unsigned int i = 0; i < table->capacity; ++i)
+    {
+        const Symbol* symbol = table->slots[i].symbol;
+        if (symbol && ((symbol->block.gc_flags & GC_MOVED) || symbol->pinned)) ++size;
+    }
+
+    InternTable old = *table;
+    intern_table_init(table, size * 2 > min_capacity ? size * 2 : min_capacity);
+
+    if (LISP_DEBUG)
+        printf("symbol table: %u -> %u\n", old.size, size);
+
+    for (unsigned int i = 0; i < old.capacity; ++i)
+    {
+        Symbol* symbol = old.slots[i].symbol;
+        if (!symbol) continue;
+
+        if ((symbol->block.gc_flags & GC_MOVED) || symbol->pinned)
+        {
+            Lisp l;
+            l.type = LISP_SYMBOL;
+            l.val.ptr_val = symbol;
+            l = gc_move(l, to);
+            intern_table_insert(table, l.val.ptr_val);
+        }
+    }
+    free(old.slots);
+}
+
+// a view keeps its parent alive.
+// but when views are all that refer to the parent,
+// slices much shorter than it are copied out, so it can be collected.
+// nothing else can change the parent, so this can't be noticed.
+static void gc_move_views(StringView** views, size_t count, Heap* to)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        StringView* view = views[i];
+        String* parent = view->parent;
+        if (parent->block.gc_flags & GC_MOVED)
+        {
+            view->parent = (String*)parent->block.forward_address;
+        }
+        else if (view->length <= STRING_VIEW_INLINE)
+        {
+            // becomes a string, in the same block
+            unsigned int length = view->length;
+            String* string = (String*)view;
+            memmove(string->string, parent->string + view->offset, length);
+            string->string[length] = '\0';
+            string->block.type = LISP_STRING;
+        }
+        else if (view->length * 4 < parent->length)
+        {
+            String* copy = heap_alloc(sizeof(String) + view->length + 1, LISP_STRING, to);
+            copy->length = view->length;
+            copy->hash = 0;
+            memcpy(copy->string, parent->string + view->offset, view->length);
+            copy->string[view->length] = '\0';
+            view->parent = copy;
+            view->offset = 0;
+        }
+        else
+        {
+            view->parent = gc_move_block(&parent->block, to);
+        }
+    }
+}
+
+Lisp lisp_collect(Lisp root_to_save, LispContext ctx)
+{
+    Heap* to = &ctx.impl->to_heap;
+
+    // move root object
+    // (the symbol table is weak and is moved after everything else)
+    ctx.impl->global_env = gc_move(ctx.impl->global_env, to);
+    
+    Lisp result = gc_move(root_to_save, to);
+
+    StringView** views = NULL;
+    size_t view_count = 0;
+    size_t view_capacity = 0;
+
+    // move references
+    const Page* page = to->first_page;
+    int page_counter = 0;
+    while (page)
+    {
+        size_t offset = 0;
+        while (offset < page->size)
+        {
+            Block* block = (Block*)(page->buffer + offset);
+            if (!(block->gc_flags & GC_VISITED))
+            {
+                switch (block->type)
+                {
+                    // these add to the buffer!
+                    // so lists are handled in a single pass
+                    case LISP_PAIR:
+                    {
+                        // move the CAR and CDR
+                        Pair* pair = (Pair*)block;
+                        pair->car = gc_move(pair->car, to);
+                        pair->cdr = gc_move(pair->cdr, to);
+                        break;
+                    }
+                    case LISP_VECTOR:
+                    {
+                        Vector* vector = (Vector*)block;
+                        Lisp temp;
+                        temp.type = vector->type;
+                        for (int i = 0; i < vector->length; ++i)
+                        {
+                           temp.val = vector->entries[i];
+                           temp = gc_move(temp, to);
+                           vector->entries[i] = temp.val;
+                        }
+                        vector->index = gc_move(vector->index, to);
+                        break;
+                    }
+                    case LISP_HASH_TABLE:
+                    {
+                        HashTable* hash_table = (HashTable*)block;
+                        hash_table->table = gc_move(hash_table->table, to);
+                        hash_table->old = gc_move(hash_table->old, to);
+                        // moving may resize the old table, so its buckets are moved again from the start
+                        hash_table->migrated = 0;
+                        break;
+                    }
+                    case LISP_RECORD:
+                    {
+                        Record* record = (Record*)block;
+                        record->type = gc_move(record->type, to);
+                        for (unsigned int i = 0; i < record->field_count; ++i)
+                            record->fields[i] = gc_move(record->fields[i], to);
+                        break;
+                    }
+                    case LISP_RECORD_TYPE:
+                    {
+                        RecordType* type = (RecordType*)block;
+                        type->name = gc_move(type->name, to);
+                        type->field_names = gc_move(type->field_names, to);
+                        break;
+                    }
+                    case LISP_STRING_BUILDER:
+                    {
+                        StringBuilder* builder = (StringBuilder*)block;
+                        builder->buffer = gc_move(builder->buffer, to);
+                        break;
+                    }
+                    case BLOCK_COMPACT_LIST:
+                    {
+                        CompactList* list = (CompactList*)block;
+                        for (unsigned int i = 0; i < list->length; ++i)
+                        {
+                            CompactSlot* slot = list->slots + i;
+                            Lisp temp;
+                            temp.type = slot->forwarded ? LISP_PAIR : slot->type;
+                            temp.val = slot->car;
+                            slot->car = gc_move(temp, to).val;
+                        }
+                        list->tail = gc_move(list->tail, to);
+                        break;
+                    }
+                    case LISP_PMAP:
+                    {
+                        PMap* map = (PMap*)block;
+                        if (map->root) map->root = gc_move_block(&map->root->block, to);
+                        break;
+                    }
+                    case BLOCK_HAMT_NODE:
+                    case BLOCK_HAMT_COLLISION:
+                    {
+                        HamtNode* node = (HamtNode*)block;
+                        unsigned int pairs = hamt_pair_count(node);
+                        for (unsigned int i = 0; i < pairs * 2; ++i)
+                            node->entries[i] = gc_move(node->entries[i], to);
+
+                        unsigned int children = hamt_child_count(node);
+                        HamtNode** child = hamt_children(node);
+                        for (unsigned int i = 0; i < children; ++i)
+                            child[i] = gc_move_block(&child[i]->block, to);
+                        break;
+                    }
+                    case LISP_PVECTOR:
+                    {
+                        PVector* vector = (PVector*)block;
+                        vector->root = gc_move_block(&vector->root->block, to);
+                        vector->tail = gc_move_block(&vector->tail->block, to);
+                        break;
+                    }
+                    case BLOCK_TRIE_BRANCH:
+                    {
+                        TrieBranch* branch = (TrieBranch*)block;
+                        for (int i = 0; i < TRIE_WIDTH; ++i)
+                        {
+                            if (branch->children[i])
+                                branch->children[i] = gc_move_block(branch->children[i], to);
+                        }
+                        break;
+                    }
+                    case BLOCK_TRIE_LEAF:
+                    {
+                        TrieLeaf* leaf = (TrieLeaf*)block;
+                        for (int i = 0; i < TRIE_WIDTH; ++i)
+                            leaf->values[i] = gc_move(leaf->values[i], to);
+                        break;
+                    }
+                    case LISP_PRIORITY_QUEUE:
+                    {
+                        PriorityQueue* queue = (PriorityQueue*)block;
+                        queue->compare = gc_move(queue->compare, to);
+                        queue->slots = gc_move_block(&queue->slots->block, to);
+                        break;
+                    }
+                    case LISP_DEQUE:
+                    {
+                        Deque* deque = (Deque*)block;
+                        deque->slots = gc_move_block(&deque->slots->block, to);
+                        break;
+                    }
+                    case BLOCK_SLOTS:
+                    {
+                        Slots* slots = (Slots*)block;
+                        for (unsigned int i = 0; i < slots->capacity; ++i)
+                            slots->entries[i] = gc_move(slots->entries[i], to);
+                        break;
+                    }
+                    case BLOCK_LAZY:
+                    {
+                        LazyNode* node = (LazyNode*)block;
+                        node->tape->marked = 1;
+                        break;
+                    }
+                    case BLOCK_STRING_VIEW:
+                    {
+                        // the parent is only known to be needed once everything else is moved
+                        if (view_count == view_capacity)
+                        {
+                            view_capacity = view_capacity ? view_capacity * 2 : 64;
+                            views = realloc(views, sizeof(StringView*) * view_capacity);
+                        }
+                        views[view_count++] = (StringView*)block;
+                        break;
+                    }
+                    case LISP_LAMBDA:
+                    {
+                        // move the body and args
+                        Lambda* lambda = (Lambda*)block;
+                        lambda->args = gc_move(lambda->args, to);
+                        lambda->body = gc_move(lambda->body, to);
+                        lambda->env = gc_move(lambda->env, to);
+                        break;
+                    }
+                    default: break;
+                }
+                block->gc_flags |= GC_VISITED;
+            }
+            offset += block->size;
+        }
+        page = page->next;
+        ++page_counter;
+    }
+    // check that we visited all the pages
+    assert(page_counter == to->page_count);
+
+    gc_move_views(views, view_count, to);
+    free(views);
+
+    gc_move_symbol_table(&ctx.impl->symbol_table, ctx.impl->symbol_table_size, to);
+    lazy_sweep(ctx);
+    
+    if (LISP_DEBUG)
+    {
+        // DEBUG, check offsets
+        const Page* page = to->first_page;
+        while (page)
+        {
+            size_t offset = 0;
+            while (offset < page->size)
+            {
+                Block* block = (Block*)(page->buffer + offset);
+                offset += block->size;
+            }
+            assert(offset == page->size);
+            page = page->next;
+        }
+    }
+
+    size_t diff = ctx.impl->heap.size - ctx.impl->to_heap.size;
+
+    // swap the heaps
+    Heap temp = ctx.impl->heap;
+    ctx.impl->heap = ctx.impl->to_heap;
+    ctx.impl->to_heap = temp;
+    
+    // reset the heap
+    heap_shutdown(&ctx.impl->to_heap);
+    heap_init(&ctx.impl->to_heap, ctx.impl->heap.page_size);
+
+    if (LISP_DEBUG)
+        printf("gc collected: %lu heap: %lu\n", diff, ctx.impl->heap.size);
+
+    return result;
+}
+
+size_t lisp_heap_size(LispContext ctx)
+{
+    return ctx.impl->heap.size;
+}
+
+Lisp lisp_env_global(LispContext ctx)
+{
+    return ctx.impl->global_env;
+}
+
+void lisp_shutdown(LispContext ctx)
+{
+    heap_shutdown(&ctx.impl->heap);
+    heap_shutdown(&ctx.impl->to_heap);
+    free(ctx.impl->symbol_table.slots);
+    while (ctx.impl->lazy_tapes)
+    {
+        LazyTape* tape = ctx.impl->lazy_tapes;
+        ctx.impl->lazy_tapes = tape->next;
+        lazy_tape_free(tape);
+    }
+    free(ctx.impl);
+}
+
+const char* lisp_error_string(LispError error)
+{
+    switch (error)
+    {
+        case LISP_ERROR_NONE:
+            return "none";
+        case LISP_ERROR_FILE_OPEN:
+            return "file error: could not open file";
+        case LISP_ERROR_PAREN_UNEXPECTED:
+            return "syntax error: unexpected ) paren";
+        case LISP_ERROR_PAREN_EXPECTED:
+            return "syntax error: expected ) paren";
+        case LISP_ERROR_DOT_UNEXPECTED:
+            return "syntax error: dot . was unexpected";
+        case LISP_ERROR_BAD_TOKEN:
+            return "syntax error: bad token";
+        case LISP_ERROR_BAD_DEFINE:
+            return "expand error: bad define (define var x)";
+        case LISP_ERROR_BAD_SET:
+            return "expand error: bad set (set! var x)";
+        case LISP_ERROR_BAD_COND:
+            return "expand error: bad cond";
+        case LISP_ERROR_BAD_AND:
+            return "expand error: bad and (and a b)";
+        case LISP_ERROR_BAD_OR:
+            return "expand error: bad or (or a b)";
+        case LISP_ERROR_BAD_LET:
+            return "expand error: bad let";
+        case LISP_ERROR_BAD_LAMBDA:
+            return "expand error: bad lambda";
+        case LISP_ERROR_BAD_RECORD:
+            return "expand error: bad record (define-record name field0 ... fieldN)";
+        case LISP_ERROR_UNKNOWN_VAR:
+            return "eval error: unknown variable";
+        case LISP_ERROR_BAD_OP:
+            return "eval error: application was not an operator";
+        case LISP_ERROR_UNKNOWN_EVAL:
+            return "eval error: got into a bad state";
+        case LISP_ERROR_BAD_ARG:
+            return "eval error: bad argument type";
+        case LISP_ERROR_OUT_OF_BOUNDS:
+            return "eval error: index out of bounds";
+        default:
+            return "unknown error code";
+    }
+}
+
+static Lisp func_cons(Lisp args, LispError* e, LispContext ctx)
+{
+    return lisp_cons(lisp_car(args), lisp_car(lisp_cdr(args)), ctx);
+}
+
+static Lisp func_car(Lisp args, LispError* e, LispContext ctx)
+{
+    return lisp_car(lisp_car(args));
+}
+
+static Lisp func_cdr(Lisp args, LispError* e, LispContext ctx)
+{
+    return lisp_cdr(lisp_car(args));
+}
+
+static Lisp func_nav(Lisp args, LispError* e, LispContext ctx)
+{
+    Lisp path = lisp_car(args);
+    Lisp l = lisp_car(lisp_cdr(args));
+
+    return lisp_list_nav(l, lisp_string(string_terminated(path, ctx)));
+}
+
+static Lisp func_eq(Lisp args, LispError* e, LispContext ctx)
+{
+    Lisp a = lisp_car(args);
+    Lisp b = lisp_car(lisp_cdr(args));
+    return lisp_make_int(lisp_eq(a, b));
+}
+
+static Lisp func_equal(Lisp args, LispError* e, LispContext ctx)
+{
+    Lisp a = lisp_car(args);
+    Lisp b = lisp_car(lisp_cdr(args));
+    return lisp_make_int(lisp_equal(a, b));
+}
+
+static Lisp func_is_null(Lisp args, LispError* e, LispContext ctx)
+{
+    while (!lisp_is_null(args))
+    {
+        if (!lisp_is_null(lisp_car(args))) return lisp_make_int(0);
+        args = lisp_cdr(args);
+    }
+    return lisp_make_int(1);
+}
+
+static Lisp func_is_pair(Lisp args, LispError* e, LispContext ctx)
+{
+    while (lisp_is_pair(args))
+    {
+        if (!lisp_is_pair(lisp_car(args))) return lisp_make_int(0);
+        args = lisp_cdr(args);
+    }
+    return lisp_make_int(1);
+}
+
+static Lisp func_display(Lisp args, LispError* e, LispContext ctx)
+{
+    Lisp l = lisp_car(args);
+    if (lisp_type(l) == LISP_STRING)
+    {
+        fwrite(lisp_string(l), 1, lisp_string_length(l), stdout);
+    }
+    else
+    {
+        lisp_print(l); 
+    }
+    return lisp_make_null();
+}
+
+static Lisp func_newline(Lisp args, LispError* e, LispContext ctx)
+{
+    printf("\n"); return lisp_make_null();
+}
+
+static Lisp func_assert(Lisp args, LispError* e, LispContext ctx)
+{
+   if (lisp_int(lisp_car(args)) != 1)
+   {
+       fprintf(stderr, "assertion: ");
+       lisp_printf(stderr, lisp_car(lisp_cdr(args)));
+       fprintf(stderr, "\n");
+       assert(0);
+   }
+
+   return lisp_make_null();
+}
+
+static Lisp func_equals(Lisp args, LispError* e, LispContext ctx)
+{
+    Lisp to_check  = lisp_car(args);
+    if (lisp_is_null(to_check)) return lisp_make_int(1);
+    
+    args = lisp_cdr(args);
+    while (lisp_is_pair(args))
+    {
+        if (lisp_int(lisp_car(args)) != lisp_int(to_check)) return lisp_make_int(0);
+        args = lisp_cdr(args);
+    }
+    
+    return lisp_make_int(1);
+}
+
+static Lisp func_list(Lisp args, LispError* e, LispContext ctx) { return args; }
+
+static Lisp func_append(Lisp args, LispError* e, LispContext ctx)
+{
+    Lisp l = lisp_car(args);
+
+    if (lisp_type(l) != LISP_PAIR)
+    {
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
+    }
+    args = lisp_cdr(args);
+    while (lisp_is_pair(args))
+    {
+        l = lisp_list_append(l, lisp_car(args), ctx);
+        args = lisp_cdr(args);
+    }
+
+    return l;
+}
+
+static Lisp func_map(Lisp args, LispError* e, LispContext ctx)
+{
+    Lisp op = lisp_car(args);
+
+    if (lisp_type(op) != LISP_FUNC && lisp_type(op) != LISP_LAMBDA)
+    {
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
+    }
+
+    // multiple lists can be passed in
+    Lisp lists = lisp_cdr(args);      
+    int n = lisp_list_length(lists);
+    if (n == 0) return lisp_make_null();
+
+    Lisp result_lists = lisp_make_list(lisp_make_null(), n, ctx);
+    Lisp result_it = result_lists;
+
+    while (lisp_is_pair(lists))
+    {        
+        // advance all the lists
+        Lisp it = lisp_car(lists);
+
+        // results are stored in a compact list
+        Lisp front = lisp_make_list(lisp_make_null(), lisp_list_length(it), ctx);
+        Lisp back = front;
+
+        while (lisp_is_pair(it))
+        { 
+            Lisp expr = lisp_cons(op, lisp_cons(lisp_car(it), lisp_make_null(), ctx), ctx);
+            Lisp result = lisp_eval(expr, lisp_env_global(ctx), NULL, ctx);
+            lisp_set_car(back, result);
+            back = lisp_cdr(back);
+            it = lisp_cdr(it);
+        } 
+
+        lisp_set_car(result_it, front);
+        lists = lisp_cdr(lists);
+        result_it = lisp_cdr(result_it);
+    }
+
+    if (n == 1)
+    {
+        return lisp_car(result_lists);
+    }
+    else
+    {
+        return result_lists;
+    }
+}
+
+static Lisp func_list_ref(Lisp args, LispError* e, LispContext ctx)
+{
+    Lisp index = lisp_car(args);
+    Lisp list = lisp_car(lisp_cdr(args));
+    return lisp_list_ref(list, lisp_int(index));
+}
+
+static Lisp func_length(Lisp args, LispError* e, LispContext ctx)
+{
+    return lisp_make_int(lisp_list_length(lisp_car(args)));
+}
+
+static Lisp func_reverse_inplace(Lisp args, LispError* e, LispContext ctx)
+{
+    return lisp_list_reverse(lisp_car(args));
+}
+
+static Lisp func_assoc(Lisp args, LispError* e, LispContext ctx)
+{
+    Lisp key = lisp_car(args);
+    Lisp l = lisp_car(lisp_cdr(args)); 
+    return lisp_list_assoc(l, key);
+}
+
+static Lisp func_add(Lisp args, LispError* e, LispContext ctx)
+{
+    Lisp accum = lisp_car(args);
+    args = lisp_cdr(args);
+
+    while (lisp_is_pair(args))
+    {
+        if (lisp_type(accum) == LISP_INT)
+        {
+            accum.val.int_val += lisp_int(lisp_car(args));
+        }
+        else if (lisp_type(accum) == LISP_FLOAT)
+        {
+            accum.val.float_val += lisp_float(lisp_car(args));
+        }
+        args = lisp_cdr(args);
+    }
+    return accum;
+}
+
+static Lisp func_sub(Lisp args, LispError* e, LispContext ctx)
+{
+    Lisp accum = lisp_car(args);
+    args = lisp_cdr(args);
+
+    while (lisp_is_pair(args))
+    {
+        if (lisp_type(accum) == LISP_INT)
+        {
+            accum.val.int_val -= lisp_int(lisp_car(args));
+        }
+        else if (lisp_type(accum) == LISP_FLOAT)
+        {
+            accum.val.float_val -= lisp_float(lisp_car(args));
+        }
+        else
+        {
+            *e = LISP_ERROR_BAD_ARG;
+            return lisp_make_null();
+        }
+        args = lisp_cdr(args);
+    }
+    return accum;
+}
+
+static Lisp func_mult(Lisp args, LispError* e, LispContext ctx)
+{
+    Lisp accum = lisp_car(args);
+    args = lisp_cdr(args);
+
+    while (lisp_is_pair(args))
+    {
+        if (lisp_type(accum) == LISP_INT)
+        {
+            accum.val.int_val *= lisp_int(lisp_car(args));
+        }
+        else if (lisp_type(accum) == LISP_FLOAT)
+        {
+            accum.val.float_val *= lisp_float(lisp_car(args));
+        }
+        else
+        {
+            *e = LISP_ERROR_BAD_ARG;
+            return lisp_make_null();
+        } 
+        args = lisp_cdr(args);
+    }
+    return accum;
+}
+
+static Lisp func_divide(Lisp args, LispError* e, LispContext ctx)
+{
+    Lisp accum = lisp_car(args);
+    args = lisp_cdr(args);
+
+    while (lisp_is_pair(args))
+    {
+        if (lisp_type(accum) == LISP_INT)
+        {
+            accum.val.int_val /= lisp_int(lisp_car(args));
+        }
+        else if (lisp_type(accum) == LISP_FLOAT)
+        {
+            accum.val.float_val /= lisp_float(lisp_car(args));
+        }
+        else
+        {
+            *e = LISP_ERROR_BAD_ARG;
+            return lisp_make_null();
+        } 
+        args = lisp_cdr(args);
+    }
+    return accum;
+}
+
+static Lisp func_less(Lisp args, LispError* e, LispContext ctx)
+{
+    Lisp accum = lisp_car(args);
+    args = lisp_cdr(args);
+    int result = 0;
+
+    if (lisp_type(accum) == LISP_INT)
+    {
+        result = lisp_int(accum) < lisp_int(lisp_car(args));
+    }
+    else if (lisp_type(accum) == LISP_FLOAT)
+    {
+        result = lisp_float(accum) < lisp_float(lisp_car(args));
+    }
+    else
+    {
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
+    } 
+    return lisp_make_int(result);
+}
+
+static Lisp func_greater(Lisp args, LispError* e, LispContext ctx)
+{
+    Lisp accum = lisp_car(args);
+    args = lisp_cdr(args);
+    int result = 0;
+
+    if (lisp_type(accum) == LISP_INT)
+    {
+        result = lisp_int(accum) > lisp_int(lisp_car(args));
+    }
+    else if (lisp_type(accum) == LISP_FLOAT)
+    {
+        result = lisp_float(accum) > lisp_float(lisp_car(args));
+    }
+    else
+    {
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
+    } 
+    return lisp_make_int(result);
+}
+
+static Lisp func_less_equal(Lisp args, LispError* e, LispContext ctx)
+{
+    // a <= b = !(a > b)
+    Lisp l = func_greater(args, e, ctx);
+    return  lisp_make_int(!lisp_int(l));
+}
+
+static Lisp func_greater_equal(Lisp args, LispError* e, LispContext ctx)
+{
+    // a >= b = !(a < b)
+    Lisp l = func_less(args, e, ctx);
+    return  lisp_make_int(!lisp_int(l));
+}
+
+static Lisp func_to_int(Lisp args, LispError* e, LispContext ctx)
+{
+    Lisp val = lisp_car(args);
+    switch (lisp_type(val))
+    {
+        case LISP_INT:
+            return val;
+        case LISP_FLOAT:
+            return lisp_make_int(lisp_int(val));
+        case LISP_STRING:
+            return lisp_make_int(atoi(lisp_string(string_terminated(val, ctx))));
+        default:
+            *e = LISP_ERROR_BAD_ARG;
+            return lisp_make_null();
+    }
+}
+
+static Lisp func_to_float(Lisp args, LispError* e, LispContext ctx)
+{
+    Lisp val = lisp_car(args);
+    switch (lisp_type(val))
+    {
+        case LISP_FLOAT:
+            return val;
+        case LISP_INT:
+            return lisp_make_float(lisp_float(val));
+        case LISP_STRING:
+            return lisp_make_float(atof(lisp_string(string_terminated(val, ctx))));
+        default:
+            *e = LISP_ERROR_BAD_ARG;
+            return lisp_make_null();
+    }
+}
+
+static Lisp func_to_string(Lisp args, LispError* e, LispContext ctx)
+{
+    char scratch[SCRATCH_MAX];
+    Lisp val = lisp_car(args);
+    switch (lisp_type(val))
+    {
+        case LISP_FLOAT:
+            snprintf(scratch, SCRATCH_MAX, "%f", lisp_float(val));
+            return lisp_make_string(scratch, ctx);
+        case LISP_INT:
+            snprintf(scratch, SCRATCH_MAX, "%i", lisp_int(val));
+            return lisp_make_string(scratch, ctx);
+        case LISP_SYMBOL:
+            return lisp_make_string(lisp_symbol(val), ctx);
+        case LISP_STRING:
+            return val;
+        default:
+            *e = LISP_ERROR_BAD_ARG;
+            return lisp_make_null();
+    }
+}
+
+static Lisp func_to_symbol(Lisp args, LispError* e, LispContext ctx)
+{
+    Lisp val = lisp_car(args);
+    switch (lisp_type(val))
+    {
+        case LISP_SYMBOL:
+            return val;
+        case LISP_STRING:
+            return lisp_make_symbol(lisp_string(string_terminated(val, ctx)), ctx);
+        default:
+            *e = LISP_ERROR_BAD_ARG;
+            return lisp_make_null();
+    }
+}
+
+static Lisp func_is_string(Lisp args, LispError* e, LispContext ctx)
+{
+    while (lisp_is_pair(args))
+    {
+        if (lisp_type(lisp_car(args)) != LISP_STRING) return lisp_make_int(0);
+        args = lisp_cdr(args);
+    }
+    return lisp_make_int(1);
+}
+
+static Lisp func_string_copy(Lisp args, LispError* e, LispContext ctx)
+{
+    Lisp val = lisp_car(args);
+    if (lisp_type(val) != LISP_STRING)
+    {
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
+    }
+     return lisp_make_string_n(lisp_string(val), lisp_string_length(val), ctx);
+}
+
+static Lisp func_string_length(Lisp args, LispError* e, LispContext ctx)
+{
+    Lisp x = lisp_car(args);
+    if (lisp_type(x) != LISP_STRING)
+    {
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
+    }
+
+    return lisp_make_int(lisp_string_length(x));
+}
+
+static Lisp func_string_ref(Lisp args, LispError* e, LispContext ctx)
+{
+    Lisp str = lisp_car(args);
+    Lisp index = lisp_car(lisp_cdr(args));
+    if (lisp_type(str) != LISP_STRING || lisp_type(index) != LISP_INT)
+    {
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
+    }
+
+    if (lisp_int(index) < 0 || lisp_int(index) >= lisp_string_length(str))
+    {
+        *e = LISP_ERROR_OUT_OF_BOUNDS;
+        return lisp_make_null();
+    }
+
+    return lisp_make_int((int)lisp_string_ref(str, lisp_int(index)));
+}
+
+static Lisp func_string_set(Lisp args, LispError* e, LispContext ctx)
+{
+    Lisp str = lisp_list_ref(args, 0);
+    Lisp index = lisp_list_ref(args, 1);
+    Lisp val = lisp_list_ref(args, 2);
+    if (lisp_type(str) != LISP_STRING || lisp_type(index) != LISP_INT || lisp_string_is_view(str))
+    {
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
+    }
+
+    if (lisp_int(index) < 0 || lisp_int(index) >= lisp_string_length(str))
+    {
+        *e = LISP_ERROR_OUT_OF_BOUNDS;
+        return lisp_make_null();
+    }
+
+    lisp_string_set(str, lisp_int(index), (char)lisp_int(val));
+    return lisp_make_null();
+}
+
+static Lisp func_substring(Lisp args, LispError* e, LispContext ctx)
+{
+    // (substring s start [end])
+    Lisp str = lisp_list_ref(args, 0);
+    Lisp start = lisp_list_ref(args, 1);
+    Lisp end = lisp_list_ref(args, 2);
+    if (lisp_type(str) != LISP_STRING || lisp_type(start) != LISP_INT ||
+        (!lisp_is_null(end) && lisp_type(end) != LISP_INT))
+    {
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
+    }
+
+    int length = lisp_string_length(str);
+    int a = lisp_int(start);
+    int b = lisp_is_null(end) ? length : lisp_int(end);
+    if (a < 0 || a > b || b > length)
+    {
+        *e = LISP_ERROR_OUT_OF_BOUNDS;
+        return lisp_make_null();
+    }
+    return lisp_substring(str, a, b, ctx);
+}
+
+static Lisp func_string_equal(Lisp args, LispError* e, LispContext ctx)
+{
+    Lisp to_check = lisp_car(args);
+    if (lisp_type(to_check) != LISP_STRING)
+    {
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
+    }
+
+    args = lisp_cdr(args);
+    while (lisp_is_pair(args))
+    {
+        Lisp x = lisp_car(args);
+        if (lisp_type(x) != LISP_STRING)
+        {
+            *e = LISP_ERROR_BAD_ARG;
+            return lisp_make_null();
+        }
+        if (!lisp_string_equal(x, to_check)) return lisp_make_int(0);
+        args = lisp_cdr(args);
+    }
+    return lisp_make_int(1);
+}
+
+static Lisp func_make_string_builder(Lisp args, LispError* e, LispContext ctx)
+{
+    Lisp capacity = lisp_list_ref(args, 0);
+    if (!lisp_is_null(capacity) && (lisp_type(capacity) != LISP_INT || lisp_int(capacity) < 0))
+    {
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
+    }
+    return lisp_make_string_builder(lisp_is_null(capacity) ? 0 : lisp_int(capacity), ctx);
+}
+
+static Lisp func_is_string_builder(Lisp args, LispError* e, LispContext ctx)
+{
+    while (lisp_is_pair(args))
+    {
+        if (lisp_type(lisp_car(args)) != LISP_STRING_BUILDER) return lisp_make_int(0);
+        args = lisp_cdr(args);
+    }
+    return lisp_make_int(1);
+}
+
+static Lisp func_sb_append(Lisp args, LispError* e, LispContext ctx)
+{
+    // (sb-append! sb "text" 'symbol 1 2.0 ...)
+    Lisp sb = lisp_car(args);
+    if (lisp_type(sb) != LISP_STRING_BUILDER)
+    {
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
+    }
+
+    char scratch[SCRATCH_MAX];
+    args = lisp_cdr(args);
+    while (lisp_is_pair(args))
+    {
+        Lisp x = lisp_car(args);
+        switch (lisp_type(x))
+        {
+            case LISP_STRING:
+                lisp_string_builder_append(sb, lisp_string(x), lisp_string_length(x), ctx);
+                break;
+            case LISP_SYMBOL:
+                lisp_string_builder_append(sb, lisp_symbol(x), (unsigned int)strlen(lisp_symbol(x)), ctx);
+                break;
+            case LISP_INT:
+            case LISP_FLOAT:
+            {
+                int n = lisp_type(x) == LISP_INT ?
+                    snprintf(scratch, SCRATCH_MAX, "%i", lisp_int(x)) :
+                    snprintf(scratch, SCRATCH_MAX, "%f", lisp_float(x));
+                lisp_string_builder_append(sb, scratch, (unsigned int)n, ctx);
+                break;
+            }
+            default:
+                *e = LISP_ERROR_BAD_ARG;
+                return lisp_make_null();
+        }
+        args = lisp_cdr(args);
+    }
+    return lisp_make_null();
+}
+
+static Lisp func_sb_to_string(Lisp args, LispError* e, LispContext ctx)
+{
+    Lisp sb = lisp_car(args);
+    if (lisp_type(sb) != LISP_STRING_BUILDER)
+    {
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
+    }
+    return lisp_string_builder_to_string(sb, ctx);
+}
+
+static Lisp func_sb_length(Lisp args, LispError* e, LispContext ctx)
+{
+    Lisp sb = lisp_car(args);
+    if (lisp_type(sb) != LISP_STRING_BUILDER)
+    {
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
+    }
+    return lisp_make_int(lisp_string_builder_length(sb));
+}
+
+static Lisp func_is_int(Lisp args, LispError* e, LispContext ctx)
+{
+    while (lisp_is_pair(args))
+    {
+        if (lisp_type(lisp_car(args)) != LISP_INT) return lisp_make_int(0);
+        args = lisp_cdr(args);
+    }
+    return lisp_make_int(1);
+}
+
+static Lisp func_is_float(Lisp args, LispError* e, LispContext ctx)
+{
+    while (lisp_is_pair(args))
+    {
+        if (lisp_type(lisp_car(args)) != LISP_FLOAT) return lisp_make_int(0);
+        args = lisp_cdr(args);
+    }
+    return lisp_make_int(1);
+}
+
+static Lisp func_even(Lisp args, LispError* e, LispContext ctx)
+{
+    while (!lisp_is_null(args))
+    {
+        if ((lisp_int(lisp_car(args)) & 1) == 1) return lisp_make_int(0);
+        args = lisp_cdr(args);
+    }
+    return lisp_make_int(1);
+}
+
+static Lisp func_odd(Lisp args, LispError* e, LispContext ctx)
+{
+    while (lisp_is_pair(args))
+    {
+        if ((lisp_int(lisp_car(args)) & 1) == 0) return lisp_make_int(0);
+        args = lisp_cdr(args);
+    }
+    return lisp_make_int(1);
+}
+
+static Lisp func_sin(Lisp args, LispError* e, LispContext ctx)
+{
+    float x = sinf(lisp_float(lisp_car(args)));
+    return lisp_make_float(x);
+}
+
+static Lisp func_cos(Lisp args, LispError* e, LispContext ctx)
+{
+    float x = cosf(lisp_float(lisp_car(args)));
+    return lisp_make_float(x);
+}
+
+static Lisp func_tan(Lisp args, LispError* e, LispContext ctx)
+{
+    float x = tanf(lisp_float(lisp_car(args)));
+    return lisp_make_float(x);
+}
+
+static Lisp func_sqrt(Lisp args, LispError* e, LispContext ctx)
+{
+    float x = sqrtf(lisp_float(lisp_car(args)));
+    return lisp_make_float(x);
+}
+
+static Lisp func_make_vector(Lisp args, LispError* e, LispContext ctx)
+{
+    Lisp length = lisp_car(args);
+    Lisp val = lisp_car(lisp_cdr(args));
+
+    if (lisp_type(length) != LISP_INT)
+    {
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
+    }
+
+    return lisp_make_vector(lisp_int(length), val, ctx);
+}
+
+static Lisp func_vector_grow(Lisp args, LispError* e, LispContext ctx)
+{
+    Lisp v = lisp_car(args);
+    Lisp length = lisp_car(lisp_cdr(args));
+
+    if (lisp_type(length) != LISP_INT || lisp_type(v) != LISP_VECTOR)
+    {
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
+    }
+
+    if (lisp_int(length) < lisp_vector_length(v))
+    {
+        *e = LISP_ERROR_OUT_OF_BOUNDS;
+        return lisp_make_null();
+    }
+
+    return lisp_vector_grow(v, lisp_int(length), ctx);
+}
+
+static int is_any_vector(Lisp v)
+{
+    return lisp_type(v) == LISP_VECTOR || lisp_type(v) == LISP_TYPED_VECTOR;
+}
+
+static int any_vector_length(Lisp v)
+{
+    if (lisp_type(v) == LISP_TYPED_VECTOR) return lisp_typed_vector_length(v);
+    return lisp_vector_length(v);
+}
+
+static Lisp func_vector_length(Lisp args, LispError* e, LispContext ctx)
+{
+    Lisp v = lisp_car(args);
+    if (!is_any_vector(v))
+    {
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
+    }
+
+    return lisp_make_int(any_vector_length(v));
+}
+
+static Lisp func_vector_ref(Lisp args, LispError* e, LispContext ctx)
+{
+    Lisp v = lisp_car(args);
+    Lisp i = lisp_car(lisp_cdr(args));
+
+    if (!is_any_vector(v) || lisp_type(i) != LISP_INT)
+    {
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
+    }
+
+    if (lisp_int(i) < 0 || lisp_int(i) >= any_vector_length(v))
+    {
+        *e = LISP_ERROR_OUT_OF_BOUNDS;
+        return lisp_make_null();
+    }
+
+    if (lisp_type(v) == LISP_TYPED_VECTOR) return lisp_typed_vector_ref(v, lisp_int(i));
+    return lisp_vector_ref(v, lisp_int(i));
+}
+
+static Lisp func_vector_set(Lisp args, LispError* e, LispContext ctx)
+{
+    Lisp v = lisp_list_ref(args, 0);
+    Lisp i = lisp_list_ref(args, 1);
+    Lisp x = lisp_list_ref(args, 2);
+
+    if (!is_any_vector(v) || lisp_type(i) != LISP_INT)
+    {
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
+    }
+
+    if (lisp_int(i) < 0 || lisp_int(i) >= any_vector_length(v))
+    {
+        *e = LISP_ERROR_OUT_OF_BOUNDS;
+        return lisp_make_null();
+    }
+
+    if (lisp_type(v) == LISP_TYPED_VECTOR)
+    {
+        if (!typed_vector_accepts(lisp_typed_vector_kind(v), x))
+        {
+            *e = LISP_ERROR_BAD_ARG;
+            return lisp_make_null();
+        }
+
+        lisp_typed_vector_set(v, lisp_int(i), x);
+    }
+    else
+    {
+        lisp_vector_set(v, lisp_int(i), x);
+    }
+    return lisp_make_null();
+}
+
+static Lisp make_typed_vector(LispTypedKind kind, Lisp args, LispError* e, LispContext ctx)
+{
+    // (make-xxxvector n fill)
+    Lisp length = lisp_list_ref(args, 0);
+    Lisp fill = lisp_list_ref(args, 1);
+
+    if (lisp_type(length) != LISP_INT || lisp_int(length) < 0 ||
+        (!lisp_is_null(fill) && !typed_vector_accepts(kind, fill)))
+    {
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
+    }
+
+    Lisp v = lisp_make_typed_vector(kind, lisp_int(length), ctx);
+    if (!lisp_is_null(fill))
+    {
+        for (int i = 0; i < lisp_int(length); ++i)
+            lisp_typed_vector_set(v, i, fill);
+    }
+    return v;
+}
+
+static Lisp typed_vector_from_list(LispTypedKind kind, Lisp args, LispError* e, LispContext ctx)
+{
+    // (xxxvector a b c ...)
+    Lisp v = lisp_make_typed_vector(kind, lisp_list_length(args), ctx);
+    int i = 0;
+    while (lisp_is_pair(args))
+    {
+        Lisp x = lisp_car(args);
+        if (!typed_vector_accepts(kind, x))
+        {
+            *e = LISP_ERROR_BAD_ARG;
+            return lisp_make_null();
+        }
+        lisp_typed_vector_set(v, i++, x);
+        args = lisp_cdr(args);
+    }
+    return v;
+}
+
+static Lisp func_make_f32vector(Lisp args, LispError* e, LispContext ctx)
+{
+    return make_typed_vector(LISP_TYPED_F32, args, e, ctx);
+}
+
+static Lisp func_make_i32vector(Lisp args, LispError* e, LispContext ctx)
+{
+    return make_typed_vector(LISP_TYPED_I32, args, e, ctx);
+}
+
+static Lisp func_make_bytevector(Lisp args, LispError* e, LispContext ctx)
+{
+    return make_typed_vector(LISP_TYPED_U8, args, e, ctx);
+}
+
+static Lisp func_f32vector(Lisp args, LispError* e, LispContext ctx)
+{
+    return typed_vector_from_list(LISP_TYPED_F32, args, e, ctx);
+}
+
+static Lisp func_i32vector(Lisp args, LispError* e, LispContext ctx)
+{
+    return typed_vector_from_list(LISP_TYPED_I32, args, e, ctx);
+}
+
+static Lisp func_bytevector(Lisp args, LispError* e, LispContext ctx)
+{
+    return typed_vector_from_list(LISP_TYPED_U8, args, e, ctx);
+}
+
+static Lisp func_is_typed_vector(Lisp args, LispError* e, LispContext ctx)
+{
+    while (lisp_is_pair(args))
+    {
+        if (lisp_type(lisp_car(args)) != LISP_TYPED_VECTOR) return lisp_make_int(0);
+        args = lisp_cdr(args);
+    }
+    return lisp_make_int(1);
+}
+
+static Lisp func_vector_assoc(Lisp args, LispError* e, LispContext ctx)
+{
+    Lisp key = lisp_car(args);
+    Lisp v = lisp_car(lisp_cdr(args));
+    return lisp_vector_assoc(v, key); 
+}
+
+// KERNELS
+// -----------------------------------------
+// Kernels over packed float and int arrays, bytes of strings, words of bitvectors,
+// and classes of lexer input.
+// On x86-64 the SSE2 or AVX2 versions are chosen at runtime using CPUID.
+// Other platforms use the scalar versions.
+// (float sums are reassociated, so results may differ in the last bits)
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define LISP_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+typedef enum
+{
+    COMPARE_LESS = 0,
+    COMPARE_GREATER,
+    COMPARE_EQUAL,
+    COMPARE_LESS_EQUAL,
+    COMPARE_GREATER_EQUAL,
+} CompareOp;
+
+typedef enum
+{
+    LOGIC_AND = 0,
+    LOGIC_OR,
+    LOGIC_XOR,
+    LOGIC_NOT, // of a, b is unused
+} LogicOp;
+
+typedef struct
+{
+    float (*f32_sum)(const float* x, size_t n);
+    float (*f32_dot)(const float* x, const float* y, size_t n);
+    float (*f32_min)(const float* x, size_t n);
+    float (*f32_max)(const float* x, size_t n);
+    void (*f32_scale)(float* x, float a, size_t n);
+    void (*f32_axpy)(float* y, float a, const float* x, size_t n);
+    void (*f32_compare)(const float* x, float t, CompareOp op, unsigned char* out, size_t n);
+
+    int (*i32_sum)(const int* x, size_t n);
+    int (*i32_dot)(const int* x, const int* y, size_t n);
+    int (*i32_min)(const int* x, size_t n);
+    int (*i32_max)(const int* x, size_t n);
+    void (*i32_scale)(int* x, int a, size_t n);
+    void (*i32_axpy)(int* y, int a, const int* x, size_t n);
+    void (*i32_compare)(const int* x, int t, CompareOp op, unsigned char* out, size_t n);
+
+    size_t (*byte_find)(const char* s, size_t n, char c);
+    size_t (*byte_count)(const char* s, size_t n, char c);
+    size_t (*byte_search)(const char* s, size_t n, const char* needle, size_t m);
+
+    void (*bits_logic)(uint64_t* out, const uint64_t* a, const uint64_t* b, LogicOp op, size_t n);
+    size_t (*bits_count)(const uint64_t* x, size_t n);
+    size_t (*bits_first)(const uint64_t* x, size_t n);
+
+    void (*lex_classify)(const char* s, uint64_t* masks);
+    void (*lex_structure)(const char* s, uint64_t* masks);
+} Kernels;
+
+// SCALAR
+
+static float f32_sum_scalar(const float* x, size_t n)
+{
+    float s = 0.0f;
+    for (size_t i = 0; i < n; ++i) s += x[i];
+    return s;
+}
+
+static float f32_dot_scalar(const float* x, const float* y, size_t n)
+{
+    float s = 0.0f;
+    for (size_t i = 0; i < n; ++i) s += x[i] * y[i];
+    return s;
+}
+
+// a NaN anywhere gives NaN, as it does for the sum.
+// every version of min and max agrees on this.
+static float f32_min_scalar(const float* x, size_t n)
+{
+    float m = x[0];
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (x[i] != x[i]) return NAN;
+        m = x[i] < m ? x[i] : m;
+    }
+    return m;
+}
+
+static float f32_max_scalar(const float* x, size_t n)
+{
+    float m = x[0];
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (x[i] != x[i]) return NAN;
+        m = x[i] > m ? x[i] : m;
+    }
+    return m;
+}
+
+static int i32_sum_scalar(const int* x, size_t n)
+{
+    unsigned int s = 0;
+    for (size_t i = 0; i < n; ++i) s += (unsigned int)x[i];
+    return (int)s;
+}
+
+static int i32_dot_scalar(const int* x, const int* y, size_t n)
+{
+    unsigned int s = 0;
+    for (size_t i = 0; i < n; ++i) s += (unsigned int)x[i] * (unsigned int)y[i];
+    return (int)s;
+}
+
+static int i32_min_scalar(const int* x, size_t n)
+{
+    int m = x[0];
+    for (size_t i = 1; i < n; ++i) m = x[i] < m ? x[i] : m;
+    return m;
+}
+
+static int i32_max_scalar(const int* x, size_t n)
+{
+    int m = x[0];
+    for (size_t i = 1; i < n; ++i) m = x[i] > m ? x[i] : m;
+    return m;
+}
+
+// The elementwise kernels are plain loops which the compiler vectorizes.
+// They are instantiated for the baseline, and again for AVX2.
+#define DEFINE_ELEMENTWISE_KERNELS(SUFFIX, ATTRIBUTES) \
+    ATTRIBUTES static void f32_scale_##SUFFIX(float* x, float a, size_t n) \
+    { \
+        for (size_t i = 0; i < n; ++i) x[i] *= a; \
+    } \
+    ATTRIBUTES static void f32_axpy_##SUFFIX(float* y, float a, const float* x, size_t n) \
+    { \
+        for (size_t i = 0; i < n; ++i) y[i] += a * x[i]; \
+    } \
+    ATTRIBUTES static void i32_scale_##SUFFIX(int* x, int a, size_t n) \
+    { \
+        for (size_t i = 0; i < n; ++i) x[i] = (int)((unsigned int)x[i] * (unsigned int)a); \
+    } \
+    ATTRIBUTES static void i32_axpy_##SUFFIX(int* y, int a, const int* x, size_t n) \
+    { \
+        for (size_t i = 0; i < n; ++i) y[i] = (int)((unsigned int)y[i] + (unsigned int)a * (unsigned int)x[i]); \
+    } \
+    ATTRIBUTES static void f32_compare_##SUFFIX(const float* x, float t, CompareOp op, unsigned char* out, size_t n) \
+    { \
+        switch (op) \
+        { \
+            case COMPARE_LESS: for (size_t i = 0; i < n; ++i) out[i] = x[i] < t; break; \
+            case COMPARE_GREATER: for (size_t i = 0; i < n; ++i) out[i] = x[i] > t; break; \
+            case COMPARE_EQUAL: for (size_t i = 0; i < n; ++i) out[i] = x[i] == t; break; \
+            case COMPARE_LESS_EQUAL: for (size_t i = 0; i < n; ++i) out[i] = x[i] <= t; break; \
+            case COMPARE_GREATER_EQUAL: for (size_t i = 0; i < n; ++i) out[i] = x[i] >= t; break; \
+        } \
+    } \
+    ATTRIBUTES static void i32_compare_##SUFFIX(const int* x, int t, CompareOp op, unsigned char* out, size_t n) \
+    { \
+        switch (op) \
+        { \
+            case COMPARE_LESS: for (size_t i = 0; i < n; ++i) out[i] = x[i] < t; break; \
+            case COMPARE_GREATER: for (size_t i = 0; i < n; ++i) out[i] = x[i] > t; break; \
+            case COMPARE_EQUAL: for (size_t i = 0; i < n; ++i) out[i] = x[i] == t; break; \
+            case COMPARE_LESS_EQUAL: for (size_t i = 0; i < n; ++i) out[i] = x[i] <= t; break; \
+            case COMPARE_GREATER_EQUAL: for (size_t i = 0; i < n; ++i) out[i] = x[i] >= t; break; \
+        } \
+    }
+
+DEFINE_ELEMENTWISE_KERNELS(scalar, )
+
+// bytes. find and search return n when there is no match.
+
+static size_t byte_find_scalar(const char* s, size_t n, char c)
+{
+    const char* p = memchr(s, c, n);
+    return p ? (size_t)(p - s) : n;
+}
+
+static size_t byte_count_scalar(const char* s, size_t n, char c)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < n; ++i) count += s[i] == c;
+    return count;
+}
+
+// checks each start from i onwards
+static size_t byte_search_from(const char* s, size_t n, const char* needle, size_t m, size_t i)
+{
+    for (; i + m <= n; ++i)
+    {
+        if (s[i] == needle[0] && memcmp(s + i, needle, m) == 0) return i;
+    }
+    return n;
+}
+
+static size_t byte_search_scalar(const char* s, size_t n, const char* needle, size_t m)
+{
+    assert(m > 0);
+    size_t i = 0;
+    while (i + m <= n)
+    {
+        i += byte_find_scalar(s + i, n - m + 1 - i, needle[0]);
+        if (i + m > n) break;
+        if (memcmp(s + i, needle, m) == 0) return i;
+        ++i;
+    }
+    return n;
+}
+
+// words. bits_first returns the index of the first non zero word, or n.
+
+static void bits_logic_scalar(uint64_t* out, const uint64_t* a, const uint64_t* b, LogicOp op, size_t n)
+{
+    switch (op)
+    {
+        case LOGIC_AND: for (size_t i = 0; i < n; ++i) out[i] = a[i] & b[i]; break;
+        case LOGIC_OR: for (size_t i = 0; i < n; ++i) out[i] = a[i] | b[i]; break;
+        case LOGIC_XOR: for (size_t i = 0; i < n; ++i) out[i] = a[i] ^ b[i]; break;
+        case LOGIC_NOT: for (size_t i = 0; i < n; ++i) out[i] = ~a[i]; break;
+    }
+}
+
+static size_t word_count_bits(uint64_t x)
+{
+    x = x - ((x >> 1) & 0x5555555555555555ull);
+    x = (x & 0x3333333333333333ull) + ((x >> 2) & 0x3333333333333333ull);
+    x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+    return (size_t)((x * 0x0101010101010101ull) >> 56);
+}
+
+static size_t bits_count_scalar(const uint64_t* x, size_t n)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < n; ++i) count += word_count_bits(x[i]);
+    return count;
+}
+
+static size_t bits_first_scalar(const uint64_t* x, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) if (x[i]) return i;
+    return n;
+}
+
+// lexer classes of LEX_BLOCK bytes, one mask per class
+
+static void lex_classify_scalar(const char* s, uint64_t* masks)
+{
+    for (int k = 0; k < LEX_CLASS_COUNT; ++k) masks[k] = 0;
+    for (int i = 0; i < LEX_BLOCK; ++i)
+    {
+        unsigned int classes = lex_class_table[(unsigned char)s[i]];
+        for (int k = 0; k < LEX_CLASS_COUNT; ++k)
+            masks[k] |= (uint64_t)((classes >> k) & 1) << i;
+    }
+}
+
+static void lex_structure_scalar(const char* s, uint64_t* masks)
+{
+    for (int k = 0; k < SCAN_CLASS_COUNT; ++k) masks[k] = 0;
+    for (int i = 0; i < LEX_BLOCK; ++i)
+    {
+        unsigned int classes = lex_structure_table[(unsigned char)s[i]];
+        for (int k = 0; k < SCAN_CLASS_COUNT; ++k)
+            masks[k] |= (uint64_t)((classes >> k) & 1) << i;
+    }
+}
+
+#if LISP_SIMD_X86
+
+// SSE2 (always available on x86-64)
+
+static float f32_hsum_sse2(__m128 v)
+{
+    __m128 shuf = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+    __m128 sums = _mm_add_ps(v, shuf);
+    shuf = _mm_movehl_ps(shuf, sums);
+    sums = _mm_add_ss(sums, shuf);
+    return _mm_cvtss_f32(sums);
+}
+
+static float f32_sum_sse2(const float* x, size_t n)
+{
+    __m128 a0 = _mm_setzero_ps();
+    __m128 a1 = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        a0 = _mm_add_ps(a0, _mm_loadu_ps(x + i));
+        a1 = _mm_add_ps(a1, _mm_loadu_ps(x + i + 4));
+    }
+    float s = f32_hsum_sse2(_mm_add_ps(a0, a1));
+    for (; i < n; ++i) s += x[i];
+    return s;
+}
+
+static float f32_dot_sse2(const float* x, const float* y, size_t n)
+{
+    __m128 a0 = _mm_setzero_ps();
+    __m128 a1 = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        a0 = _mm_add_ps(a0, _mm_mul_ps(_mm_loadu_ps(x + i), _mm_loadu_ps(y + i)));
+        a1 = _mm_add_ps(a1, _mm_mul_ps(_mm_loadu_ps(x + i + 4), _mm_loadu_ps(y + i + 4)));
+    }
+    float s = f32_hsum_sse2(_mm_add_ps(a0, a1));
+    for (; i < n; ++i) s += x[i] * y[i];
+    return s;
+}
+
+static float f32_min_sse2(const float* x, size_t n)
+{
+    if (n < 4) return f32_min_scalar(x, n);
+    __m128 m = _mm_loadu_ps(x);
+    __m128 v = m;
+    __m128 nan = _mm_cmpunord_ps(v, v);
+    size_t i = 4;
+    for (; i + 4 <= n; i += 4)
+    {
+        v = _mm_loadu_ps(x + i);
+        nan = _mm_or_ps(nan, _mm_cmpunord_ps(v, v));
+        m = _mm_min_ps(m, v);
+    }
+    if (_mm_movemask_ps(nan)) return NAN;
+    float lanes[4];
+    _mm_storeu_ps(lanes, m);
+    float r = f32_min_scalar(lanes, 4);
+    if (i == n) return r;
+    float rest = f32_min_scalar(x + i, n - i);
+    return rest != rest || rest < r ? rest : r;
+}
+
+static float f32_max_sse2(const float* x, size_t n)
+{
+    if (n < 4) return f32_max_scalar(x, n);
+    __m128 m = _mm_loadu_ps(x);
+    __m128 v = m;
+    __m128 nan = _mm_cmpunord_ps(v, v);
+    size_t i = 4;
+    for (; i + 4 <= n; i += 4)
+    {
+        v = _mm_loadu_ps(x + i);
+        nan = _mm_or_ps(nan, _mm_cmpunord_ps(v, v));
+        m = _mm_max_ps(m, v);
+    }
+    if (_mm_movemask_ps(nan)) return NAN;
+    float lanes[4];
+    _mm_storeu_ps(lanes, m);
+    float r = f32_max_scalar(lanes, 4);
+    if (i == n) return r;
+    float rest = f32_max_scalar(x + i, n - i);
+    return rest != rest || rest > r ? rest : r;
+}
+
+static int i32_sum_sse2(const int* x, size_t n)
+{
+    __m128i a = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) a = _mm_add_epi32(a, _mm_loadu_si128((const __m128i*)(x + i)));
+    int lanes[4];
+    _mm_storeu_si128((__m128i*)lanes, a);
+    return i32_sum_scalar(lanes, 4) + i32_sum_scalar(x + i, n - i);
+}
+
+static __m128i i32_min_sse2_lanes(__m128i a, __m128i b)
+{
+    // no pminsd before SSE4.1
+    __m128i less = _mm_cmplt_epi32(a, b);
+    return _mm_or_si128(_mm_and_si128(less, a), _mm_andnot_si128(less, b));
+}
+
+static int i32_min_sse2(const int* x, size_t n)
+{
+    if (n < 4) return i32_min_scalar(x, n);
+    __m128i m = _mm_loadu_si128((const __m128i*)x);
+    size_t i = 4;
+    for (; i + 4 <= n; i += 4) m = i32_min_sse2_lanes(m, _mm_loadu_si128((const __m128i*)(x + i)));
+    int lanes[4];
+    _mm_storeu_si128((__m128i*)lanes, m);
+    int r = i32_min_scalar(lanes, 4);
+    for (; i < n; ++i) r = x[i] < r ? x[i] : r;
+    return r;
+}
+
+static int i32_max_sse2(const int* x, size_t n)
+{
+    if (n < 4) return i32_max_scalar(x, n);
+    __m128i m = _mm_loadu_si128((const __m128i*)x);
+    size_t i = 4;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128i b = _mm_loadu_si128((const __m128i*)(x + i));
+        __m128i greater = _mm_cmpgt_epi32(m, b);
+        m = _mm_or_si128(_mm_and_si128(greater, m), _mm_andnot_si128(greater, b));
+    }
+    int lanes[4];
+    _mm_storeu_si128((__m128i*)lanes, m);
+    int r = i32_max_scalar(lanes, 4);
+    for (; i < n; ++i) r = x[i] > r ? x[i] : r;
+    return r;
+}
+
+static size_t byte_find_sse2(const char* s, size_t n, char c)
+{
+    __m128i k = _mm_set1_epi8(c);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(s + i)), k));
+        if (mask) return i + __builtin_ctz(mask);
+    }
+    for (; i < n; ++i) if (s[i] == c) return i;
+    return n;
+}
+
+static size_t byte_count_sse2(const char* s, size_t n, char c)
+{
+    __m128i k = _mm_set1_epi8(c);
+    __m128i zero = _mm_setzero_si128();
+    __m128i total = zero;
+    size_t i = 0;
+    while (i + 16 <= n)
+    {
+        // matches are -1, so subtracting counts them.
+        // bytes overflow after 255 steps, so widen before then.
+        __m128i counts = zero;
+        for (int step = 0; step < 255 && i + 16 <= n; ++step, i += 16)
+            counts = _mm_sub_epi8(counts, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(s + i)), k));
+        total = _mm_add_epi64(total, _mm_sad_epu8(counts, zero));
+    }
+    size_t count = (size_t)_mm_cvtsi128_si64(total) + (size_t)_mm_cvtsi128_si64(_mm_unpackhi_epi64(total, total));
+    for (; i < n; ++i) count += s[i] == c;
+    return count;
+}
+
+// compare the first and last byte of the needle at 16 starts at once,
+// and only check the middle where both match.
+static size_t byte_search_sse2(const char* s, size_t n, const char* needle, size_t m)
+{
+    assert(m > 0);
+    if (m == 1) return byte_find_sse2(s, n, needle[0]);
+
+    __m128i first = _mm_set1_epi8(needle[0]);
+    __m128i last = _mm_set1_epi8(needle[m - 1]);
+    size_t i = 0;
+    for (; i + m - 1 + 16 <= n; i += 16)
+    {
+        __m128i a = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(s + i)), first);
+        __m128i b = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(s + i + m - 1)), last);
+        int mask = _mm_movemask_epi8(_mm_and_si128(a, b));
+        while (mask)
+        {
+            size_t j = i + __builtin_ctz(mask);
+            if (memcmp(s + j + 1, needle + 1, m - 2) == 0) return j;
+            mask &= mask - 1;
+        }
+    }
+    return byte_search_from(s, n, needle, m, i);
+}
+
+static void lex_classify_sse2(const char* s, uint64_t* masks)
+{
+    for (int k = 0; k < LEX_CLASS_COUNT; ++k) masks[k] = 0;
+
+    for (int i = 0; i < LEX_BLOCK; i += 16)
+    {
+        // bytes compare as signed, so bytes over 127 are below ' '
+        __m128i v = _mm_loadu_si128((const __m128i*)(s + i));
+        __m128i space = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                                     _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('\t' - 1)),
+                                                   _mm_cmplt_epi8(v, _mm_set1_epi8('\r' + 1))));
+        __m128i illegal = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('(')),
+                                                    _mm_cmpeq_epi8(v, _mm_set1_epi8(')'))),
+                                       _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('#')),
+                                                    _mm_cmpeq_epi8(v, _mm_set1_epi8(';'))));
+        __m128i symbol = _mm_andnot_si128(illegal,
+                                          _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(' ')),
+                                                        _mm_cmplt_epi8(v, _mm_set1_epi8('z' + 1))));
+        __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+                                      _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+
+        masks[LEX_SPACE] |= (uint64_t)(unsigned int)_mm_movemask_epi8(space) << i;
+        masks[LEX_SYMBOL] |= (uint64_t)(unsigned int)_mm_movemask_epi8(symbol) << i;
+        masks[LEX_DIGIT] |= (uint64_t)(unsigned int)_mm_movemask_epi8(digit) << i;
+        masks[LEX_DOT] |= (uint64_t)(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('.'))) << i;
+        masks[LEX_QUOTE] |= (uint64_t)(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('"'))) << i;
+        masks[LEX_NEWLINE] |= (uint64_t)(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))) << i;
+        masks[LEX_NUL] |= (uint64_t)(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128())) << i;
+    }
+}
+
+static void lex_structure_sse2(const char* s, uint64_t* masks)
+{
+    // kept in registers, as the masks may alias s
+    uint64_t quote = 0, open = 0, close = 0, boundary = 0, unsafe = 0, line_end = 0;
+
+    for (int i = 0; i < LEX_BLOCK; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(s + i));
+        __m128i space = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                                     _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('\t' - 1)),
+                                                   _mm_cmplt_epi8(v, _mm_set1_epi8('\r' + 1))));
+        __m128i open_bytes = _mm_cmpeq_epi8(v, _mm_set1_epi8('('));
+        __m128i close_bytes = _mm_cmpeq_epi8(v, _mm_set1_epi8(')'));
+        __m128i boundary_bytes = _mm_or_si128(_mm_or_si128(space, _mm_cmpeq_epi8(v, _mm_set1_epi8('#'))),
+                                        _mm_or_si128(open_bytes, close_bytes));
+        // symbols are ! to z, without ( ) # ;
+        __m128i symbol = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(' ')),
+                                       _mm_cmplt_epi8(v, _mm_set1_epi8('z' + 1)));
+        __m128i unsafe_bytes = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(';')),
+                                      _mm_andnot_si128(_mm_or_si128(symbol, boundary_bytes), _mm_set1_epi8(-1)));
+        __m128i line_end_bytes = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')),
+                                        _mm_cmpeq_epi8(v, _mm_setzero_si128()));
+
+        quote |= (uint64_t)(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('"'))) << i;
+        open |= (uint64_t)(unsigned int)_mm_movemask_epi8(open_bytes) << i;
+        close |= (uint64_t)(unsigned int)_mm_movemask_epi8(close_bytes) << i;
+        boundary |= (uint64_t)(unsigned int)_mm_movemask_epi8(boundary_bytes) << i;
+        unsafe |= (uint64_t)(unsigned int)_mm_movemask_epi8(unsafe_bytes) << i;
+        line_end |= (uint64_t)(unsigned int)_mm_movemask_epi8(line_end_bytes) << i;
+    }
+
+    masks[SCAN_QUOTE] = quote;
+    masks[SCAN_OPEN] = open;
+    masks[SCAN_CLOSE] = close;
+    masks[SCAN_BOUNDARY] = boundary;
+    masks[SCAN_UNSAFE] = unsafe;
+    masks[SCAN_LINE_END] = line_end;
+}
+
+static void bits_logic_sse2(uint64_t* out, const uint64_t* a, const uint64_t* b, LogicOp op, size_t n)
+{
+    __m128i ones = _mm_set1_epi32(-1);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i*)(a + i));
+        __m128i y = op == LOGIC_NOT ? ones : _mm_loadu_si128((const __m128i*)(b + i));
+        __m128i r;
+        switch (op)
+        {
+            case LOGIC_AND: r = _mm_and_si128(x, y); break;
+            case LOGIC_OR: r = _mm_or_si128(x, y); break;
+            default: r = _mm_xor_si128(x, y); break; // not is xor with ones
+        }
+        _mm_storeu_si128((__m128i*)(out + i), r);
+    }
+    bits_logic_scalar(out + i, a + i, b + i, op, n - i);
+}
+
+static size_t bits_count_sse2(const uint64_t* x, size_t n)
+{
+    __m128i m1 = _mm_set1_epi8(0x55);
+    __m128i m2 = _mm_set1_epi8(0x33);
+    __m128i m4 = _mm_set1_epi8(0x0F);
+    __m128i total = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2)
+    {
+        // count bits in each byte, then add bytes
+        __m128i v = _mm_loadu_si128((const __m128i*)(x + i));
+        v = _mm_sub_epi8(v, _mm_and_si128(_mm_srli_epi64(v, 1), m1));
+        v = _mm_add_epi8(_mm_and_si128(v, m2), _mm_and_si128(_mm_srli_epi64(v, 2), m2));
+        v = _mm_and_si128(_mm_add_epi8(v, _mm_srli_epi64(v, 4)), m4);
+        total = _mm_add_epi64(total, _mm_sad_epu8(v, _mm_setzero_si128()));
+    }
+    long long lanes[2];
+    _mm_storeu_si128((__m128i*)lanes, total);
+    return (size_t)(lanes[0] + lanes[1]) + bits_count_scalar(x + i, n - i);
+}
+
+static size_t bits_first_sse2(const uint64_t* x, size_t n)
+{
+    __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(x + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)) != 0xFFFF) break;
+    }
+    return i + bits_first_scalar(x + i, n - i);
+}
+
+// AVX2
+
+#define AVX2 __attribute__((target("avx2")))
+
+DEFINE_ELEMENTWISE_KERNELS(avx2, AVX2)
+
+AVX2 static float f32_hsum_avx2(__m256 v)
+{
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    __m128 shuf = _mm_movehdup_ps(sum);
+    sum = _mm_add_ps(sum, shuf);
+    shuf = _mm_movehl_ps(shuf, sum);
+    sum = _mm_add_ss(sum, shuf);
+    return _mm_cvtss_f32(sum);
+}
+
+AVX2 static float f32_sum_avx2(const float* x, size_t n)
+{
+    __m256 a0 = _mm256_setzero_ps();
+    __m256 a1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        a0 = _mm256_add_ps(a0, _mm256_loadu_ps(x + i));
+        a1 = _mm256_add_ps(a1, _mm256_loadu_ps(x + i + 8));
+    }
+    float s = f32_hsum_avx2(_mm256_add_ps(a0, a1));
+    for (; i < n; ++i) s += x[i];
+    return s;
+}
+
+AVX2 static float f32_dot_avx2(const float* x, const float* y, size_t n)
+{
+    __m256 a0 = _mm256_setzero_ps();
+    __m256 a1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        a0 = _mm256_add_ps(a0, _mm256_mul_ps(_mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i)));
+        a1 = _mm256_add_ps(a1, _mm256_mul_ps(_mm256_loadu_ps(x + i + 8), _mm256_loadu_ps(y + i + 8)));
+    }
+    float s = f32_hsum_avx2(_mm256_add_ps(a0, a1));
+    for (; i < n; ++i) s += x[i] * y[i];
+    return s;
+}
+
+AVX2 static float f32_min_avx2(const float* x, size_t n)
+{
+    if (n < 8) return f32_min_scalar(x, n);
+    __m256 m = _mm256_loadu_ps(x);
+    __m256 v = m;
+    __m256 nan = _mm256_cmp_ps(v, v, _CMP_UNORD_Q);
+    size_t i = 8;
+    for (; i + 8 <= n; i += 8)
+    {
+        v = _mm256_loadu_ps(x + i);
+        nan = _mm256_or_ps(nan, _mm256_cmp_ps(v, v, _CMP_UNORD_Q));
+        m = _mm256_min_ps(m, v);
+    }
+    if (_mm256_movemask_ps(nan)) return NAN;
+    float lanes[8];
+    _mm256_storeu_ps(lanes, m);
+    float r = f32_min_scalar(lanes, 8);
+    if (i == n) return r;
+    float rest = f32_min_scalar(x + i, n - i);
+    return rest != rest || rest < r ? rest : r;
+}
+
+AVX2 static float f32_max_avx2(const float* x, size_t n)
+{
+    if (n < 8) return f32_max_scalar(x, n);
+    __m256 m = _mm256_loadu_ps(x);
+    __m256 v = m;
+    __m256 nan = _mm256_cmp_ps(v, v, _CMP_UNORD_Q);
+    size_t i = 8;
+    for (; i + 8 <= n; i += 8)
+    {
+        v = _mm256_loadu_ps(x + i);
+        nan = _mm256_or_ps(nan, _mm256_cmp_ps(v, v, _CMP_UNORD_Q));
+        m = _mm256_max_ps(m, v);
+    }
+    if (_mm256_movemask_ps(nan)) return NAN;
+    float lanes[8];
+    _mm256_storeu_ps(lanes, m);
+    float r = f32_max_scalar(lanes, 8);
+    if (i == n) return r;
+    float rest = f32_max_scalar(x + i, n - i);
+    return rest != rest || rest > r ? rest : r;
+}
+
+AVX2 static int i32_sum_avx2(const int* x, size_t n)
+{
+    __m256i a = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) a = _mm256_add_epi32(a, _mm256_loadu_si256((const __m256i*)(x + i)));
+    int lanes[8];
+    _mm256_storeu_si256((__m256i*)lanes, a);
+    return i32_sum_scalar(lanes, 8) + i32_sum_scalar(x + i, n - i);
+}
+
+AVX2 static int i32_dot_avx2(const int* x, const int* y, size_t n)
+{
+    __m256i a = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i p = _mm256_mullo_epi32(_mm256_loadu_si256((const __m256i*)(x + i)),
+                                       _mm256_loadu_si256((const __m256i*)(y + i)));
+        a = _mm256_add_epi32(a, p);
+    }
+    int lanes[8];
+    _mm256_storeu_si256((__m256i*)lanes, a);
+    return i32_sum_scalar(lanes, 8) + i32_dot_scalar(x + i, y + i, n - i);
+}
+
+AVX2 static int i32_min_avx2(const int* x, size_t n)
+{
+    if (n < 8) return i32_min_scalar(x, n);
+    __m256i m = _mm256_loadu_si256((const __m256i*)x);
+    size_t i = 8;
+    for (; i + 8 <= n; i += 8) m = _mm256_min_epi32(m, _mm256_loadu_si256((const __m256i*)(x + i)));
+    int lanes[8];
+    _mm256_storeu_si256((__m256i*)lanes, m);
+    int r = i32_min_scalar(lanes, 8);
+    for (; i < n; ++i) r = x[i] < r ? x[i] : r;
+    return r;
+}
+
+AVX2 static int i32_max_avx2(const int* x, size_t n)
+{
+    if (n < 8) return i32_max_scalar(x, n);
+    __m256i m = _mm256_loadu_si256((const __m256i*)x);
+    size_t i = 8;
+    for (; i + 8 <= n; i += 8) m = _mm256_max_epi32(m, _mm256_loadu_si256((const __m256i*)(x + i)));
+    int lanes[8];
+    _mm256_storeu_si256((__m256i*)lanes, m);
+    int r = i32_max_scalar(lanes, 8);
+    for (; i < n; ++i) r = x[i] > r ? x[i] : r;
+    return r;
+}
+
+
+AVX2 static size_t byte_find_avx2(const char* s, size_t n, char c)
+{
+    __m256i k = _mm256_set1_epi8(c);
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64)
+    {
+        // test two vectors per step
+        __m256i a = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(s + i)), k);
+        __m256i b = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(s + i + 32)), k);
+        if (!_mm256_testz_si256(_mm256_or_si256(a, b), _mm256_or_si256(a, b)))
+        {
+            unsigned int mask = (unsigned int)_mm256_movemask_epi8(a);
+            if (mask) return i + __builtin_ctz(mask);
+            return i + 32 + __builtin_ctz((unsigned int)_mm256_movemask_epi8(b));
+        }
+    }
+    for (; i + 32 <= n; i += 32)
+    {
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(s + i)), k));
+        if (mask) return i + __builtin_ctz(mask);
+    }
+    for (; i < n; ++i) if (s[i] == c) return i;
+    return n;
+}
+
+AVX2 static size_t byte_count_avx2(const char* s, size_t n, char c)
+{
+    __m256i k = _mm256_set1_epi8(c);
+    __m256i zero = _mm256_setzero_si256();
+    __m256i total = zero;
+    size_t i = 0;
+    while (i + 32 <= n)
+    {
+        __m256i counts = zero;
+        for (int step = 0; step < 255 && i + 32 <= n; ++step, i += 32)
+            counts = _mm256_sub_epi8(counts, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(s + i)), k));
+        total = _mm256_add_epi64(total, _mm256_sad_epu8(counts, zero));
+    }
+    long long lanes[4];
+    _mm256_storeu_si256((__m256i*)lanes, total);
+    size_t count = (size_t)(lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+    for (; i < n; ++i) count += s[i] == c;
+    return count;
+}
+
+AVX2 static size_t byte_search_avx2(const char* s, size_t n, const char* needle, size_t m)
+{
+    assert(m > 0);
+    if (m == 1) return byte_find_avx2(s, n, needle[0]);
+
+    __m256i first = _mm256_set1_epi8(needle[0]);
+    __m256i last = _mm256_set1_epi8(needle[m - 1]);
+    size_t i = 0;
+    for (; i + m - 1 + 32 <= n; i += 32)
+    {
+        __m256i a = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(s + i)), first);
+        __m256i b = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(s + i + m - 1)), last);
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(_mm256_and_si256(a, b));
+        while (mask)
+        {
+            size_t j = i + __builtin_ctz(mask);
+            if (memcmp(s + j + 1, needle + 1, m - 2) == 0) return j;
+            mask &= mask - 1;
+        }
+    }
+    return byte_search_from(s, n, needle, m, i);
+}
+
+AVX2 static void lex_classify_avx2(const char* s, uint64_t* masks)
+{
+    for (int k = 0; k < LEX_CLASS_COUNT; ++k) masks[k] = 0;
+
+    for (int i = 0; i < LEX_BLOCK; i += 32)
+    {
+        // bytes compare as signed, so bytes over 127 are below ' '
+        __m256i v = _mm256_loadu_si256((const __m256i*)(s + i));
+        __m256i space = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                                        _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('\t' - 1)),
+                                                         _mm256_cmpgt_epi8(_mm256_set1_epi8('\r' + 1), v)));
+        __m256i illegal = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('(')),
+                                                          _mm256_cmpeq_epi8(v, _mm256_set1_epi8(')'))),
+                                          _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('#')),
+                                                          _mm256_cmpeq_epi8(v, _mm256_set1_epi8(';'))));
+        __m256i symbol = _mm256_andnot_si256(illegal,
+                                             _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(' ')),
+                                                              _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), v)));
+        __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)),
+                                         _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));
+
+        masks[LEX_SPACE] |= (uint64_t)(unsigned int)_mm256_movemask_epi8(space) << i;
+        masks[LEX_SYMBOL] |= (uint64_t)(unsigned int)_mm256_movemask_epi8(symbol) << i;
+        masks[LEX_DIGIT] |= (uint64_t)(unsigned int)_mm256_movemask_epi8(digit) << i;
+        masks[LEX_DOT] |= (uint64_t)(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('.'))) << i;
+        masks[LEX_QUOTE] |= (uint64_t)(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"'))) << i;
+        masks[LEX_NEWLINE] |= (uint64_t)(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'))) << i;
+        masks[LEX_NUL] |= (uint64_t)(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_setzero_si256())) << i;
+    }
+}
+
+AVX2 static void lex_structure_avx2(const char* s, uint64_t* masks)
+{
+    // kept in registers, as the masks may alias s
+    uint64_t quote = 0, open = 0, close = 0, boundary = 0, unsafe = 0, line_end = 0;
+
+    for (int i = 0; i < LEX_BLOCK; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(s + i));
+        __m256i space = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                                        _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('\t' - 1)),
+                                                         _mm256_cmpgt_epi8(_mm256_set1_epi8('\r' + 1), v)));
+        __m256i open_bytes = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('('));
+        __m256i close_bytes = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(')'));
+        __m256i boundary_bytes = _mm256_or_si256(_mm256_or_si256(space, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('#'))),
+                                           _mm256_or_si256(open_bytes, close_bytes));
+        // symbols are ! to z, without ( ) # ;
+        __m256i symbol = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(' ')),
+                                          _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), v));
+        __m256i unsafe_bytes = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(';')),
+                                         _mm256_andnot_si256(_mm256_or_si256(symbol, boundary_bytes), _mm256_set1_epi8(-1)));
+        __m256i line_end_bytes = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')),
+                                           _mm256_cmpeq_epi8(v, _mm256_setzero_si256()));
+
+        quote |= (uint64_t)(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"'))) << i;
+        open |= (uint64_t)(unsigned int)_mm256_movemask_epi8(open_bytes) << i;
+        close |= (uint64_t)(unsigned int)_mm256_movemask_epi8(close_bytes) << i;
+        boundary |= (uint64_t)(unsigned int)_mm256_movemask_epi8(boundary_bytes) << i;
+        unsafe |= (uint64_t)(unsigned int)_mm256_movemask_epi8(unsafe_bytes) << i;
+        line_end |= (uint64_t)(unsigned int)_mm256_movemask_epi8(line_end_bytes) << i;
+    }
+
+    masks[SCAN_QUOTE] = quote;
+    masks[SCAN_OPEN] = open;
+    masks[SCAN_CLOSE] = close;
+    masks[SCAN_BOUNDARY] = boundary;
+    masks[SCAN_UNSAFE] = unsafe;
+    masks[SCAN_LINE_END] = line_end;
+}
+
+AVX2 static void bits_logic_avx2(uint64_t* out, const uint64_t* a, const uint64_t* b, LogicOp op, size_t n)
+{
+    __m256i ones = _mm256_set1_epi32(-1);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(a + i));
+        __m256i y = op == LOGIC_NOT ? ones : _mm256_loadu_si256((const __m256i*)(b + i));
+        __m256i r;
+        switch (op)
+        {
+            case LOGIC_AND: r = _mm256_and_si256(x, y); break;
+            case LOGIC_OR: r = _mm256_or_si256(x, y); break;
+            default: r = _mm256_xor_si256(x, y); break; // not is xor with ones
+        }
+        _mm256_storeu_si256((__m256i*)(out + i), r);
+    }
+    bits_logic_scalar(out + i, a + i, b + i, op, n - i);
+}
+
+AVX2 static size_t bits_count_avx2(const uint64_t* x, size_t n)
+{
+    // look up the count of each nibble
+    __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                     0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    __m256i low = _mm256_set1_epi8(0x0F);
+    __m256i total = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(x + i));
+        __m256i counts = _mm256_add_epi8(_mm256_shuffle_epi8(table, _mm256_and_si256(v, low)),
+                                         _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(v, 4), low)));
+        total = _mm256_add_epi64(total, _mm256_sad_epu8(counts, _mm256_setzero_si256()));
+    }
+    long long lanes[4];
+    _mm256_storeu_si256((__m256i*)lanes, total);
+    return (size_t)(lanes[0] + lanes[1] + lanes[2] + lanes[3]) + bits_count_scalar(x + i, n - i);
+}
+
+AVX2 static size_t bits_first_avx2(const uint64_t* x, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(x + i));
+        if (!_mm256_testz_si256(v, v)) break;
+    }
+    return i + bits_first_scalar(x + i, n - i);
+}
+#endif
+
+static Kernels kernels = {
+    f32_sum_scalar,
+    f32_dot_scalar,
+    f32_min_scalar,
+    f32_max_scalar,
+    f32_scale_scalar,
+    f32_axpy_scalar,
+    f32_compare_scalar,
+    i32_sum_scalar,
+    i32_dot_scalar,
+    i32_min_scalar,
+    i32_max_scalar,
+    i32_scale_scalar,
+    i32_axpy_scalar,
+    i32_compare_scalar,
+    byte_find_scalar,
+    byte_count_scalar,
+    byte_search_scalar,
+    bits_logic_scalar,
+    bits_count_scalar,
+    bits_first_scalar,
+    lex_classify_scalar,
+    lex_structure_scalar,
+};
+
+static void kernels_choose(void)
+{
+    for (int c = 0; c < 256; ++c)
+    {
+        lex_class_table[c] = lex_class_of((unsigned char)c);
+        lex_structure_table[c] = lex_structure_of((unsigned char)c);
+    }
+
+#if LISP_SIMD_X86
+    kernels.f32_sum = f32_sum_sse2;
+    kernels.f32_dot = f32_dot_sse2;
+    kernels.f32_min = f32_min_sse2;
+    kernels.f32_max = f32_max_sse2;
+    kernels.i32_sum = i32_sum_sse2;
+    kernels.i32_min = i32_min_sse2;
+    kernels.i32_max = i32_max_sse2;
+    kernels.byte_find = byte_find_sse2;
+    kernels.byte_count = byte_count_sse2;
+    kernels.byte_search = byte_search_sse2;
+    kernels.bits_logic = bits_logic_sse2;
+    kernels.bits_count = bits_count_sse2;
+    kernels.bits_first = bits_first_sse2;
+    kernels.lex_classify = lex_classify_sse2;
+    kernels.lex_structure = lex_structure_sse2;
+
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        kernels.f32_sum = f32_sum_avx2;
+        kernels.f32_dot = f32_dot_avx2;
+        kernels.f32_min = f32_min_avx2;
+        kernels.f32_max = f32_max_avx2;
+        kernels.f32_scale = f32_scale_avx2;
+        kernels.f32_axpy = f32_axpy_avx2;
+        kernels.f32_compare = f32_compare_avx2;
+        kernels.i32_sum = i32_sum_avx2;
+        kernels.i32_dot = i32_dot_avx2;
+        kernels.i32_min = i32_min_avx2;
+        kernels.i32_max = i32_max_avx2;
+        kernels.i32_scale = i32_scale_avx2;
+        kernels.i32_axpy = i32_axpy_avx2;
+        kernels.i32_compare = i32_compare_avx2;
+        kernels.byte_find = byte_find_avx2;
+        kernels.byte_count = byte_count_avx2;
+        kernels.byte_search = byte_search_avx2;
+        kernels.bits_logic = bits_logic_avx2;
+        kernels.bits_count = bits_count_avx2;
+        kernels.bits_first = bits_first_avx2;
+        kernels.lex_classify = lex_classify_avx2;
+        kernels.lex_structure = lex_structure_avx2;
+    }
+#endif
+}
+
+// readers may start on any thread, before any context is made,
+// so the tables are filled only once.
+#if LISP_THREADS
+static pthread_once_t kernels_once = PTHREAD_ONCE_INIT;
+
+static void kernels_init(void)
+{
+    pthread_once(&kernels_once, kernels_choose);
+}
+#else
+static void kernels_init(void)
+{
+    static int chosen = 0;
+    if (!chosen) kernels_choose();
+    chosen = 1;
+}
+#endif
+
+static void bitvector_logic(Lisp out, Lisp a, Lisp b, LogicOp op)
+{
+    BitVector* result = lisp_bitvector(out);
+    const BitVector* x = lisp_bitvector(a);
+    const BitVector* y = op == LOGIC_NOT ? x : lisp_bitvector(b);
+    assert(result->length == x->length && x->length == y->length);
+
+    size_t n = bit_word_count(result->length);
+    kernels.bits_logic(result->words, x->words, y->words, op, n);
+
+    // clear bits past the end
+    if (op == LOGIC_NOT && result->length % 64)
+        result->words[n - 1] &= ((uint64_t)1 << (result->length % 64)) - 1;
+}
+
+void lisp_bitvector_and(Lisp out, Lisp a, Lisp b)
+{
+    bitvector_logic(out, a, b, LOGIC_AND);
+}
+
+void lisp_bitvector_or(Lisp out, Lisp a, Lisp b)
+{
+    bitvector_logic(out, a, b, LOGIC_OR);
+}
+
+void lisp_bitvector_xor(Lisp out, Lisp a, Lisp b)
+{
+    bitvector_logic(out, a, b, LOGIC_XOR);
+}
+
+void lisp_bitvector_not(Lisp out, Lisp a)
+{
+    bitvector_logic(out, a, a, LOGIC_NOT);
+}
+
+int lisp_bitvector_count(Lisp v)
+{
+    const BitVector* vector = lisp_bitvector(v);
+    return (int)kernels.bits_count(vector->words, bit_word_count(vector->length));
+}
+
+int lisp_bitvector_first(Lisp v, unsigned int start)
+{
+    const BitVector* vector = lisp_bitvector(v);
+    if (start >= vector->length) return -1;
+
+    size_t n = bit_word_count(vector->length);
+    size_t i = start / 64;
+
+    // the first word may start part way through
+    uint64_t word = vector->words[i] & (~(uint64_t)0 << (start % 64));
+    if (!word)
+    {
+        ++i;
+        i += kernels.bits_first(vector->words + i, n - i);
+        if (i == n) return -1;
+        word = vector->words[i];
+    }
+    return (int)(i * 64 + word_first_bit(word));
+}
+
+static void lex_classify(const char* s, uint64_t* masks)
+{
+    kernels.lex_classify(s, masks);
+}
+
+static void lex_structure(const char* s, uint64_t* masks)
+{
+    kernels.lex_structure(s, masks);
+}
+
+// a float or int array, either packed in a typed vector,
+// or spread through the entries of a homogenous vector.
+typedef struct
+{
+    LispType type; // LISP_FLOAT or LISP_INT
+    char* data;
+    size_t stride; // bytes between elements
+    size_t length;
+} NumericArray;
+
+#define NUMERIC_AT(a, T, i) (*(T*)((a)->data + (i) * (a)->stride))
+
+static int numeric_array(Lisp v, NumericArray* out)
+{
+    if (lisp_type(v) == LISP_TYPED_VECTOR)
+    {
+        TypedVector* vector = lisp_typed_vector(v);
+        if (vector->kind == LISP_TYPED_U8) return 0;
+        out->type = vector->kind == LISP_TYPED_F32 ? LISP_FLOAT : LISP_INT;
+        out->data = (char*)vector->data;
+        out->stride = 4;
+        out->length = vector->length;
+        return 1;
+    }
+    else if (lisp_type(v) == LISP_VECTOR)
+    {
+        Vector* vector = lisp_vector(v);
+        if (vector->type != LISP_FLOAT && vector->type != LISP_INT) return 0;
+        out->type = vector->type;
+        out->data = (char*)vector->entries;
+        out->stride = sizeof(union LispVal);
+        out->length = vector->length;
+        return 1;
+    }
+    return 0;
+}
+
+static int numeric_array_packed(const NumericArray* a) { return a->stride == 4; }
+
+// homogenous vectors are worked on this many entries at a time,
+// gathered into a packed buffer, so the kernels can take them.
+#define NUMERIC_RUN_MAX 256
+
+// the number of entries from start the kernels are given at once
+static size_t numeric_run(const NumericArray* a, const NumericArray* b, size_t start)
+{
+    size_t n = a->length - start;
+    int packed = numeric_array_packed(a) && (!b || numeric_array_packed(b));
+    return packed || n < NUMERIC_RUN_MAX ? n : NUMERIC_RUN_MAX;
+}
+
+// n entries from start, packed. those of a homogenous vector are copied to buffer.
+static void* numeric_gather(const NumericArray* a, size_t start, size_t n, uint32_t* buffer)
+{
+    if (numeric_array_packed(a)) return a->data + start * 4;
+    for (size_t i = 0; i < n; ++i) buffer[i] = NUMERIC_AT(a, uint32_t, start + i);
+    return buffer;
+}
+
+// puts back entries changed in a buffer from numeric_gather
+static void numeric_scatter(NumericArray* a, size_t start, size_t n, const uint32_t* buffer)
+{
+    if (numeric_array_packed(a)) return;
+    for (size_t i = 0; i < n; ++i) NUMERIC_AT(a, uint32_t, start + i) = buffer[i];
+}
+
+static int is_number(Lisp x) { return lisp_type(x) == LISP_INT || lisp_type(x) == LISP_FLOAT; }
+
+static Lisp func_vector_sum(Lisp args, LispError* e, LispContext ctx)
+{
+    NumericArray a;
+    if (!numeric_array(lisp_car(args), &a))
+    {
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
+    }
+
+    uint32_t buffer[NUMERIC_RUN_MAX];
+    float fs = 0.0f;
+    unsigned int is = 0;
+    for (size_t i = 0, n; i < a.length; i += n)
+    {
+        n = numeric_run(&a, NULL, i);
+        void* x = numeric_gather(&a, i, n, buffer);
+        if (a.type == LISP_FLOAT)
+            fs += kernels.f32_sum(x, n);
+        else
+            is += (unsigned int)kernels.i32_sum(x, n);
+    }
+    return a.type == LISP_FLOAT ? lisp_make_float(fs) : lisp_make_int((int)is);
+}
+
+static Lisp func_vector_dot(Lisp args, LispError* e, LispContext ctx)
+{
+    NumericArray a, b;
+    if (!numeric_array(lisp_list_ref(args, 0), &a) ||
+        !numeric_array(lisp_list_ref(args, 1), &b) ||
+        a.type != b.type)
+    {
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
+    }
+
+    if (a.length != b.length)
+    {
+        *e = LISP_ERROR_OUT_OF_BOUNDS;
+        return lisp_make_null();
+    }
+
+    uint32_t buffer_a[NUMERIC_RUN_MAX];
+    uint32_t buffer_b[NUMERIC_RUN_MAX];
+    float fs = 0.0f;
+    unsigned int is = 0;
+    for (size_t i = 0, n; i < a.length; i += n)
+    {
+        n = numeric_run(&a, &b, i);
+        void* x = numeric_gather(&a, i, n, buffer_a);
+        void* y = numeric_gather(&b, i, n, buffer_b);
+        if (a.type == LISP_FLOAT)
+            fs += kernels.f32_dot(x, y, n);
+        else
+            is += (unsigned int)kernels.i32_dot(x, y, n);
+    }
+    return a.type == LISP_FLOAT ? lisp_make_float(fs) : lisp_make_int((int)is);
+}
+
+static Lisp vector_extreme(Lisp args, int want_max, LispError* e)
+{
+    NumericArray a;
+    if (!numeric_array(lisp_car(args), &a))
+    {
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
+    }
+
+    if (a.length == 0) return lisp_make_null();
+
+    uint32_t buffer[NUMERIC_RUN_MAX];
+    float fm = 0.0f;
+    int im = 0;
+    for (size_t i = 0, n; i < a.length; i += n)
+    {
+        n = numeric_run(&a, NULL, i);
+        void* x = numeric_gather(&a, i, n, buffer);
+        if (a.type == LISP_FLOAT)
+        {
+            float m = want_max ? kernels.f32_max(x, n) : kernels.f32_min(x, n);
+            if (m != m) return lisp_make_float(m);
+            if (i == 0 || (want_max ? m > fm : m < fm)) fm = m;
+        }
+        else
+        {
+            int m = want_max ? kernels.i32_max(x, n) : kernels.i32_min(x, n);
+            if (i == 0 || (want_max ? m > im : m < im)) im = m;
+        }
+    }
+    return a.type == LISP_FLOAT ? lisp_make_float(fm) : lisp_make_int(im);
+}
+
+static Lisp func_vector_min(Lisp args, LispError* e, LispContext ctx)
+{
+    return vector_extreme(args, 0, e);
+}
+
+static Lisp func_vector_max(Lisp args, LispError* e, LispContext ctx)
+{
+    return vector_extreme(args, 1, e);
+}
+
+static Lisp func_vector_scale(Lisp args, LispError* e, LispContext ctx)
+{
+    NumericArray a;
+    Lisp scale = lisp_list_ref(args, 1);
+    if (!numeric_array(lisp_list_ref(args, 0), &a) || !is_number(scale))
+    {
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
+    }
+
+    uint32_t buffer[NUMERIC_RUN_MAX];
+    for (size_t i = 0, n; i < a.length; i += n)
+    {
+        n = numeric_run(&a, NULL, i);
+        void* x = numeric_gather(&a, i, n, buffer);
+        if (a.type == LISP_FLOAT)
+            kernels.f32_scale(x, lisp_float(scale), n);
+        else
+            kernels.i32_scale(x, lisp_int(scale), n);
+        numeric_scatter(&a, i, n, buffer);
+    }
+    return lisp_make_null();
+}
+
+static void vector_axpy(NumericArray* y, Lisp scale, NumericArray* x)
+{
+    // y = y + a * x
+    uint32_t buffer_y[NUMERIC_RUN_MAX];
+    uint32_t buffer_x[NUMERIC_RUN_MAX];
+    for (size_t i = 0, n; i < y->length; i += n)
+    {
+        n = numeric_run(y, x, i);
+        void* run_y = numeric_gather(y, i, n, buffer_y);
+        void* run_x = numeric_gather(x, i, n, buffer_x);
+        if (y->type == LISP_FLOAT)
+            kernels.f32_axpy(run_y, lisp_float(scale), run_x, n);
+        else
+            kernels.i32_axpy(run_y, lisp_int(scale), run_x, n);
+        numeric_scatter(y, i, n, buffer_y);
+    }
+}
+
+static Lisp func_vector_add(Lisp args, LispError* e, LispContext ctx)
+{
+    // (vector-add! y x) y = y + x
+    NumericArray y, x;
+    if (!numeric_array(lisp_list_ref(args, 0), &y) ||
+        !numeric_array(lisp_list_ref(args, 1), &x) ||
+        y.type != x.type)
+    {
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
+    }
+
+    if (y.length != x.length)
+    {
+        *e = LISP_ERROR_OUT_OF_BOUNDS;
+        return lisp_make_null();
+    }
+
+    vector_axpy(&y, lisp_make_int(1), &x);
+    return lisp_make_null();
+}
+
+static Lisp func_vector_axpy(Lisp args, LispError* e, LispContext ctx)
+{
+    // (vector-axpy! y a x) y = y + a * x
+    NumericArray y, x;
+    Lisp a = lisp_list_ref(args, 1);
+    if (!numeric_array(lisp_list_ref(args, 0), &y) ||
+        !numeric_array(lisp_list_ref(args, 2), &x) ||
+        y.type != x.type || !is_number(a))
+    {
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
+    }
+
+    if (y.length != x.length)
+    {
+        *e = LISP_ERROR_OUT_OF_BOUNDS;
+        return lisp_make_null();
+    }
+
+    vector_axpy(&y, a, &x);
+    return lisp_make_null();
+}
+
+static int compare_op(Lisp op, CompareOp* out)
+{
+    if (lisp_type(op) != LISP_SYMBOL) return 0;
+
+    const char* names[] = { "<", ">", "=", "<=", ">=" };
+    for (int i = 0; i < 5; ++i)
+    {
+        if (strcmp(lisp_symbol(op), names[i]) == 0)
+        {
+            *out = i;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static Lisp func_vector_compare(Lisp args, LispError* e, LispContext ctx)
+{
+    // (vector-compare v '< x) -> #u8(...) of 0 or 1 for each element
+    NumericArray a;
+    CompareOp op;
+    Lisp t = lisp_list_ref(args, 2);
+    if (!numeric_array(lisp_list_ref(args, 0), &a) ||
+        !compare_op(lisp_list_ref(args, 1), &op) ||
+        !is_number(t))
+    {
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
+    }
+
+    Lisp mask = lisp_make_typed_vector(LISP_TYPED_U8, a.length, ctx);
+    unsigned char* out = lisp_bytevector(mask, NULL);
+
+    uint32_t buffer[NUMERIC_RUN_MAX];
+    for (size_t i = 0, n; i < a.length; i += n)
+    {
+        n = numeric_run(&a, NULL, i);
+        void* x = numeric_gather(&a, i, n, buffer);
+        if (a.type == LISP_FLOAT)
+            kernels.f32_compare(x, lisp_float(t), op, out + i, n);
+        else
+            kernels.i32_compare(x, lisp_int(t), op, out + i, n);
+    }
+    return mask;
+}
+
+static Lisp func_vector_fill(Lisp args, LispError* e, LispContext ctx)
+{
+    Lisp v = lisp_list_ref(args, 0);
+    Lisp x = lisp_list_ref(args, 1);
+
+    if (lisp_type(v) == LISP_VECTOR)
+    {
+        // the whole vector is replaced, so it can change type
+        Vector* vector = lisp_vector(v);
+        vector->type = lisp_type(x);
+        vector->index = lisp_make_null();
+        for (unsigned int i = 0; i < vector->length; ++i) vector->entries[i] = x.val;
+        return lisp_make_null();
+    }
+
+    if (lisp_type(v) != LISP_TYPED_VECTOR || !typed_vector_accepts(lisp_typed_vector_kind(v), x))
+    {
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
+    }
+
+    int n;
+    void* data = lisp_typed_vector_data(v, &n);
+    switch (lisp_typed_vector_kind(v))
+    {
+        case LISP_TYPED_F32:
+        {
+            float f = lisp_float(x);
+            for (int i = 0; i < n; ++i) ((float*)data)[i] = f;
+            break;
+        }
+        case LISP_TYPED_I32:
+        {
+            int k = lisp_int(x);
+            for (int i = 0; i < n; ++i) ((int*)data)[i] = k;
+            break;
+        }
+        default:
+            memset(data, (unsigned char)lisp_int(x), n);
+            break;
+    }
+    return lisp_make_null();
+}
+
+// a byte (char code) or string to look for
+static int string_needle(Lisp x, char* byte, const char** needle, size_t* length)
+{
+    if (lisp_type(x) == LISP_INT)
+    {
+        *byte = (char)lisp_int(x);
+        *needle = byte;
+        *length = 1;
+        return 1;
+    }
+    else if (lisp_type(x) == LISP_STRING && lisp_string_length(x) > 0)
+    {
+        *needle = lisp_string(x);
+        *length = lisp_string_length(x);
+        return 1;
+    }
+    return 0;
+}
+
+static Lisp string_find(Lisp args, int single_byte, LispError* e)
+{
+    // (string-index s c [start]) (string-search s "text" [start])
+    Lisp str = lisp_list_ref(args, 0);
+    Lisp start = lisp_list_ref(args, 2);
+    char byte;
+    const char* needle;
+    size_t m;
+    if (lisp_type(str) != LISP_STRING ||
+        !string_needle(lisp_list_ref(args, 1), &byte, &needle, &m) ||
+        (single_byte && m != 1) ||
+        (!lisp_is_null(start) && lisp_type(start) != LISP_INT))
+    {
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
+    }
+
+    int n = lisp_string_length(str);
+    int i = lisp_is_null(start) ? 0 : lisp_int(start);
+    if (i < 0 || i > n)
+    {
+        *e = LISP_ERROR_OUT_OF_BOUNDS;
+        return lisp_make_null();
+    }
+
+    const char* s = lisp_string(str) + i;
+    size_t found = kernels.byte_search(s, n - i, needle, m);
+    if (found == (size_t)(n - i)) return lisp_make_null();
+    return lisp_make_int(i + (int)found);
+}
+
+static Lisp func_string_index(Lisp args, LispError* e, LispContext ctx)
+{
+    return string_find(args, 1, e);
+}
+
+static Lisp func_string_search(Lisp args, LispError* e, LispContext ctx)
+{
+    return string_find(args, 0, e);
+}
+
+static Lisp func_string_count(Lisp args, LispError* e, LispContext ctx)
+{
+    // (string-count s c) counts non overlapping matches
+    Lisp str = lisp_list_ref(args, 0);
+    char byte;
+    const char* needle;
+    size_t m;
+    if (lisp_type(str) != LISP_STRING || !string_needle(lisp_list_ref(args, 1), &byte, &needle, &m))
+    {
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
+    }
+
+    const char* s = lisp_string(str);
+    size_t n = lisp_string_length(str);
+    if (m == 1) return lisp_make_int((int)kernels.byte_count(s, n, needle[0]));
+
+    int count = 0;
+    size_t i = 0;
+    while (1)
+    {
+        size_t found = kernels.byte_search(s + i, n - i, needle, m);
+        if (found == n - i) break;
+        ++count;
+        i += found + m;
+    }
+    return lisp_make_int(count);
+}
+
+static Lisp func_string_split(Lisp args, LispError* e, LispContext ctx)
+{
+    // (string-split "a,b,,c" ",") -> ("a" "b" "" "c")
+    // fields are views of str, like substrings
+    Lisp str = lisp_list_ref(args, 0);
+    char byte;
+    const char* needle;
+    size_t m;
+    if (lisp_type(str) != LISP_STRING || !string_needle(lisp_list_ref(args, 1), &byte, &needle, &m))
+    {
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
+    }
+
+    Lisp front = lisp_make_null();
+    Lisp back = front;
+
+    const char* s = lisp_string(str);
+    size_t n = lisp_string_length(str);
+    size_t i = 0;
+    while (1)
+    {
+        size_t found = kernels.byte_search(s + i, n - i, needle, m);
+        size_t end = found == n - i ? n : i + found;
+        // long pieces are views of str
+        back_append(&front, &back, lisp_substring(str, (unsigned int)i, (unsigned int)end, ctx), ctx);
+        if (end == n) break;
+        i = end + m;
+    }
+    return front;
+}
+
+static Lisp func_string_join(Lisp args, LispError* e, LispContext ctx)
+{
+    // (string-join list [separator])
+    Lisp list = lisp_list_ref(args, 0);
+    Lisp separator = lisp_list_ref(args, 1);
+    if ((!lisp_is_null(list) && !lisp_is_pair(list)) ||
+        (!lisp_is_null(separator) && lisp_type(separator) != LISP_STRING))
+    {
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
     }
-    // check that we visited all the pages
-    assert(page_counter == to->page_count);
-    
-    if (LISP_DEBUG)
+
+    size_t separator_length = lisp_is_null(separator) ? 0 : lisp_string_length(separator);
+    size_t length = 0;
+    int count = 0;
+    for (Lisp it = list; lisp_is_pair(it); it = lisp_cdr(it))
     {
-        // DEBUG, check offsets
-        const Page* page = to->first_page;
-        while (page)
+        Lisp x = lisp_car(it);
+        if (lisp_type(x) != LISP_STRING)
         {
-            size_t offset = 0;
-            while (offset < page->size)
-            {
-                Block* block = (Block*)(page->buffer + offset);
-                offset += block->size;
-            }
-            assert(offset == page->size);
-            page = page->next;
+            *e = LISP_ERROR_BAD_ARG;
+            return lisp_make_null();
         }
+        length += lisp_string_length(x);
+        ++count;
     }
+    if (count > 1) length += separator_length * (count - 1);
 
-    size_t diff = ctx.impl->heap.size - ctx.impl->to_heap.size;
-
-    // swap the heaps
-    Heap temp = ctx.impl->heap;
-    ctx.impl->heap = ctx.impl->to_heap;
-    ctx.impl->to_heap = temp;
-    
-    // reset the heap
-    heap_shutdown(&ctx.impl->to_heap);
-    heap_init(&ctx.impl->to_heap, ctx.impl->heap.page_size);
-
-    if (LISP_DEBUG)
-        printf("gc collected: %lu heap: %lu\n", diff, ctx.impl->heap.size);
+    String* string = string_alloc((unsigned int)length, ctx);
+    char* out = string->string;
+    for (Lisp it = list; lisp_is_pair(it); it = lisp_cdr(it))
+    {
+        // separators go before every string but the first
+        if (separator_length > 0 && !lisp_eq(it, list))
+        {
+            memcpy(out, lisp_string(separator), separator_length);
+            out += separator_length;
+        }
+        Lisp x = lisp_car(it);
+        memcpy(out, lisp_string(x), lisp_string_length(x));
+        out += lisp_string_length(x);
+    }
 
-    return result;
+    Lisp l;
+    l.type = LISP_STRING;
+    l.val.ptr_val = string;
+    return l;
 }
 
-Lisp lisp_env_global(LispContext ctx)
+static Lisp func_make_record_type(Lisp args, LispError* e, LispContext ctx)
 {
-    return ctx.impl->global_env;
+    // (make-record-type 'name '(field0 ... fieldN))
+    Lisp name = lisp_list_ref(args, 0);
+    Lisp fields = lisp_list_ref(args, 1);
+    if (lisp_type(name) != LISP_SYMBOL || (!lisp_is_null(fields) && !lisp_is_pair(fields)))
+    {
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
+    }
+    return lisp_make_record_type(name, fields, ctx);
 }
 
-void lisp_shutdown(LispContext ctx)
+static Lisp func_record(Lisp args, LispError* e, LispContext ctx)
 {
-    heap_shutdown(&ctx.impl->heap);
-    heap_shutdown(&ctx.impl->to_heap);
-    free(ctx.impl);
-}
+    // (record type field0 ... fieldN)
+    Lisp type = lisp_car(args);
+    if (lisp_type(type) != LISP_RECORD_TYPE)
+    {
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
+    }
 
-const char* lisp_error_string(LispError error)
-{
-    switch (error)
+    Lisp r = lisp_make_record(type, ctx);
+    Record* record = lisp_record(r);
+
+    args = lisp_cdr(args);
+    for (unsigned int i = 0; i < record->field_count && lisp_is_pair(args); ++i)
     {
-        case LISP_ERROR_NONE:
-            return "none";
-        case LISP_ERROR_FILE_OPEN:
-            return "file error: could not open file";
-        case LISP_ERROR_PAREN_UNEXPECTED:
-            return "syntax error: unexpected ) paren";
-        case LISP_ERROR_PAREN_EXPECTED:
-            return "syntax error: expected ) paren";
-        case LISP_ERROR_DOT_UNEXPECTED:
-            return "syntax error: dot . was unexpected";
-        case LISP_ERROR_BAD_TOKEN:
-            return "syntax error: bad token";
-        case LISP_ERROR_BAD_DEFINE:
-            return "expand error: bad define (define var x)";
-        case LISP_ERROR_BAD_SET:
-            return "expand error: bad set (set! var x)";
-        case LISP_ERROR_BAD_COND:
-            return "expand error: bad cond";
-        case LISP_ERROR_BAD_AND:
-            return "expand error: bad and (and a b)";
-        case LISP_ERROR_BAD_OR:
-            return "expand error: bad or (or a b)";
-        case LISP_ERROR_BAD_LET:
-            return "expand error: bad let";
-        case LISP_ERROR_BAD_LAMBDA:
-            return "expand error: bad lambda";
-        case LISP_ERROR_UNKNOWN_VAR:
-            return "eval error: unknown variable";
-        case LISP_ERROR_BAD_OP:
-            return "eval error: application was not an operator";
-        case LISP_ERROR_UNKNOWN_EVAL:
-            return "eval error: got into a bad state";
-        case LISP_ERROR_BAD_ARG:
-            return "eval error: bad argument type";
-        case LISP_ERROR_OUT_OF_BOUNDS:
-            return "eval error: index out of bounds";
-        default:
-            return "unknown error code";
+        record->fields[i] = lisp_car(args);
+        args = lisp_cdr(args);
     }
+    return r;
 }
 
-static Lisp func_cons(Lisp args, LispError* e, LispContext ctx)
+static Lisp func_is_record(Lisp args, LispError* e, LispContext ctx)
 {
-    return lisp_cons(lisp_car(args), lisp_car(lisp_cdr(args)), ctx);
+    // (record? x [type])
+    Lisp x = lisp_list_ref(args, 0);
+    Lisp type = lisp_list_ref(args, 1);
+    if (lisp_type(x) != LISP_RECORD) return lisp_make_int(0);
+    if (lisp_is_null(type)) return lisp_make_int(1);
+    return lisp_make_int(lisp_eq(lisp_record(x)->type, type));
 }
 
-static Lisp func_car(Lisp args, LispError* e, LispContext ctx)
+// the record, if it has the type, and the field index is in range
+static Record* record_checked(Lisp r, Lisp type, Lisp index, LispError* e)
 {
-    return lisp_car(lisp_car(args));
+    if (lisp_type(r) != LISP_RECORD || !lisp_eq(lisp_record(r)->type, type) || lisp_type(index) != LISP_INT)
+    {
+        *e = LISP_ERROR_BAD_ARG;
+        return NULL;
+    }
+
+    Record* record = lisp_record(r);
+    if (lisp_int(index) < 0 || lisp_int(index) >= record->field_count)
+    {
+        *e = LISP_ERROR_OUT_OF_BOUNDS;
+        return NULL;
+    }
+    return record;
 }
 
-static Lisp func_cdr(Lisp args, LispError* e, LispContext ctx)
+static Lisp func_record_ref(Lisp args, LispError* e, LispContext ctx)
 {
-    return lisp_cdr(lisp_car(args));
+    // (record-ref r type index)
+    Lisp index = lisp_list_ref(args, 2);
+    Record* record = record_checked(lisp_list_ref(args, 0), lisp_list_ref(args, 1), index, e);
+    if (!record) return lisp_make_null();
+    return record->fields[lisp_int(index)];
 }
 
-static Lisp func_nav(Lisp args, LispError* e, LispContext ctx)
+static Lisp func_record_set(Lisp args, LispError* e, LispContext ctx)
 {
-    Lisp path = lisp_car(args);
-    Lisp l = lisp_car(lisp_cdr(args));
-
-    return lisp_list_nav(l, lisp_string(path));
+    // (record-set! r type index x)
+    Lisp index = lisp_list_ref(args, 2);
+    Record* record = record_checked(lisp_list_ref(args, 0), lisp_list_ref(args, 1), index, e);
+    if (!record) return lisp_make_null();
+    record->fields[lisp_int(index)] = lisp_list_ref(args, 3);
+    return lisp_make_null();
 }
 
-static Lisp func_eq(Lisp args, LispError* e, LispContext ctx)
+static Lisp func_record_type(Lisp args, LispError* e, LispContext ctx)
 {
-    Lisp a = lisp_car(args);
-    Lisp b = lisp_car(lisp_cdr(args));
-    return lisp_make_int(lisp_eq(a, b));
+    Lisp r = lisp_car(args);
+    if (lisp_type(r) != LISP_RECORD)
+    {
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
+    }
+    return lisp_record_type(r);
 }
 
-static Lisp func_is_null(Lisp args, LispError* e, LispContext ctx)
+static Lisp func_pmap(Lisp args, LispError* e, LispContext ctx)
 {
-    while (!lisp_is_null(args))
+    // (pmap key value key value ...)
+    Lisp t = lisp_pmap_transient(lisp_make_pmap(ctx), ctx);
+    while (lisp_is_pair(args))
     {
-        if (!lisp_is_null(lisp_car(args))) return lisp_make_int(0);
-        args = lisp_cdr(args);
+        Lisp key = lisp_car(args);
+        Lisp rest = lisp_cdr(args);
+        if (!is_hashable(key) || !lisp_is_pair(rest))
+        {
+            *e = LISP_ERROR_BAD_ARG;
+            return lisp_make_null();
+        }
+        lisp_pmap_set_in_place(t, key, lisp_car(rest), ctx);
+        args = lisp_cdr(rest);
     }
-    return lisp_make_int(1);
+    return lisp_pmap_persistent(t);
 }
 
-static Lisp func_is_pair(Lisp args, LispError* e, LispContext ctx)
+static Lisp func_is_pmap(Lisp args, LispError* e, LispContext ctx)
 {
     while (lisp_is_pair(args))
     {
-        if (!lisp_is_pair(lisp_car(args))) return lisp_make_int(0);
+        if (lisp_type(lisp_car(args)) != LISP_PMAP) return lisp_make_int(0);
         args = lisp_cdr(args);
     }
     return lisp_make_int(1);
 }
 
-static Lisp func_display(Lisp args, LispError* e, LispContext ctx)
+static Lisp func_pmap_ref(Lisp args, LispError* e, LispContext ctx)
 {
-    Lisp l = lisp_car(args);
-    if (lisp_type(l) == LISP_STRING)
-    {
-        printf("%s", lisp_string(l));
-    }
-    else
+    Lisp m = lisp_list_ref(args, 0);
+    Lisp key = lisp_list_ref(args, 1);
+
+    if (lisp_type(m) != LISP_PMAP || !is_hashable(key))
     {
-        lisp_print(l); 
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
     }
-    return lisp_make_null();
+
+    // optional default value
+    Lisp x;
+    return lisp_pmap_get(m, key, &x) ? x : lisp_list_ref(args, 2);
 }
 
-static Lisp func_newline(Lisp args, LispError* e, LispContext ctx)
+static Lisp func_pmap_set(Lisp args, LispError* e, LispContext ctx)
 {
-    printf("\n"); return lisp_make_null();
+    Lisp m = lisp_list_ref(args, 0);
+    Lisp key = lisp_list_ref(args, 1);
+
+    if (lisp_type(m) != LISP_PMAP || lisp_pmap_is_transient(m) || !is_hashable(key))
+    {
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
+    }
+    return lisp_pmap_set(m, key, lisp_list_ref(args, 2), ctx);
 }
 
-static Lisp func_assert(Lisp args, LispError* e, LispContext ctx)
+static Lisp func_pmap_delete(Lisp args, LispError* e, LispContext ctx)
 {
-   if (lisp_int(lisp_car(args)) != 1)
-   {
-       fprintf(stderr, "assertion: ");
-       lisp_printf(stderr, lisp_car(lisp_cdr(args)));
-       fprintf(stderr, "\n");
-       assert(0);
-   }
+    Lisp m = lisp_list_ref(args, 0);
 
-   return lisp_make_null();
+    if (lisp_type(m) != LISP_PMAP || lisp_pmap_is_transient(m))
+    {
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
+    }
+    return lisp_pmap_delete(m, lisp_list_ref(args, 1), ctx);
 }
 
-static Lisp func_equals(Lisp args, LispError* e, LispContext ctx)
+static Lisp func_pmap_count(Lisp args, LispError* e, LispContext ctx)
 {
-    Lisp to_check  = lisp_car(args);
-    if (lisp_is_null(to_check)) return lisp_make_int(1);
-    
-    args = lisp_cdr(args);
-    while (lisp_is_pair(args))
+    Lisp m = lisp_car(args);
+    if (lisp_type(m) != LISP_PMAP)
     {
-        if (lisp_int(lisp_car(args)) != lisp_int(to_check)) return lisp_make_int(0);
-        args = lisp_cdr(args);
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
     }
-    
-    return lisp_make_int(1);
+    return lisp_make_int(lisp_pmap_count(m));
 }
 
-static Lisp func_list(Lisp args, LispError* e, LispContext ctx) { return args; }
-
-static Lisp func_append(Lisp args, LispError* e, LispContext ctx)
+static Lisp func_pmap_to_list(Lisp args, LispError* e, LispContext ctx)
 {
-    Lisp l = lisp_car(args);
-
-    if (lisp_type(l) != LISP_PAIR)
+    Lisp m = lisp_car(args);
+    if (lisp_type(m) != LISP_PMAP)
     {
         *e = LISP_ERROR_BAD_ARG;
         return lisp_make_null();
     }
-    args = lisp_cdr(args);
-    while (lisp_is_pair(args))
+    return lisp_pmap_to_list(m, ctx);
+}
+
+static Lisp func_pmap_transient(Lisp args, LispError* e, LispContext ctx)
+{
+    Lisp m = lisp_car(args);
+    if (lisp_type(m) != LISP_PMAP || lisp_pmap_is_transient(m))
     {
-        l = lisp_list_append(l, lisp_car(args), ctx);
-        args = lisp_cdr(args);
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
     }
-
-    return l;
+    return lisp_pmap_transient(m, ctx);
 }
 
-static Lisp func_map(Lisp args, LispError* e, LispContext ctx)
+static Lisp func_pmap_set_in_place(Lisp args, LispError* e, LispContext ctx)
 {
-    Lisp op = lisp_car(args);
+    Lisp t = lisp_list_ref(args, 0);
+    Lisp key = lisp_list_ref(args, 1);
 
-    if (lisp_type(op) != LISP_FUNC && lisp_type(op) != LISP_LAMBDA)
+    if (lisp_type(t) != LISP_PMAP || !lisp_pmap_is_transient(t) || !is_hashable(key))
     {
         *e = LISP_ERROR_BAD_ARG;
         return lisp_make_null();
     }
+    lisp_pmap_set_in_place(t, key, lisp_list_ref(args, 2), ctx);
+    return t;
+}
 
-    // multiple lists can be passed in
-    Lisp lists = lisp_cdr(args);      
-    int n = lisp_list_length(lists);
-    if (n == 0) return lisp_make_null();
+static Lisp func_pmap_delete_in_place(Lisp args, LispError* e, LispContext ctx)
+{
+    Lisp t = lisp_list_ref(args, 0);
 
-    Lisp result_lists = lisp_make_list(lisp_make_null(), n, ctx);
-    Lisp result_it = result_lists;
+    if (lisp_type(t) != LISP_PMAP || !lisp_pmap_is_transient(t))
+    {
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
+    }
+    lisp_pmap_delete_in_place(t, lisp_list_ref(args, 1), ctx);
+    return t;
+}
 
-    while (lisp_is_pair(lists))
-    {        
-        // advance all the lists
-        Lisp it = lisp_car(lists);
+static Lisp func_pmap_persistent(Lisp args, LispError* e, LispContext ctx)
+{
+    Lisp t = lisp_car(args);
+    if (lisp_type(t) != LISP_PMAP || !lisp_pmap_is_transient(t))
+    {
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
+    }
+    return lisp_pmap_persistent(t);
+}
 
-        Lisp front = lisp_make_null();
-        Lisp back = front;
+static Lisp func_pvector(Lisp args, LispError* e, LispContext ctx)
+{
+    Lisp t = lisp_pvector_transient(lisp_make_pvector(ctx), ctx);
+    while (lisp_is_pair(args))
+    {
+        lisp_pvector_push_in_place(t, lisp_car(args), ctx);
+        args = lisp_cdr(args);
+    }
+    return lisp_pvector_persistent(t);
+}
 
-        while (lisp_is_pair(it))
-        { 
-            Lisp expr = lisp_cons(op, lisp_cons(lisp_car(it), lisp_make_null(), ctx), ctx);
-            Lisp result = lisp_eval(expr, lisp_env_global(ctx), NULL, ctx);
-            back_append(&front, &back, result, ctx);
-            it = lisp_cdr(it);
-        } 
+static Lisp func_list_to_pvector(Lisp args, LispError* e, LispContext ctx)
+{
+    return func_pvector(lisp_car(args), e, ctx);
+}
 
-        lisp_set_car(result_it, front);
-        lists = lisp_cdr(lists);
-        result_it = lisp_cdr(result_it);
+static Lisp func_is_pvector(Lisp args, LispError* e, LispContext ctx)
+{
+    while (lisp_is_pair(args))
+    {
+        if (lisp_type(lisp_car(args)) != LISP_PVECTOR) return lisp_make_int(0);
+        args = lisp_cdr(args);
+    }
+    return lisp_make_int(1);
+}
+
+static Lisp func_pvector_length(Lisp args, LispError* e, LispContext ctx)
+{
+    Lisp v = lisp_car(args);
+    if (lisp_type(v) != LISP_PVECTOR)
+    {
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
     }
+    return lisp_make_int(lisp_pvector_length(v));
+}
 
-    if (n == 1)
+static Lisp func_pvector_ref(Lisp args, LispError* e, LispContext ctx)
+{
+    Lisp v = lisp_car(args);
+    Lisp i = lisp_car(lisp_cdr(args));
+    if (lisp_type(v) != LISP_PVECTOR || lisp_type(i) != LISP_INT)
     {
-        return lisp_car(result_lists);
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
     }
-    else
+    if (lisp_int(i) < 0 || lisp_int(i) >= lisp_pvector_length(v))
     {
-        return result_lists;
+        *e = LISP_ERROR_OUT_OF_BOUNDS;
+        return lisp_make_null();
     }
+    return lisp_pvector_ref(v, lisp_int(i));
 }
 
-static Lisp func_list_ref(Lisp args, LispError* e, LispContext ctx)
+static Lisp func_pvector_set(Lisp args, LispError* e, LispContext ctx)
 {
-    Lisp index = lisp_car(args);
-    Lisp list = lisp_car(lisp_cdr(args));
-    return lisp_list_ref(list, lisp_int(index));
+    Lisp v = lisp_list_ref(args, 0);
+    Lisp i = lisp_list_ref(args, 1);
+    if (lisp_type(v) != LISP_PVECTOR || lisp_pvector_is_transient(v) || lisp_type(i) != LISP_INT)
+    {
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
+    }
+    if (lisp_int(i) < 0 || lisp_int(i) >= lisp_pvector_length(v))
+    {
+        *e = LISP_ERROR_OUT_OF_BOUNDS;
+        return lisp_make_null();
+    }
+    return lisp_pvector_set(v, lisp_int(i), lisp_list_ref(args, 2), ctx);
 }
 
-static Lisp func_length(Lisp args, LispError* e, LispContext ctx)
+static Lisp func_pvector_push(Lisp args, LispError* e, LispContext ctx)
 {
-    return lisp_make_int(lisp_list_length(lisp_car(args)));
+    Lisp v = lisp_car(args);
+    if (lisp_type(v) != LISP_PVECTOR || lisp_pvector_is_transient(v))
+    {
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
+    }
+    return lisp_pvector_push(v, lisp_car(lisp_cdr(args)), ctx);
 }
 
-static Lisp func_reverse_inplace(Lisp args, LispError* e, LispContext ctx)
+static Lisp func_pvector_to_list(Lisp args, LispError* e, LispContext ctx)
 {
-    return lisp_list_reverse(lisp_car(args));
+    Lisp v = lisp_car(args);
+    if (lisp_type(v) != LISP_PVECTOR)
+    {
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
+    }
+    return lisp_pvector_to_list(v, ctx);
 }
 
-static Lisp func_assoc(Lisp args, LispError* e, LispContext ctx)
+static Lisp func_pvector_transient(Lisp args, LispError* e, LispContext ctx)
 {
-    Lisp key = lisp_car(args);
-    Lisp l = lisp_car(lisp_cdr(args)); 
-    return lisp_list_assoc(l, key);
+    Lisp v = lisp_car(args);
+    if (lisp_type(v) != LISP_PVECTOR || lisp_pvector_is_transient(v))
+    {
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
+    }
+    return lisp_pvector_transient(v, ctx);
 }
 
-static Lisp func_add(Lisp args, LispError* e, LispContext ctx)
+static Lisp func_pvector_set_in_place(Lisp args, LispError* e, LispContext ctx)
 {
-    Lisp accum = lisp_car(args);
-    args = lisp_cdr(args);
-
-    while (lisp_is_pair(args))
+    Lisp t = lisp_list_ref(args, 0);
+    Lisp i = lisp_list_ref(args, 1);
+    if (lisp_type(t) != LISP_PVECTOR || !lisp_pvector_is_transient(t) || lisp_type(i) != LISP_INT)
     {
-        if (lisp_type(accum) == LISP_INT)
-        {
-            accum.val.int_val += lisp_int(lisp_car(args));
-        }
-        else if (lisp_type(accum) == LISP_FLOAT)
-        {
-            accum.val.float_val += lisp_float(lisp_car(args));
-        }
-        args = lisp_cdr(args);
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
     }
-    return accum;
+    if (lisp_int(i) < 0 || lisp_int(i) >= lisp_pvector_length(t))
+    {
+        *e = LISP_ERROR_OUT_OF_BOUNDS;
+        return lisp_make_null();
+    }
+    lisp_pvector_set_in_place(t, lisp_int(i), lisp_list_ref(args, 2), ctx);
+    return t;
 }
 
-static Lisp func_sub(Lisp args, LispError* e, LispContext ctx)
+static Lisp func_pvector_push_in_place(Lisp args, LispError* e, LispContext ctx)
 {
-    Lisp accum = lisp_car(args);
-    args = lisp_cdr(args);
-
-    while (lisp_is_pair(args))
+    Lisp t = lisp_car(args);
+    if (lisp_type(t) != LISP_PVECTOR || !lisp_pvector_is_transient(t))
     {
-        if (lisp_type(accum) == LISP_INT)
-        {
-            accum.val.int_val -= lisp_int(lisp_car(args));
-        }
-        else if (lisp_type(accum) == LISP_FLOAT)
-        {
-            accum.val.float_val -= lisp_float(lisp_car(args));
-        }
-        else
-        {
-            *e = LISP_ERROR_BAD_ARG;
-            return lisp_make_null();
-        }
-        args = lisp_cdr(args);
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
     }
-    return accum;
+    lisp_pvector_push_in_place(t, lisp_car(lisp_cdr(args)), ctx);
+    return t;
 }
 
-static Lisp func_mult(Lisp args, LispError* e, LispContext ctx)
+static Lisp func_pvector_persistent(Lisp args, LispError* e, LispContext ctx)
 {
-    Lisp accum = lisp_car(args);
-    args = lisp_cdr(args);
-
-    while (lisp_is_pair(args))
+    Lisp t = lisp_car(args);
+    if (lisp_type(t) != LISP_PVECTOR || !lisp_pvector_is_transient(t))
     {
-        if (lisp_type(accum) == LISP_INT)
-        {
-            accum.val.int_val *= lisp_int(lisp_car(args));
-        }
-        else if (lisp_type(accum) == LISP_FLOAT)
-        {
-            accum.val.float_val *= lisp_float(lisp_car(args));
-        }
-        else
-        {
-            *e = LISP_ERROR_BAD_ARG;
-            return lisp_make_null();
-        } 
-        args = lisp_cdr(args);
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
     }
-    return accum;
+    return lisp_pvector_persistent(t);
 }
 
-static Lisp func_divide(Lisp args, LispError* e, LispContext ctx)
+static Lisp func_make_priority_queue(Lisp args, LispError* e, LispContext ctx)
 {
-    Lisp accum = lisp_car(args);
-    args = lisp_cdr(args);
+    // optional compare procedure
+    Lisp compare = lisp_list_ref(args, 0);
+    if (!lisp_is_null(compare) && lisp_type(compare) != LISP_FUNC && lisp_type(compare) != LISP_LAMBDA)
+    {
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
+    }
+    return lisp_make_priority_queue(compare, ctx);
+}
 
+static Lisp func_is_priority_queue(Lisp args, LispError* e, LispContext ctx)
+{
     while (lisp_is_pair(args))
     {
-        if (lisp_type(accum) == LISP_INT)
-        {
-            accum.val.int_val /= lisp_int(lisp_car(args));
-        }
-        else if (lisp_type(accum) == LISP_FLOAT)
-        {
-            accum.val.float_val /= lisp_float(lisp_car(args));
-        }
-        else
-        {
-            *e = LISP_ERROR_BAD_ARG;
-            return lisp_make_null();
-        } 
+        if (lisp_type(lisp_car(args)) != LISP_PRIORITY_QUEUE) return lisp_make_int(0);
         args = lisp_cdr(args);
     }
-    return accum;
+    return lisp_make_int(1);
 }
 
-static Lisp func_less(Lisp args, LispError* e, LispContext ctx)
+static Lisp func_pq_push(Lisp args, LispError* e, LispContext ctx)
 {
-    Lisp accum = lisp_car(args);
-    args = lisp_cdr(args);
-    int result = 0;
+    // (pq-push! q x priority), the priority defaults to x
+    Lisp q = lisp_list_ref(args, 0);
+    Lisp x = lisp_list_ref(args, 1);
+    Lisp priority = lisp_list_length(args) > 2 ? lisp_list_ref(args, 2) : x;
 
-    if (lisp_type(accum) == LISP_INT)
+    if (lisp_type(q) != LISP_PRIORITY_QUEUE)
     {
-        result = lisp_int(accum) < lisp_int(lisp_car(args));
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
     }
-    else if (lisp_type(accum) == LISP_FLOAT)
+
+    if (lisp_is_null(lisp_priority_queue(q)->compare) &&
+        lisp_type(priority) != LISP_INT && lisp_type(priority) != LISP_FLOAT)
     {
-        result = lisp_float(accum) < lisp_float(lisp_car(args));
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
     }
-    else
+
+    lisp_priority_queue_push(q, x, priority, e, ctx);
+    return lisp_make_null();
+}
+
+static Lisp func_pq_pop(Lisp args, LispError* e, LispContext ctx)
+{
+    Lisp q = lisp_car(args);
+    if (lisp_type(q) != LISP_PRIORITY_QUEUE)
     {
         *e = LISP_ERROR_BAD_ARG;
         return lisp_make_null();
-    } 
-    return lisp_make_int(result);
+    }
+    if (lisp_priority_queue_count(q) == 0)
+    {
+        *e = LISP_ERROR_OUT_OF_BOUNDS;
+        return lisp_make_null();
+    }
+    return lisp_priority_queue_pop(q, e, ctx);
 }
 
-static Lisp func_greater(Lisp args, LispError* e, LispContext ctx)
+static Lisp func_pq_peek(Lisp args, LispError* e, LispContext ctx)
 {
-    Lisp accum = lisp_car(args);
-    args = lisp_cdr(args);
-    int result = 0;
-
-    if (lisp_type(accum) == LISP_INT)
+    Lisp q = lisp_car(args);
+    if (lisp_type(q) != LISP_PRIORITY_QUEUE)
     {
-        result = lisp_int(accum) > lisp_int(lisp_car(args));
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
     }
-    else if (lisp_type(accum) == LISP_FLOAT)
+    if (lisp_priority_queue_count(q) == 0)
     {
-        result = lisp_float(accum) > lisp_float(lisp_car(args));
+        *e = LISP_ERROR_OUT_OF_BOUNDS;
+        return lisp_make_null();
     }
-    else
+    return lisp_priority_queue_peek(q);
+}
+
+static Lisp func_pq_count(Lisp args, LispError* e, LispContext ctx)
+{
+    Lisp q = lisp_car(args);
+    if (lisp_type(q) != LISP_PRIORITY_QUEUE)
     {
         *e = LISP_ERROR_BAD_ARG;
         return lisp_make_null();
-    } 
-    return lisp_make_int(result);
+    }
+    return lisp_make_int(lisp_priority_queue_count(q));
 }
 
-static Lisp func_less_equal(Lisp args, LispError* e, LispContext ctx)
+static Lisp func_make_deque(Lisp args, LispError* e, LispContext ctx)
 {
-    // a <= b = !(a > b)
-    Lisp l = func_greater(args, e, ctx);
-    return  lisp_make_int(!lisp_int(l));
+    // optional capacity
+    Lisp capacity = lisp_list_ref(args, 0);
+    if (lisp_is_null(capacity)) return lisp_make_deque(8, ctx);
+
+    if (lisp_type(capacity) != LISP_INT || lisp_int(capacity) < 0)
+    {
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
+    }
+    return lisp_make_deque(lisp_int(capacity), ctx);
 }
 
-static Lisp func_greater_equal(Lisp args, LispError* e, LispContext ctx)
+static Lisp func_is_deque(Lisp args, LispError* e, LispContext ctx)
 {
-    // a >= b = !(a < b)
-    Lisp l = func_less(args, e, ctx);
-    return  lisp_make_int(!lisp_int(l));
+    while (lisp_is_pair(args))
+    {
+        if (lisp_type(lisp_car(args)) != LISP_DEQUE) return lisp_make_int(0);
+        args = lisp_cdr(args);
+    }
+    return lisp_make_int(1);
 }
 
-static Lisp func_to_int(Lisp args, LispError* e, LispContext ctx)
+static Lisp func_deque_push_back(Lisp args, LispError* e, LispContext ctx)
 {
-    Lisp val = lisp_car(args);
-    switch (lisp_type(val))
+    Lisp d = lisp_car(args);
+    if (lisp_type(d) != LISP_DEQUE)
     {
-        case LISP_INT:
-            return val;
-        case LISP_FLOAT:
-            return lisp_make_int(lisp_int(val));
-        case LISP_STRING:
-            return lisp_make_int(atoi(lisp_string(val)));
-        default:
-            *e = LISP_ERROR_BAD_ARG;
-            return lisp_make_null();
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
     }
+    lisp_deque_push_back(d, lisp_car(lisp_cdr(args)), ctx);
+    return lisp_make_null();
 }
 
-static Lisp func_to_float(Lisp args, LispError* e, LispContext ctx)
+static Lisp func_deque_push_front(Lisp args, LispError* e, LispContext ctx)
 {
-    Lisp val = lisp_car(args);
-    switch (lisp_type(val))
+    Lisp d = lisp_car(args);
+    if (lisp_type(d) != LISP_DEQUE)
     {
-        case LISP_FLOAT:
-            return val;
-        case LISP_INT:
-            return lisp_make_float(lisp_float(val));
-        case LISP_STRING:
-            return lisp_make_float(atof(lisp_string(val)));
-        default:
-            *e = LISP_ERROR_BAD_ARG;
-            return lisp_make_null();
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
     }
+    lisp_deque_push_front(d, lisp_car(lisp_cdr(args)), ctx);
+    return lisp_make_null();
 }
 
-static Lisp func_to_string(Lisp args, LispError* e, LispContext ctx)
+// checks for the deque builtins which read an end
+static int deque_end_arg(Lisp d, LispError* e)
 {
-    char scratch[SCRATCH_MAX];
-    Lisp val = lisp_car(args);
-    switch (lisp_type(val))
+    if (lisp_type(d) != LISP_DEQUE)
     {
-        case LISP_FLOAT:
-            snprintf(scratch, SCRATCH_MAX, "%f", lisp_float(val));
-            return lisp_make_string(scratch, ctx);
-        case LISP_INT:
-            snprintf(scratch, SCRATCH_MAX, "%i", lisp_int(val));
-            return lisp_make_string(scratch, ctx);
-        case LISP_SYMBOL:
-            return lisp_make_string(lisp_symbol(val), ctx);
-        case LISP_STRING:
-            return val;
-        default:
-            *e = LISP_ERROR_BAD_ARG;
-            return lisp_make_null();
+        *e = LISP_ERROR_BAD_ARG;
+        return 0;
     }
+    if (lisp_deque_count(d) == 0)
+    {
+        *e = LISP_ERROR_OUT_OF_BOUNDS;
+        return 0;
+    }
+    return 1;
 }
 
-static Lisp func_to_symbol(Lisp args, LispError* e, LispContext ctx)
+static Lisp func_deque_pop_back(Lisp args, LispError* e, LispContext ctx)
 {
-    Lisp val = lisp_car(args);
-    switch (lisp_type(val))
-    {
-        case LISP_SYMBOL:
-            return val;
-        case LISP_STRING:
-            return lisp_make_symbol(lisp_string(val), ctx);
-        default:
-            *e = LISP_ERROR_BAD_ARG;
-            return lisp_make_null();
-    }
+    Lisp d = lisp_car(args);
+    if (!deque_end_arg(d, e)) return lisp_make_null();
+    return lisp_deque_pop_back(d);
 }
 
-static Lisp func_is_string(Lisp args, LispError* e, LispContext ctx)
+static Lisp func_deque_pop_front(Lisp args, LispError* e, LispContext ctx)
 {
-    while (lisp_is_pair(args))
-    {
-        if (lisp_type(lisp_car(args)) != LISP_STRING) return lisp_make_int(0);
-        args = lisp_cdr(args);
-    }
-    return lisp_make_int(1);
+    Lisp d = lisp_car(args);
+    if (!deque_end_arg(d, e)) return lisp_make_null();
+    return lisp_deque_pop_front(d);
 }
 
-static Lisp func_string_copy(Lisp args, LispError* e, LispContext ctx)
+static Lisp func_deque_back(Lisp args, LispError* e, LispContext ctx)
 {
-    Lisp val = lisp_car(args);
-    if (lisp_type(val) != LISP_STRING)
+    Lisp d = lisp_car(args);
+    if (!deque_end_arg(d, e)) return lisp_make_null();
+    return lisp_deque_ref(d, lisp_deque_count(d) - 1);
+}
+
+static Lisp func_deque_front(Lisp args, LispError* e, LispContext ctx)
+{
+    Lisp d = lisp_car(args);
+    if (!deque_end_arg(d, e)) return lisp_make_null();
+    return lisp_deque_ref(d, 0);
+}
+
+static Lisp func_deque_ref(Lisp args, LispError* e, LispContext ctx)
+{
+    Lisp d = lisp_car(args);
+    Lisp i = lisp_car(lisp_cdr(args));
+    if (lisp_type(d) != LISP_DEQUE || lisp_type(i) != LISP_INT)
     {
         *e = LISP_ERROR_BAD_ARG;
         return lisp_make_null();
     }
-     return lisp_make_string(lisp_string(val), ctx);
+    if (lisp_int(i) < 0 || lisp_int(i) >= lisp_deque_count(d))
+    {
+        *e = LISP_ERROR_OUT_OF_BOUNDS;
+        return lisp_make_null();
+    }
+    return lisp_deque_ref(d, lisp_int(i));
 }
 
-static Lisp func_string_length(Lisp args, LispError* e, LispContext ctx)
+static Lisp func_deque_count(Lisp args, LispError* e, LispContext ctx)
 {
-    Lisp x = lisp_car(args);
-    if (lisp_type(x) != LISP_STRING)
+    Lisp d = lisp_car(args);
+    if (lisp_type(d) != LISP_DEQUE)
     {
         *e = LISP_ERROR_BAD_ARG;
         return lisp_make_null();
     }
-
-    return lisp_make_int((int)strlen(lisp_string(x)));
+    return lisp_make_int(lisp_deque_count(d));
 }
 
-static Lisp func_string_ref(Lisp args, LispError* e, LispContext ctx)
+static Lisp func_deque_to_list(Lisp args, LispError* e, LispContext ctx)
 {
-    Lisp str = lisp_car(args);
-    Lisp index = lisp_car(lisp_cdr(args));
-    if (lisp_type(str) != LISP_STRING || lisp_type(index) != LISP_INT)
+    Lisp d = lisp_car(args);
+    if (lisp_type(d) != LISP_DEQUE)
     {
         *e = LISP_ERROR_BAD_ARG;
         return lisp_make_null();
     }
 
-    return lisp_make_int((int)lisp_string_ref(str, lisp_int(index)));
+    Lisp front = lisp_make_null();
+    Lisp back = front;
+    for (int i = 0; i < lisp_deque_count(d); ++i)
+        back_append(&front, &back, lisp_deque_ref(d, i), ctx);
+    return front;
 }
 
-static Lisp func_string_set(Lisp args, LispError* e, LispContext ctx)
+static Lisp func_make_bitvector(Lisp args, LispError* e, LispContext ctx)
 {
-    Lisp str = lisp_list_ref(args, 0);
-    Lisp index = lisp_list_ref(args, 1);
-    Lisp val = lisp_list_ref(args, 2);
-    if (lisp_type(str) != LISP_STRING || lisp_type(index) != LISP_INT)
+    Lisp n = lisp_list_ref(args, 0);
+    Lisp fill = lisp_list_ref(args, 1);
+    if (lisp_type(n) != LISP_INT || lisp_int(n) < 0 ||
+        (!lisp_is_null(fill) && lisp_type(fill) != LISP_INT))
     {
         *e = LISP_ERROR_BAD_ARG;
         return lisp_make_null();
     }
 
-    lisp_string_set(str, lisp_int(index), (char)lisp_int(val));
-    return lisp_make_null();
+    Lisp v = lisp_make_bitvector(lisp_int(n), ctx);
+    // optional fill, set with not
+    if (!lisp_is_null(fill) && lisp_int(fill)) lisp_bitvector_not(v, v);
+    return v;
 }
 
-static Lisp func_is_int(Lisp args, LispError* e, LispContext ctx)
+static Lisp func_is_bitvector(Lisp args, LispError* e, LispContext ctx)
 {
     while (lisp_is_pair(args))
     {
-        if (lisp_type(lisp_car(args)) != LISP_INT) return lisp_make_int(0);
+        if (lisp_type(lisp_car(args)) != LISP_BITVECTOR) return lisp_make_int(0);
         args = lisp_cdr(args);
     }
     return lisp_make_int(1);
 }
 
-static Lisp func_is_float(Lisp args, LispError* e, LispContext ctx)
+static Lisp func_bitvector_length(Lisp args, LispError* e, LispContext ctx)
 {
-    while (lisp_is_pair(args))
+    Lisp v = lisp_car(args);
+    if (lisp_type(v) != LISP_BITVECTOR)
     {
-        if (lisp_type(lisp_car(args)) != LISP_FLOAT) return lisp_make_int(0);
-        args = lisp_cdr(args);
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
     }
-    return lisp_make_int(1);
+    return lisp_make_int(lisp_bitvector_length(v));
 }
 
-static Lisp func_even(Lisp args, LispError* e, LispContext ctx)
+// checks (op v i ...)
+static int bitvector_index_args(Lisp args, LispError* e)
 {
-    while (!lisp_is_null(args))
+    Lisp v = lisp_list_ref(args, 0);
+    Lisp i = lisp_list_ref(args, 1);
+    if (lisp_type(v) != LISP_BITVECTOR || lisp_type(i) != LISP_INT)
     {
-        if ((lisp_int(lisp_car(args)) & 1) == 1) return lisp_make_int(0);
-        args = lisp_cdr(args);
+        *e = LISP_ERROR_BAD_ARG;
+        return 0;
     }
-    return lisp_make_int(1);
+    if (lisp_int(i) < 0 || lisp_int(i) >= lisp_bitvector_length(v))
+    {
+        *e = LISP_ERROR_OUT_OF_BOUNDS;
+        return 0;
+    }
+    return 1;
 }
 
-static Lisp func_odd(Lisp args, LispError* e, LispContext ctx)
+static Lisp func_bitvector_ref(Lisp args, LispError* e, LispContext ctx)
 {
-    while (lisp_is_pair(args))
+    if (!bitvector_index_args(args, e)) return lisp_make_null();
+    return lisp_make_int(lisp_bitvector_ref(lisp_car(args), lisp_int(lisp_list_ref(args, 1))));
+}
+
+static Lisp func_bitvector_set(Lisp args, LispError* e, LispContext ctx)
+{
+    // optional bit, defaults to 1
+    if (!bitvector_index_args(args, e)) return lisp_make_null();
+    Lisp bit = lisp_list_ref(args, 2);
+    lisp_bitvector_set(lisp_car(args), lisp_int(lisp_list_ref(args, 1)), lisp_is_null(bit) || lisp_int(bit) != 0);
+    return lisp_make_null();
+}
+
+static Lisp func_bitvector_clear(Lisp args, LispError* e, LispContext ctx)
+{
+    if (!bitvector_index_args(args, e)) return lisp_make_null();
+    lisp_bitvector_set(lisp_car(args), lisp_int(lisp_list_ref(args, 1)), 0);
+    return lisp_make_null();
+}
+
+static Lisp bitvector_logic_args(Lisp args, LogicOp op, int in_place, LispError* e, LispContext ctx)
+{
+    Lisp a = lisp_list_ref(args, 0);
+    Lisp b = op == LOGIC_NOT ? a : lisp_list_ref(args, 1);
+    if (lisp_type(a) != LISP_BITVECTOR || lisp_type(b) != LISP_BITVECTOR ||
+        lisp_bitvector_length(a) != lisp_bitvector_length(b))
     {
-        if ((lisp_int(lisp_car(args)) & 1) == 0) return lisp_make_int(0);
-        args = lisp_cdr(args);
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
     }
-    return lisp_make_int(1);
+
+    Lisp out = in_place ? a : lisp_make_bitvector(lisp_bitvector_length(a), ctx);
+    bitvector_logic(out, a, b, op);
+    return out;
 }
 
-static Lisp func_sin(Lisp args, LispError* e, LispContext ctx)
+static Lisp func_bitvector_and(Lisp args, LispError* e, LispContext ctx)
 {
-    float x = sinf(lisp_float(lisp_car(args)));
-    return lisp_make_float(x);
+    return bitvector_logic_args(args, LOGIC_AND, 0, e, ctx);
 }
 
-static Lisp func_cos(Lisp args, LispError* e, LispContext ctx)
+static Lisp func_bitvector_or(Lisp args, LispError* e, LispContext ctx)
 {
-    float x = cosf(lisp_float(lisp_car(args)));
-    return lisp_make_float(x);
+    return bitvector_logic_args(args, LOGIC_OR, 0, e, ctx);
 }
 
-static Lisp func_tan(Lisp args, LispError* e, LispContext ctx)
+static Lisp func_bitvector_xor(Lisp args, LispError* e, LispContext ctx)
 {
-    float x = tanf(lisp_float(lisp_car(args)));
-    return lisp_make_float(x);
+    return bitvector_logic_args(args, LOGIC_XOR, 0, e, ctx);
 }
 
-static Lisp func_sqrt(Lisp args, LispError* e, LispContext ctx)
+static Lisp func_bitvector_not(Lisp args, LispError* e, LispContext ctx)
 {
-    float x = sqrtf(lisp_float(lisp_car(args)));
-    return lisp_make_float(x);
+    return bitvector_logic_args(args, LOGIC_NOT, 0, e, ctx);
 }
 
-static Lisp func_make_vector(Lisp args, LispError* e, LispContext ctx)
+static Lisp func_bitvector_and_in_place(Lisp args, LispError* e, LispContext ctx)
 {
-    Lisp length = lisp_car(args);
-    Lisp val = lisp_car(lisp_cdr(args));
+    return bitvector_logic_args(args, LOGIC_AND, 1, e, ctx);
+}
 
-    if (lisp_type(length) != LISP_INT)
+static Lisp func_bitvector_or_in_place(Lisp args, LispError* e, LispContext ctx)
+{
+    return bitvector_logic_args(args, LOGIC_OR, 1, e, ctx);
+}
+
+static Lisp func_bitvector_xor_in_place(Lisp args, LispError* e, LispContext ctx)
+{
+    return bitvector_logic_args(args, LOGIC_XOR, 1, e, ctx);
+}
+
+static Lisp func_bitvector_not_in_place(Lisp args, LispError* e, LispContext ctx)
+{
+    return bitvector_logic_args(args, LOGIC_NOT, 1, e, ctx);
+}
+
+static Lisp func_bitvector_count(Lisp args, LispError* e, LispContext ctx)
+{
+    Lisp v = lisp_car(args);
+    if (lisp_type(v) != LISP_BITVECTOR)
     {
         *e = LISP_ERROR_BAD_ARG;
         return lisp_make_null();
     }
-
-    return lisp_make_vector(lisp_int(length), val, ctx);
+    return lisp_make_int(lisp_bitvector_count(v));
 }
 
-static Lisp func_vector_grow(Lisp args, LispError* e, LispContext ctx)
+static Lisp func_bitvector_first(Lisp args, LispError* e, LispContext ctx)
 {
-    Lisp v = lisp_car(args);
-    Lisp length = lisp_car(lisp_cdr(args));
-
-    if (lisp_type(length) != LISP_INT || lisp_type(v) != LISP_VECTOR)
+    // optional start
+    Lisp v = lisp_list_ref(args, 0);
+    Lisp start = lisp_list_ref(args, 1);
+    if (lisp_type(v) != LISP_BITVECTOR ||
+        (!lisp_is_null(start) && (lisp_type(start) != LISP_INT || lisp_int(start) < 0)))
     {
         *e = LISP_ERROR_BAD_ARG;
         return lisp_make_null();
     }
+    return lisp_make_int(lisp_bitvector_first(v, lisp_is_null(start) ? 0 : lisp_int(start)));
+}
 
-    if (lisp_int(length) < lisp_vector_length(v))
+static Lisp func_make_hash_table(Lisp args, LispError* e, LispContext ctx)
+{
+    // optional capacity
+    Lisp capacity = lisp_list_ref(args, 0);
+    if (lisp_is_null(capacity)) return lisp_make_hash_table(13, ctx);
+
+    if (lisp_type(capacity) != LISP_INT || lisp_int(capacity) < 0)
     {
-        *e = LISP_ERROR_OUT_OF_BOUNDS;
+        *e = LISP_ERROR_BAD_ARG;
         return lisp_make_null();
     }
+    return lisp_make_hash_table(lisp_int(capacity), ctx);
+}
 
-    return lisp_vector_grow(v, lisp_int(length), ctx);
+static Lisp func_is_hash_table(Lisp args, LispError* e, LispContext ctx)
+{
+    while (lisp_is_pair(args))
+    {
+        if (lisp_type(lisp_car(args)) != LISP_HASH_TABLE) return lisp_make_int(0);
+        args = lisp_cdr(args);
+    }
+    return lisp_make_int(1);
 }
 
-static Lisp func_vector_length(Lisp args, LispError* e, LispContext ctx)
+static Lisp func_hash_ref(Lisp args, LispError* e, LispContext ctx)
 {
-    Lisp v = lisp_car(args);
-    if (lisp_type(v) != LISP_VECTOR)
+    Lisp h = lisp_list_ref(args, 0);
+    Lisp key = lisp_list_ref(args, 1);
+
+    if (lisp_type(h) != LISP_HASH_TABLE)
     {
         *e = LISP_ERROR_BAD_ARG;
         return lisp_make_null();
     }
 
-    return lisp_make_int(lisp_vector_length(v));
+    // optional default value
+    Lisp pair = lisp_hash_table_get(h, key);
+    return lisp_is_null(pair) ? lisp_list_ref(args, 2) : lisp_cdr(pair);
 }
 
-static Lisp func_vector_ref(Lisp args, LispError* e, LispContext ctx)
+static Lisp func_hash_set(Lisp args, LispError* e, LispContext ctx)
 {
-    Lisp v = lisp_car(args);
-    Lisp i = lisp_car(lisp_cdr(args));
+    Lisp h = lisp_list_ref(args, 0);
+    Lisp key = lisp_list_ref(args, 1);
+    Lisp x = lisp_list_ref(args, 2);
 
-    if (lisp_type(v) != LISP_VECTOR || lisp_type(i) != LISP_INT)
+    if (lisp_type(h) != LISP_HASH_TABLE || !is_hashable(key))
     {
         *e = LISP_ERROR_BAD_ARG;
         return lisp_make_null();
     }
 
-    if (lisp_int(i) >= lisp_vector_length(v))
+    lisp_hash_table_set(h, key, x, ctx);
+    return lisp_make_null();
+}
+
+static Lisp func_hash_delete(Lisp args, LispError* e, LispContext ctx)
+{
+    Lisp h = lisp_car(args);
+    Lisp key = lisp_car(lisp_cdr(args));
+
+    if (lisp_type(h) != LISP_HASH_TABLE)
     {
-        *e = LISP_ERROR_OUT_OF_BOUNDS;
+        *e = LISP_ERROR_BAD_ARG;
         return lisp_make_null();
     }
 
-    return lisp_vector_ref(v, lisp_int(i));
+    return lisp_make_int(lisp_hash_table_delete(h, key));
 }
 
-static Lisp func_vector_set(Lisp args, LispError* e, LispContext ctx)
+static Lisp func_hash_count(Lisp args, LispError* e, LispContext ctx)
 {
-    Lisp v = lisp_list_ref(args, 0);
-    Lisp i = lisp_list_ref(args, 1);
-    Lisp x = lisp_list_ref(args, 2);
-
-    if (lisp_type(v) != LISP_VECTOR || lisp_type(i) != LISP_INT)
+    Lisp h = lisp_car(args);
+    if (lisp_type(h) != LISP_HASH_TABLE)
     {
         *e = LISP_ERROR_BAD_ARG;
         return lisp_make_null();
     }
+    return lisp_make_int(lisp_hash_table_count(h));
+}
 
-    if (lisp_int(i) >= lisp_vector_length(v))
+static Lisp func_hash_to_list(Lisp args, LispError* e, LispContext ctx)
+{
+    Lisp h = lisp_car(args);
+    if (lisp_type(h) != LISP_HASH_TABLE)
     {
-        *e = LISP_ERROR_OUT_OF_BOUNDS;
+        *e = LISP_ERROR_BAD_ARG;
         return lisp_make_null();
     }
+    return lisp_hash_table_to_list(h, ctx);
+}
 
-    lisp_vector_set(v, lisp_int(i), x);
-    return lisp_make_null();
+static Lisp func_hash_keys(Lisp args, LispError* e, LispContext ctx)
+{
+    Lisp it = func_hash_to_list(args, e, ctx);
+    Lisp front = lisp_make_null();
+    Lisp back = front;
+    while (lisp_is_pair(it))
+    {
+        back_append(&front, &back, lisp_car(lisp_car(it)), ctx);
+        it = lisp_cdr(it);
+    }
+    return front;
 }
 
-static Lisp func_vector_assoc(Lisp args, LispError* e, LispContext ctx)
+static Lisp func_hash_values(Lisp args, LispError* e, LispContext ctx)
 {
-    Lisp key = lisp_car(args);
-    Lisp v = lisp_car(lisp_cdr(args));
-    return lisp_vector_assoc(v, key); 
+    Lisp it = func_hash_to_list(args, e, ctx);
+    Lisp front = lisp_make_null();
+    Lisp back = front;
+    while (lisp_is_pair(it))
+    {
+        back_append(&front, &back, lisp_cdr(lisp_car(it)), ctx);
+        it = lisp_cdr(it);
+    }
+    return front;
+}
+
+static Lisp func_hash_for_each(Lisp args, LispError* e, LispContext ctx)
+{
+    Lisp op = lisp_car(args);
+    if (lisp_type(op) != LISP_FUNC && lisp_type(op) != LISP_LAMBDA)
+    {
+        *e = LISP_ERROR_BAD_ARG;
+        return lisp_make_null();
+    }
+
+    Lisp it = func_hash_to_list(lisp_cdr(args), e, ctx);
+
+    while (lisp_is_pair(it))
+    {
+        // (op key value)
+        Lisp pair = lisp_car(it);
+        apply_procedure(op, lisp_make_listv(ctx, lisp_car(pair), lisp_cdr(pair), lisp_make_null()), e, ctx);
+        if (*e != LISP_ERROR_NONE) break;
+        it = lisp_cdr(it);
+    }
+    return lisp_make_null();
 }
 
 static Lisp func_pseudo_seed(Lisp args, LispError* e, LispContext ctx)
@@ -2928,11 +11821,86 @@ static Lisp func_unix_time(Lisp args, LispError* e, LispContext ctx)
 
 static Lisp func_read_path(Lisp args, LispError *e, LispContext ctx)
 {
-    const char* path = lisp_string(lisp_car(args));
+    const char* path = lisp_string(string_terminated(lisp_car(args), ctx));
     Lisp result = lisp_read_path(path, e, ctx);
     return result;
 }
 
+// (read-path-parallel path [thread-count])
+static Lisp func_read_path_parallel(Lisp args, LispError *e, LispContext ctx)
+{
+    const char* path = lisp_string(string_terminated(lisp_car(args), ctx));
+    Lisp rest = lisp_cdr(args);
+    int thread_count = lisp_is_null(rest) ? 0 : lisp_int(lisp_car(rest));
+    return lisp_read_path_parallel(path, thread_count, LISP_READ_DEFAULT, e, ctx);
+}
+
+static Lisp func_read_path_lazy(Lisp args, LispError *e, LispContext ctx)
+{
+    const char* path = lisp_string(string_terminated(lisp_car(args), ctx));
+    return lisp_read_path_lazy(path, LISP_READ_DEFAULT, e, ctx);
+}
+
+static Lisp func_read_binary_path(Lisp args, LispError *e, LispContext ctx)
+{
+    const char* path = lisp_string(string_terminated(lisp_car(args), ctx));
+    return lisp_read_binary_path(path, e, ctx);
+}
+
+// (write-binary-path path data)
+static Lisp func_write_binary_path(Lisp args, LispError *e, LispContext ctx)
+{
+    const char* path = lisp_string(string_terminated(lisp_car(args), ctx));
+    FILE* file = fopen(path, "wb");
+    if (!file)
+    {
+        *e = LISP_ERROR_FILE_OPEN;
+        return lisp_make_null();
+    }
+
+    int ok = lisp_write_binary(file, lisp_car(lisp_cdr(args)));
+    fclose(file);
+    if (!ok) *e = LISP_ERROR_BAD_ARG;
+    return lisp_make_null();
+}
+
+static Lisp func_read_json_path(Lisp args, LispError *e, LispContext ctx)
+{
+    const char* path = lisp_string(string_terminated(lisp_car(args), ctx));
+    return lisp_read_json_path(path, LISP_READ_DEFAULT, e, ctx);
+}
+
+// (write-json data [path])
+// writes to standard output without a path.
+static Lisp func_write_json(Lisp args, LispError *e, LispContext ctx)
+{
+    Lisp data = lisp_car(args);
+    FILE* file = stdout;
+    if (!lisp_is_null(lisp_cdr(args)))
+    {
+        const char* path = lisp_string(string_terminated(lisp_car(lisp_cdr(args)), ctx));
+        file = fopen(path, "w");
+        if (!file)
+        {
+            *e = LISP_ERROR_FILE_OPEN;
+            return lisp_make_null();
+        }
+    }
+
+    int ok = lisp_write_json(file, data);
+    if (file != stdout) fclose(file);
+    if (!ok) *e = LISP_ERROR_BAD_ARG;
+    return lisp_make_null();
+}
+
+// (delete-file path)
+static Lisp func_delete_file(Lisp args, LispError *e, LispContext ctx)
+{
+    const char* path = lisp_string(string_terminated(lisp_car(args), ctx));
+    if (remove(path) != 0) *e = LISP_ERROR_FILE_OPEN;
+    return lisp_make_null();
+}
+
 static Lisp func_lambda_body(Lisp args, LispError* e, LispContext ctx)
 {
     Lisp l = lisp_car(args);
@@ -2958,13 +11926,18 @@ LispContext lisp_init_empty_opt(int symbol_table_size, size_t page_size)
     ctx.impl = malloc(sizeof(struct LispImpl));
     if (!ctx.impl) return ctx;
 
+    kernels_init();
+
     ctx.impl->lambda_counter = 0;
+    ctx.impl->edit_counter = 0;
     heap_init(&ctx.impl->heap, page_size);
     heap_init(&ctx.impl->to_heap, page_size);
 
-    ctx.impl->symbol_table = lisp_make_table(symbol_table_size, ctx);
+    ctx.impl->symbol_table_size = symbol_table_size;
+    intern_table_init(&ctx.impl->symbol_table, symbol_table_size);
     ctx.impl->global_env = lisp_make_null();
     ctx.impl->reuse_env = lisp_make_null();
+    ctx.impl->lazy_tapes = NULL;
     return ctx;
 }
 
@@ -2991,6 +11964,7 @@ LispContext lisp_init_lang_opt(int symbol_table_size, size_t page_size)
         "CDR",
         "NAV",
         "EQ?",
+        "EQUAL?",
         "NULL?",
         "PAIR?",
         "LIST",
@@ -3004,6 +11978,13 @@ LispContext lisp_init_lang_opt(int symbol_table_size, size_t page_size)
         "NEWLINE",
         "ASSERT",
         "READ-PATH",
+        "READ-PATH-PARALLEL",
+        "READ-PATH-LAZY",
+        "READ-BINARY-PATH",
+        "WRITE-BINARY-PATH",
+        "READ-JSON-PATH",
+        "WRITE-JSON",
+        "DELETE-FILE",
         "LAMBDA-BODY",
         "EXPAND",
         "GLOBAL-ENV",
@@ -3025,6 +12006,18 @@ LispContext lisp_init_lang_opt(int symbol_table_size, size_t page_size)
         "STRING-LENGTH",
         "STRING-REF",
         "STRING-SET!",
+        "STRING=?",
+        "SUBSTRING",
+        "STRING-INDEX",
+        "STRING-SEARCH",
+        "STRING-COUNT",
+        "STRING-SPLIT",
+        "STRING-JOIN",
+        "MAKE-STRING-BUILDER",
+        "STRING-BUILDER?",
+        "SB-APPEND!",
+        "SB->STRING",
+        "SB-LENGTH",
         "INT?",
         "FLOAT?",
         "EVEN?",
@@ -3039,6 +12032,94 @@ LispContext lisp_init_lang_opt(int symbol_table_size, size_t page_size)
         "VECTOR-REF",
         "VECTOR-SET!",
         "VECTOR-ASSOC",
+        "MAKE-F32VECTOR",
+        "MAKE-I32VECTOR",
+        "MAKE-BYTEVECTOR",
+        "F32VECTOR",
+        "I32VECTOR",
+        "BYTEVECTOR",
+        "TYPED-VECTOR?",
+        "VECTOR-SUM",
+        "VECTOR-DOT",
+        "VECTOR-MIN",
+        "VECTOR-MAX",
+        "VECTOR-SCALE!",
+        "VECTOR-ADD!",
+        "VECTOR-AXPY!",
+        "VECTOR-COMPARE",
+        "VECTOR-FILL!",
+        "MAKE-BITVECTOR",
+        "BITVECTOR?",
+        "BITVECTOR-LENGTH",
+        "BITVECTOR-REF",
+        "BITVECTOR-SET!",
+        "BITVECTOR-CLEAR!",
+        "BITVECTOR-AND",
+        "BITVECTOR-OR",
+        "BITVECTOR-XOR",
+        "BITVECTOR-NOT",
+        "BITVECTOR-AND!",
+        "BITVECTOR-OR!",
+        "BITVECTOR-XOR!",
+        "BITVECTOR-NOT!",
+        "BITVECTOR-COUNT",
+        "BITVECTOR-FIRST",
+        "MAKE-RECORD-TYPE",
+        "RECORD",
+        "RECORD?",
+        "RECORD-REF",
+        "RECORD-SET!",
+        "RECORD-TYPE",
+        "MAKE-HASH-TABLE",
+        "HASH-TABLE?",
+        "HASH-REF",
+        "HASH-SET!",
+        "HASH-DELETE!",
+        "HASH-COUNT",
+        "HASH-KEYS",
+        "HASH-VALUES",
+        "HASH->LIST",
+        "HASH-FOR-EACH",
+        "PMAP",
+        "PMAP?",
+        "PMAP-REF",
+        "PMAP-SET",
+        "PMAP-DELETE",
+        "PMAP-COUNT",
+        "PMAP->LIST",
+        "PMAP-TRANSIENT",
+        "PMAP-SET!",
+        "PMAP-DELETE!",
+        "PMAP-PERSISTENT!",
+        "PVECTOR",
+        "LIST->PVECTOR",
+        "PVECTOR?",
+        "PVECTOR-LENGTH",
+        "PVECTOR-REF",
+        "PVECTOR-SET",
+        "PVECTOR-PUSH",
+        "PVECTOR->LIST",
+        "PVECTOR-TRANSIENT",
+        "PVECTOR-SET!",
+        "PVECTOR-PUSH!",
+        "PVECTOR-PERSISTENT!",
+        "MAKE-PRIORITY-QUEUE",
+        "PRIORITY-QUEUE?",
+        "PQ-PUSH!",
+        "PQ-POP!",
+        "PQ-PEEK",
+        "PQ-COUNT",
+        "MAKE-DEQUE",
+        "DEQUE?",
+        "DEQUE-PUSH-BACK!",
+        "DEQUE-PUSH-FRONT!",
+        "DEQUE-POP-BACK!",
+        "DEQUE-POP-FRONT!",
+        "DEQUE-BACK",
+        "DEQUE-FRONT",
+        "DEQUE-REF",
+        "DEQUE-COUNT",
+        "DEQUE->LIST",
         "PSEUDO-RAND",
         "PSEUDO-SEED!",
         "UNIX-TIME",
@@ -3051,6 +12132,7 @@ LispContext lisp_init_lang_opt(int symbol_table_size, size_t page_size)
         func_cdr,
         func_nav,
         func_eq,
+        func_equal,
         func_is_null,
         func_is_pair,
         func_list,
@@ -3064,6 +12146,13 @@ LispContext lisp_init_lang_opt(int symbol_table_size, size_t page_size)
         func_newline,
         func_assert,
         func_read_path,
+        func_read_path_parallel,
+        func_read_path_lazy,
+        func_read_binary_path,
+        func_write_binary_path,
+        func_read_json_path,
+        func_write_json,
+        func_delete_file,
         func_lambda_body,
         func_expand,
         func_global_env,
@@ -3085,6 +12174,18 @@ LispContext lisp_init_lang_opt(int symbol_table_size, size_t page_size)
         func_string_length,
         func_string_ref,
         func_string_set,
+        func_string_equal,
+        func_substring,
+        func_string_index,
+        func_string_search,
+        func_string_count,
+        func_string_split,
+        func_string_join,
+        func_make_string_builder,
+        func_is_string_builder,
+        func_sb_append,
+        func_sb_to_string,
+        func_sb_length,
         func_is_int,
         func_is_float,
         func_even,
@@ -3099,6 +12200,94 @@ LispContext lisp_init_lang_opt(int symbol_table_size, size_t page_size)
         func_vector_ref,
         func_vector_set,
         func_vector_assoc,
+        func_make_f32vector,
+        func_make_i32vector,
+        func_make_bytevector,
+        func_f32vector,
+        func_i32vector,
+        func_bytevector,
+        func_is_typed_vector,
+        func_vector_sum,
+        func_vector_dot,
+        func_vector_min,
+        func_vector_max,
+        func_vector_scale,
+        func_vector_add,
+        func_vector_axpy,
+        func_vector_compare,
+        func_vector_fill,
+        func_make_bitvector,
+        func_is_bitvector,
+        func_bitvector_length,
+        func_bitvector_ref,
+        func_bitvector_set,
+        func_bitvector_clear,
+        func_bitvector_and,
+        func_bitvector_or,
+        func_bitvector_xor,
+        func_bitvector_not,
+        func_bitvector_and_in_place,
+        func_bitvector_or_in_place,
+        func_bitvector_xor_in_place,
+        func_bitvector_not_in_place,
+        func_bitvector_count,
+        func_bitvector_first,
+        func_make_record_type,
+        func_record,
+        func_is_record,
+        func_record_ref,
+        func_record_set,
+        func_record_type,
+        func_make_hash_table,
+        func_is_hash_table,
+        func_hash_ref,
+        func_hash_set,
+        func_hash_delete,
+        func_hash_count,
+        func_hash_keys,
+        func_hash_values,
+        func_hash_to_list,
+        func_hash_for_each,
+        func_pmap,
+        func_is_pmap,
+        func_pmap_ref,
+        func_pmap_set,
+        func_pmap_delete,
+        func_pmap_count,
+        func_pmap_to_list,
+        func_pmap_transient,
+        func_pmap_set_in_place,
+        func_pmap_delete_in_place,
+        func_pmap_persistent,
+        func_pvector,
+        func_list_to_pvector,
+        func_is_pvector,
+        func_pvector_length,
+        func_pvector_ref,
+        func_pvector_set,
+        func_pvector_push,
+        func_pvector_to_list,
+        func_pvector_transient,
+        func_pvector_set_in_place,
+        func_pvector_push_in_place,
+        func_pvector_persistent,
+        func_make_priority_queue,
+        func_is_priority_queue,
+        func_pq_push,
+        func_pq_pop,
+        func_pq_peek,
+        func_pq_count,
+        func_make_deque,
+        func_is_deque,
+        func_deque_push_back,
+        func_deque_push_front,
+        func_deque_pop_back,
+        func_deque_pop_front,
+        func_deque_back,
+        func_deque_front,
+        func_deque_ref,
+        func_deque_count,
+        func_deque_to_list,
         func_pseudo_rand,
         func_pseudo_seed,
         func_unix_time,
@@ -3107,6 +12296,28 @@ LispContext lisp_init_lang_opt(int symbol_table_size, size_t page_size)
 
     lisp_table_add_funcs(table, names, funcs, ctx);
     ctx.impl->global_env = lisp_env_extend(ctx.impl->global_env, table, ctx);
+
+    // keep the language symbols around even if
+    // nothing refers to them, so they don't get re-created.
+    const char** name = names;
+    while (*name)
+    {
+        lisp_symbol_pin(lisp_make_symbol(*name, ctx));
+        ++name;
+    }
+
+    const char* special_forms[] = {
+        "QUOTE", "IF", "BEGIN", "DEFINE", "SET!", "LAMBDA",
+        "COND", "ELSE", "AND", "OR", "LET", "NULL",
+        NULL,
+    };
+
+    name = special_forms;
+    while (*name)
+    {
+        lisp_symbol_pin(lisp_make_symbol(*name, ctx));
+        ++name;
+    }
     return ctx;
 }
 
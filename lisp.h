@@ -9,6 +9,10 @@
 // into memory at once from a file
 #define LISP_FILE_CHUNK_SIZE 4096
 
+// association vectors shorter than this
+// are searched without an index
+#define LISP_VECTOR_INDEX_MIN 8
+
 typedef enum
 {
     LISP_NULL = 0,
@@ -21,8 +25,27 @@ typedef enum
     LISP_FUNC,   // C function
     LISP_TABLE,  // key/value storage
     LISP_VECTOR, // homogenous array
+    LISP_HASH_TABLE, // key/value storage for any hashable key
+    LISP_TYPED_VECTOR, // densely packed numbers
+    LISP_STRING_BUILDER, // growable string buffer
+    LISP_RECORD, // fixed slots described by a record type
+    LISP_RECORD_TYPE, // name and field names of records
+    LISP_PMAP, // immutable key/value storage
+    LISP_PVECTOR, // immutable array
+    LISP_PRIORITY_QUEUE, // binary heap
+    LISP_DEQUE, // ring buffer
+    LISP_BITVECTOR, // packed bits
 } LispType;
 
+// element types of typed vectors
+typedef enum
+{
+    LISP_TYPED_F32 = 0, // float
+    LISP_TYPED_I32,     // int
+    LISP_TYPED_U8,      // unsigned char (bytevector)
+    LISP_TYPED_KIND_COUNT,
+} LispTypedKind;
+
 typedef enum
 {
     LISP_ERROR_NONE = 0,
@@ -47,6 +70,8 @@ typedef enum
     LISP_ERROR_OUT_OF_BOUNDS,
 
     LISP_ERROR_BAD_ARG,
+    // added after the others, so existing codes keep their values
+    LISP_ERROR_BAD_RECORD,
 } LispError;
 
 typedef struct
@@ -79,7 +104,11 @@ void lisp_shutdown(LispContext ctx);
 
 // garbage collection. 
 // this will free all objects which are not reachable from root_to_save or the global env
+// The symbol table is weak. Symbols which are not reachable are removed from it,
+// unless they are pinned with lisp_symbol_pin.
 Lisp lisp_collect(Lisp root_to_save, LispContext ctx);
+// bytes in the heap, including garbage since the last collection
+size_t lisp_heap_size(LispContext ctx);
 const char* lisp_error_string(LispError error);
 
 // LOADING
@@ -89,8 +118,64 @@ const char* lisp_error_string(LispError error);
 // For code call expand after reading
 Lisp lisp_read(const char* text, LispError* out_error, LispContext ctx);
 Lisp lisp_read_file(FILE* file, LispError* out_error, LispContext ctx);
+// regular files are memory mapped where available. other files are read in chunks.
+// tokens may be any length.
 Lisp lisp_read_path(const char* path, LispError* out_error, LispContext ctx);
 
+typedef enum
+{
+    LISP_READ_DEFAULT = 0,
+    LISP_READ_PACK_NUMBERS = 1 << 0, // lists of only numbers become #I32( or #F32( (if any are floats)
+} LispReadFlags;
+
+// reads data such as converted JSON. Vectors always have their exact size.
+Lisp lisp_read_data(const char* text, int flags, LispError* out_error, LispContext ctx);
+Lisp lisp_read_data_file(FILE* file, int flags, LispError* out_error, LispContext ctx);
+Lisp lisp_read_data_path(const char* path, int flags, LispError* out_error, LispContext ctx);
+// reads a file holding one large list or vector on several threads (0 for one per processor).
+// its items are split between the threads. other files are read as by lisp_read_data_path.
+Lisp lisp_read_path_parallel(const char* path, int thread_count, int flags, LispError* out_error, LispContext ctx);
+// checks the text up front, but only reads each list or vector in it
+// when CAR, VECTOR-REF and the like first reach it.
+// anything but one list or vector is read as by lisp_read_data.
+// the check should catch every error, but one found later reads as ().
+Lisp lisp_read_lazy(const char* text, int flags, LispError* out_error, LispContext ctx);
+Lisp lisp_read_path_lazy(const char* path, int flags, LispError* out_error, LispContext ctx);
+
+// reads one top level form at a time, so each can be used
+// and collected before the next is read. flags are LispReadFlags.
+typedef struct LispReader LispReader;
+LispReader* lisp_reader_open(const char* text, int flags);
+LispReader* lisp_reader_open_file(FILE* file, int flags);
+LispReader* lisp_reader_open_path(const char* path, int flags, LispError* out_error);
+// returns 0 at the end of the input, or after an error
+int lisp_reader_next(LispReader* reader, Lisp* out_form, LispError* out_error, LispContext ctx);
+void lisp_reader_close(LispReader* reader);
+
+// reads without building anything, calling back for each part of the input,
+// so huge files can be filtered or converted in constant memory.
+// callbacks may be NULL. one returning nonzero stops the read.
+typedef struct
+{
+    void* user;
+    int (*list_begin)(void* user);
+    // kind is a LispTypedKind for #F32( and the like, or -1 for #(
+    int (*vector_begin)(void* user, int kind);
+    // the next value is the cdr of the list
+    int (*dot)(void* user);
+    // type is LISP_INT, LISP_FLOAT, LISP_STRING or LISP_SYMBOL.
+    // text is as written, without quotes, and is only valid during the call.
+    int (*atom)(void* user, LispType type, const char* text, size_t length);
+    // of the innermost list or vector
+    int (*end)(void* user);
+} LispEvents;
+
+// 'x is given as (QUOTE x). errors are the same as from lisp_reader_next.
+// returns 1 at the end of the input, or 0 after an error or if a callback stopped.
+int lisp_read_events(const char* text, const LispEvents* events, LispError* out_error);
+int lisp_read_events_file(FILE* file, const LispEvents* events, LispError* out_error);
+int lisp_read_events_path(const char* path, const LispEvents* events, LispError* out_error);
+
 // expands Lisp syntax (For code)
 Lisp lisp_expand(Lisp lisp, LispError* out_error, LispContext ctx);
 // read and then expand for convenience
@@ -108,11 +193,29 @@ Lisp lisp_eval_global(Lisp expr, LispError* out_error, LispContext ctx);
 // print out a lisp structure
 void lisp_print(Lisp l);
 void lisp_printf(FILE* file, Lisp l);
+// a compact binary form of data as read by lisp_read:
+// numbers, symbols, strings, lists and vectors.
+// returns 0 if l holds anything else.
+int lisp_write_binary(FILE* file, Lisp l);
+Lisp lisp_read_binary(const void* data, size_t size, LispError* out_error, LispContext ctx);
+Lisp lisp_read_binary_file(FILE* file, LispError* out_error, LispContext ctx);
+Lisp lisp_read_binary_path(const char* path, LispError* out_error, LispContext ctx);
+// JSON in the form tools/json-to-lisp.py gives: objects are vectors of (key . value)
+// pairs with symbol keys, arrays are lists, and true and false are the symbols TRUE and FALSE.
+// null reads as NIL. flags are LispReadFlags.
+Lisp lisp_read_json(const char* text, int flags, LispError* out_error, LispContext ctx);
+Lisp lisp_read_json_file(FILE* file, int flags, LispError* out_error, LispContext ctx);
+Lisp lisp_read_json_path(const char* path, int flags, LispError* out_error, LispContext ctx);
+// returns 0 if l holds something JSON can't, such as lambdas or dotted lists.
+int lisp_write_json(FILE* file, Lisp l);
 
 // DATA STRUCTURES
 // -----------------------------------------
 #define lisp_type(x) ((x).type)
 #define lisp_eq(a, b) ((a).val.ptr_val == (b).val.ptr_val)
+// compares lists and vectors by their items, strings and numbers by value,
+// and anything else with lisp_eq.
+int lisp_equal(Lisp a, Lisp b);
 Lisp lisp_make_null(void);
 #define lisp_is_null(x) ((x).type == LISP_NULL)
 
@@ -122,13 +225,36 @@ int lisp_int(Lisp x);
 Lisp lisp_make_float(float x);
 float lisp_float(Lisp x);
 
+// strings know their length, and may contain NUL bytes.
+// lisp_string is NUL terminated, unless the string is a view.
+// lisp_string_n works for any string, and gives the length with the bytes.
 Lisp lisp_make_string(const char* c_string, LispContext ctx);
+Lisp lisp_make_string_n(const char* bytes, unsigned int length, LispContext ctx);
 char lisp_string_ref(Lisp s, int n);
-void lisp_string_set(Lisp s, int n, char c);
+void lisp_string_set(Lisp s, int n, char c); // not for views
 const char* lisp_string(Lisp s);
+const char* lisp_string_n(Lisp s, int* out_length);
+int lisp_string_length(Lisp s);
+int lisp_string_equal(Lisp a, Lisp b);
+// substrings of any length share the bytes of their parent (a view).
+// views see changes made to the parent with lisp_string_set.
+// they keep the parent alive, unless they are much shorter than it
+// and nothing else refers to it. then collection copies them out.
+Lisp lisp_substring(Lisp s, unsigned int start, unsigned int end, LispContext ctx);
+int lisp_string_is_view(Lisp s);
 
+// appends are amortized O(1)
+Lisp lisp_make_string_builder(unsigned int capacity, LispContext ctx);
+void lisp_string_builder_append(Lisp sb, const char* bytes, unsigned int length, LispContext ctx);
+int lisp_string_builder_length(Lisp sb);
+Lisp lisp_string_builder_to_string(Lisp sb, LispContext ctx);
+
+// returns null if a long name can't be copied
 Lisp lisp_make_symbol(const char* symbol, LispContext ctx);
 const char* lisp_symbol(Lisp x);
+// keep a symbol in the symbol table, even when it is unreachable.
+// (lisp_init_lang pins builtin and special form names)
+void lisp_symbol_pin(Lisp x);
 
 Lisp lisp_car(Lisp p);
 Lisp lisp_cdr(Lisp p);
@@ -159,15 +285,128 @@ Lisp lisp_make_vector(unsigned int n, Lisp x, LispContext ctx);
 int lisp_vector_length(Lisp v);
 Lisp lisp_vector_ref(Lisp v, unsigned int i);
 void lisp_vector_set(Lisp v, unsigned int i, Lisp x);
-Lisp lisp_vector_assoc(Lisp v, Lisp key); // O(n)
+Lisp lisp_vector_assoc(Lisp v, Lisp key); // O(1) for symbol keys when indexed, otherwise O(n)
+// index an association vector of (symbol . value) pairs for lisp_vector_assoc.
+// the reader does this for vector literals. lisp_vector_set drops the index.
+// after lisp_set_car gives an entry a new key, index again, or an earlier
+// entry with that key may be passed over for a later one.
+void lisp_vector_index(Lisp v, LispContext ctx);
 Lisp lisp_vector_grow(Lisp v, unsigned int n, LispContext ctx);
 
+// typed vectors store numbers without a type per element. (elements are zero)
+Lisp lisp_make_typed_vector(LispTypedKind kind, unsigned int n, LispContext ctx);
+LispTypedKind lisp_typed_vector_kind(Lisp v);
+int lisp_typed_vector_length(Lisp v);
+Lisp lisp_typed_vector_ref(Lisp v, unsigned int i);
+void lisp_typed_vector_set(Lisp v, unsigned int i, Lisp x);
+// raw pointers to the elements. valid until the next garbage collection
+void* lisp_typed_vector_data(Lisp v, int* out_length);
+float* lisp_f32_vector(Lisp v, int* out_length);
+int* lisp_i32_vector(Lisp v, int* out_length);
+unsigned char* lisp_bytevector(Lisp v, int* out_length);
+
+// bitvectors store one bit per element. (bits start clear)
+Lisp lisp_make_bitvector(unsigned int n, LispContext ctx);
+int lisp_bitvector_length(Lisp v);
+int lisp_bitvector_ref(Lisp v, unsigned int i);
+void lisp_bitvector_set(Lisp v, unsigned int i, int bit);
+// out may be one of the arguments. all must have the same length
+void lisp_bitvector_and(Lisp out, Lisp a, Lisp b);
+void lisp_bitvector_or(Lisp out, Lisp a, Lisp b);
+void lisp_bitvector_xor(Lisp out, Lisp a, Lisp b);
+void lisp_bitvector_not(Lisp out, Lisp a);
+// number of set bits
+int lisp_bitvector_count(Lisp v);
+// index of the first set bit at or after start, or -1
+int lisp_bitvector_first(Lisp v, unsigned int start);
+
 Lisp lisp_make_table(unsigned int capacity, LispContext ctx);
 void lisp_table_set(Lisp t, Lisp key, Lisp x, LispContext ctx);
 // returns the key value pair, or null if not found
 Lisp lisp_table_get(Lisp t, Lisp key, LispContext ctx);
 void lisp_table_add_funcs(Lisp t, const char** names, LispFunc* funcs, LispContext ctx);
 
+// records have a fixed number of fields, read by index.
+// (define-record point x y) defines POINT (the type), MAKE-POINT, POINT?,
+// POINT-X and SET-POINT-X! for each field.
+Lisp lisp_make_record_type(Lisp name, Lisp field_names, LispContext ctx);
+int lisp_record_type_field_count(Lisp type);
+// index of the field, or -1
+int lisp_record_type_field_index(Lisp type, Lisp field_name);
+// fields start null
+Lisp lisp_make_record(Lisp type, LispContext ctx);
+Lisp lisp_record_type(Lisp r);
+Lisp lisp_record_ref(Lisp r, int i);
+void lisp_record_set(Lisp r, int i, Lisp x);
+
+// persistent maps and vectors are immutable.
+// updates return a new version in O(log32 n), sharing structure with the old one.
+// keys are hashed and compared like hash table keys.
+// updating functions only take persistent versions, not transients.
+Lisp lisp_make_pmap(LispContext ctx);
+int lisp_pmap_count(Lisp m);
+// returns 1 and stores the value if the key is found
+int lisp_pmap_get(Lisp m, Lisp key, Lisp* out_x);
+Lisp lisp_pmap_set(Lisp m, Lisp key, Lisp x, LispContext ctx);
+Lisp lisp_pmap_delete(Lisp m, Lisp key, LispContext ctx);
+// list of all (key . value) pairs
+Lisp lisp_pmap_to_list(Lisp m, LispContext ctx);
+
+Lisp lisp_make_pvector(LispContext ctx);
+int lisp_pvector_length(Lisp v);
+Lisp lisp_pvector_ref(Lisp v, unsigned int i);
+Lisp lisp_pvector_set(Lisp v, unsigned int i, Lisp x, LispContext ctx);
+Lisp lisp_pvector_push(Lisp v, Lisp x, LispContext ctx);
+Lisp lisp_pvector_to_list(Lisp v, LispContext ctx);
+
+// transients are for building quickly. they are changed in place,
+// (nodes they created are not copied again) until made persistent.
+// the version a transient was made from is not affected.
+Lisp lisp_pmap_transient(Lisp m, LispContext ctx);
+int lisp_pmap_is_transient(Lisp m);
+void lisp_pmap_set_in_place(Lisp t, Lisp key, Lisp x, LispContext ctx);
+int lisp_pmap_delete_in_place(Lisp t, Lisp key, LispContext ctx);
+Lisp lisp_pmap_persistent(Lisp t);
+
+Lisp lisp_pvector_transient(Lisp v, LispContext ctx);
+int lisp_pvector_is_transient(Lisp v);
+void lisp_pvector_set_in_place(Lisp t, unsigned int i, Lisp x, LispContext ctx);
+void lisp_pvector_push_in_place(Lisp t, Lisp x, LispContext ctx);
+Lisp lisp_pvector_persistent(Lisp t);
+
+// priority queues pop the value with the lowest priority first.
+// without a compare procedure priorities must be numbers,
+// otherwise (compare a b) is true if a comes out before b.
+// errors from compare are stored in out_error.
+Lisp lisp_make_priority_queue(Lisp compare, LispContext ctx);
+int lisp_priority_queue_count(Lisp q);
+void lisp_priority_queue_push(Lisp q, Lisp x, Lisp priority, LispError* out_error, LispContext ctx);
+Lisp lisp_priority_queue_peek(Lisp q); // not empty
+Lisp lisp_priority_queue_pop(Lisp q, LispError* out_error, LispContext ctx); // not empty
+
+// double ended queues. push and pop at either end are amortized O(1)
+Lisp lisp_make_deque(unsigned int capacity, LispContext ctx);
+int lisp_deque_count(Lisp d);
+Lisp lisp_deque_ref(Lisp d, unsigned int i); // from the front
+void lisp_deque_push_back(Lisp d, Lisp x, LispContext ctx);
+void lisp_deque_push_front(Lisp d, Lisp x, LispContext ctx);
+Lisp lisp_deque_pop_back(Lisp d); // not empty
+Lisp lisp_deque_pop_front(Lisp d); // not empty
+
+// hash tables for symbol, string, int, and float keys.
+// symbols are compared by identity, the others by content.
+// the table grows as entries are added.
+// string views are copied when they become keys.
+Lisp lisp_make_hash_table(unsigned int capacity, LispContext ctx);
+void lisp_hash_table_set(Lisp h, Lisp key, Lisp x, LispContext ctx);
+// returns the key value pair, or null if not found
+Lisp lisp_hash_table_get(Lisp h, Lisp key);
+// returns 1 if the key was removed
+int lisp_hash_table_delete(Lisp h, Lisp key);
+int lisp_hash_table_count(Lisp h);
+// list of all (key . value) pairs
+Lisp lisp_hash_table_to_list(Lisp h, LispContext ctx);
+
 // programatically generate compound procedures
 Lisp lisp_make_lambda(Lisp args, Lisp body, Lisp env, LispContext ctx);
 
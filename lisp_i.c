@@ -5,6 +5,9 @@
 
 #define LINE_MAX 2048
 
+// garbage allowed to build up between forms
+#define COLLECT_MIN (1 << 20)
+
 int main(int argc, const char* argv[])
 {
     const char* file_path = NULL;
@@ -24,7 +27,7 @@ int main(int argc, const char* argv[])
     
     LispContext ctx = lisp_init_lang_opt(512, page_size);
 
-    clock_t start_time, end_time;
+    clock_t start_time;
         
     if (file_path)
     {
@@ -33,59 +36,60 @@ int main(int argc, const char* argv[])
             printf("loading: %s\n", file_path);
         }
 
-        start_time = clock();        
-        FILE* file = fopen(file_path, "r");
-        
-        if (!file)
-        {
-            fprintf(stderr, "failed to open: %s", argv[1]);
-            return 2;
-        }
-     
         LispError error;
-        Lisp l = lisp_read_file(file, &error, ctx);
+        LispReader* reader = lisp_reader_open_path(file_path, LISP_READ_DEFAULT, &error);
 
-        if (error != LISP_ERROR_NONE)
+        if (!reader)
         {
-            fprintf(stderr, "%s\n", lisp_error_string(error));
+            fprintf(stderr, "failed to open: %s", file_path);
+            return 2;
         }
 
-
-        fclose(file);
-        end_time = clock();
-
-        if (LISP_DEBUG)
-            printf("read (us): %lu\n", 1000000 * (end_time - start_time) / CLOCKS_PER_SEC);
-
+        // one form at a time, so only the current form
+        // and what it defines needs to be in memory.
+        // collect when the heap has doubled since the last time.
+        size_t live_size = lisp_heap_size(ctx);
         start_time = clock();
-
-        Lisp code = lisp_expand(l, &error, ctx);
-
-        if (error != LISP_ERROR_NONE)
+        while (1)
         {
-            fprintf(stderr, "%s\n", lisp_error_string(error));
-        }
+            Lisp l;
+            int more = lisp_reader_next(reader, &l, &error, ctx);
 
+            if (error != LISP_ERROR_NONE)
+            {
+                fprintf(stderr, "%s\n", lisp_error_string(error));
+                break;
+            }
+            if (!more) break;
 
-        end_time = clock();
+            Lisp code = lisp_expand(l, &error, ctx);
 
-        if (LISP_DEBUG)
-            printf("expand (us): %lu\n", 1000000 * (end_time - start_time) / CLOCKS_PER_SEC);
+            if (error != LISP_ERROR_NONE)
+            {
+                fprintf(stderr, "%s\n", lisp_error_string(error));
+                break;
+            }
 
+            lisp_eval_global(code, &error, ctx);
 
-        start_time = clock(); 
-        lisp_eval_global(code, &error, ctx);  
-        end_time = clock();
+            if (error != LISP_ERROR_NONE)
+            {
+                fprintf(stderr, "%s\n", lisp_error_string(error));
+                break;
+            }
 
-        if (error != LISP_ERROR_NONE)
-        {
-            fprintf(stderr, "%s\n", lisp_error_string(error));
+            if (lisp_heap_size(ctx) > live_size * 2 + COLLECT_MIN)
+            {
+                lisp_collect(lisp_make_null(), ctx);
+                live_size = lisp_heap_size(ctx);
+            }
         }
 
+        lisp_reader_close(reader);
         lisp_collect(lisp_make_null(), ctx);
 
         if (LISP_DEBUG)
-            printf("eval (us): %lu\n", 1000000 * (end_time - start_time) / CLOCKS_PER_SEC);
+            printf("load (us): %lu\n", 1000000 * (clock() - start_time) / CLOCKS_PER_SEC);
     }
     else
     {
@@ -10,3 +10,11 @@ do
     printf "\n"
 done
 
+for file in *.c
+do
+    test="./${file%.c}"
+    echo "${test}"
+    $test
+    echo "FINISHED"
+    printf "\n"
+done
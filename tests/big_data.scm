@@ -17,3 +17,82 @@
     (display "records: ")
     (display (vector-length data)))
 
+
+(newline)
+
+; the binary form reads back the same data
+(define binary-path "/tmp/lisp_big_data_gen.bin")
+(define json-path "/tmp/lisp_big_data_gen_copy.json")
+
+(let ((data (read-path "big_data_gen.sexpr")))
+    (write-binary-path binary-path data)
+    (let ((copy (read-binary-path binary-path)))
+        (assert (= (length copy) (length data)))
+        (let ((record (car copy)))
+            (assert (= (cdr (vector-assoc 'index record)) 0))
+            (assert (eq? (cdr (vector-assoc 'isActive record)) 'False))
+            (assert (string=? (cdr (vector-assoc 'eyeColor record)) "blue")))
+        (let ((record (car (reverse! copy))))
+            (assert (= (cdr (vector-assoc 'index record)) (- (length data) 1))))))
+
+(let ((data (read-binary-path binary-path)))
+    (display "binary records: ")
+    (display (length data)))
+
+(newline)
+
+; JSON reads as the same data the converter gives
+(let ((data (read-json-path "big_data_gen.json")))
+    (assert (= (length data) (length (read-path "big_data_gen.sexpr"))))
+    (let ((record (car data)))
+        (assert (= (cdr (vector-assoc 'index record)) 0))
+        (assert (eq? (cdr (vector-assoc 'isActive record)) 'False))
+        (assert (string=? (cdr (vector-assoc 'eyeColor record)) "blue")))
+    (write-json data json-path)
+    (let ((copy (read-json-path json-path)))
+        (assert (= (length copy) (length data)))
+        (assert (= (cdr (vector-assoc 'index (car (reverse! copy)))) (- (length data) 1)))))
+
+(display "json records: ")
+(display (length (read-json-path "big_data_gen.json")))
+
+(newline)
+
+; lazily read data is the same, however much of it is reached
+(let ((data (read-path-lazy "big_data_gen.sexpr")))
+    (let ((count (length data)))
+        (assert (= count (length (read-path "big_data_gen.sexpr"))))
+        (let ((record (car data)))
+            (assert (= (cdr (vector-assoc 'index record)) 0))
+            (assert (eq? (cdr (vector-assoc 'isActive record)) 'False))
+            (assert (string=? (cdr (vector-assoc 'eyeColor record)) "blue")))
+        (assert (= (cdr (vector-assoc 'index (car (reverse! data)))) (- count 1)))))
+
+(let ((data (read-path-lazy "big_data_canada.sexpr")))
+    (display "lazy records: ")
+    (display (vector-length data)))
+
+(newline)
+
+; reading on several threads gives the same data, before and after a collection
+(define parallel-gen (read-path-parallel "big_data_gen.sexpr" 4))
+(define parallel-canada (read-path-parallel "big_data_canada.sexpr" 4))
+(assert (equal? parallel-gen (read-path "big_data_gen.sexpr")))
+(assert (equal? parallel-canada (read-path "big_data_canada.sexpr")))
+(assert (= (equal? parallel-gen parallel-canada) 0))
+
+(define (churn i) (if (> i 0) (begin (string-copy "churn") (churn (- i 1)))))
+(churn 200000)
+(assert (equal? parallel-gen (read-path "big_data_gen.sexpr")))
+(assert (equal? parallel-canada (read-path "big_data_canada.sexpr")))
+(display "parallel records: ")
+(display (length parallel-gen))
+
+(newline)
+
+; ints too large for an int read as floats
+(assert (> 12345678901234567890 2147483647))
+(assert (< -3000000000 -2147483648))
+
+(delete-file binary-path)
+(delete-file json-path)
@@ -37,8 +37,36 @@
 (assert (= (cdr (vector-assoc 'alice vec-map)) 4))
 (assert (null? (vector-assoc 'bad-key vec-map)))
 
+; empty vector literal
+(assert (= (vector-length #()) 0))
+
+; long enough to be indexed
+(define record #((a . 1) (b . 2) (c . 3) (d . 4) (e . 5) (f . 6) (g . 7) (h . 8) (a . 9)))
+(assert (= (cdr (vector-assoc 'a record)) 1))
+(assert (= (cdr (vector-assoc 'h record)) 8))
+(assert (null? (vector-assoc 'z record)))
+
 (assert (= (cdr (assoc 'john list-map)) 2))
 (assert (= (cdr (assoc 'alice list-map)) 4))
 (assert (null? (assoc 'bad-key list-map)))
 
 
+
+; lists read as compact runs
+(define numbers '(1 2 3 4 5 6 7 8 . 9))
+(assert (= (length numbers) 8))
+(assert (= (cdr (cdr (cdr (cdr (cdr (cdr (cdr (cdr numbers)))))))) 9))
+(define reversed (reverse! '(1 2 3 4)))
+(assert (= (car reversed) 4))
+(assert (= (length reversed) 4))
+(assert (= (car (cdr (cdr (cdr reversed)))) 1))
+(define squares (map (lambda (x) (* x x)) '(1 2 3 4)))
+(assert (= (length squares) 4))
+(assert (= (car (cdr (cdr (cdr squares)))) 16))
+
+; numbers are converted as they are read
+(assert (= -42 (- 0 42)))
+(assert (= 0.5 (/ 1.0 2.0)))
+(assert (= -0.25 (- 0.0 0.25)))
+(assert (= 1.5 1.50000000000000000000001))
+(assert (= 12.0 12.))
@@ -0,0 +1,77 @@
+; hash tables with symbol, string, int and float keys
+
+(define h (make-hash-table))
+
+(hash-set! h 'bob 1)
+(hash-set! h "bob" 2)
+(hash-set! h 3 'three)
+(hash-set! h 2.5 "two and a half")
+
+(assert (hash-table? h))
+(assert (= (hash-count h) 4))
+(assert (= (hash-ref h 'bob) 1))
+(assert (= (hash-ref h "bob") 2))
+(assert (eq? (hash-ref h 3) 'three))
+(assert (null? (hash-ref h 4)))
+(assert (= (hash-ref h 4 -1) -1))
+
+; strings compare by content
+(assert (= (hash-ref h (string-copy "bob")) 2))
+
+; replace and delete
+(hash-set! h 'bob 10)
+(assert (= (hash-ref h 'bob) 10))
+(assert (= (hash-count h) 4))
+(assert (= (hash-delete! h 'bob) 1))
+(assert (= (hash-delete! h 'bob) 0))
+(assert (null? (hash-ref h 'bob)))
+(assert (= (hash-count h) 3))
+
+; grow past the initial capacity
+(define (fill-table t i n)
+  (if (< i n)
+      (begin
+        (hash-set! t i (* i i))
+        (fill-table t (+ i 1) n))))
+
+(define squares (make-hash-table 1))
+(fill-table squares 0 1000)
+(assert (= (hash-count squares) 1000))
+(assert (= (hash-ref squares 999) 998001))
+(assert (= (length (hash-keys squares)) 1000))
+
+; every key is found while the chains move to the grown table,
+; including after a collection
+(define (all-squares? t i n)
+  (or (= i n)
+      (and (= (hash-ref t i) (* i i)) (all-squares? t (+ i 1) n))))
+
+(assert (all-squares? squares 0 1000))
+(define (churn i) (if (> i 0) (begin (string-copy "churn") (churn (- i 1)))))
+(churn 20000)
+(assert (all-squares? squares 0 1000))
+(assert (= (hash-count squares) 1000))
+
+(define sum 0)
+(hash-for-each (lambda (k v) (set! sum (+ sum v))) squares)
+(assert (= sum 332833500))
+; builtins can be called too
+(hash-for-each + squares)
+
+; index loaded data by a string field
+(define data (read-path "big_data_gen.sexpr"))
+(define by-id (make-hash-table))
+
+(define (index-records records)
+  (if (pair? records)
+      (begin
+        (hash-set! by-id (cdr (vector-assoc '_id (car records))) (car records))
+        (index-records (cdr records)))))
+
+(index-records data)
+(assert (= (hash-count by-id) (length data)))
+(assert (= (cdr (vector-assoc 'index (hash-ref by-id "5ab30217581d62de8de4ff96"))) 0))
+
+(display "hash tables: ")
+(display (hash-count by-id))
+(newline)
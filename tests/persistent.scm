@@ -0,0 +1,56 @@
+; persistent maps and vectors
+
+(define m (pmap 'a 1 'b 2 "c" 3))
+(assert (pmap? m))
+(assert (= (pmap-count m) 3))
+(assert (= (pmap-ref m 'a) 1))
+(assert (= (pmap-ref m "c") 3))
+(assert (null? (pmap-ref m 'z)))
+(assert (= (pmap-ref m 'z 99) 99))
+
+(define m2 (pmap-set m 'a 10))
+(assert (= (pmap-ref m2 'a) 10))
+(assert (= (pmap-ref m 'a) 1))
+(assert (= (pmap-count m2) 3))
+
+(define m3 (pmap-delete m2 'b))
+(assert (= (pmap-count m3) 2))
+(assert (null? (pmap-ref m3 'b)))
+(assert (= (pmap-ref m2 'b) 2))
+(assert (= (length (pmap->list m3)) 2))
+
+(define (fill-map t i n)
+  (if (= i n)
+      t
+      (fill-map (pmap-set! t i (* i i)) (+ i 1) n)))
+
+(define big (pmap-persistent! (fill-map (pmap-transient (pmap)) 0 2000)))
+(assert (= (pmap-count big) 2000))
+(assert (= (pmap-ref big 1234) (* 1234 1234)))
+(define smaller (pmap-delete big 1234))
+(assert (= (pmap-count smaller) 1999))
+(assert (= (pmap-ref big 1234) (* 1234 1234)))
+
+(define v (pvector 1 2 3))
+(assert (pvector? v))
+(assert (= (pvector-length v) 3))
+(assert (= (pvector-ref v 2) 3))
+(define v2 (pvector-set (pvector-push v 4) 0 100))
+(assert (= (pvector-ref v2 0) 100))
+(assert (= (pvector-ref v2 3) 4))
+(assert (= (pvector-ref v 0) 1))
+(assert (= (pvector-length v) 3))
+(assert (= (car (cdr (pvector->list v))) 2))
+
+(define (fill-vector t i n)
+  (if (= i n)
+      t
+      (fill-vector (pvector-push! t i) (+ i 1) n)))
+
+(define long (pvector-persistent! (fill-vector (pvector-transient (pvector)) 0 5000)))
+(assert (= (pvector-length long) 5000))
+(assert (= (pvector-ref long 4321) 4321))
+(define changed (pvector-set long 4321 'x))
+(assert (eq? (pvector-ref changed 4321) 'x))
+(assert (= (pvector-ref long 4321) 4321))
+(assert (= (pvector-length (list->pvector '(a b c))) 3))
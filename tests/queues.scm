@@ -0,0 +1,67 @@
+; priority queues and deques
+
+(define q (make-priority-queue))
+(assert (priority-queue? q))
+(pq-push! q 'c 3)
+(pq-push! q 'a 1)
+(pq-push! q 'e 5.5)
+(pq-push! q 'b 2)
+(pq-push! q 'd 4)
+(assert (= (pq-count q) 5))
+(assert (eq? (pq-peek q) 'a))
+(assert (eq? (pq-pop! q) 'a))
+(assert (eq? (pq-pop! q) 'b))
+(assert (eq? (pq-pop! q) 'c))
+(assert (= (pq-count q) 2))
+
+; the priority defaults to the value
+(define (push-all q items)
+  (if (null? items)
+      q
+      (begin (pq-push! q (car items)) (push-all q (cdr items)))))
+
+(define (pop-all q)
+  (if (= (pq-count q) 0)
+      '()
+      (cons (pq-pop! q) (pop-all q))))
+
+(define sorted (pop-all (push-all (make-priority-queue) '(5 3 9 1 7 2 8))))
+(assert (= (car sorted) 1))
+(assert (= (length sorted) 7))
+(assert (= (car (cdr (cdr sorted))) 3))
+
+; largest first
+(define most (make-priority-queue >))
+(push-all most '(5 3 9 1 7))
+(assert (= (pq-pop! most) 9))
+(assert (= (pq-pop! most) 7))
+
+(define by-length (make-priority-queue (lambda (a b) (< (length a) (length b)))))
+(pq-push! by-length 'long '(1 2 3))
+(pq-push! by-length 'short '(1))
+(assert (eq? (pq-pop! by-length) 'short))
+
+(define d (make-deque))
+(assert (deque? d))
+(deque-push-back! d 2)
+(deque-push-back! d 3)
+(deque-push-front! d 1)
+(assert (= (deque-count d) 3))
+(assert (= (deque-front d) 1))
+(assert (= (deque-back d) 3))
+(assert (= (deque-ref d 1) 2))
+(assert (= (deque-pop-front! d) 1))
+(assert (= (deque-pop-back! d) 3))
+(assert (= (deque-count d) 1))
+
+(define (fill-deque d i n)
+  (if (= i n)
+      d
+      (begin (deque-push-front! d i) (deque-push-back! d i) (fill-deque d (+ i 1) n))))
+
+(fill-deque d 0 100)
+(assert (= (deque-count d) 201))
+(assert (= (deque-front d) 99))
+(assert (= (deque-back d) 99))
+(assert (= (deque-ref d 100) 2))
+(assert (= (length (deque->list d)) 201))
@@ -0,0 +1,104 @@
+// checks lisp_read_events against the data files and lisp_reader_next.
+// run from tests/
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "lisp.h"
+
+typedef struct
+{
+    int lists;
+    int vectors;
+    int dots;
+    int atoms;
+    int ends;
+} Counts;
+
+static int count_list(void* user) { ++((Counts*)user)->lists; return 0; }
+static int count_vector(void* user, int kind) { ++((Counts*)user)->vectors; return 0; }
+static int count_dot(void* user) { ++((Counts*)user)->dots; return 0; }
+static int count_end(void* user) { ++((Counts*)user)->ends; return 0; }
+
+static int count_atom(void* user, LispType type, const char* text, size_t length)
+{
+    ++((Counts*)user)->atoms;
+    return 0;
+}
+
+static LispEvents counting(Counts* counts)
+{
+    memset(counts, 0, sizeof(Counts));
+    LispEvents events;
+    events.user = counts;
+    events.list_begin = count_list;
+    events.vector_begin = count_vector;
+    events.dot = count_dot;
+    events.atom = count_atom;
+    events.end = count_end;
+    return events;
+}
+
+// the error a LispReader finds in text
+static LispError reader_error(const char* text, LispContext ctx)
+{
+    LispReader* reader = lisp_reader_open(text, LISP_READ_DEFAULT);
+    LispError error;
+    Lisp form;
+    while (lisp_reader_next(reader, &form, &error, ctx)) {}
+    lisp_reader_close(reader);
+    return error;
+}
+
+static void same_error(const char* text, LispContext ctx)
+{
+    Counts counts;
+    LispEvents events = counting(&counts);
+    LispError error;
+    assert(!lisp_read_events(text, &events, &error));
+
+    LispError expected = reader_error(text, ctx);
+    assert(expected != LISP_ERROR_NONE);
+    if (error != expected)
+    {
+        fprintf(stderr, "%s: %s, expected %s\n", text, lisp_error_string(error), lisp_error_string(expected));
+        assert(0);
+    }
+}
+
+int main(int argc, const char* argv[])
+{
+    LispContext ctx = lisp_init_empty();
+    Counts counts;
+    LispEvents events;
+    LispError error;
+
+    // every list, vector, dot and atom, and an end for each list and vector
+    events = counting(&counts);
+    assert(lisp_read_events_path("big_data_canada.sexpr", &events, &error));
+    assert(error == LISP_ERROR_NONE);
+    assert(counts.lists == 56053);
+    assert(counts.vectors == 4);
+    assert(counts.dots == 8);
+    assert(counts.atoms == 111138);
+    assert(counts.ends == counts.lists + counts.vectors);
+
+    events = counting(&counts);
+    assert(lisp_read_events("(a . b) #(1 2) '(x)", &events, &error));
+    assert(counts.lists == 3);
+    assert(counts.dots == 1);
+    assert(counts.atoms == 6);
+
+    // malformed input gives the same errors as a LispReader
+    same_error("(. a)", ctx);
+    same_error("#(1 a)", ctx);
+    same_error("))", ctx);
+    same_error("(a b", ctx);
+    same_error("(a . b c)", ctx);
+    same_error("#u8(1 300)", ctx);
+    same_error("#u8(-1)", ctx);
+    assert(reader_error("(a . b) #(1 2)", ctx) == LISP_ERROR_NONE);
+
+    lisp_shutdown(ctx);
+    return 0;
+}
@@ -0,0 +1,29 @@
+; records
+
+(define-record point x y)
+
+(define p (make-point 1 2))
+(assert (point? p))
+(assert (= (point? 5) 0))
+(assert (= (point-x p) 1))
+(assert (= (point-y p) 2))
+(set-point-y! p 10)
+(assert (= (point-y p) 10))
+(assert (eq? (record-type p) point))
+
+
+(define-record employee name age manager)
+(define boss (make-employee "ann" 50 '()))
+(define worker (make-employee "bob" 31 boss))
+(assert (string=? (employee-name (employee-manager worker)) "ann"))
+(assert (= (employee? p) 0))
+(assert (= (point? worker) 0))
+
+(define-record empty)
+(assert (empty? (make-empty)))
+
+(define (sum-x points)
+  (if (null? points)
+      0
+      (+ (point-x (car points)) (sum-x (cdr points)))))
+(assert (= (sum-x (list (make-point 1 0) (make-point 2 0) p)) 4))
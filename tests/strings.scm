@@ -0,0 +1,95 @@
+; strings and string builders
+
+(define s "hello world")
+(assert (= (string-length s) 11))
+(assert (= (string-length "") 0))
+(assert (string=? s "hello world" (string-copy s)))
+(assert (= (string=? s "hello") 0))
+
+(define copy (string-copy s))
+(string-set! copy 0 72)
+(assert (= (string-ref copy 0) 72))
+(assert (= (string=? s copy) 0))
+
+(define sb (make-string-builder))
+(assert (string-builder? sb))
+(define (build i)
+  (if (< i 100)
+      (begin (sb-append! sb "x" i 'y) (build (+ i 1)))))
+(build 0)
+(assert (= (sb-length sb) 390))
+(define built (sb->string sb))
+(assert (= (string-length built) 390))
+(assert (= (string-ref built 1) 48))
+(assert (= (string-ref built 389) 89))
+
+(define table (make-hash-table))
+(hash-set! table built 1)
+(assert (= (hash-ref table (sb->string sb)) 1))
+
+; substrings share their parent's bytes
+(define text "the quick brown fox jumps over the lazy dog")
+(define middle (substring text 4 39))
+(assert (= (string-length middle) 35))
+(assert (string=? (substring middle 0 5) "quick"))
+(assert (string=? (substring text 40) "dog"))
+(assert (= (string-ref middle 34) 121))
+(assert (= (to->int (substring "x12345678901234567890123" 1 4)) 123))
+(hash-set! table middle 2)
+(assert (= (hash-ref table (string-copy middle)) 2))
+
+; a view has no hash of its own to go stale,
+; and tables keep a copy of it as the key.
+(define changing (string-copy text))
+(define view (substring changing 0 30))
+(hash-set! table view 3)
+(string-set! changing 0 84)
+(assert (string=? view (substring "The quick brown fox jumps over" 0 30)))
+(assert (= (hash-ref table (substring text 0 30)) 3))
+(assert (null? (hash-ref table view)))
+
+; views go on seeing their parent after a collection
+(define long (string-copy (string-join (list text text text))))
+(define short (substring long 0 25))
+(define (churn i) (if (> i 0) (begin (string-copy text) (churn (- i 1)))))
+(churn 20000)
+(string-set! long 0 98)
+(assert (= (string-ref short 0) 98))
+
+; short ones too
+(define tiny (substring long 1 3))
+(string-set! long 1 97)
+(assert (= (string-ref tiny 0) 97))
+
+; views are all that keep these parents,
+; so collection copies out the short slices
+(define quick (substring (string-copy text) 4 9))
+(define brown (substring (string-copy (string-join (list text text))) 10 30))
+(define most (substring (string-copy text) 1))
+(churn 20000)
+(assert (string=? quick "quick"))
+(assert (string=? brown "brown fox jumps over"))
+(assert (string=? most (substring text 1)))
+(assert (string=? (string-join (list quick brown)) "quickbrown fox jumps over"))
+
+; searching
+(define line "GET /index.html 200, GET /about.html 404, POST /form 200")
+(assert (= (string-index line 47) 4))
+(assert (= (string-index line "/" 5) 25))
+(assert (null? (string-index line 126)))
+(assert (= (string-search line "200") 16))
+(assert (= (string-search line "200" 17) 53))
+(assert (null? (string-search line "DELETE")))
+(assert (= (string-count line "GET") 2))
+(assert (= (string-count line 32) 8))
+(assert (= (string-count "aaaa" "aa") 2))
+
+(define fields (string-split line ", "))
+(assert (= (length fields) 3))
+(assert (string=? (car fields) "GET /index.html 200"))
+(assert (string=? (car (cdr (cdr fields))) "POST /form 200"))
+(assert (= (length (string-split ",a,,b," 44)) 5))
+(assert (string=? (string-join fields ", ") line))
+(assert (string=? (string-join (string-split ",a,,b," ",") "-") "-a--b-"))
+(assert (string=? (string-join '("a" "b")) "ab"))
+(assert (string=? (string-join '()) ""))
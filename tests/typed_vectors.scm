@@ -0,0 +1,138 @@
+; packed numeric vectors
+
+(define f (make-f32vector 4 1.5))
+(assert (typed-vector? f))
+(assert (= (vector-length f) 4))
+(assert (= (vector-ref f 3) 1.5))
+(vector-set! f 0 2)
+(assert (float? (vector-ref f 0)))
+(assert (= (vector-ref f 0) 2.0))
+
+(define i (i32vector 1 2 3 -4))
+(assert (int? (vector-ref i 3)))
+(assert (= (vector-ref i 3) -4))
+
+(define b (make-bytevector 3))
+(assert (= (vector-ref b 1) 0))
+(vector-set! b 1 255)
+(assert (= (vector-ref b 1) 255))
+(vector-fill! b 7)
+(assert (= (vector-ref b 2) 7))
+(assert (= (vector-ref (bytevector 0 255) 1) 255))
+(assert (= (vector-ref (make-bytevector 2 255) 0) 255))
+
+; reader syntax
+(define r #u8(1 2 3))
+(assert (= (vector-length r) 3))
+(assert (= (vector-ref r 2) 3))
+
+(define (sum-vector v)
+  (define (iter sum i)
+    (if (= i (vector-length v))
+        sum
+        (iter (+ sum (vector-ref v i)) (+ i 1))))
+  (iter 0 0))
+
+(assert (= (sum-vector #i32(1 2 3 4 5 6 7 8 9 10)) 55))
+(assert (= (vector-ref #f32(0.5 0.25) 1) 0.25))
+
+(display #f32(1.5 2.5))
+(newline)
+
+; numeric kernels
+(define (iota-into! v n)
+  (define (iter i)
+    (if (< i n)
+        (begin (vector-set! v i (- i 5)) (iter (+ i 1)))))
+  (iter 0))
+
+(define fi (make-f32vector 19))
+(iota-into! fi 19)
+(define ii (make-i32vector 19))
+(iota-into! ii 19)
+
+(assert (= (vector-sum ii) 76))
+(assert (= (vector-sum fi) 76.0))
+(assert (= (vector-dot ii ii) 874))
+(assert (= (vector-min ii) -5))
+(assert (= (vector-max fi) 13.0))
+(assert (null? (vector-min (make-i32vector 0))))
+
+(vector-scale! ii 2)
+(assert (= (vector-ref ii 18) 26))
+(define ones (make-i32vector 19 1))
+(vector-axpy! ii 3 ones)
+(assert (= (vector-ref ii 0) -7))
+(vector-add! ii ones)
+(assert (= (vector-ref ii 18) 30))
+
+(define mask (vector-compare fi '>= 0))
+(assert (= (vector-ref mask 4) 0))
+(assert (= (vector-ref mask 5) 1))
+(assert (= (vector-sum (i32vector 1 1)) 2))
+
+; generic vectors of numbers take the same operations
+(define g (make-vector 3 2.5))
+(assert (= (vector-sum g) 7.5))
+(vector-fill! g 4)
+(assert (= (vector-dot g #(1 2 3)) 24))
+(vector-fill! fi 0.25)
+(assert (= (vector-sum fi) 4.75))
+
+; long generic vectors are worked on in runs
+(define big (make-vector 600 1))
+(vector-set! big 300 7)
+(vector-set! big 599 -3)
+(assert (= (vector-sum big) 602))
+(assert (= (vector-min big) -3))
+(assert (= (vector-max big) 7))
+(assert (= (vector-dot big big) 656))
+(vector-scale! big 2)
+(assert (= (vector-ref big 599) -6))
+(vector-add! big (make-vector 600 1))
+(assert (= (vector-ref big 300) 15))
+(assert (= (vector-ref (vector-compare big '> 10) 300) 1))
+(assert (= (vector-ref (vector-compare big '> 10) 301) 0))
+
+; a NaN anywhere makes the min and max NaN (NaN compares false)
+(define (nan? x) (if (< x 1.0) 0 (if (> x 0.0) 0 1)))
+(define nf (make-f32vector 17 1.0))
+(vector-set! nf 16 (/ 0.0 0.0))
+(assert (= (nan? (vector-min nf)) 1))
+(vector-set! nf 16 1.0)
+(vector-set! nf 0 (/ 0.0 0.0))
+(assert (= (nan? (vector-max nf)) 1))
+(define ng (make-vector 3 1.0))
+(vector-set! ng 1 (/ 0.0 0.0))
+(assert (= (nan? (vector-min ng)) 1))
+
+; bitvectors
+(define bits (make-bitvector 200))
+(assert (bitvector? bits))
+(assert (= (bitvector-length bits) 200))
+(assert (= (bitvector-count bits) 0))
+(assert (= (bitvector-first bits) -1))
+(bitvector-set! bits 3)
+(bitvector-set! bits 130)
+(bitvector-set! bits 199)
+(assert (= (bitvector-ref bits 130) 1))
+(assert (= (bitvector-ref bits 131) 0))
+(assert (= (bitvector-count bits) 3))
+(assert (= (bitvector-first bits) 3))
+(assert (= (bitvector-first bits 4) 130))
+(bitvector-clear! bits 3)
+(assert (= (bitvector-first bits) 130))
+
+(define evens (make-bitvector 200))
+(define (mark-evens i)
+  (if (< i 200)
+      (begin (bitvector-set! evens i) (mark-evens (+ i 2)))))
+(mark-evens 0)
+(assert (= (bitvector-count evens) 100))
+(assert (= (bitvector-count (bitvector-not evens)) 100))
+(assert (= (bitvector-count (bitvector-and bits evens)) 1))
+(assert (= (bitvector-count (bitvector-or bits evens)) 101))
+(assert (= (bitvector-count (bitvector-xor bits evens)) 100))
+(assert (= (bitvector-count (make-bitvector 70 1)) 70))
+(bitvector-or! bits evens)
+(assert (= (bitvector-count bits) 101))